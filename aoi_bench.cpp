@@ -0,0 +1,435 @@
+#include "aoi_group.h"
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <cmath>
+#include <array>
+
+// 参数化的性能测试，每次只改变基准配置中的一个参数，输出CSV方便比较不同版本的结果
+// 用法: aoibench [--quick] [--filter=<用例名中的字符串>] [--label=<写在每一行开头的标签>]
+
+enum RangeDistribution {
+    RANGE_FIXED, // 都是20
+    RANGE_UNIFORM, // 1到20均匀分布
+    RANGE_BIMODAL, // 90%是8，10%是60
+    RANGE_PARETO, // 最小5的长尾分布，最大100
+};
+
+enum WatchMix {
+    MIX_BOTH, // 都是 watcher + maker
+    MIX_HALF, // 一半只是watcher，一半只是maker
+    MIX_PLAYERS, // 10%是 watcher + maker，其余只是maker，类似玩家和NPC
+};
+
+enum MoveModel {
+    MOVE_WALK, // 每次在附近随机走动
+    MOVE_TELEPORT, // 每次随机传送到任意位置
+    MOVE_CROWD, // 随机走动并向移动中的聚集点靠拢
+    MOVE_FORMATION, // 16个元素一组，跟随队长保持固定的相对位置
+};
+
+const char *RangeRepr(int range) {
+    switch(range) {
+        case RANGE_FIXED:
+            return "fixed";
+        case RANGE_UNIFORM:
+            return "uniform";
+        case RANGE_BIMODAL:
+            return "bimodal";
+        case RANGE_PARETO:
+            return "pareto";
+        default:
+            return "unknown";
+    }
+}
+
+const char *MixRepr(int mix) {
+    switch(mix) {
+        case MIX_BOTH:
+            return "both";
+        case MIX_HALF:
+            return "half";
+        case MIX_PLAYERS:
+            return "players";
+        default:
+            return "unknown";
+    }
+}
+
+const char *MoveRepr(int move) {
+    switch(move) {
+        case MOVE_WALK:
+            return "walk";
+        case MOVE_TELEPORT:
+            return "teleport";
+        case MOVE_CROWD:
+            return "crowd";
+        case MOVE_FORMATION:
+            return "formation";
+        default:
+            return "unknown";
+    }
+}
+
+struct BenchConfigType {
+    const char *NAME;
+    unsigned ELEMENTS = 10000;
+    double DENSITY = 100; // 每个边长为100的格子中平均的元素数量
+    int RANGE = RANGE_UNIFORM;
+    int MIX = MIX_BOTH;
+    int MOVE = MOVE_WALK;
+    int DIMENSION = 2;
+    bool NOTIFY_MOVE = false;
+    bool KINETIC = false; // 进入后设置随机速度，之后每个tick调用一次 AdvanceTime，不再调用 Move
+    unsigned TICKS = 10; // 每个元素移动的次数
+};
+
+struct BenchOptionsType {
+    bool QUICK = false;
+    std::string FILTER;
+    std::string LABEL;
+};
+
+// 单次操作耗时，单位纳秒
+struct PhaseStatsType {
+    std::vector<uint64_t> COSTS;
+    unsigned long EVENTS = 0;
+};
+
+static uint64_t Percentile(std::vector<uint64_t> &costs, double p) {
+    if(costs.empty()) {
+        return 0;
+    }
+
+    size_t index = (size_t)(p * (costs.size() - 1));
+    std::nth_element(costs.begin(), costs.begin() + index, costs.end());
+    return costs[index];
+}
+
+static void PrintHeader() {
+    std::cout << "label,case,dimension,notify_move,elements,density,range,mix,move,phase,ops,total_ms,ops_per_sec,"
+        << "p50_ns,p90_ns,p99_ns,max_ns,events,events_per_op\n";
+}
+
+static void PrintPhase(const BenchOptionsType &options, const BenchConfigType &config, const char *phase, PhaseStatsType &stats) {
+    std::vector<uint64_t> &costs = stats.COSTS;
+
+    uint64_t total = 0;
+    for(uint64_t cost: costs) {
+        total += cost;
+    }
+
+    size_t ops = costs.size();
+
+    std::cout << options.LABEL << "," << config.NAME << "," << config.DIMENSION << "," << (config.NOTIFY_MOVE ? 1 : 0) << ","
+        << config.ELEMENTS << "," << config.DENSITY << "," << RangeRepr(config.RANGE) << "," << MixRepr(config.MIX) << ","
+        << MoveRepr(config.MOVE) << "," << phase << "," << ops << ","
+        << std::fixed << std::setprecision(3) << total / 1e6 << "," << std::setprecision(0) << (total ? ops * 1e9 / total : 0) << ","
+        << Percentile(costs, 0.5) << "," << Percentile(costs, 0.9) << "," << Percentile(costs, 0.99) << ","
+        << (ops ? *std::max_element(costs.begin(), costs.end()) : 0) << "," << stats.EVENTS << ","
+        << std::setprecision(3) << (ops ? (double)stats.EVENTS / ops : 0) << "\n";
+    std::cout.unsetf(std::ios::fixed);
+}
+
+template<int Dimension, bool NotifyMoveEvent>
+void RunBench(const BenchOptionsType &options, const BenchConfigType &config) {
+    constexpr int DIMENSION = Dimension;
+    using GroupType = AoiGroup<unsigned, long, DIMENSION, NotifyMoveEvent>;
+
+    std::mt19937 rng(0x87654321);
+
+    // 按密度计算世界的边长
+    const unsigned elements = config.ELEMENTS;
+    const long world = std::max(1L, (long)(100 * std::pow(elements / config.DENSITY, 1.0 / DIMENSION)));
+
+    long range_max = 20;
+    if(config.RANGE == RANGE_BIMODAL) {
+        range_max = 60;
+    } else if(config.RANGE == RANGE_PARETO) {
+        range_max = 100;
+    }
+
+    long max_watch_range[DIMENSION];
+    std::fill(max_watch_range, max_watch_range + DIMENSION, range_max);
+
+    GroupType group(1, max_watch_range);
+
+    unsigned long events = 0;
+    group.SetCallback([&events](unsigned long id, unsigned receiver, unsigned sender, const typename GroupType::AOI_EVENT_TYPE &event) {
+        ++events;
+    });
+
+    auto random_range = [&config, &rng]() {
+        switch(config.RANGE) {
+            case RANGE_FIXED:
+                return 20L;
+            case RANGE_BIMODAL:
+                return rng() % 10 ? 8L : 60L;
+            case RANGE_PARETO:
+                return std::min(100L, (long)(5 / std::pow(1 - std::uniform_real_distribution<double>(0, 1)(rng), 1 / 1.5)));
+            default:
+                return (long)(rng() % 20) + 1;
+        }
+    };
+
+    auto watch_type = [&config](unsigned id) {
+        switch(config.MIX) {
+            case MIX_HALF:
+                return id % 2 ? AOI_WATCH_TYPES::MAKER : AOI_WATCH_TYPES::WATCHER;
+            case MIX_PLAYERS:
+                return id % 10 ? AOI_WATCH_TYPES::MAKER : AOI_WATCH_TYPES::BOTH;
+            default:
+                return AOI_WATCH_TYPES::BOTH;
+        }
+    };
+
+    auto clamp = [world](long value) {
+        return std::max(0L, std::min(world - 1, value));
+    };
+
+    constexpr long speed = 3;
+    constexpr unsigned formation_size = 16;
+    const long formation_spread = std::max(1L, std::min(world / 4, 40L));
+
+    // 每个元素当前的位置，聚集点和队形中的相对位置
+    std::vector<std::array<long, DIMENSION>> positions(elements);
+    std::vector<std::array<long, DIMENSION>> offsets(elements);
+    std::vector<std::array<long, DIMENSION>> hotspots(elements / 500 + 1);
+
+    for(auto &hotspot: hotspots) {
+        for(int i = 0; i < DIMENSION; ++i) {
+            hotspot[i] = (long)(rng() % world);
+        }
+    }
+
+    for(unsigned id = 0; id < elements; ++id) {
+        for(int i = 0; i < DIMENSION; ++i) {
+            positions[id][i] = (long)(rng() % world);
+            offsets[id][i] = id % formation_size ? (long)(rng() % (2 * formation_spread + 1)) - formation_spread : 0;
+        }
+    }
+
+    if(config.MOVE == MOVE_CROWD) {
+        std::normal_distribution<double> spread(0, std::max(1.0, world / 20.0));
+
+        for(unsigned id = 0; id < elements; ++id) {
+            for(int i = 0; i < DIMENSION; ++i) {
+                positions[id][i] = clamp(hotspots[id % hotspots.size()][i] + (long)spread(rng));
+            }
+        }
+    } else if(config.MOVE == MOVE_FORMATION) {
+        for(unsigned id = 0; id < elements; ++id) {
+            for(int i = 0; i < DIMENSION; ++i) {
+                positions[id][i] = clamp(positions[id - id % formation_size][i] + offsets[id][i]);
+            }
+        }
+    }
+
+    PhaseStatsType enter_stats;
+    enter_stats.COSTS.reserve(elements);
+
+    for(unsigned id = 0; id < elements; ++id) {
+        long watch_range[DIMENSION];
+        std::fill(watch_range, watch_range + DIMENSION, random_range());
+
+        auto begin = std::chrono::steady_clock::now();
+        group.Enter(id, positions[id].data(), watch_type(id), watch_range);
+        auto end = std::chrono::steady_clock::now();
+
+        enter_stats.COSTS.emplace_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+    }
+
+    enter_stats.EVENTS = events;
+    events = 0;
+
+    PhaseStatsType move_stats;
+    move_stats.COSTS.reserve((size_t)elements * config.TICKS);
+
+    if(config.KINETIC) {
+        group.SetKineticHorizon(8);
+
+        for(unsigned id = 0; id < elements; ++id) {
+            long velocity[DIMENSION];
+
+            for(int i = 0; i < DIMENSION; ++i) {
+                velocity[i] = (long)(rng() % (2 * speed + 1)) - speed;
+            }
+
+            group.SetVelocity(id, velocity);
+        }
+
+        events = 0;
+    }
+
+    for(unsigned tick = 0; tick < config.TICKS && config.KINETIC; ++tick) {
+        auto begin = std::chrono::steady_clock::now();
+        group.AdvanceTime(tick + 1);
+        auto end = std::chrono::steady_clock::now();
+
+        move_stats.COSTS.emplace_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+    }
+
+    for(unsigned tick = 0; tick < config.TICKS && !config.KINETIC; ++tick) {
+        for(auto &hotspot: hotspots) {
+            for(int i = 0; i < DIMENSION; ++i) {
+                hotspot[i] = clamp(hotspot[i] + (long)(rng() % (4 * speed + 1)) - 2 * speed);
+            }
+        }
+
+        for(unsigned id = 0; id < elements; ++id) {
+            std::array<long, DIMENSION> &pos = positions[id];
+
+            for(int i = 0; i < DIMENSION; ++i) {
+                long step = (long)(rng() % (2 * speed + 1)) - speed;
+
+                switch(config.MOVE) {
+                    case MOVE_TELEPORT:
+                        pos[i] = (long)(rng() % world);
+                        break;
+                    case MOVE_CROWD:
+                        {
+                            long target = hotspots[id % hotspots.size()][i];
+                            long pull = target > pos[i] ? 1 : (target < pos[i] ? -1 : 0);
+                            pos[i] = clamp(pos[i] + step + pull * (long)(rng() % (speed + 1)));
+                        }
+                        break;
+                    case MOVE_FORMATION:
+                        // 队长先移动，队员跟随
+                        pos[i] = id % formation_size ? clamp(positions[id - id % formation_size][i] + offsets[id][i]) : clamp(pos[i] + step);
+                        break;
+                    default:
+                        pos[i] = clamp(pos[i] + step);
+                        break;
+                }
+            }
+
+            auto begin = std::chrono::steady_clock::now();
+            group.Move(id, pos.data());
+            auto end = std::chrono::steady_clock::now();
+
+            move_stats.COSTS.emplace_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+        }
+    }
+
+    move_stats.EVENTS = events;
+    events = 0;
+
+    PhaseStatsType leave_stats;
+    leave_stats.COSTS.reserve(elements);
+
+    for(unsigned id = 0; id < elements; ++id) {
+        auto begin = std::chrono::steady_clock::now();
+        group.Leave(id);
+        auto end = std::chrono::steady_clock::now();
+
+        leave_stats.COSTS.emplace_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+    }
+
+    leave_stats.EVENTS = events;
+
+    PrintPhase(options, config, "enter", enter_stats);
+    PrintPhase(options, config, config.KINETIC ? "advance" : "move", move_stats);
+    PrintPhase(options, config, "leave", leave_stats);
+}
+
+static void RunConfig(const BenchOptionsType &options, BenchConfigType config) {
+    if(!options.FILTER.empty() && std::string(config.NAME).find(options.FILTER) == std::string::npos) {
+        return;
+    }
+
+    if(options.QUICK) {
+        config.ELEMENTS = std::max(1u, config.ELEMENTS / 10);
+        config.TICKS = std::min(config.TICKS, 2u);
+    }
+
+    if(config.DIMENSION == 3) {
+        config.NOTIFY_MOVE ? RunBench<3, true>(options, config) : RunBench<3, false>(options, config);
+    } else {
+        config.NOTIFY_MOVE ? RunBench<2, true>(options, config) : RunBench<2, false>(options, config);
+    }
+}
+
+int main(int argc, char **argv) {
+    BenchOptionsType options;
+
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if(arg == "--quick") {
+            options.QUICK = true;
+        } else if(arg.compare(0, 9, "--filter=") == 0) {
+            options.FILTER = arg.substr(9);
+        } else if(arg.compare(0, 8, "--label=") == 0) {
+            options.LABEL = arg.substr(8);
+        } else {
+            std::cout << "usage: " << argv[0] << " [--quick] [--filter=<case>] [--label=<label>]\n";
+            return 1;
+        }
+    }
+
+    PrintHeader();
+
+    // 基准配置和原来的 TestStress 相同: 10000个元素，1000x1000，范围1到20，二维
+    BenchConfigType base;
+    base.NAME = "base";
+    RunConfig(options, base);
+
+    BenchConfigType config;
+
+    for(unsigned elements: { 1000u, 50000u }) {
+        config = base;
+        config.NAME = elements < base.ELEMENTS ? "elements_small" : "elements_large";
+        config.ELEMENTS = elements;
+        RunConfig(options, config);
+    }
+
+    for(double density: { 25.0, 400.0 }) {
+        config = base;
+        config.NAME = density < base.DENSITY ? "density_sparse" : "density_dense";
+        config.DENSITY = density;
+        RunConfig(options, config);
+    }
+
+    for(int range: { RANGE_FIXED, RANGE_BIMODAL, RANGE_PARETO }) {
+        config = base;
+        config.NAME = range == RANGE_FIXED ? "range_fixed" : (range == RANGE_BIMODAL ? "range_bimodal" : "range_pareto");
+        config.RANGE = range;
+        RunConfig(options, config);
+    }
+
+    for(int mix: { MIX_HALF, MIX_PLAYERS }) {
+        config = base;
+        config.NAME = mix == MIX_HALF ? "mix_half" : "mix_players";
+        config.MIX = mix;
+        RunConfig(options, config);
+    }
+
+    for(int move: { MOVE_TELEPORT, MOVE_CROWD, MOVE_FORMATION }) {
+        config = base;
+        config.NAME = move == MOVE_TELEPORT ? "move_teleport" : (move == MOVE_CROWD ? "move_crowd" : "move_formation");
+        config.MOVE = move;
+        RunConfig(options, config);
+    }
+
+    config = base;
+    config.NAME = "dimension_3";
+    config.DIMENSION = 3;
+    RunConfig(options, config);
+
+    config = base;
+    config.NAME = "notify_move";
+    config.NOTIFY_MOVE = true;
+    RunConfig(options, config);
+
+    // 每个tick推进一次时间，统计的是整个tick的耗时
+    for(int mix: { MIX_BOTH, MIX_PLAYERS }) {
+        config = base;
+        config.NAME = mix == MIX_BOTH ? "kinetic" : "kinetic_players";
+        config.MIX = mix;
+        config.KINETIC = true;
+        config.TICKS = 100;
+        RunConfig(options, config);
+    }
+
+    return 0;
+}
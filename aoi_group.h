@@ -4,11 +4,27 @@
 #include "zeeset.h"
 
 #include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <functional>
+#include <iterator>
 #include <algorithm>
+#include <map>
+#include <random>
 #include <set>
+#include <string>
+#include <tuple>
+#include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 struct AOI_EVENT_IDS {
     static constexpr int ENTER = -1;
@@ -35,650 +51,5720 @@ const char *AoiEventIdRepr(int event) {
     }
 }
 
-template<typename KeyType, typename PosType, int Dimension>
-class AoiEventType {
-public:
-    using KEY_TYPE = KeyType;
-    using POS_TYPE = PosType;
-    static constexpr int DIMENSION = Dimension;
-
-    int EVENT_ID = 0;
-    POS_TYPE POS[DIMENSION];
-    POS_TYPE POS_FROM[DIMENSION];
-    void *USERDATA = NULL;
+// journal中每条记录的操作类型，记录的格式是 1字节的操作类型 + key + 参数，不对齐
+// ADVANCE_TIME、SET_KINETIC_HORIZON 没有key
+struct AOI_JOURNAL_OPS {
+    static constexpr int ENTER = 1;
+    static constexpr int ENTER_STATIC = 2;
+    static constexpr int ENTER_TRIGGER = 3;
+    static constexpr int LEAVE = 4;
+    static constexpr int MOVE = 5;
+    static constexpr int MOVE_DIFF = 6;
+    static constexpr int CHANGE_WATCH_TYPE = 7;
+    static constexpr int CHANGE_WATCH_RANGE = 8;
+    static constexpr int CHANGE_MAKER_RADIUS = 9;
+    static constexpr int SET_VISIBLE_LIMIT = 10;
+    static constexpr int SET_VELOCITY = 11;
+    static constexpr int ADVANCE_TIME = 12;
+    static constexpr int SET_KINETIC_HORIZON = 13;
+    static constexpr int MOVE_VIEW_GROUP = 14;
+    static constexpr int COUNT = 15;
 };
 
-template<typename KeyType, typename PosType, int Dimension, bool NotifyMoveEvent = false>
-class AoiGroup {
-public:
-    using KEY_TYPE = KeyType;
-    using POS_TYPE = PosType;
-    static constexpr int DIMENSION = Dimension;
-    static constexpr POS_TYPE POS_ZERO = (POS_TYPE)0;
-    static constexpr bool NOTIFY_MOVE_EVENT = NotifyMoveEvent;
-
-    using AOI_EVENT_TYPE = AoiEventType<KEY_TYPE, POS_TYPE, DIMENSION>;
-    using EVENT_CALLBACK = typename std::function<void(unsigned long id, const KEY_TYPE &receiver, const KEY_TYPE &sender, const AOI_EVENT_TYPE &event)>;
-
-private:
-    unsigned long m_id;
-    EVENT_CALLBACK m_eventcb = NULL;
-    POS_TYPE m_max_watch_range[DIMENSION];
+const char *AoiJournalOpRepr(int op) {
+    switch(op) {
+        case AOI_JOURNAL_OPS::ENTER:
+            return "ENTER";
+        case AOI_JOURNAL_OPS::ENTER_STATIC:
+            return "ENTER_STATIC";
+        case AOI_JOURNAL_OPS::ENTER_TRIGGER:
+            return "ENTER_TRIGGER";
+        case AOI_JOURNAL_OPS::LEAVE:
+            return "LEAVE";
+        case AOI_JOURNAL_OPS::MOVE:
+            return "MOVE";
+        case AOI_JOURNAL_OPS::MOVE_DIFF:
+            return "MOVE_DIFF";
+        case AOI_JOURNAL_OPS::CHANGE_WATCH_TYPE:
+            return "CHANGE_WATCH_TYPE";
+        case AOI_JOURNAL_OPS::CHANGE_WATCH_RANGE:
+            return "CHANGE_WATCH_RANGE";
+        case AOI_JOURNAL_OPS::CHANGE_MAKER_RADIUS:
+            return "CHANGE_MAKER_RADIUS";
+        case AOI_JOURNAL_OPS::SET_VISIBLE_LIMIT:
+            return "SET_VISIBLE_LIMIT";
+        case AOI_JOURNAL_OPS::SET_VELOCITY:
+            return "SET_VELOCITY";
+        case AOI_JOURNAL_OPS::ADVANCE_TIME:
+            return "ADVANCE_TIME";
+        case AOI_JOURNAL_OPS::SET_KINETIC_HORIZON:
+            return "SET_KINETIC_HORIZON";
+        case AOI_JOURNAL_OPS::MOVE_VIEW_GROUP:
+            return "MOVE_VIEW_GROUP";
+        default:
+            return "UNKNOWN";
+    }
+}
 
-    struct ElementType {
-        int WATCH_TYPE;
-        POS_TYPE POS[DIMENSION];
-        POS_TYPE WATCH_RANGE[DIMENSION];
+// journal的头部，回放工具要先读出类型信息才能选择 AoiGroup 的模板参数，所以不放在 AoiGroup 里
+// 头部之后依次是配置(max_watch_range、max_maker_radius、hysteresis)、开始记录时的快照、操作记录
+struct AoiJournalHeader {
+    static constexpr uint32_t VERSION_CURRENT = 1;
+    static constexpr uint32_t POS_FLOAT = 1;
+    static constexpr uint32_t NOTIFY_MOVE = 2;
+
+    char MAGIC[4];
+    uint32_t VERSION;
+    uint32_t DIMENSION;
+    uint32_t KEY_SIZE;
+    uint32_t POS_SIZE;
+    uint32_t FLAGS;
+    uint64_t SNAPSHOT_SIZE;
+
+    // 只检查头部本身，类型是否匹配由使用者判断
+    static bool Read(const char *data, size_t size, AoiJournalHeader &header) {
+        if(size < sizeof(AoiJournalHeader)) {
+            return false;
+        }
 
-        std::unordered_set<KEY_TYPE> RELATED_WATCHERS;
-        std::unordered_set<KEY_TYPE> RELATED_MAKERS;
-    };
-    std::unordered_map<KEY_TYPE, ElementType> m_elements;
+        memcpy(&header, data, sizeof(AoiJournalHeader));
 
-    struct DimensionType {
-        ZeeSkiplist<KEY_TYPE, POS_TYPE> WATCHER_LOWER_LIST;
-        ZeeSkiplist<KEY_TYPE, POS_TYPE> WATCHER_UPPER_LIST;
-        ZeeSkiplist<KEY_TYPE, POS_TYPE> MAKER_LIST;
-    };
-    DimensionType m_dimensions[DIMENSION];
+        return memcmp(header.MAGIC, "AOIJ", 4) == 0 && header.VERSION == VERSION_CURRENT;
+    }
+};
 
-    struct GetMakersInRangeHint {
-        int TARGET_DIMENSION;
-        unsigned long COMPLEXITY;
-    };
+// 操作耗时的直方图，单位纳秒，和 HdrHistogram 一样按二进制指数分组，每组再线性分成 SUB_BUCKET_COUNT 个桶
+// 小于 SUB_BUCKET_COUNT 的值每个值一个桶，之后每个桶的相对误差不超过 1 / SUB_BUCKET_COUNT
+struct AoiLatencyHistogram {
+    static constexpr int SUB_BUCKET_BITS = 3;
+    static constexpr int SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+    static constexpr int MAX_EXPONENT = 39; // 约9分钟，更大的值都计入最后一个桶
+    static constexpr int BUCKET_COUNT = (MAX_EXPONENT - SUB_BUCKET_BITS + 2) * SUB_BUCKET_COUNT;
+
+    unsigned long COUNT = 0;
+    unsigned long TOTAL_NS = 0;
+    unsigned long MAX_NS = 0;
+    unsigned long BUCKETS[BUCKET_COUNT] = { 0 };
+
+    static int BucketIndex(uint64_t ns) {
+        if(ns < (uint64_t)SUB_BUCKET_COUNT) {
+            return (int)ns;
+        }
 
-    struct GetWatchersRelatedToPosHint {
-        int TARGET_DIMENSION;
-        unsigned long COMPLEXITY;
-        bool USE_LOWER;
-    };
+        int exponent = 63 - __builtin_clzll(ns);
 
-    struct MoveWatcherHint {
-        int LEAVE_DIMENSION[DIMENSION];
-        int ENTER_DIMENSION[DIMENSION];
-        unsigned long COMPLEXITY;
-    };
+        if(exponent > MAX_EXPONENT) {
+            return BUCKET_COUNT - 1;
+        }
 
-    struct MoveMakerHint {
-        int LEAVE_DIMENSION[DIMENSION];
-        int ENTER_DIMENSION[DIMENSION];
-        bool LEAVE_USE_LOWER[DIMENSION];
-        bool ENTER_USE_LOWER[DIMENSION];
-        unsigned long COMPLEXITY;
-    };
+        int sub = (int)(ns >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKET_COUNT - 1);
+        return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT + sub;
+    }
 
-public:
-    AoiGroup(unsigned long id, const POS_TYPE max_watch_range[DIMENSION]) : m_id(id) {
-        for(int i = 0; i < DIMENSION; ++i) {
-            assert(POS_ZERO < max_watch_range[i]);
+    // 桶内的最小值
+    static uint64_t BucketLower(int index) {
+        if(index < SUB_BUCKET_COUNT) {
+            return (uint64_t)index;
         }
 
-        CopyPos(max_watch_range, m_max_watch_range);
+        int exponent = index / SUB_BUCKET_COUNT + SUB_BUCKET_BITS - 1;
+        int sub = index % SUB_BUCKET_COUNT;
+        return (uint64_t)(SUB_BUCKET_COUNT + sub) << (exponent - SUB_BUCKET_BITS);
     }
 
-    void SetCallback(EVENT_CALLBACK cb) {
-        m_eventcb = cb;
+    // 桶内的最大值
+    static uint64_t BucketUpper(int index) {
+        if(index < SUB_BUCKET_COUNT) {
+            return (uint64_t)index;
+        }
+
+        int exponent = index / SUB_BUCKET_COUNT + SUB_BUCKET_BITS - 1;
+        return BucketLower(index) + ((uint64_t)1 << (exponent - SUB_BUCKET_BITS)) - 1;
     }
 
-    unsigned long Id() {
-        return m_id;
+    void Record(uint64_t ns) {
+        ++COUNT;
+        TOTAL_NS += ns;
+        MAX_NS = std::max(MAX_NS, (unsigned long)ns);
+        ++BUCKETS[BucketIndex(ns)];
     }
 
-    bool Enter(const KEY_TYPE &key, const POS_TYPE pos[DIMENSION], int watch_type, const POS_TYPE watch_range[DIMENSION]) {
-        if(m_elements.count(key)) {
-            return false;
+    // 第p(0到1)分位所在桶的最大值，不超过记录到的最大值
+    unsigned long Percentile(double p) const {
+        if(!COUNT) {
+            return 0;
         }
 
-        ElementType &element = m_elements[key];
-
-        element.WATCH_TYPE = watch_type;
-        CopyPos(pos, element.POS);
-        CopyPos(watch_range, element.WATCH_RANGE);
-        TrimWatchRange(element.WATCH_RANGE);
+        unsigned long rank = (unsigned long)(p * (COUNT - 1)) + 1;
+        unsigned long seen = 0;
 
-        if(watch_type & AOI_WATCH_TYPES::MAKER) {
-            InsertMaker(key, element);
-        }
+        for(int i = 0; i < BUCKET_COUNT; ++i) {
+            seen += BUCKETS[i];
 
-        if(watch_type & AOI_WATCH_TYPES::WATCHER) {
-            InsertWatcher(key, element);
+            if(seen >= rank) {
+                return std::min(MAX_NS, (unsigned long)BucketUpper(i));
+            }
         }
 
-        return true;
+        return MAX_NS;
     }
+};
 
-    bool Enter(const KEY_TYPE &key, const POS_TYPE pos[DIMENSION], int watch_type) {
-        POS_TYPE range[DIMENSION] = { POS_ZERO };
+// 所有watcher和maker之间的关系放在一张表里，每个关系只存一条边
+// 边同时挂在watcher和maker各自的环形双向链表上，每个元素用一个哨兵节点作为两个链表的表头，
+// 增删一条边只改相邻的节点，不用再分别修改两端的哈希集合，也不会为每个关系分配内存
+// 按 (watcher, maker) 查找边使用开放寻址的哈希表，表中只存边的下标
+template<typename KeyType>
+class AoiEdgeTable {
+public:
+    static constexpr unsigned NIL = (unsigned)-1;
+    static constexpr int WATCHER_SIDE = 0; // watcher的链表，其中是它看到的maker
+    static constexpr int MAKER_SIDE = 1; // maker的链表，其中是看到它的watcher
+
+    struct EdgeType {
+        KeyType KEY[2]; // KEY[WATCHER_SIDE] 是watcher，KEY[MAKER_SIDE] 是maker
+        unsigned NEXT[2];
+        unsigned PREV[2];
+    };
 
-        return Enter(key, pos, watch_type, range);
-    }
+    // 一个元素某一侧的链表，遍历时得到另一端的key，用法和集合相同
+    class ListType {
+    public:
+        class Iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = KeyType;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const KeyType *;
+            using reference = const KeyType &;
+
+            Iterator(const AoiEdgeTable *table, unsigned index, int side) : m_table(table), m_index(index), m_side(side) {
+            }
 
-    bool Leave(const KEY_TYPE &key) {
-        auto iter = m_elements.find(key);
+            reference operator*() const {
+                return m_table->m_edges[m_index].KEY[1 - m_side];
+            }
 
-        if(iter == m_elements.end()) {
-            return false;
-        }
+            pointer operator->() const {
+                return &**this;
+            }
 
-        ElementType element = iter->second;
-        m_elements.erase(iter);
+            Iterator &operator++() {
+                m_index = m_table->m_edges[m_index].NEXT[m_side];
+                return *this;
+            }
 
-        int watch_type = element.WATCH_TYPE;
-        if(watch_type & AOI_WATCH_TYPES::MAKER) {
-            RemoveMaker(key, element);
-        }
+            Iterator operator++(int) {
+                Iterator old = *this;
+                ++*this;
+                return old;
+            }
 
-        if(watch_type & AOI_WATCH_TYPES::WATCHER) {
-            RemoveWatcher(key, element);
-        }
+            bool operator==(const Iterator &other) const {
+                return m_index == other.m_index;
+            }
 
-        return true;
-    }
+            bool operator!=(const Iterator &other) const {
+                return m_index != other.m_index;
+            }
 
-    bool Move(const KEY_TYPE &key, const POS_TYPE pos[DIMENSION]) {
-        auto iter = m_elements.find(key);
+        private:
+            const AoiEdgeTable *m_table;
+            unsigned m_index;
+            int m_side;
+        };
 
-        if(iter == m_elements.end()) {
-            return false;
+        ListType() {
         }
 
-        ElementType &element = iter->second;
-
-        if(IsSamePos(element.POS, pos)) {
-            return true;
+        ListType(const AoiEdgeTable *table, unsigned head, int side) : m_table(table), m_head(head), m_side(side) {
         }
 
-        ElementType old_element = element;
-        CopyPos(pos, element.POS);
-
-        int watch_type = element.WATCH_TYPE;
-        if(watch_type & AOI_WATCH_TYPES::MAKER) {
-            MoveMaker(key, element, old_element);
+        Iterator begin() const {
+            return Iterator(m_table, m_table ? m_table->m_edges[m_head].NEXT[m_side] : NIL, m_side);
         }
 
-        if(watch_type & AOI_WATCH_TYPES::WATCHER) {
-            MoveWatcher(key, element, old_element);
+        Iterator end() const {
+            return Iterator(m_table, m_head, m_side);
         }
 
-        return true;
-    }
-
-    bool MoveDiff(const KEY_TYPE &key, const POS_TYPE diff[DIMENSION]) {
-        auto iter = m_elements.find(key);
-
-        if(iter == m_elements.end()) {
-            return false;
+        size_t size() const {
+            return m_size;
         }
 
-        ElementType &element = iter->second;
-
-        if(IsZeroPos(diff)) {
-            return true;
+        bool empty() const {
+            return m_size == 0;
         }
 
-        ElementType old_element = element;
-        for(int i = 0; i < DIMENSION; ++i) {
-            element.POS[i] += diff[i];
+        unsigned Head() const {
+            return m_head;
         }
 
-        int watch_type = element.WATCH_TYPE;
-        if(watch_type & AOI_WATCH_TYPES::MAKER) {
-            MoveMaker(key, element, old_element);
-        }
+    private:
+        friend class AoiEdgeTable;
 
-        if(watch_type & AOI_WATCH_TYPES::WATCHER) {
-            MoveWatcher(key, element, old_element);
-        }
+        const AoiEdgeTable *m_table = NULL;
+        unsigned m_head = NIL;
+        int m_side = WATCHER_SIDE;
+        size_t m_size = 0;
+    };
 
-        return true;
+    AoiEdgeTable() {
     }
 
-    bool ChangeWatchType(const KEY_TYPE &key, int watch_type) {
-        auto iter = m_elements.find(key);
+    AoiEdgeTable(const AoiEdgeTable &) = delete;
+    AoiEdgeTable &operator=(const AoiEdgeTable &) = delete;
 
-        if(iter == m_elements.end()) {
-            return false;
+    // 新元素的哨兵节点，两个链表都指向自己
+    unsigned NewHead() {
+        unsigned head = AllocEdge();
+
+        for(int s = 0; s < 2; ++s) {
+            m_edges[head].NEXT[s] = head;
+            m_edges[head].PREV[s] = head;
         }
 
-        ElementType &element = iter->second;
+        return head;
+    }
 
-        int old_watch_type = element.WATCH_TYPE;
-        element.WATCH_TYPE = watch_type;
+    void FreeHead(unsigned head) {
+        assert(m_edges[head].NEXT[WATCHER_SIDE] == head && m_edges[head].NEXT[MAKER_SIDE] == head);
+        FreeEdge(head);
+    }
 
-        bool old_is_watcher = (old_watch_type & AOI_WATCH_TYPES::WATCHER) != 0;
-        bool old_is_maker = (old_watch_type & AOI_WATCH_TYPES::MAKER) != 0;
-        bool new_is_watcher = (watch_type & AOI_WATCH_TYPES::WATCHER) != 0;
-        bool new_is_maker = (watch_type & AOI_WATCH_TYPES::MAKER) != 0;
+    unsigned Find(const KeyType &watcher, const KeyType &maker) const {
+        size_t slot = FindSlot(watcher, maker);
 
-        if(old_is_maker && !new_is_maker) {
-            RemoveMaker(key, element);
-        }
+        return slot == m_slots.size() ? NIL : m_slots[slot];
+    }
 
-        if(!old_is_maker && new_is_maker) {
-            InsertMaker(key, element);
+    // 已经存在时返回false
+    bool Link(const KeyType &watcher, ListType &watcher_list, const KeyType &maker, ListType &maker_list) {
+        if(FindSlot(watcher, maker) != m_slots.size()) {
+            return false;
         }
 
-        if(old_is_watcher && !new_is_watcher) {
-            RemoveWatcher(key, element);
-        }
+        unsigned edge = AllocEdge();
+        m_edges[edge].KEY[WATCHER_SIDE] = watcher;
+        m_edges[edge].KEY[MAKER_SIDE] = maker;
 
-        if(!old_is_watcher && new_is_watcher) {
-            InsertWatcher(key, element);
-        }
+        Attach(edge, watcher_list);
+        Attach(edge, maker_list);
+        InsertSlot(edge);
 
         return true;
     }
 
-    bool ChangeWatchRange(const KEY_TYPE &key, const POS_TYPE watch_range[DIMENSION]) {
-        auto iter = m_elements.find(key);
+    // 不存在时返回false
+    bool Unlink(const KeyType &watcher, ListType &watcher_list, const KeyType &maker, ListType &maker_list) {
+        size_t slot = FindSlot(watcher, maker);
 
-        if(iter == m_elements.end()) {
+        if(slot == m_slots.size()) {
             return false;
         }
 
-        ElementType &element = iter->second;
+        unsigned edge = m_slots[slot];
+        EraseSlot(slot);
 
-        POS_TYPE watch_range_mutable[DIMENSION];
-        CopyPos(watch_range, watch_range_mutable);
-        TrimWatchRange(watch_range_mutable);
+        Detach(edge, watcher_list);
+        Detach(edge, maker_list);
+        FreeEdge(edge);
 
-        if(IsSamePos(element.WATCH_RANGE, watch_range_mutable)) {
-            return true;
-        }
+        return true;
+    }
 
-        ElementType old_element = element;
-        CopyPos(watch_range_mutable, element.WATCH_RANGE);
+    size_t Size() const {
+        return m_size;
+    }
 
-        int watch_type = element.WATCH_TYPE;
-        if(watch_type & AOI_WATCH_TYPES::WATCHER) {
-            UpdateWatcher(key, element, old_element);
+private:
+    std::vector<EdgeType> m_edges;
+    unsigned m_free = NIL; // 空闲的边用 NEXT[0] 串起来
+    std::vector<unsigned> m_slots; // 大小是2的幂，空位是 NIL，最多用一半
+    size_t m_size = 0;
+
+    unsigned AllocEdge() {
+        if(m_free != NIL) {
+            unsigned edge = m_free;
+            m_free = m_edges[edge].NEXT[0];
+            return edge;
         }
 
-        return false;
+        m_edges.emplace_back();
+        return (unsigned)(m_edges.size() - 1);
     }
 
-    bool GetElementPosition(const KEY_TYPE &key, POS_TYPE pos[DIMENSION]) {
-        auto iter = m_elements.find(key);
+    void FreeEdge(unsigned edge) {
+        m_edges[edge].NEXT[0] = m_free;
+        m_free = edge;
+    }
 
-        if(iter == m_elements.end()) {
-            return false;
-        }
+    // 插到表头后面
+    void Attach(unsigned edge, ListType &list) {
+        int s = list.m_side;
+        unsigned head = list.m_head;
+        unsigned next = m_edges[head].NEXT[s];
+
+        m_edges[edge].PREV[s] = head;
+        m_edges[edge].NEXT[s] = next;
+        m_edges[next].PREV[s] = edge;
+        m_edges[head].NEXT[s] = edge;
+        ++list.m_size;
+    }
 
-        ElementType &element = iter->second;
+    void Detach(unsigned edge, ListType &list) {
+        int s = list.m_side;
+        unsigned prev = m_edges[edge].PREV[s];
+        unsigned next = m_edges[edge].NEXT[s];
 
-        CopyPos(element.POS, pos);
+        m_edges[prev].NEXT[s] = next;
+        m_edges[next].PREV[s] = prev;
+        --list.m_size;
+    }
 
-        return true;
+    static size_t Hash(const KeyType &watcher, const KeyType &maker) {
+        size_t h = std::hash<KeyType>()(watcher) * (size_t)0x9e3779b97f4a7c15ULL ^ std::hash<KeyType>()(maker);
+        h ^= h >> 16;
+        h *= (size_t)0x85ebca6bU;
+        h ^= h >> 13;
+        return h;
     }
 
-    bool BroadcastEventToWatchers(const KEY_TYPE &key, const AOI_EVENT_TYPE &event) {
-        auto iter = m_elements.find(key);
+    size_t HomeSlot(unsigned edge) const {
+        return Hash(m_edges[edge].KEY[WATCHER_SIDE], m_edges[edge].KEY[MAKER_SIDE]) & (m_slots.size() - 1);
+    }
 
-        if(iter == m_elements.end()) {
-            return false;
+    // 找不到时返回 m_slots.size()
+    size_t FindSlot(const KeyType &watcher, const KeyType &maker) const {
+        if(m_slots.empty()) {
+            return 0;
         }
 
-        ElementType &element = iter->second;
+        size_t mask = m_slots.size() - 1;
 
-        std::vector<KEY_TYPE> related_watchers(element.RELATED_WATCHERS.begin(), element.RELATED_WATCHERS.end());
+        for(size_t i = Hash(watcher, maker) & mask; m_slots[i] != NIL; i = (i + 1) & mask) {
+            const EdgeType &edge = m_edges[m_slots[i]];
 
-        for(const KEY_TYPE &watcher: related_watchers) {
-            Callback(watcher, key, event);
+            if(edge.KEY[WATCHER_SIDE] == watcher && edge.KEY[MAKER_SIDE] == maker) {
+                return i;
+            }
         }
 
-        return true;
+        return m_slots.size();
     }
 
-    // get whom can see i
-    bool GetWatchersList(const KEY_TYPE &key, std::vector<KEY_TYPE> &watchers) {
-        auto iter = m_elements.find(key);
-
-        if(iter == m_elements.end()) {
-            return false;
+    void InsertSlot(unsigned edge) {
+        if((m_size + 1) * 2 > m_slots.size()) {
+            Rehash(m_slots.empty() ? 16 : m_slots.size() * 2);
         }
 
-        ElementType &element = iter->second;
+        size_t mask = m_slots.size() - 1;
+        size_t i = HomeSlot(edge);
 
-        watchers.assign(element.RELATED_WATCHERS.begin(), element.RELATED_WATCHERS.end());
+        while(m_slots[i] != NIL) {
+            i = (i + 1) & mask;
+        }
 
-        return true;
+        m_slots[i] = edge;
+        ++m_size;
     }
 
-    // get whom i can see
-    bool GetMakersList(const KEY_TYPE &key, std::vector<KEY_TYPE> &makers) {
-        auto iter = m_elements.find(key);
+    // 线性探测的删除：把后面探测链上的边往前挪，不留删除标记
+    void EraseSlot(size_t i) {
+        size_t mask = m_slots.size() - 1;
+        size_t j = i;
 
-        if(iter == m_elements.end()) {
-            return false;
-        }
+        while(true) {
+            j = (j + 1) & mask;
 
-        ElementType &element = iter->second;
+            if(m_slots[j] == NIL) {
+                break;
+            }
 
-        makers.assign(element.RELATED_MAKERS.begin(), element.RELATED_MAKERS.end());
+            size_t home = HomeSlot(m_slots[j]);
 
-        return true;
+            // home 不在 (i, j] 之间时，j 上的边可以挪到 i
+            bool movable = i <= j ? (home <= i || j < home) : (home <= i && j < home);
+
+            if(movable) {
+                m_slots[i] = m_slots[j];
+                i = j;
+            }
+        }
+
+        m_slots[i] = NIL;
+        --m_size;
     }
 
-    void CalcGetMakersInRangeHint(const POS_TYPE pos[DIMENSION], const POS_TYPE range[DIMENSION], GetMakersInRangeHint &hint) {
-        hint.TARGET_DIMENSION = -1;
-        hint.COMPLEXITY = 0;
+    void Rehash(size_t capacity) {
+        std::vector<unsigned> old;
+        old.swap(m_slots);
+        m_slots.assign(capacity, NIL);
 
-        for(int i = 0; i < DIMENSION; ++i) {
-            POS_TYPE lower = pos[i] - range[i];
-            POS_TYPE upper = pos[i] + range[i];
+        size_t mask = capacity - 1;
 
-            unsigned long count = m_dimensions[i].MAKER_LIST.GetElementsCountByRangedValue(lower, false, upper, false);
+        for(unsigned edge: old) {
+            if(edge == NIL) {
+                continue;
+            }
 
-            if(hint.TARGET_DIMENSION < 0 || count < hint.COMPLEXITY) {
+            size_t i = HomeSlot(edge);
+
+            while(m_slots[i] != NIL) {
+                i = (i + 1) & mask;
+            }
+
+            m_slots[i] = edge;
+        }
+    }
+};
+
+template<typename KeyType>
+constexpr unsigned AoiEdgeTable<KeyType>::NIL;
+
+template<typename KeyType>
+constexpr int AoiEdgeTable<KeyType>::WATCHER_SIDE;
+
+template<typename KeyType>
+constexpr int AoiEdgeTable<KeyType>::MAKER_SIDE;
+
+// 位置数组的对齐，按整个数组的大小向上取2的幂，不超过默认分配器能保证的对齐
+template<typename PosType, int Dimension>
+struct AoiPosAlign {
+    static constexpr size_t Fit(size_t align) {
+        return align >= sizeof(PosType) * Dimension || align >= alignof(std::max_align_t) ? align : Fit(align * 2);
+    }
+
+    static constexpr size_t VALUE = Fit(alignof(PosType));
+};
+
+// 点 p 是否在盒子 (c - a - b - e, c + a + b + e) 内，所有维度都是开区间
+// 不在某一维失败时提前返回，各维度的比较结果按位与，没有数据相关的分支
+// 2、3维单独展开，其他维度交给编译器展开固定次数的循环
+template<typename PosType, int Dimension>
+struct AoiBox {
+    static bool InsideAt(int i, const PosType c[], const PosType a[], const PosType b[], const PosType e[], const PosType p[]) {
+        return (c[i] - a[i] - b[i] - e[i] < p[i]) & (p[i] < c[i] + a[i] + b[i] + e[i]);
+    }
+
+    static bool InsideAt(int i, const PosType c[], const PosType a[], const PosType b[], const PosType p[]) {
+        return (c[i] - a[i] - b[i] < p[i]) & (p[i] < c[i] + a[i] + b[i]);
+    }
+
+    static bool Inside(const PosType c[], const PosType a[], const PosType b[], const PosType e[], const PosType p[]) {
+        bool inside = true;
+        for(int i = 0; i < Dimension; ++i) {
+            inside &= InsideAt(i, c, a, b, e, p);
+        }
+        return inside;
+    }
+
+    static bool Inside(const PosType c[], const PosType a[], const PosType b[], const PosType p[]) {
+        bool inside = true;
+        for(int i = 0; i < Dimension; ++i) {
+            inside &= InsideAt(i, c, a, b, p);
+        }
+        return inside;
+    }
+};
+
+template<typename PosType>
+struct AoiBox<PosType, 2> {
+    using BASE = AoiBox<PosType, 1>;
+
+    static bool Inside(const PosType c[], const PosType a[], const PosType b[], const PosType e[], const PosType p[]) {
+        return BASE::InsideAt(0, c, a, b, e, p) & BASE::InsideAt(1, c, a, b, e, p);
+    }
+
+    static bool Inside(const PosType c[], const PosType a[], const PosType b[], const PosType p[]) {
+        return BASE::InsideAt(0, c, a, b, p) & BASE::InsideAt(1, c, a, b, p);
+    }
+};
+
+template<typename PosType>
+struct AoiBox<PosType, 3> {
+    using BASE = AoiBox<PosType, 1>;
+
+    static bool Inside(const PosType c[], const PosType a[], const PosType b[], const PosType e[], const PosType p[]) {
+        return BASE::InsideAt(0, c, a, b, e, p) & BASE::InsideAt(1, c, a, b, e, p) & BASE::InsideAt(2, c, a, b, e, p);
+    }
+
+    static bool Inside(const PosType c[], const PosType a[], const PosType b[], const PosType p[]) {
+        return BASE::InsideAt(0, c, a, b, p) & BASE::InsideAt(1, c, a, b, p) & BASE::InsideAt(2, c, a, b, p);
+    }
+};
+
+// 一批候选在某一维上的筛选，每一维的数据连续存放，结果与到 mask 上
+// 运算顺序和 AoiBox 相同，结果和逐个判断完全一致
+template<typename PosType>
+struct AoiBatchFilter {
+    // 固定区间 (lower, upper) 按各候选的半径扩大后，是否包含候选的位置
+    static void FilterPoint(const PosType &lower, const PosType &upper, const PosType *pos, const PosType *extent,
+            size_t begin, size_t n, unsigned char *mask) {
+        for(size_t j = begin; j < n; ++j) {
+            mask[j] &= (lower - extent[j] < pos[j]) & (pos[j] < upper + extent[j]);
+        }
+    }
+
+    // 各候选的区间 (center - extent, center + extent) 按固定半径扩大后，是否包含固定的位置
+    static void FilterBox(const PosType &pos, const PosType &radius, const PosType *center, const PosType *extent,
+            size_t begin, size_t n, unsigned char *mask) {
+        for(size_t j = begin; j < n; ++j) {
+            mask[j] &= (center[j] - extent[j] - radius < pos) & (pos < center[j] + extent[j] + radius);
+        }
+    }
+
+    static void FilterPoint(const PosType &lower, const PosType &upper, const PosType *pos, const PosType *extent,
+            size_t n, unsigned char *mask) {
+        FilterPoint(lower, upper, pos, extent, 0, n, mask);
+    }
+
+    static void FilterBox(const PosType &pos, const PosType &radius, const PosType *center, const PosType *extent,
+            size_t n, unsigned char *mask) {
+        FilterBox(pos, radius, center, extent, 0, n, mask);
+    }
+};
+
+#if defined(__AVX2__)
+// 编译时打开AVX2时，double和64位整数每次处理4个候选，剩下的交给上面的逐个处理
+inline void AoiBatchMask4(int bits, unsigned char *mask) {
+    mask[0] &= bits & 1;
+    mask[1] &= (bits >> 1) & 1;
+    mask[2] &= (bits >> 2) & 1;
+    mask[3] &= (bits >> 3) & 1;
+}
+
+template<>
+inline void AoiBatchFilter<double>::FilterPoint(const double &lower, const double &upper, const double *pos, const double *extent,
+        size_t n, unsigned char *mask) {
+    __m256d lo = _mm256_set1_pd(lower);
+    __m256d up = _mm256_set1_pd(upper);
+    size_t j = 0;
+
+    for(; j + 4 <= n; j += 4) {
+        __m256d p = _mm256_loadu_pd(pos + j);
+        __m256d e = _mm256_loadu_pd(extent + j);
+        __m256d m = _mm256_and_pd(_mm256_cmp_pd(_mm256_sub_pd(lo, e), p, _CMP_LT_OQ),
+                _mm256_cmp_pd(p, _mm256_add_pd(up, e), _CMP_LT_OQ));
+        AoiBatchMask4(_mm256_movemask_pd(m), mask + j);
+    }
+
+    FilterPoint(lower, upper, pos, extent, j, n, mask);
+}
+
+template<>
+inline void AoiBatchFilter<double>::FilterBox(const double &pos, const double &radius, const double *center, const double *extent,
+        size_t n, unsigned char *mask) {
+    __m256d p = _mm256_set1_pd(pos);
+    __m256d r = _mm256_set1_pd(radius);
+    size_t j = 0;
+
+    for(; j + 4 <= n; j += 4) {
+        __m256d c = _mm256_loadu_pd(center + j);
+        __m256d e = _mm256_loadu_pd(extent + j);
+        __m256d m = _mm256_and_pd(_mm256_cmp_pd(_mm256_sub_pd(_mm256_sub_pd(c, e), r), p, _CMP_LT_OQ),
+                _mm256_cmp_pd(p, _mm256_add_pd(_mm256_add_pd(c, e), r), _CMP_LT_OQ));
+        AoiBatchMask4(_mm256_movemask_pd(m), mask + j);
+    }
+
+    FilterBox(pos, radius, center, extent, j, n, mask);
+}
+
+#if defined(__LP64__)
+template<>
+inline void AoiBatchFilter<long>::FilterPoint(const long &lower, const long &upper, const long *pos, const long *extent,
+        size_t n, unsigned char *mask) {
+    __m256i lo = _mm256_set1_epi64x(lower);
+    __m256i up = _mm256_set1_epi64x(upper);
+    size_t j = 0;
+
+    for(; j + 4 <= n; j += 4) {
+        __m256i p = _mm256_loadu_si256((const __m256i *)(pos + j));
+        __m256i e = _mm256_loadu_si256((const __m256i *)(extent + j));
+        __m256i m = _mm256_and_si256(_mm256_cmpgt_epi64(p, _mm256_sub_epi64(lo, e)),
+                _mm256_cmpgt_epi64(_mm256_add_epi64(up, e), p));
+        AoiBatchMask4(_mm256_movemask_pd(_mm256_castsi256_pd(m)), mask + j);
+    }
+
+    FilterPoint(lower, upper, pos, extent, j, n, mask);
+}
+
+template<>
+inline void AoiBatchFilter<long>::FilterBox(const long &pos, const long &radius, const long *center, const long *extent,
+        size_t n, unsigned char *mask) {
+    __m256i p = _mm256_set1_epi64x(pos);
+    __m256i r = _mm256_set1_epi64x(radius);
+    size_t j = 0;
+
+    for(; j + 4 <= n; j += 4) {
+        __m256i c = _mm256_loadu_si256((const __m256i *)(center + j));
+        __m256i e = _mm256_loadu_si256((const __m256i *)(extent + j));
+        __m256i m = _mm256_and_si256(_mm256_cmpgt_epi64(p, _mm256_sub_epi64(_mm256_sub_epi64(c, e), r)),
+                _mm256_cmpgt_epi64(_mm256_add_epi64(_mm256_add_epi64(c, e), r), p));
+        AoiBatchMask4(_mm256_movemask_pd(_mm256_castsi256_pd(m)), mask + j);
+    }
+
+    FilterBox(pos, radius, center, extent, j, n, mask);
+}
+#endif
+#endif
+
+template<typename KeyType, typename PosType, int Dimension>
+class AoiEventType {
+public:
+    using KEY_TYPE = KeyType;
+    using POS_TYPE = PosType;
+    static constexpr int DIMENSION = Dimension;
+
+    int EVENT_ID = 0;
+    POS_TYPE POS[DIMENSION];
+    POS_TYPE POS_FROM[DIMENSION];
+    void *USERDATA = NULL;
+};
+
+template<typename KeyType, typename PosType, int Dimension, bool NotifyMoveEvent = false, bool EnableStats = false>
+class AoiGroup {
+public:
+    using KEY_TYPE = KeyType;
+    using POS_TYPE = PosType;
+    static constexpr int DIMENSION = Dimension;
+    static constexpr POS_TYPE POS_ZERO = (POS_TYPE)0;
+    static constexpr bool NOTIFY_MOVE_EVENT = NotifyMoveEvent;
+    static constexpr bool ENABLE_STATS = EnableStats;
+    static constexpr size_t POS_ALIGN = AoiPosAlign<POS_TYPE, DIMENSION>::VALUE;
+
+    using AOI_EVENT_TYPE = AoiEventType<KEY_TYPE, POS_TYPE, DIMENSION>;
+    using EVENT_CALLBACK = typename std::function<void(unsigned long id, const KEY_TYPE &receiver, const KEY_TYPE &sender, const AOI_EVENT_TYPE &event)>;
+    // 返回值越小越优先保留在可见集合中，默认按距离平方计算
+    using PRIORITY_CALLBACK = typename std::function<double(const KEY_TYPE &watcher, const POS_TYPE watcher_pos[DIMENSION], const KEY_TYPE &maker, const POS_TYPE maker_pos[DIMENSION])>;
+
+private:
+    unsigned long m_id;
+    EVENT_CALLBACK m_eventcb = NULL;
+    PRIORITY_CALLBACK m_prioritycb = NULL;
+    POS_TYPE m_max_watch_range[DIMENSION];
+    POS_TYPE m_max_maker_radius[DIMENSION];
+    alignas(POS_ALIGN) POS_TYPE m_hysteresis[DIMENSION];
+
+    // 上次移动时各维度整个区间内的数量，下次移动时用边缘的数量推算，避免重新计数
+    // 推算的误差会累积，连续推算 HINT_CACHE_MAX_DERIVED 次之后重新计数
+    static constexpr unsigned HINT_CACHE_MAX_DERIVED = 8;
+
+    struct HintCacheType {
+        bool VALID = false;
+        unsigned DERIVED = 0;
+        unsigned long COUNTS[DIMENSION];
+        bool USE_LOWER[DIMENSION]; // 只用于maker，选择watcher的lower还是upper边界列表
+    };
+
+    // 每个关系是关系表中的一条边，元素上只有两个链表的表头
+    using EDGE_TABLE = AoiEdgeTable<KEY_TYPE>;
+    using RELATION_LIST = typename EDGE_TABLE::ListType;
+    EDGE_TABLE m_edges;
+
+    // 移动前后比较的只有位置和范围，保存旧值时只复制这一部分
+    struct ElementShapeType {
+        alignas(POS_ALIGN) POS_TYPE POS[DIMENSION];
+        alignas(POS_ALIGN) POS_TYPE WATCH_RANGE[DIMENSION];
+        alignas(POS_ALIGN) POS_TYPE MAKER_RADIUS[DIMENSION]; // maker自身的可见半径，和watcher的范围相加决定是否可见
+    };
+
+    struct ElementType : public ElementShapeType {
+        int WATCH_TYPE;
+        unsigned VISIBLE_LIMIT = 0; // 0 表示不限制可见数量
+        unsigned RANKED_WATCHERS = 0; // 相关的watcher中有可见数量限制的数量，为0时maker移动不需要通知排名
+
+        // 附近没有watcher的maker进入休眠，在锚点附近移动时不更新索引
+        bool DORMANT = false;
+        bool STATIC = false; // 静态maker放在 STATIC_LIST 中，静态watcher是区域触发器，都不能移动
+        POS_TYPE ANCHOR[DIMENSION]; // 休眠时在 MAKER_LIST 中的位置
+
+        HintCacheType WATCHER_HINT;
+        HintCacheType MAKER_HINT;
+
+        // 两个链表共用一个哨兵节点，只能通过 LinkRelation、UnlinkRelation 修改
+        RELATION_LIST RELATED_WATCHERS;
+        RELATION_LIST RELATED_MAKERS; // 范围内的所有maker，有可见数量限制时只是候选集合
+
+        ElementType() {
+        }
+
+        explicit ElementType(EDGE_TABLE *edges) : RELATED_WATCHERS(edges, edges->NewHead(), EDGE_TABLE::MAKER_SIDE),
+            RELATED_MAKERS(edges, RELATED_WATCHERS.Head(), EDGE_TABLE::WATCHER_SIDE) {
+        }
+    };
+    std::unordered_map<KEY_TYPE, ElementType> m_elements;
+
+    // 快照格式：头部之后依次是配置、元素、关系、可见排名、运动元素，每一段按 SNAPSHOT_ALIGN 对齐
+    // 记录都是定长的，引用其他元素时用元素在快照中的下标，不含指针，可以直接映射到内存中读取
+    // 按本机字节序保存，只在相同的类型和维度之间恢复
+    static constexpr uint32_t SNAPSHOT_VERSION = 1;
+    static constexpr size_t SNAPSHOT_ALIGN = 8;
+
+    static constexpr uint32_t SNAPSHOT_STATIC = 1;
+    static constexpr uint32_t SNAPSHOT_DORMANT = 2;
+    static constexpr uint32_t SNAPSHOT_RANKED = 4; // 有可见数量限制，m_visible_ranks 中有记录
+
+    struct SnapshotHeaderType {
+        char MAGIC[4];
+        uint32_t VERSION;
+        uint32_t DIMENSION;
+        uint32_t KEY_SIZE;
+        uint32_t POS_SIZE;
+        uint32_t RESERVED;
+        uint64_t ELEMENT_COUNT;
+        uint64_t EDGE_COUNT;
+        uint64_t RANK_COUNT;
+        uint64_t KINETIC_COUNT;
+    };
+
+    struct SnapshotConfigType {
+        POS_TYPE MAX_WATCH_RANGE[DIMENSION];
+        POS_TYPE MAX_MAKER_RADIUS[DIMENSION];
+        POS_TYPE HYSTERESIS[DIMENSION];
+        POS_TYPE NOW;
+        POS_TYPE KINETIC_HORIZON;
+    };
+
+    struct SnapshotElementType {
+        KEY_TYPE KEY;
+        POS_TYPE POS[DIMENSION];
+        POS_TYPE WATCH_RANGE[DIMENSION];
+        POS_TYPE MAKER_RADIUS[DIMENSION];
+        POS_TYPE ANCHOR[DIMENSION];
+        int32_t WATCH_TYPE;
+        uint32_t VISIBLE_LIMIT;
+        uint32_t FLAGS;
+    };
+
+    struct SnapshotEdgeType {
+        uint32_t WATCHER;
+        uint32_t MAKER;
+    };
+
+    struct SnapshotRankType {
+        double PRIORITY;
+        uint32_t WATCHER;
+        uint32_t MAKER;
+        uint32_t VISIBLE;
+    };
+
+    struct SnapshotKineticType {
+        POS_TYPE VELOCITY[DIMENSION];
+        POS_TYPE EXPIRY;
+        uint32_t ELEMENT;
+    };
+
+    static size_t SnapshotSectionSize(size_t record_size, uint64_t count) {
+        size_t size = record_size * (size_t)count;
+        return (size + SNAPSHOT_ALIGN - 1) / SNAPSHOT_ALIGN * SNAPSHOT_ALIGN;
+    }
+
+    // 记录先清零，结构体中的填充字节不会带上随机内容
+    template<typename T>
+    static void AppendSnapshotRecord(std::string &data, const T &record) {
+        data.append((const char *)&record, sizeof(T));
+    }
+
+    static void AlignSnapshot(std::string &data) {
+        data.resize((data.size() + SNAPSHOT_ALIGN - 1) / SNAPSHOT_ALIGN * SNAPSHOT_ALIGN, '\0');
+    }
+
+    template<typename T>
+    static T ReadSnapshotRecord(const char *section, size_t index) {
+        T record;
+        memcpy(&record, section + index * sizeof(T), sizeof(T));
+        return record;
+    }
+
+    // 不为NULL时每次调用修改状态的公开接口都追加一条记录，失败的操作也记录，回放时得到同样的结果
+    std::string *m_journal = NULL;
+
+    template<typename T>
+    void JournalValue(const T &value) {
+        m_journal->append((const char *)&value, sizeof(T));
+    }
+
+    void JournalOp(int op, const KEY_TYPE &key) {
+        m_journal->push_back((char)op);
+        JournalValue(key);
+    }
+
+    void JournalPos(const POS_TYPE pos[DIMENSION]) {
+        m_journal->append((const char *)pos, sizeof(POS_TYPE) * DIMENSION);
+    }
+
+    template<typename T>
+    static bool ReadJournalValue(const char *data, size_t size, size_t &offset, T &value) {
+        if(size - offset < sizeof(T)) {
+            return false;
+        }
+
+        memcpy(&value, data + offset, sizeof(T));
+        offset += sizeof(T);
+        return true;
+    }
+
+    static bool ReadJournalPos(const char *data, size_t size, size_t &offset, POS_TYPE pos[DIMENSION]) {
+        for(int i = 0; i < DIMENSION; ++i) {
+            if(!ReadJournalValue(data, size, offset, pos[i])) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // 复制流：主group记录一个tick内状态变化的元素、关系和可见排名，FlushReplication 时按最终状态输出
+    // 运动元素随时间推进的位置不输出，只输出推进的时间点，从group按同样的速度推进
+    // 格式和快照相同，头部之后依次是时间点、元素、关系、可见排名、排名中的候选，每一段按 SNAPSHOT_ALIGN 对齐
+    static constexpr uint32_t REPLICA_VERSION = 1;
+
+    static constexpr uint32_t REPLICA_STATIC = 1;
+    static constexpr uint32_t REPLICA_DORMANT = 2;
+    static constexpr uint32_t REPLICA_KINETIC = 4;
+    static constexpr uint32_t REPLICA_REMOVED = 8; // 元素已经离开，其他字段没有意义
+
+    struct ReplicaHeaderType {
+        char MAGIC[4];
+        uint32_t VERSION;
+        uint32_t DIMENSION;
+        uint32_t KEY_SIZE;
+        uint32_t POS_SIZE;
+        uint32_t RESERVED;
+        uint64_t TIME_COUNT;
+        uint64_t ELEMENT_COUNT;
+        uint64_t EDGE_COUNT;
+        uint64_t RANK_COUNT;
+        uint64_t RANK_ITEM_COUNT;
+        POS_TYPE NOW;
+        POS_TYPE KINETIC_HORIZON;
+    };
+
+    struct ReplicaElementType {
+        KEY_TYPE KEY;
+        POS_TYPE POS[DIMENSION];
+        POS_TYPE WATCH_RANGE[DIMENSION];
+        POS_TYPE MAKER_RADIUS[DIMENSION];
+        POS_TYPE ANCHOR[DIMENSION];
+        POS_TYPE VELOCITY[DIMENSION];
+        POS_TYPE EXPIRY;
+        int32_t WATCH_TYPE;
+        uint32_t VISIBLE_LIMIT;
+        uint32_t FLAGS;
+    };
+
+    struct ReplicaEdgeType {
+        KEY_TYPE WATCHER;
+        KEY_TYPE MAKER;
+        uint32_t LINKED;
+    };
+
+    // LIMIT 为0表示没有可见数量限制，之后 ITEM_COUNT 个候选属于这个watcher
+    struct ReplicaRankType {
+        KEY_TYPE KEY;
+        uint32_t LIMIT;
+        uint32_t ITEM_COUNT;
+    };
+
+    struct ReplicaRankItemType {
+        double PRIORITY;
+        KEY_TYPE MAKER;
+        uint32_t VISIBLE;
+    };
+
+    struct ReplicaPairHash {
+        size_t operator()(const std::pair<KEY_TYPE, KEY_TYPE> &pair) const {
+            size_t h = std::hash<KEY_TYPE>()(pair.first);
+            return h ^ (std::hash<KEY_TYPE>()(pair.second) + 0x9e3779b9 + (h << 6) + (h >> 2));
+        }
+    };
+
+    // 只记录发生变化的key，一个tick内多次变化只输出一次
+    bool m_replication = false;
+    std::vector<POS_TYPE> m_replica_times;
+    std::unordered_set<KEY_TYPE> m_replica_elements;
+    std::unordered_set<std::pair<KEY_TYPE, KEY_TYPE>, ReplicaPairHash> m_replica_edges;
+    std::unordered_set<KEY_TYPE> m_replica_ranks;
+
+    void MarkReplicaElement(const KEY_TYPE &key) {
+        if(m_replication) {
+            m_replica_elements.insert(key);
+        }
+    }
+
+    void MarkReplicaRank(const KEY_TYPE &key) {
+        if(m_replication) {
+            m_replica_ranks.insert(key);
+        }
+    }
+
+    // 有可见数量限制的watcher，候选maker按优先级分成可见和被裁剪两部分，优先级相同时按key比较
+    // 两部分都是记录了下标的二叉堆：VISIBLE 堆顶是可见中最差的，CULLED 堆顶是被裁剪中最好的
+    // VISIBLE 中最差的一个总是优于 CULLED 中最好的一个，排名变化时只需要比较、交换两个堆顶
+    struct RankItemType {
+        double PRIORITY;
+        KEY_TYPE KEY;
+
+        bool operator<(const RankItemType &other) const {
+            return PRIORITY < other.PRIORITY || (!(other.PRIORITY < PRIORITY) && KEY < other.KEY);
+        }
+    };
+
+    struct RankSlotType {
+        bool VISIBLE;
+        size_t INDEX; // 在所属堆中的下标
+    };
+
+    struct VisibleRankType {
+        unsigned LIMIT;
+        std::vector<RankItemType> VISIBLE;
+        std::vector<RankItemType> CULLED;
+        std::unordered_map<KEY_TYPE, RankSlotType> SLOTS;
+    };
+    std::unordered_map<KEY_TYPE, VisibleRankType> m_visible_ranks;
+
+    // watcher按各维度的范围大小分桶，每个桶单独维护上下边界列表
+    // 查询时每个桶只需要按桶内实际使用的最大范围确定搜索区间，少数大范围的watcher不会拖累其他watcher
+    static constexpr int WATCHER_BUCKET_COUNT = 4;
+
+    struct WatcherBucketType {
+        ZeeSkiplist<KEY_TYPE, POS_TYPE> WATCHER_LOWER_LIST;
+        ZeeSkiplist<KEY_TYPE, POS_TYPE> WATCHER_UPPER_LIST;
+        std::map<POS_TYPE, unsigned long> RANGES; // 桶内正在使用的范围 -> watcher数量
+    };
+
+    struct DimensionType {
+        WatcherBucketType WATCHER_BUCKETS[WATCHER_BUCKET_COUNT];
+        POS_TYPE BUCKET_BOUNDS[WATCHER_BUCKET_COUNT]; // 范围不超过 BUCKET_BOUNDS[b] 的watcher放在第b个桶
+        ZeeSkiplist<KEY_TYPE, POS_TYPE> MAKER_LIST;
+        std::vector<std::pair<POS_TYPE, KEY_TYPE>> STATIC_LIST; // 静态maker，前 STATIC_SORTED 个按位置排好序，之后是新加入的
+        ZeeSkiplist<KEY_TYPE, POS_TYPE> KINETIC_LIST; // 匀速运动的元素，用于查找受影响的预测
+        ZeeSkiplist<KEY_TYPE, POS_TYPE> DORMANT_LIST; // 休眠maker的锚点
+    };
+    DimensionType m_dimensions[DIMENSION];
+
+    // 静态maker加入、离开时只记录下来，下次查询前批量重建：新加入的排序后合并，离开的一次性去掉
+    size_t m_static_sorted = 0;
+    unsigned long m_static_count = 0;
+    std::unordered_set<KEY_TYPE> m_static_removed;
+
+    // 区域触发器（任务区域、陷阱等静态watcher）不放进watcher的分桶，范围不受 max_watch_range 限制，
+    // 也不会扩大动态watcher的搜索区间。在一个维度上按下边界排序，并记录每个子树上边界的最大值，
+    // 组成隐式的区间树；加入、离开时只标记，下次查询前重建
+    struct TriggerType {
+        POS_TYPE LOWER;
+        POS_TYPE UPPER;
+        KEY_TYPE KEY;
+
+        bool operator<(const TriggerType &other) const {
+            return LOWER < other.LOWER;
+        }
+    };
+    std::unordered_set<KEY_TYPE> m_triggers;
+    bool m_trigger_dirty = false;
+    int m_trigger_dimension = 0;
+    std::vector<TriggerType> m_trigger_list;
+    std::vector<POS_TYPE> m_trigger_max_upper; // 以 mid 为根的子树 [l, r) 中上边界的最大值
+
+    // 范围查询先把候选收集到这里，每一维的位置和半径分列存放，再整批筛选
+    // 作为成员复用，查询时不用每次分配内存
+    struct ScanBufferType {
+        std::vector<KEY_TYPE> KEYS;
+        std::vector<POS_TYPE> POS[DIMENSION];
+        std::vector<POS_TYPE> EXTENT[DIMENSION];
+        std::vector<unsigned char> MASK;
+
+        void Clear() {
+            KEYS.clear();
+            for(int i = 0; i < DIMENSION; ++i) {
+                POS[i].clear();
+                EXTENT[i].clear();
+            }
+        }
+
+        void Add(const KEY_TYPE &key, const POS_TYPE pos[DIMENSION], const POS_TYPE extent[DIMENSION]) {
+            KEYS.emplace_back(key);
+            for(int i = 0; i < DIMENSION; ++i) {
+                POS[i].emplace_back(pos[i]);
+                EXTENT[i].emplace_back(extent[i]);
+            }
+        }
+
+        void ResetMask() {
+            MASK.assign(KEYS.size(), 1);
+        }
+    };
+    ScanBufferType m_scan;
+
+    // 预计的候选少于这个数量时，分列收集的开销超过整批筛选的收益，遍历时逐个判断
+    static constexpr unsigned long SCAN_BATCH_MIN = 32;
+
+    // 两个维度的候选只需要遍历、排序，比查找元素再筛选便宜，按这个比例折算代价
+    static constexpr unsigned long INTERSECT_COST_DIVISOR = 4;
+    std::vector<KEY_TYPE> m_intersect_keys[2];
+    std::vector<std::vector<KEY_TYPE>> m_scratch_keys;
+
+    // MoveViewGroup 中每个成员的状态，只在一次调用内使用，回调里再次调用时互不影响
+    // 回调中可能移除元素，只保存key，每次使用前重新查找
+    struct ViewMemberType {
+        KEY_TYPE KEY;
+        ElementShapeType OLD;
+        bool DONE; // 没有移动、休眠中移动或者已经被移除，不需要再处理
+    };
+    std::vector<KEY_TYPE> m_view_journal_keys;
+    std::vector<POS_TYPE> m_view_journal_positions;
+    unsigned long m_maker_count = 0;
+
+    // 匀速运动的元素，位置随时间推进，只在关系可能变化的时间点重新计算关系
+    // 时间和位置使用相同的类型，VELOCITY 是单位时间的位移
+    struct KineticType {
+        POS_TYPE VELOCITY[DIMENSION];
+        POS_TYPE LIST_POS[DIMENSION]; // 在 KINETIC_LIST 中的位置，只在计算预测时更新，和实际位置的偏差见 KineticDrift
+        POS_TYPE EXPIRY; // 在这个时间之前，关系不会发生变化
+    };
+    std::unordered_map<KEY_TYPE, KineticType> m_kinetics;
+    std::set<std::pair<POS_TYPE, KEY_TYPE>> m_kinetic_queue; // 按 EXPIRY 排序
+    std::map<POS_TYPE, unsigned long> m_kinetic_speeds[DIMENSION]; // 每个维度上速度绝对值的计数
+    POS_TYPE m_now = POS_ZERO;
+    unsigned long m_dormant_count = 0;
+    POS_TYPE m_kinetic_horizon = POS_ZERO;
+
+    // 每 CHOOSER_SAMPLE_INTERVAL 次选择测量一次实际耗时，得到每单位代价的耗时
+    // 每 CHOOSER_EXPLORE_INTERVAL 次测量反转一次选择，保证两种方式都持续有样本
+    static constexpr unsigned long CHOOSER_SAMPLE_INTERVAL = 16;
+    static constexpr unsigned long CHOOSER_EXPLORE_INTERVAL = 8;
+    static constexpr double CHOOSER_EWMA_ALPHA = 0.125;
+    bool m_chooser_calibration = true;
+
+    // watcher和maker分开计数，同时是watcher和maker的元素移动时不会总是只采样到一边
+    struct ChooserSamplerType {
+        unsigned long TICKS = 0;
+        unsigned long SAMPLES = 0;
+    };
+    ChooserSamplerType m_watcher_sampler;
+    ChooserSamplerType m_maker_sampler;
+
+    // INTERSECT_DIMENSION >= 0 时，先取 TARGET_DIMENSION 和 INTERSECT_DIMENSION 两个维度候选的交集再筛选
+    struct GetMakersInRangeHint {
+        int TARGET_DIMENSION;
+        int INTERSECT_DIMENSION;
+        unsigned long COMPLEXITY;
+    };
+
+    struct GetWatchersRelatedToPosHint {
+        int TARGET_DIMENSION;
+        unsigned long COMPLEXITY;
+        bool USE_LOWER;
+    };
+
+    // DIMENSION >= 0 时在该维度上遍历整个区间，否则在每个维度上遍历区间变化的边缘
+    struct MoveWatcherHint {
+        int LEAVE_DIMENSION;
+        int ENTER_DIMENSION;
+        unsigned long COMPLEXITY;
+    };
+
+    struct MoveMakerHint {
+        int LEAVE_DIMENSION;
+        bool LEAVE_USE_LOWER;
+        int ENTER_DIMENSION;
+        bool ENTER_USE_LOWER;
+        unsigned long COMPLEXITY;
+    };
+
+public:
+    // 移动时选择重新查询(UPDATE)还是增量处理(SHIFT)的统计
+    // *_WEIGHT 是测量得到的每单位代价耗时(纳秒)，0 表示还没有样本，此时直接比较代价
+    struct MoveChooserStatsType {
+        unsigned long WATCHER_UPDATES = 0;
+        unsigned long WATCHER_SHIFTS = 0;
+        unsigned long MAKER_UPDATES = 0;
+        unsigned long MAKER_SHIFTS = 0;
+        unsigned long HINT_CACHE_HITS = 0;
+        unsigned long HINT_CACHE_MISSES = 0;
+        double WATCHER_UPDATE_WEIGHT = 0;
+        double WATCHER_SHIFT_WEIGHT = 0;
+        double MAKER_UPDATE_WEIGHT = 0;
+        double MAKER_SHIFT_WEIGHT = 0;
+    };
+
+    // 热点路径的统计，只有模板参数 EnableStats 为true时才计数，否则计数的代码在编译时去掉
+    // 计数是上次 TakeStats 之后的增量，关系集合的大小是取统计时的当前值
+    static constexpr int STATS_HISTOGRAM_SIZE = 16;
+
+    struct StatsType {
+        // 移动时的选择，来自 MoveChooserStatsType 的增量
+        unsigned long WATCHER_UPDATES = 0;
+        unsigned long WATCHER_SHIFTS = 0;
+        unsigned long MAKER_UPDATES = 0;
+        unsigned long MAKER_SHIFTS = 0;
+        unsigned long HINT_CACHE_HITS = 0;
+        unsigned long HINT_CACHE_MISSES = 0;
+
+        unsigned long QUERIES = 0; // GetMakersInRange 和 GetWatchersRelatedToPos 的次数
+        unsigned long QUERY_SCANNED = 0; // 查询中按位置筛选的候选数量
+        unsigned long QUERY_ACCEPTED = 0; // 候选中在范围内的数量
+        unsigned long SHIFT_SCANNED = 0; // 增量处理中检查的边缘候选数量
+        unsigned long SHIFT_ACCEPTED = 0; // 边缘候选中进入或离开的数量
+        unsigned long RANK_COUNTS = 0; // 跳表按区间计数的次数，来自 Calc*Hint 和休眠时的检查
+        unsigned long VIEW_GROUP_MEMBERS = 0; // MoveViewGroup 中共享一次查询的watcher数量
+        unsigned long VIEW_GROUP_EDGE_CHECKS = 0; // 不在所有成员交集内、需要逐个成员判断的次数
+
+        unsigned long ENTER_EVENTS = 0;
+        unsigned long LEAVE_EVENTS = 0;
+        unsigned long MOVE_EVENTS = 0;
+        unsigned long OTHER_EVENTS = 0; // 广播的自定义事件
+
+        // CheckConsistency 的结果，CHECK_FAILURE_KEY 是最近一个不一致的元素
+        unsigned long CHECKED = 0;
+        unsigned long CHECK_FAILURES = 0;
+        unsigned long CHECK_NS = 0;
+        bool HAS_CHECK_FAILURE_KEY = false;
+        KEY_TYPE CHECK_FAILURE_KEY = KEY_TYPE();
+
+        unsigned long ELEMENTS = 0;
+        unsigned long RELATIONS = 0;
+        unsigned long MAX_RELATED_MAKERS = 0;
+        unsigned long MAX_RELATED_WATCHERS = 0;
+        // 按 watcher 看到的maker数量分组，第0组是0个，第i组是 [2^(i-1), 2^i)，最后一组包含更大的值
+        unsigned long RELATED_MAKERS_HISTOGRAM[STATS_HISTOGRAM_SIZE] = { 0 };
+    };
+
+    // 超过阈值的慢操作，OP 是 AOI_JOURNAL_OPS 中的值，HAS_KEY 为false的操作(例如 AdvanceTime)没有key
+    // 候选数量和事件数量是操作期间 StatsType 中对应计数的增加值
+    struct SlowOpType {
+        int OP = 0;
+        bool HAS_KEY = false;
+        KEY_TYPE KEY = KEY_TYPE();
+        unsigned long NS = 0;
+        unsigned long CANDIDATES_SCANNED = 0;
+        unsigned long CANDIDATES_ACCEPTED = 0;
+        unsigned long RANK_COUNTS = 0;
+        unsigned long EVENTS = 0;
+    };
+
+    // GetHeatmap 的结果，CELLS 按第0维变化最快的顺序排列
+    // RELATIONS 是格子内的watcher看到的maker数量之和，格子外的元素计入 OUTSIDE
+    struct HeatmapCellType {
+        unsigned long MAKERS = 0;
+        unsigned long WATCHERS = 0;
+        unsigned long RELATIONS = 0;
+    };
+
+    struct HeatmapType {
+        POS_TYPE ORIGIN[DIMENSION];
+        POS_TYPE CELL_SIZE[DIMENSION];
+        unsigned SIZE[DIMENSION];
+        std::vector<HeatmapCellType> CELLS;
+        HeatmapCellType OUTSIDE;
+
+        // 格子的下标，越界时返回 CELLS.size()
+        size_t CellIndex(const unsigned index[DIMENSION]) const {
+            size_t cell = 0;
+
+            for(int i = DIMENSION - 1; i >= 0; --i) {
+                if(index[i] >= SIZE[i]) {
+                    return CELLS.size();
+                }
+
+                cell = cell * SIZE[i] + index[i];
+            }
+
+            return cell;
+        }
+    };
+
+    static constexpr size_t HEATMAP_MAX_CELLS = 1 << 24;
+
+private:
+    MoveChooserStatsType m_chooser_stats;
+    StatsType m_stats;
+    MoveChooserStatsType m_stats_chooser_base; // 上次 TakeStats 时的选择统计
+
+    // 按 AOI_JOURNAL_OPS 分开的耗时直方图，第一次记录时才分配
+    std::vector<AoiLatencyHistogram> m_latency;
+
+    // 慢操作的环形缓冲区，满了之后覆盖最早的记录
+    std::vector<SlowOpType> m_slow_ops;
+    size_t m_slow_op_next = 0;
+    size_t m_slow_op_capacity = 64;
+    unsigned long m_slow_op_threshold_ns = 1000000;
+    unsigned m_op_depth = 0;
+
+    // 等待 CheckConsistency 检查的最近修改过的元素
+    std::vector<KEY_TYPE> m_check_recent;
+    size_t m_check_recent_capacity = 0;
+    std::mt19937 m_check_rng;
+
+public:
+    AoiGroup(unsigned long id, const POS_TYPE max_watch_range[DIMENSION]) : m_id(id) {
+        for(int i = 0; i < DIMENSION; ++i) {
+            assert(POS_ZERO < max_watch_range[i]);
+        }
+
+        CopyPos(max_watch_range, m_max_watch_range);
+        std::fill(m_max_maker_radius, m_max_maker_radius + DIMENSION, POS_ZERO);
+        std::fill(m_hysteresis, m_hysteresis + DIMENSION, POS_ZERO);
+
+        // 分桶的上界依次减半
+        for(int i = 0; i < DIMENSION; ++i) {
+            POS_TYPE bound = m_max_watch_range[i];
+
+            for(int b = WATCHER_BUCKET_COUNT - 1; b >= 0; --b) {
+                m_dimensions[i].BUCKET_BOUNDS[b] = bound;
+                bound = bound / (POS_TYPE)2;
+            }
+        }
+    }
+
+    // max_maker_radius 限制maker可见半径的上限，搜索watcher区间时据此扩大范围
+    AoiGroup(unsigned long id, const POS_TYPE max_watch_range[DIMENSION], const POS_TYPE max_maker_radius[DIMENSION]) : AoiGroup(id, max_watch_range) {
+        for(int i = 0; i < DIMENSION; ++i) {
+            assert(!(max_maker_radius[i] < POS_ZERO));
+        }
+
+        CopyPos(max_maker_radius, m_max_maker_radius);
+    }
+
+    // hysteresis 是离开时额外的距离：maker在区间内进入，超出区间加上 hysteresis 才离开，
+    // 避免在边界附近抖动的maker反复进出
+    AoiGroup(unsigned long id, const POS_TYPE max_watch_range[DIMENSION], const POS_TYPE max_maker_radius[DIMENSION],
+            const POS_TYPE hysteresis[DIMENSION]) : AoiGroup(id, max_watch_range, max_maker_radius) {
+        for(int i = 0; i < DIMENSION; ++i) {
+            assert(!(hysteresis[i] < POS_ZERO));
+        }
+
+        CopyPos(hysteresis, m_hysteresis);
+    }
+
+    void SetCallback(EVENT_CALLBACK cb) {
+        m_eventcb = cb;
+    }
+
+    void SetPriorityCallback(PRIORITY_CALLBACK cb) {
+        m_prioritycb = cb;
+
+        // 优先级规则变了，所有有数量限制的watcher重新排序
+        for(auto iter = m_visible_ranks.begin(); iter != m_visible_ranks.end(); ++iter) {
+            auto eiter = m_elements.find(iter->first);
+
+            if(eiter == m_elements.end()) {
+                continue;
+            }
+
+            std::vector<KEY_TYPE> old_visible;
+            GetVisibleKeys(iter->second, old_visible);
+            ResyncVisible(iter->first, eiter->second, iter->second, old_visible);
+        }
+    }
+
+    unsigned long Id() {
+        return m_id;
+    }
+
+    bool Enter(const KEY_TYPE &key, const POS_TYPE pos[DIMENSION], int watch_type, const POS_TYPE watch_range[DIMENSION], const POS_TYPE maker_radius[DIMENSION]) {
+        OP_TIMER timer(this, AOI_JOURNAL_OPS::ENTER, &key);
+
+        if(m_journal) {
+            JournalOp(AOI_JOURNAL_OPS::ENTER, key);
+            JournalValue((int32_t)watch_type);
+            JournalPos(pos);
+            JournalPos(watch_range);
+            JournalPos(maker_radius);
+        }
+
+        MarkReplicaElement(key);
+
+        if(m_elements.count(key)) {
+            return false;
+        }
+
+        ElementType &element = m_elements.emplace(std::piecewise_construct, std::forward_as_tuple(key),
+                std::forward_as_tuple(&m_edges)).first->second;
+
+        element.WATCH_TYPE = watch_type;
+        CopyPos(pos, element.POS);
+        CopyPos(watch_range, element.WATCH_RANGE);
+        TrimWatchRange(element.WATCH_RANGE);
+        CopyPos(maker_radius, element.MAKER_RADIUS);
+        TrimMakerRadius(element.MAKER_RADIUS);
+
+        if(watch_type & AOI_WATCH_TYPES::WATCHER) {
+            WakeDormantNear(element.POS);
+        }
+
+        if(watch_type & AOI_WATCH_TYPES::MAKER) {
+            InsertMaker(key, element);
+        }
+
+        if(watch_type & AOI_WATCH_TYPES::WATCHER) {
+            InsertWatcher(key, element);
+        }
+
+        TouchKinetic(key, element);
+        TryDormant(key, element);
+
+        return true;
+    }
+
+    bool Enter(const KEY_TYPE &key, const POS_TYPE pos[DIMENSION], int watch_type, const POS_TYPE watch_range[DIMENSION]) {
+        POS_TYPE radius[DIMENSION] = { POS_ZERO };
+
+        return Enter(key, pos, watch_type, watch_range, radius);
+    }
+
+    bool Enter(const KEY_TYPE &key, const POS_TYPE pos[DIMENSION], int watch_type) {
+        POS_TYPE range[DIMENSION] = { POS_ZERO };
+
+        return Enter(key, pos, watch_type, range);
+    }
+
+    // 加入一个不会移动的maker，例如树木、建筑，放在单独的有序数组中，不占用动态maker的跳表
+    // 静态maker不能移动、改变类型、可见半径和速度，只能离开
+    bool EnterStatic(const KEY_TYPE &key, const POS_TYPE pos[DIMENSION], const POS_TYPE maker_radius[DIMENSION]) {
+        OP_TIMER timer(this, AOI_JOURNAL_OPS::ENTER_STATIC, &key);
+
+        if(m_journal) {
+            JournalOp(AOI_JOURNAL_OPS::ENTER_STATIC, key);
+            JournalPos(pos);
+            JournalPos(maker_radius);
+        }
+
+        MarkReplicaElement(key);
+
+        if(m_elements.count(key)) {
+            return false;
+        }
+
+        ElementType &element = m_elements.emplace(std::piecewise_construct, std::forward_as_tuple(key),
+                std::forward_as_tuple(&m_edges)).first->second;
+
+        element.WATCH_TYPE = AOI_WATCH_TYPES::MAKER;
+        element.STATIC = true;
+        CopyPos(pos, element.POS);
+        std::fill(element.WATCH_RANGE, element.WATCH_RANGE + DIMENSION, POS_ZERO);
+        CopyPos(maker_radius, element.MAKER_RADIUS);
+        TrimMakerRadius(element.MAKER_RADIUS);
+
+        InsertMaker(key, element);
+        TouchKinetic(key, element);
+
+        return true;
+    }
+
+    bool EnterStatic(const KEY_TYPE &key, const POS_TYPE pos[DIMENSION]) {
+        POS_TYPE radius[DIMENSION] = { POS_ZERO };
+
+        return EnterStatic(key, pos, radius);
+    }
+
+    // 加入一个不会移动的区域触发器，例如任务区域、PvP区域、陷阱，maker进出区域时收到事件
+    // 触发器放在单独的区间索引中，范围可以超过 max_watch_range，不能移动、改变类型和范围，只能离开
+    bool EnterTrigger(const KEY_TYPE &key, const POS_TYPE pos[DIMENSION], const POS_TYPE watch_range[DIMENSION]) {
+        OP_TIMER timer(this, AOI_JOURNAL_OPS::ENTER_TRIGGER, &key);
+
+        if(m_journal) {
+            JournalOp(AOI_JOURNAL_OPS::ENTER_TRIGGER, key);
+            JournalPos(pos);
+            JournalPos(watch_range);
+        }
+
+        MarkReplicaElement(key);
+
+        if(m_elements.count(key)) {
+            return false;
+        }
+
+        ElementType &element = m_elements.emplace(std::piecewise_construct, std::forward_as_tuple(key),
+                std::forward_as_tuple(&m_edges)).first->second;
+
+        element.WATCH_TYPE = AOI_WATCH_TYPES::WATCHER;
+        element.STATIC = true;
+        CopyPos(pos, element.POS);
+        CopyPos(watch_range, element.WATCH_RANGE);
+        std::fill(element.MAKER_RADIUS, element.MAKER_RADIUS + DIMENSION, POS_ZERO);
+
+        POS_TYPE reach[DIMENSION];
+        for(int i = 0; i < DIMENSION; ++i) {
+            if(element.WATCH_RANGE[i] < POS_ZERO) {
+                element.WATCH_RANGE[i] = POS_ZERO;
+            }
+
+            reach[i] = TriggerReach(i, element.WATCH_RANGE[i]);
+        }
+
+        WakeDormantInBox(element.POS, reach);
+        InsertWatcher(key, element);
+        TouchKinetic(key, element);
+
+        return true;
+    }
+
+    bool Leave(const KEY_TYPE &key) {
+        OP_TIMER timer(this, AOI_JOURNAL_OPS::LEAVE, &key);
+
+        if(m_journal) {
+            JournalOp(AOI_JOURNAL_OPS::LEAVE, key);
+        }
+
+        MarkReplicaElement(key);
+
+        auto iter = m_elements.find(key);
+
+        if(iter == m_elements.end()) {
+            return false;
+        }
+
+        if(iter->second.DORMANT) {
+            WakeDormant(key, iter->second, iter->second.POS);
+        }
+
+        ElementType element = iter->second;
+        m_elements.erase(iter);
+
+        auto kiter = m_kinetics.find(key);
+        if(kiter != m_kinetics.end()) {
+            RemoveKinetic(key, kiter->second);
+            m_kinetics.erase(kiter);
+        }
+
+        int watch_type = element.WATCH_TYPE;
+        if(watch_type & AOI_WATCH_TYPES::MAKER) {
+            RemoveMaker(key, element);
+        }
+
+        if(watch_type & AOI_WATCH_TYPES::WATCHER) {
+            RemoveWatcher(key, element);
+        }
+
+        m_edges.FreeHead(element.RELATED_MAKERS.Head());
+
+        return true;
+    }
+
+    bool Move(const KEY_TYPE &key, const POS_TYPE pos[DIMENSION]) {
+        OP_TIMER timer(this, AOI_JOURNAL_OPS::MOVE, &key);
+
+        if(m_journal) {
+            JournalOp(AOI_JOURNAL_OPS::MOVE, key);
+            JournalPos(pos);
+        }
+
+        MarkReplicaElement(key);
+
+        auto iter = m_elements.find(key);
+
+        if(iter == m_elements.end() || iter->second.STATIC) {
+            return false;
+        }
+
+        ElementType &element = iter->second;
+
+        if(IsSamePos(element.POS, pos)) {
+            return true;
+        }
+
+        ElementShapeType old_element = element;
+        CopyPos(pos, element.POS);
+
+        if(element.DORMANT) {
+            if(MoveDormant(key, element)) {
+                return true;
+            }
+
+            WakeDormant(key, element, old_element.POS);
+        }
+
+        int watch_type = element.WATCH_TYPE;
+        if(watch_type & AOI_WATCH_TYPES::WATCHER) {
+            WakeDormantNear(element.POS);
+        }
+
+        if(watch_type & AOI_WATCH_TYPES::MAKER) {
+            MoveMaker(key, element, old_element);
+        }
+
+        if(watch_type & AOI_WATCH_TYPES::WATCHER) {
+            MoveWatcher(key, element, old_element);
+        }
+
+        TouchKinetic(key, element);
+        TryDormant(key, element);
+
+        return true;
+    }
+
+    bool MoveDiff(const KEY_TYPE &key, const POS_TYPE diff[DIMENSION]) {
+        OP_TIMER timer(this, AOI_JOURNAL_OPS::MOVE_DIFF, &key);
+
+        if(m_journal) {
+            JournalOp(AOI_JOURNAL_OPS::MOVE_DIFF, key);
+            JournalPos(diff);
+        }
+
+        MarkReplicaElement(key);
+
+        auto iter = m_elements.find(key);
+
+        if(iter == m_elements.end() || iter->second.STATIC) {
+            return false;
+        }
+
+        ElementType &element = iter->second;
+
+        if(IsZeroPos(diff)) {
+            return true;
+        }
+
+        ElementShapeType old_element = element;
+        for(int i = 0; i < DIMENSION; ++i) {
+            element.POS[i] += diff[i];
+        }
+
+        if(element.DORMANT) {
+            if(MoveDormant(key, element)) {
+                return true;
+            }
+
+            WakeDormant(key, element, old_element.POS);
+        }
+
+        int watch_type = element.WATCH_TYPE;
+        if(watch_type & AOI_WATCH_TYPES::WATCHER) {
+            WakeDormantNear(element.POS);
+        }
+
+        if(watch_type & AOI_WATCH_TYPES::MAKER) {
+            MoveMaker(key, element, old_element);
+        }
+
+        if(watch_type & AOI_WATCH_TYPES::WATCHER) {
+            MoveWatcher(key, element, old_element);
+        }
+
+        TouchKinetic(key, element);
+        TryDormant(key, element);
+
+        return true;
+    }
+
+    // 同时移动一组站在一起的元素，例如一起行动的队伍，positions 依次是每个元素的位置，共 count * DIMENSION 个值
+    // maker 一侧和 Move 相同；watcher 一侧只对所有成员观察范围的并集查询一次，
+    // 落在所有成员交集内的候选对所有成员都可见，只有边缘的候选需要逐个成员判断
+    // 成员分散时退回逐个处理；有元素不存在、是静态元素或者重复时返回false，不做任何修改
+    // 和依次调用 Move 的区别只在滞后区间内：成员之间先按新位置判断，处于滞后区间内的关系可能不同
+    bool MoveViewGroup(const KEY_TYPE keys[], const POS_TYPE positions[], size_t count) {
+        OP_TIMER timer(this, AOI_JOURNAL_OPS::MOVE_VIEW_GROUP, count ? keys : NULL);
+
+        if(m_journal) {
+            m_journal->push_back((char)AOI_JOURNAL_OPS::MOVE_VIEW_GROUP);
+            JournalValue((uint32_t)count);
+
+            for(size_t j = 0; j < count; ++j) {
+                JournalValue(keys[j]);
+                JournalPos(positions + j * DIMENSION);
+            }
+        }
+
+        std::vector<ViewMemberType> members(count);
+
+        for(size_t j = 0; j < count; ++j) {
+            MarkReplicaElement(keys[j]);
+
+            auto iter = m_elements.find(keys[j]);
+
+            if(iter == m_elements.end() || iter->second.STATIC) {
+                return false;
+            }
+
+            members[j].KEY = keys[j];
+            members[j].DONE = IsSamePos(iter->second.POS, positions + j * DIMENSION);
+        }
+
+        for(size_t j = 1; j < count; ++j) {
+            if(std::find(keys, keys + j, keys[j]) != keys + j) {
+                return false;
+            }
+
+            timer.AddKey(keys[j]);
+        }
+
+        // 先移动所有成员，处理maker一侧
+        for(size_t j = 0; j < count; ++j) {
+            ViewMemberType &member = members[j];
+
+            if(member.DONE) {
+                continue;
+            }
+
+            auto iter = m_elements.find(member.KEY);
+
+            if(iter == m_elements.end()) {
+                member.DONE = true;
+                continue;
+            }
+
+            ElementType &element = iter->second;
+            member.OLD = element;
+            CopyPos(positions + j * DIMENSION, element.POS);
+
+            if(element.DORMANT) {
+                if(MoveDormant(member.KEY, element)) {
+                    member.DONE = true;
+                    continue;
+                }
+
+                WakeDormant(member.KEY, element, member.OLD.POS);
+            }
+
+            if(element.WATCH_TYPE & AOI_WATCH_TYPES::WATCHER) {
+                WakeDormantNear(element.POS);
+            }
+
+            if(element.WATCH_TYPE & AOI_WATCH_TYPES::MAKER) {
+                MoveMaker(member.KEY, element, member.OLD);
+            }
+        }
+
+        MoveViewGroupWatchers(members);
+
+        for(const ViewMemberType &member: members) {
+            auto iter = member.DONE ? m_elements.end() : m_elements.find(member.KEY);
+
+            if(iter != m_elements.end()) {
+                TouchKinetic(member.KEY, iter->second);
+                TryDormant(member.KEY, iter->second);
+            }
+        }
+
+        return true;
+    }
+
+    bool ChangeWatchType(const KEY_TYPE &key, int watch_type) {
+        OP_TIMER timer(this, AOI_JOURNAL_OPS::CHANGE_WATCH_TYPE, &key);
+
+        if(m_journal) {
+            JournalOp(AOI_JOURNAL_OPS::CHANGE_WATCH_TYPE, key);
+            JournalValue((int32_t)watch_type);
+        }
+
+        MarkReplicaElement(key);
+
+        auto iter = m_elements.find(key);
+
+        if(iter == m_elements.end() || iter->second.STATIC) {
+            return false;
+        }
+
+        ElementType &element = iter->second;
+
+        if(element.DORMANT) {
+            WakeDormant(key, element, element.POS);
+        }
+
+        int old_watch_type = element.WATCH_TYPE;
+        element.WATCH_TYPE = watch_type;
+
+        bool old_is_watcher = (old_watch_type & AOI_WATCH_TYPES::WATCHER) != 0;
+        bool old_is_maker = (old_watch_type & AOI_WATCH_TYPES::MAKER) != 0;
+        bool new_is_watcher = (watch_type & AOI_WATCH_TYPES::WATCHER) != 0;
+        bool new_is_maker = (watch_type & AOI_WATCH_TYPES::MAKER) != 0;
+
+        if(old_is_maker && !new_is_maker) {
+            RemoveMaker(key, element);
+        }
+
+        if(!old_is_maker && new_is_maker) {
+            InsertMaker(key, element);
+        }
+
+        if(old_is_watcher && !new_is_watcher) {
+            RemoveWatcher(key, element);
+        }
+
+        if(!old_is_watcher && new_is_watcher) {
+            WakeDormantNear(element.POS);
+            InsertWatcher(key, element);
+        }
+
+        TouchKinetic(key, element);
+        TryDormant(key, element);
+
+        return true;
+    }
+
+    bool ChangeWatchRange(const KEY_TYPE &key, const POS_TYPE watch_range[DIMENSION]) {
+        OP_TIMER timer(this, AOI_JOURNAL_OPS::CHANGE_WATCH_RANGE, &key);
+
+        if(m_journal) {
+            JournalOp(AOI_JOURNAL_OPS::CHANGE_WATCH_RANGE, key);
+            JournalPos(watch_range);
+        }
+
+        MarkReplicaElement(key);
+
+        auto iter = m_elements.find(key);
+
+        if(iter == m_elements.end() || iter->second.STATIC) {
+            return false;
+        }
+
+        ElementType &element = iter->second;
+
+        POS_TYPE watch_range_mutable[DIMENSION];
+        CopyPos(watch_range, watch_range_mutable);
+        TrimWatchRange(watch_range_mutable);
+
+        if(IsSamePos(element.WATCH_RANGE, watch_range_mutable)) {
+            return true;
+        }
+
+        ElementShapeType old_element = element;
+        CopyPos(watch_range_mutable, element.WATCH_RANGE);
+
+        int watch_type = element.WATCH_TYPE;
+        if(watch_type & AOI_WATCH_TYPES::WATCHER) {
+            // 新旧区间通常大部分重叠，只处理变化的边缘
+            MoveWatcher(key, element, old_element);
+        }
+
+        TouchKinetic(key, element);
+
+        return true;
+    }
+
+    bool ChangeMakerRadius(const KEY_TYPE &key, const POS_TYPE maker_radius[DIMENSION]) {
+        OP_TIMER timer(this, AOI_JOURNAL_OPS::CHANGE_MAKER_RADIUS, &key);
+
+        if(m_journal) {
+            JournalOp(AOI_JOURNAL_OPS::CHANGE_MAKER_RADIUS, key);
+            JournalPos(maker_radius);
+        }
+
+        MarkReplicaElement(key);
+
+        auto iter = m_elements.find(key);
+
+        if(iter == m_elements.end() || iter->second.STATIC) {
+            return false;
+        }
+
+        ElementType &element = iter->second;
+
+        POS_TYPE maker_radius_mutable[DIMENSION];
+        CopyPos(maker_radius, maker_radius_mutable);
+        TrimMakerRadius(maker_radius_mutable);
+
+        if(IsSamePos(element.MAKER_RADIUS, maker_radius_mutable)) {
+            return true;
+        }
+
+        if(element.DORMANT) {
+            WakeDormant(key, element, element.POS);
+        }
+
+        ElementShapeType old_element = element;
+        CopyPos(maker_radius_mutable, element.MAKER_RADIUS);
+
+        int watch_type = element.WATCH_TYPE;
+        if(watch_type & AOI_WATCH_TYPES::MAKER) {
+            MoveMaker(key, element, old_element);
+        }
+
+        TouchKinetic(key, element);
+        TryDormant(key, element);
+
+        return true;
+    }
+
+    // 设置匀速运动的速度，之后位置由 AdvanceTime 推进，速度为0时恢复成普通元素
+    // 轨迹已知的元素不需要每帧调用 MoveDiff，只在可能发生进出时重新计算关系
+    bool SetVelocity(const KEY_TYPE &key, const POS_TYPE velocity[DIMENSION]) {
+        OP_TIMER timer(this, AOI_JOURNAL_OPS::SET_VELOCITY, &key);
+
+        if(m_journal) {
+            JournalOp(AOI_JOURNAL_OPS::SET_VELOCITY, key);
+            JournalPos(velocity);
+        }
+
+        MarkReplicaElement(key);
+
+        auto iter = m_elements.find(key);
+
+        if(iter == m_elements.end() || iter->second.STATIC) {
+            return false;
+        }
+
+        ElementType &element = iter->second;
+
+        auto kiter = m_kinetics.find(key);
+
+        if(kiter == m_kinetics.end() && IsZeroPos(velocity)) {
+            return true;
+        }
+
+        // 运动的元素不休眠
+        if(element.DORMANT) {
+            WakeDormant(key, element, element.POS);
+        }
+
+        if(kiter != m_kinetics.end()) {
+            if(IsSamePos(kiter->second.VELOCITY, velocity)) {
+                return true;
+            }
+
+            RemoveKinetic(key, kiter->second);
+            m_kinetics.erase(kiter);
+        }
+
+        if(!IsZeroPos(velocity)) {
+            KineticType &kinetic = m_kinetics[key];
+            CopyPos(velocity, kinetic.VELOCITY);
+            InsertKinetic(key, element, kinetic);
+        }
+
+        // 附近元素的预测依赖本元素原来的轨迹
+        TouchKinetic(key, element);
+        TryDormant(key, element);
+
+        return true;
+    }
+
+    // 预测的最长时间，超过这个时间的运动元素一定会重新计算一次关系
+    // 为0时每次推进时间都会重新计算所有运动元素的关系
+    void SetKineticHorizon(const POS_TYPE &horizon) {
+        assert(!(horizon < POS_ZERO));
+
+        OP_TIMER timer(this, AOI_JOURNAL_OPS::SET_KINETIC_HORIZON, NULL);
+
+        if(m_journal) {
+            m_journal->push_back((char)AOI_JOURNAL_OPS::SET_KINETIC_HORIZON);
+            JournalValue(horizon);
+        }
+
+        m_kinetic_horizon = horizon;
+
+        // 已有的预测可能超过新的时长
+        for(auto iter = m_kinetics.begin(); iter != m_kinetics.end(); ++iter) {
+            ExpireKinetic(iter->first, iter->second);
+        }
+    }
+
+    const POS_TYPE &Now() {
+        return m_now;
+    }
+
+    const MoveChooserStatsType &GetMoveChooserStats() {
+        return m_chooser_stats;
+    }
+
+    // 只清空计数，测量得到的权重继续使用
+    void ResetMoveChooserStats() {
+        MoveChooserStatsType stats;
+        stats.WATCHER_UPDATE_WEIGHT = m_chooser_stats.WATCHER_UPDATE_WEIGHT;
+        stats.WATCHER_SHIFT_WEIGHT = m_chooser_stats.WATCHER_SHIFT_WEIGHT;
+        stats.MAKER_UPDATE_WEIGHT = m_chooser_stats.MAKER_UPDATE_WEIGHT;
+        stats.MAKER_SHIFT_WEIGHT = m_chooser_stats.MAKER_SHIFT_WEIGHT;
+        m_chooser_stats = stats;
+        m_stats_chooser_base = stats;
+    }
+
+    // 关闭后不再测量耗时，按已有的权重(或直接比较代价)选择，结果是确定的
+    void SetMoveChooserCalibration(bool enable) {
+        m_chooser_calibration = enable;
+    }
+
+    // 按 AOI_JOURNAL_OPS 取出上次调用之后每种公开操作的耗时直方图并清空，没有开启统计时返回false
+    bool TakeLatency(std::vector<AoiLatencyHistogram> &histograms) {
+        if(!ENABLE_STATS) {
+            return false;
+        }
+
+        histograms.clear();
+        histograms.resize(AOI_JOURNAL_OPS::COUNT);
+        histograms.swap(m_latency);
+        histograms.resize(AOI_JOURNAL_OPS::COUNT); // 还没有记录过任何操作时 m_latency 是空的
+
+        return true;
+    }
+
+    // 耗时不小于 threshold_ns 的操作记入慢操作缓冲区，最多保留最近的 capacity 个
+    void SetSlowOpThreshold(unsigned long threshold_ns, size_t capacity) {
+        m_slow_op_threshold_ns = threshold_ns;
+        m_slow_op_capacity = capacity;
+        m_slow_ops.clear();
+        m_slow_op_next = 0;
+    }
+
+    // 按发生的顺序取出缓冲区中的慢操作并清空，没有开启统计时返回false
+    bool TakeSlowOps(std::vector<SlowOpType> &ops) {
+        if(!ENABLE_STATS) {
+            return false;
+        }
+
+        ops.clear();
+
+        if(m_slow_ops.size() < m_slow_op_capacity) {
+            ops.swap(m_slow_ops);
+        } else {
+            ops.assign(m_slow_ops.begin() + m_slow_op_next, m_slow_ops.end());
+            ops.insert(ops.end(), m_slow_ops.begin(), m_slow_ops.begin() + m_slow_op_next);
+            m_slow_ops.clear();
+        }
+
+        m_slow_op_next = 0;
+        return true;
+    }
+
+    // 取出上次调用之后的统计并清空，没有开启统计时返回false
+    // 关系集合的大小需要遍历所有元素，适合每隔几秒调用一次
+    bool TakeStats(StatsType &stats) {
+        if(!ENABLE_STATS) {
+            return false;
+        }
+
+        stats = m_stats;
+        m_stats = StatsType();
+
+        stats.WATCHER_UPDATES = m_chooser_stats.WATCHER_UPDATES - m_stats_chooser_base.WATCHER_UPDATES;
+        stats.WATCHER_SHIFTS = m_chooser_stats.WATCHER_SHIFTS - m_stats_chooser_base.WATCHER_SHIFTS;
+        stats.MAKER_UPDATES = m_chooser_stats.MAKER_UPDATES - m_stats_chooser_base.MAKER_UPDATES;
+        stats.MAKER_SHIFTS = m_chooser_stats.MAKER_SHIFTS - m_stats_chooser_base.MAKER_SHIFTS;
+        stats.HINT_CACHE_HITS = m_chooser_stats.HINT_CACHE_HITS - m_stats_chooser_base.HINT_CACHE_HITS;
+        stats.HINT_CACHE_MISSES = m_chooser_stats.HINT_CACHE_MISSES - m_stats_chooser_base.HINT_CACHE_MISSES;
+        m_stats_chooser_base = m_chooser_stats;
+
+        stats.ELEMENTS = m_elements.size();
+
+        for(auto iter = m_elements.begin(); iter != m_elements.end(); ++iter) {
+            const ElementType &element = iter->second;
+            unsigned long makers = element.RELATED_MAKERS.size();
+
+            stats.RELATIONS += makers;
+            stats.MAX_RELATED_MAKERS = std::max(stats.MAX_RELATED_MAKERS, makers);
+            stats.MAX_RELATED_WATCHERS = std::max(stats.MAX_RELATED_WATCHERS, (unsigned long)element.RELATED_WATCHERS.size());
+
+            if(element.WATCH_TYPE & AOI_WATCH_TYPES::WATCHER) {
+                int bucket = 0;
+
+                while(makers && bucket < STATS_HISTOGRAM_SIZE - 1) {
+                    makers >>= 1;
+                    ++bucket;
+                }
+
+                ++stats.RELATED_MAKERS_HISTOGRAM[bucket];
+            }
+        }
+
+        return true;
+    }
+
+    // 推进时间到 now，运动元素按速度移动，只有预测时间已到的元素重新计算关系
+    // 运动元素不会每次都发送MOVE事件，客户端可以按速度自行插值
+    // 查询都依赖准确的索引，每次推进仍然要为每个运动元素更新 MAKER_LIST 和watcher边界，
+    // 每个元素 O(D log N)；KINETIC_LIST 和休眠maker的唤醒只在预测到期时处理
+    void AdvanceTime(const POS_TYPE &now) {
+        OP_TIMER timer(this, AOI_JOURNAL_OPS::ADVANCE_TIME, NULL);
+
+        if(m_journal) {
+            m_journal->push_back((char)AOI_JOURNAL_OPS::ADVANCE_TIME);
+            JournalValue(now);
+        }
+
+        if(m_replication && m_now < now) {
+            m_replica_times.emplace_back(now);
+        }
+
+        if(!(m_now < now)) {
+            return;
+        }
+
+        POS_TYPE dt = now - m_now;
+        m_now = now;
+
+        for(auto iter = m_kinetics.begin(); iter != m_kinetics.end(); ++iter) {
+            auto eiter = m_elements.find(iter->first);
+            assert(eiter != m_elements.end());
+
+            ElementType &element = eiter->second;
+            KineticType &kinetic = iter->second;
+
+            POS_TYPE old_pos[DIMENSION];
+            CopyPos(element.POS, old_pos);
+
+            for(int i = 0; i < DIMENSION; ++i) {
+                element.POS[i] += kinetic.VELOCITY[i] * dt;
+            }
+
+            // 预测期间关系不变，只更新索引里的位置
+            SyncKineticIndex(iter->first, element, kinetic, old_pos);
+        }
+
+        std::vector<KEY_TYPE> expired;
+
+        while(!m_kinetic_queue.empty() && !(now < m_kinetic_queue.begin()->first)) {
+            expired.emplace_back(m_kinetic_queue.begin()->second);
+            m_kinetic_queue.erase(m_kinetic_queue.begin());
+        }
+
+        for(const KEY_TYPE &key: expired) {
+            auto iter = m_elements.find(key);
+            auto kiter = m_kinetics.find(key);
+
+            if(iter == m_elements.end() || kiter == m_kinetics.end()) {
+                continue;
+            }
+
+            ElementType &element = iter->second;
+            ElementShapeType old_element = element;
+
+            int watch_type = element.WATCH_TYPE;
+
+            // 预测不超过进入休眠maker唤醒范围的时间，到期时先唤醒
+            if(watch_type & AOI_WATCH_TYPES::WATCHER) {
+                WakeDormantNear(element.POS);
+            }
+
+            if(watch_type & AOI_WATCH_TYPES::MAKER) {
+                UpdateMaker(key, element, old_element);
+            }
+
+            if(watch_type & AOI_WATCH_TYPES::WATCHER) {
+                UpdateWatcher(key, element, old_element);
+            }
+
+            ScheduleKinetic(key, element, kiter->second);
+        }
+    }
+
+    // 限制watcher最多能看到的maker数量，超出的按优先级裁剪，limit为0表示不限制
+    bool SetVisibleLimit(const KEY_TYPE &key, unsigned limit) {
+        OP_TIMER timer(this, AOI_JOURNAL_OPS::SET_VISIBLE_LIMIT, &key);
+
+        if(m_journal) {
+            JournalOp(AOI_JOURNAL_OPS::SET_VISIBLE_LIMIT, key);
+            JournalValue((uint32_t)limit);
+        }
+
+        MarkReplicaElement(key);
+
+        auto iter = m_elements.find(key);
+
+        if(iter == m_elements.end()) {
+            return false;
+        }
+
+        ElementType &element = iter->second;
+
+        if(element.VISIBLE_LIMIT == limit) {
+            return true;
+        }
+
+        SetElementVisibleLimit(element, limit);
+
+        if(!(element.WATCH_TYPE & AOI_WATCH_TYPES::WATCHER)) {
+            return true;
+        }
+
+        auto riter = m_visible_ranks.find(key);
+
+        if(limit == 0) {
+            if(riter == m_visible_ranks.end()) {
+                return true;
+            }
+
+            // 取消限制，被裁剪的maker全部变成可见
+            std::vector<KEY_TYPE> shown;
+            for(const RankItemType &item: riter->second.CULLED) {
+                shown.emplace_back(item.KEY);
+            }
+            m_visible_ranks.erase(riter);
+            MarkReplicaRank(key);
+
+            std::vector<KEY_TYPE> hidden;
+            EmitVisibleChanges(key, shown, hidden);
+            return true;
+        }
+
+        std::vector<KEY_TYPE> old_visible;
+
+        if(riter == m_visible_ranks.end()) {
+            old_visible.assign(element.RELATED_MAKERS.begin(), element.RELATED_MAKERS.end());
+            riter = m_visible_ranks.emplace(key, VisibleRankType()).first;
+        } else {
+            GetVisibleKeys(riter->second, old_visible);
+        }
+
+        riter->second.LIMIT = limit;
+        ResyncVisible(key, element, riter->second, old_visible);
+
+        return true;
+    }
+
+    bool GetElementPosition(const KEY_TYPE &key, POS_TYPE pos[DIMENSION]) {
+        auto iter = m_elements.find(key);
+
+        if(iter == m_elements.end()) {
+            return false;
+        }
+
+        ElementType &element = iter->second;
+
+        CopyPos(element.POS, pos);
+
+        return true;
+    }
+
+    bool BroadcastEventToWatchers(const KEY_TYPE &key, const AOI_EVENT_TYPE &event) {
+        auto iter = m_elements.find(key);
+
+        if(iter == m_elements.end()) {
+            return false;
+        }
+
+        ElementType &element = iter->second;
+
+        std::vector<KEY_TYPE> related_watchers;
+        GetVisibleWatchers(key, element, related_watchers);
+
+        for(const KEY_TYPE &watcher: related_watchers) {
+            Callback(watcher, key, event);
+        }
+
+        return true;
+    }
+
+    // get whom can see i
+    bool GetWatchersList(const KEY_TYPE &key, std::vector<KEY_TYPE> &watchers) {
+        auto iter = m_elements.find(key);
+
+        if(iter == m_elements.end()) {
+            return false;
+        }
+
+        ElementType &element = iter->second;
+
+        GetVisibleWatchers(key, element, watchers);
+
+        return true;
+    }
+
+    // get whom i can see
+    bool GetMakersList(const KEY_TYPE &key, std::vector<KEY_TYPE> &makers) {
+        auto iter = m_elements.find(key);
+
+        if(iter == m_elements.end()) {
+            return false;
+        }
+
+        ElementType &element = iter->second;
+
+        auto riter = m_visible_ranks.find(key);
+
+        if(riter != m_visible_ranks.end()) {
+            GetVisibleKeys(riter->second, makers);
+        } else {
+            makers.assign(element.RELATED_MAKERS.begin(), element.RELATED_MAKERS.end());
+        }
+
+        return true;
+    }
+
+    // 统计从 origin 开始、每格大小为 cell_size、各维度 size 个格子的网格中 maker、watcher 和关系的数量，用于划分分片和选择格子大小
+    // 联合分布不能由各维度独立的有序列表得到，这里顺序遍历一次元素，按位置直接算出格子的下标，不做任何查找
+    // heatmap 可以重复使用，避免每次分配；格子太多或大小不合法时返回false
+    bool GetHeatmap(const POS_TYPE origin[DIMENSION], const POS_TYPE cell_size[DIMENSION], const unsigned size[DIMENSION], HeatmapType &heatmap) {
+        size_t cells = 1;
+
+        for(int i = 0; i < DIMENSION; ++i) {
+            if(!(POS_ZERO < cell_size[i]) || !size[i] || size[i] > HEATMAP_MAX_CELLS / cells) {
+                return false;
+            }
+
+            cells *= size[i];
+        }
+
+        CopyPos(origin, heatmap.ORIGIN);
+        CopyPos(cell_size, heatmap.CELL_SIZE);
+        std::copy(size, size + DIMENSION, heatmap.SIZE);
+        heatmap.CELLS.assign(cells, HeatmapCellType());
+        heatmap.OUTSIDE = HeatmapCellType();
+
+        for(auto iter = m_elements.begin(); iter != m_elements.end(); ++iter) {
+            const ElementType &element = iter->second;
+            size_t cell = 0;
+
+            for(int i = DIMENSION - 1; i >= 0; --i) {
+                if(element.POS[i] < origin[i]) {
+                    cell = cells;
+                    break;
+                }
+
+                // 浮点数转换时可能超过 unsigned 的范围，先和格子数量比较
+                POS_TYPE index = (element.POS[i] - origin[i]) / cell_size[i];
+
+                if(!(index < (POS_TYPE)size[i])) {
+                    cell = cells;
+                    break;
+                }
+
+                cell = cell * size[i] + (size_t)index;
+            }
+
+            HeatmapCellType &target = cell < cells ? heatmap.CELLS[cell] : heatmap.OUTSIDE;
+
+            if(element.WATCH_TYPE & AOI_WATCH_TYPES::MAKER) {
+                ++target.MAKERS;
+            }
+
+            if(element.WATCH_TYPE & AOI_WATCH_TYPES::WATCHER) {
+                ++target.WATCHERS;
+                target.RELATIONS += element.RELATED_MAKERS.size();
+            }
+        }
+
+        return true;
+    }
+
+    // 遍历所有元素，cb(key, pos, watch_type)，遍历过程中不能修改group
+    template<typename CB>
+    void ForEachElement(CB &&cb) {
+        for(auto iter = m_elements.begin(); iter != m_elements.end(); ++iter) {
+            const ElementType &element = iter->second;
+            cb(iter->first, element.POS, element.WATCH_TYPE);
+        }
+    }
+
+    void CalcGetMakersInRangeHint(const POS_TYPE pos[DIMENSION], const POS_TYPE range[DIMENSION], GetMakersInRangeHint &hint) {
+        unsigned long counts[DIMENSION];
+
+        for(int i = 0; i < DIMENSION; ++i) {
+            POS_TYPE lower = pos[i] - range[i] - m_max_maker_radius[i] - DormantSlack(i);
+            POS_TYPE upper = pos[i] + range[i] + m_max_maker_radius[i] + DormantSlack(i);
+
+            counts[i] = CountMakers(i, lower, false, upper, false);
+        }
+
+        PlanGetMakersInRange(counts, hint);
+    }
+
+    // 默认使用候选最少的维度；候选第二少的维度也比较少时，按各维度独立估算交集的大小，
+    // 两个维度取交集更便宜就先取交集，适合走廊形状的地图，两个方向单独看都有很多候选
+    void PlanGetMakersInRange(const unsigned long counts[DIMENSION], GetMakersInRangeHint &hint) {
+        hint.TARGET_DIMENSION = 0;
+        hint.INTERSECT_DIMENSION = -1;
+
+        for(int i = 1; i < DIMENSION; ++i) {
+            if(counts[i] < counts[hint.TARGET_DIMENSION]) {
+                hint.TARGET_DIMENSION = i;
+            }
+        }
+
+        hint.COMPLEXITY = counts[hint.TARGET_DIMENSION];
+
+        int second = -1;
+
+        for(int i = 0; i < DIMENSION; ++i) {
+            if(i != hint.TARGET_DIMENSION && (second < 0 || counts[i] < counts[second])) {
+                second = i;
+            }
+        }
+
+        if(second < 0 || !m_maker_count) {
+            return;
+        }
+
+        unsigned long estimated = (unsigned long)((double)counts[hint.TARGET_DIMENSION] * counts[second] / m_maker_count);
+        unsigned long complexity = (counts[hint.TARGET_DIMENSION] + counts[second]) / INTERSECT_COST_DIVISOR + estimated;
+
+        if(complexity < hint.COMPLEXITY) {
+            hint.INTERSECT_DIMENSION = second;
+            hint.COMPLEXITY = complexity;
+        }
+    }
+
+    void GetMakersInRange(const POS_TYPE pos[DIMENSION], const POS_TYPE range[DIMENSION], std::vector<KEY_TYPE> &makers, const KEY_TYPE *excludes_sorted = NULL, size_t excludes_size = 0, const GetMakersInRangeHint *hint = NULL) {
+        static_assert(DIMENSION > 0, "DIMENSION should > 0");
+        assert(std::is_sorted(excludes_sorted, excludes_sorted + excludes_size));
+        makers.clear();
+
+        // 找到几个维度里面，落在区间内的maker数量最少的那个维度，减少后续筛选的数量
+        GetMakersInRangeHint h;
+        if(!hint) {
+            CalcGetMakersInRangeHint(pos, range, h);
+            hint = &h;
+        }
+
+        assert(hint->TARGET_DIMENSION >= 0);
+
+        // 遍历维度 target_dimension，进行筛选
+        {
+            int i = hint->TARGET_DIMENSION;
+            // 休眠的maker在索引中的位置可能有偏差，按实际位置筛选
+            POS_TYPE lower = pos[i] - range[i] - m_max_maker_radius[i] - DormantSlack(i);
+            POS_TYPE upper = pos[i] + range[i] + m_max_maker_radius[i] + DormantSlack(i);
+
+            bool batch = SCAN_BATCH_MIN <= hint->COMPLEXITY;
+            size_t scanned = 0;
+
+            auto gather = [excludes_sorted, excludes_size, batch, pos, range, &scanned, &makers, this](unsigned long _0, const KEY_TYPE &key, const POS_TYPE &_1) {
+                if(excludes_size && std::binary_search(excludes_sorted, excludes_sorted + excludes_size, key)) {
+                    return;
+                }
+
+                auto iter = this->m_elements.find(key);
+                if(iter == this->m_elements.end()) {
+                    return;
+                }
+
+                if(batch) {
+                    this->m_scan.Add(key, iter->second.POS, iter->second.MAKER_RADIUS);
+                } else {
+                    ++scanned;
+
+                    if(this->CanWatch(pos, range, iter->second.POS, iter->second.MAKER_RADIUS)) {
+                        makers.emplace_back(key);
+                    }
+                }
+            };
+
+            m_scan.Clear();
+
+            if(hint->INTERSECT_DIMENSION < 0) {
+                GetMakers(i, lower, false, upper, false, gather);
+            } else {
+                // 两个维度的候选按key排序后归并，只有同时出现在两边的才需要查找
+                int dims[2] = { i, hint->INTERSECT_DIMENSION };
+
+                for(int d = 0; d < 2; ++d) {
+                    int k = dims[d];
+                    std::vector<KEY_TYPE> &keys = m_intersect_keys[d];
+                    keys.clear();
+
+                    GetMakers(k, pos[k] - range[k] - m_max_maker_radius[k] - DormantSlack(k), false,
+                            pos[k] + range[k] + m_max_maker_radius[k] + DormantSlack(k), false,
+                            [&keys](unsigned long _0, const KEY_TYPE &key, const POS_TYPE &_1) {
+                                keys.emplace_back(key);
+                            });
+
+                    std::sort(keys.begin(), keys.end());
+                }
+
+                auto a = m_intersect_keys[0].begin();
+                auto b = m_intersect_keys[1].begin();
+
+                while(a != m_intersect_keys[0].end() && b != m_intersect_keys[1].end()) {
+                    if(*a < *b) {
+                        ++a;
+                    } else if(*b < *a) {
+                        ++b;
+                    } else {
+                        gather(0, *a, POS_ZERO);
+                        ++a;
+                        ++b;
+                    }
+                }
+            }
+
+            // 检查是否在范围内，maker的可见半径算在区间内
+            if(batch) {
+                m_scan.ResetMask();
+                scanned = m_scan.KEYS.size();
+
+                for(int k = 0; k < DIMENSION; ++k) {
+                    AoiBatchFilter<POS_TYPE>::FilterPoint(pos[k] - range[k], pos[k] + range[k],
+                            m_scan.POS[k].data(), m_scan.EXTENT[k].data(), scanned, m_scan.MASK.data());
+                }
+
+                for(size_t j = 0; j < scanned; ++j) {
+                    if(m_scan.MASK[j]) {
+                        makers.emplace_back(m_scan.KEYS[j]);
+                    }
+                }
+            }
+
+            if(ENABLE_STATS) {
+                ++m_stats.QUERIES;
+                m_stats.QUERY_SCANNED += scanned;
+                m_stats.QUERY_ACCEPTED += makers.size();
+            }
+        }
+    }
+
+    void CalcGetWatchersRelatedToPosHint(const POS_TYPE pos[DIMENSION], GetWatchersRelatedToPosHint &hint) {
+        POS_TYPE radius[DIMENSION] = { POS_ZERO };
+
+        CalcGetWatchersRelatedToPosHint(pos, radius, hint);
+    }
+
+    // radius 是 maker 的可见半径，watcher 的区间和 [pos - radius, pos + radius] 相交即可见
+    void CalcGetWatchersRelatedToPosHint(const POS_TYPE pos[DIMENSION], const POS_TYPE radius[DIMENSION], GetWatchersRelatedToPosHint &hint) {
+        hint.TARGET_DIMENSION = -1;
+        hint.COMPLEXITY = 0;
+        hint.USE_LOWER = true;
+
+        for(int i = 0; i < DIMENSION; ++i) {
+            unsigned long count = CountWatchersNear(i, true, pos[i] - radius[i], pos[i] + radius[i]);
+
+            if(hint.TARGET_DIMENSION < 0 || count < hint.COMPLEXITY) {
+                hint.TARGET_DIMENSION = i;
+                hint.COMPLEXITY = count;
+                hint.USE_LOWER = true;
+            }
+
+            count = CountWatchersNear(i, false, pos[i] - radius[i], pos[i] + radius[i]);
+
+            if(count < hint.COMPLEXITY) {
                 hint.TARGET_DIMENSION = i;
                 hint.COMPLEXITY = count;
+                hint.USE_LOWER = false;
+            }
+        }
+    }
+
+    void GetWatchersRelatedToPos(const POS_TYPE pos[DIMENSION], std::vector<KEY_TYPE> &watchers, const KEY_TYPE *excludes_sorted = NULL, size_t excludes_size = 0, const GetWatchersRelatedToPosHint *hint = NULL) {
+        POS_TYPE radius[DIMENSION] = { POS_ZERO };
+
+        GetWatchersRelatedToPos(pos, radius, watchers, excludes_sorted, excludes_size, hint);
+    }
+
+    void GetWatchersRelatedToPos(const POS_TYPE pos[DIMENSION], const POS_TYPE radius[DIMENSION], std::vector<KEY_TYPE> &watchers, const KEY_TYPE *excludes_sorted = NULL, size_t excludes_size = 0, const GetWatchersRelatedToPosHint *hint = NULL) {
+        static_assert(DIMENSION > 0, "DIMENSION should > 0");
+        assert(std::is_sorted(excludes_sorted, excludes_sorted + excludes_size));
+        watchers.clear();
+
+        // 找到几个维度里，落在搜索区间数量最少的维度
+        GetWatchersRelatedToPosHint h;
+        if(!hint) {
+            CalcGetWatchersRelatedToPosHint(pos, radius, h);
+            hint = &h;
+        }
+
+        assert(hint->TARGET_DIMENSION >= 0);
+
+        {
+            int i = hint->TARGET_DIMENSION;
+
+            bool batch = SCAN_BATCH_MIN <= hint->COMPLEXITY;
+            size_t scanned = 0;
+
+            auto cb = [excludes_sorted, excludes_size, batch, pos, radius, &scanned, &watchers, this](unsigned long _0, const KEY_TYPE &key, const POS_TYPE &_1) {
+                if(excludes_size && std::binary_search(excludes_sorted, excludes_sorted + excludes_size, key)) {
+                    return;
+                }
+
+                auto iter = this->m_elements.find(key);
+                if(iter == this->m_elements.end()) {
+                    return;
+                }
+
+                if(batch) {
+                    this->m_scan.Add(key, iter->second.POS, iter->second.WATCH_RANGE);
+                } else {
+                    ++scanned;
+
+                    if(this->CanWatch(iter->second.POS, iter->second.WATCH_RANGE, pos, radius)) {
+                        watchers.emplace_back(key);
+                    }
+                }
+            };
+
+            m_scan.Clear();
+            GetWatchersNear(i, hint->USE_LOWER, pos[i] - radius[i], pos[i] + radius[i], cb);
+
+            if(m_triggers.size()) {
+                POS_TYPE lower[DIMENSION];
+                POS_TYPE upper[DIMENSION];
+
+                for(int k = 0; k < DIMENSION; ++k) {
+                    lower[k] = pos[k] - radius[k];
+                    upper[k] = pos[k] + radius[k];
+                }
+
+                auto trigger_cb = [&cb](const KEY_TYPE &key) {
+                    cb(0, key, POS_ZERO);
+                };
+
+                GetTriggersNear(lower, upper, trigger_cb);
+            }
+
+            // 检查key能否观察到pos
+            if(batch) {
+                m_scan.ResetMask();
+                scanned = m_scan.KEYS.size();
+
+                for(int k = 0; k < DIMENSION; ++k) {
+                    AoiBatchFilter<POS_TYPE>::FilterBox(pos[k], radius[k],
+                            m_scan.POS[k].data(), m_scan.EXTENT[k].data(), scanned, m_scan.MASK.data());
+                }
+
+                for(size_t j = 0; j < scanned; ++j) {
+                    if(m_scan.MASK[j]) {
+                        watchers.emplace_back(m_scan.KEYS[j]);
+                    }
+                }
+            }
+
+            if(ENABLE_STATS) {
+                ++m_stats.QUERIES;
+                m_stats.QUERY_SCANNED += scanned;
+                m_stats.QUERY_ACCEPTED += watchers.size();
+            }
+        }
+
+    }
+
+    void BroadcastEventToWatchersByPos(POS_TYPE pos[DIMENSION], const KEY_TYPE &sender, const AOI_EVENT_TYPE &event) {
+        std::vector<KEY_TYPE> watchers;
+        GetWatchersRelatedToPos(pos, watchers);
+
+        for(const KEY_TYPE &watcher: watchers) {
+            Callback(watcher, sender, event);
+        }
+    }
+
+    // 把所有元素、关系和可见排名保存成二进制快照，用于进程崩溃后恢复或者迁移场景
+    // 只保存状态，回调、选择器的统计和缓存不保存
+    bool SaveSnapshot(std::string &data) {
+        static_assert(std::is_trivially_copyable<KEY_TYPE>::value && std::is_trivially_copyable<POS_TYPE>::value,
+                "snapshot needs trivially copyable KEY_TYPE and POS_TYPE");
+
+        data.clear();
+
+        if(m_elements.size() >= (size_t)UINT32_MAX) {
+            return false;
+        }
+
+        std::unordered_map<KEY_TYPE, uint32_t> indexes;
+        indexes.reserve(m_elements.size());
+
+        for(auto iter = m_elements.begin(); iter != m_elements.end(); ++iter) {
+            uint32_t index = (uint32_t)indexes.size();
+            indexes.emplace(iter->first, index);
+        }
+
+        uint64_t rank_count = 0;
+        for(auto iter = m_visible_ranks.begin(); iter != m_visible_ranks.end(); ++iter) {
+            rank_count += iter->second.SLOTS.size();
+        }
+
+        SnapshotHeaderType header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.MAGIC, "AOIS", 4);
+        header.VERSION = SNAPSHOT_VERSION;
+        header.DIMENSION = DIMENSION;
+        header.KEY_SIZE = sizeof(KEY_TYPE);
+        header.POS_SIZE = sizeof(POS_TYPE);
+        header.ELEMENT_COUNT = m_elements.size();
+        header.EDGE_COUNT = m_edges.Size();
+        header.RANK_COUNT = rank_count;
+        header.KINETIC_COUNT = m_kinetics.size();
+
+        data.reserve(sizeof(header) + SnapshotSectionSize(sizeof(SnapshotConfigType), 1) +
+                SnapshotSectionSize(sizeof(SnapshotElementType), header.ELEMENT_COUNT) +
+                SnapshotSectionSize(sizeof(SnapshotEdgeType), header.EDGE_COUNT) +
+                SnapshotSectionSize(sizeof(SnapshotRankType), header.RANK_COUNT) +
+                SnapshotSectionSize(sizeof(SnapshotKineticType), header.KINETIC_COUNT));
+
+        AppendSnapshotRecord(data, header);
+        AlignSnapshot(data);
+
+        SnapshotConfigType config;
+        memset(&config, 0, sizeof(config));
+        CopyPos(m_max_watch_range, config.MAX_WATCH_RANGE);
+        CopyPos(m_max_maker_radius, config.MAX_MAKER_RADIUS);
+        CopyPos(m_hysteresis, config.HYSTERESIS);
+        config.NOW = m_now;
+        config.KINETIC_HORIZON = m_kinetic_horizon;
+        AppendSnapshotRecord(data, config);
+        AlignSnapshot(data);
+
+        for(auto iter = m_elements.begin(); iter != m_elements.end(); ++iter) {
+            const ElementType &element = iter->second;
+
+            SnapshotElementType record;
+            memset(&record, 0, sizeof(record));
+            record.KEY = iter->first;
+            CopyPos(element.POS, record.POS);
+            CopyPos(element.WATCH_RANGE, record.WATCH_RANGE);
+            CopyPos(element.MAKER_RADIUS, record.MAKER_RADIUS);
+            CopyPos(element.DORMANT ? element.ANCHOR : element.POS, record.ANCHOR);
+            record.WATCH_TYPE = element.WATCH_TYPE;
+            record.VISIBLE_LIMIT = element.VISIBLE_LIMIT;
+            record.FLAGS = (element.STATIC ? SNAPSHOT_STATIC : 0) | (element.DORMANT ? SNAPSHOT_DORMANT : 0) |
+                (m_visible_ranks.count(iter->first) ? SNAPSHOT_RANKED : 0);
+            AppendSnapshotRecord(data, record);
+        }
+        AlignSnapshot(data);
+
+        // 每条边只在watcher一侧保存一次
+        for(auto iter = m_elements.begin(); iter != m_elements.end(); ++iter) {
+            for(const KEY_TYPE &maker: iter->second.RELATED_MAKERS) {
+                SnapshotEdgeType record;
+                record.WATCHER = indexes[iter->first];
+                record.MAKER = indexes[maker];
+                AppendSnapshotRecord(data, record);
+            }
+        }
+        AlignSnapshot(data);
+
+        for(auto iter = m_visible_ranks.begin(); iter != m_visible_ranks.end(); ++iter) {
+            const VisibleRankType &rank = iter->second;
+
+            for(int visible = 1; visible >= 0; --visible) {
+                for(const RankItemType &item: visible ? rank.VISIBLE : rank.CULLED) {
+                    SnapshotRankType record;
+                    memset(&record, 0, sizeof(record));
+                    record.PRIORITY = item.PRIORITY;
+                    record.WATCHER = indexes[iter->first];
+                    record.MAKER = indexes[item.KEY];
+                    record.VISIBLE = visible;
+                    AppendSnapshotRecord(data, record);
+                }
+            }
+        }
+        AlignSnapshot(data);
+
+        for(auto iter = m_kinetics.begin(); iter != m_kinetics.end(); ++iter) {
+            SnapshotKineticType record;
+            memset(&record, 0, sizeof(record));
+            CopyPos(iter->second.VELOCITY, record.VELOCITY);
+            record.EXPIRY = iter->second.EXPIRY;
+            record.ELEMENT = indexes[iter->first];
+            AppendSnapshotRecord(data, record);
+        }
+        AlignSnapshot(data);
+
+        return true;
+    }
+
+    // 从快照恢复，只能在空的group上调用，配置必须和保存时相同
+    // 直接按保存的关系建立索引，不做范围查询，也不产生任何事件；数据不完整或者不一致时返回false，group保持为空
+    bool LoadSnapshot(const char *data, size_t size) {
+        static_assert(std::is_trivially_copyable<KEY_TYPE>::value && std::is_trivially_copyable<POS_TYPE>::value,
+                "snapshot needs trivially copyable KEY_TYPE and POS_TYPE");
+
+        // 记录journal时恢复快照，回放时无法重现
+        if(m_elements.size() || m_journal || size < sizeof(SnapshotHeaderType)) {
+            return false;
+        }
+
+        SnapshotHeaderType header = ReadSnapshotRecord<SnapshotHeaderType>(data, 0);
+
+        if(memcmp(header.MAGIC, "AOIS", 4) != 0 || header.VERSION != SNAPSHOT_VERSION || header.DIMENSION != DIMENSION ||
+                header.KEY_SIZE != sizeof(KEY_TYPE) || header.POS_SIZE != sizeof(POS_TYPE)) {
+            return false;
+        }
+
+        // 元素下标是32位的，数量超过时一定是损坏的数据，同时避免下面计算大小时溢出
+        if(header.ELEMENT_COUNT >= UINT32_MAX || header.EDGE_COUNT > size || header.RANK_COUNT > size || header.KINETIC_COUNT > size) {
+            return false;
+        }
+
+        size_t offset = SnapshotSectionSize(sizeof(SnapshotHeaderType), 1);
+        size_t sections[5];
+        size_t section_sizes[5] = {
+            SnapshotSectionSize(sizeof(SnapshotConfigType), 1),
+            SnapshotSectionSize(sizeof(SnapshotElementType), header.ELEMENT_COUNT),
+            SnapshotSectionSize(sizeof(SnapshotEdgeType), header.EDGE_COUNT),
+            SnapshotSectionSize(sizeof(SnapshotRankType), header.RANK_COUNT),
+            SnapshotSectionSize(sizeof(SnapshotKineticType), header.KINETIC_COUNT),
+        };
+
+        for(int s = 0; s < 5; ++s) {
+            sections[s] = offset;
+            offset += section_sizes[s];
+        }
+
+        if(offset != size) {
+            return false;
+        }
+
+        SnapshotConfigType config = ReadSnapshotRecord<SnapshotConfigType>(data + sections[0], 0);
+
+        if(!IsSamePos(config.MAX_WATCH_RANGE, m_max_watch_range) || !IsSamePos(config.MAX_MAKER_RADIUS, m_max_maker_radius) ||
+                !IsSamePos(config.HYSTERESIS, m_hysteresis)) {
+            return false;
+        }
+
+        // 先检查所有记录，修改group之前发现错误
+        size_t element_count = (size_t)header.ELEMENT_COUNT;
+        std::vector<SnapshotElementType> elements(element_count);
+        std::unordered_set<KEY_TYPE> keys;
+        keys.reserve(element_count);
+
+        for(size_t j = 0; j < element_count; ++j) {
+            SnapshotElementType &record = elements[j];
+            record = ReadSnapshotRecord<SnapshotElementType>(data + sections[1], j);
+
+            int watch_type = record.WATCH_TYPE;
+
+            if(watch_type < AOI_WATCH_TYPES::WATCHER || watch_type > AOI_WATCH_TYPES::BOTH || !keys.insert(record.KEY).second) {
+                return false;
+            }
+
+            bool is_static = (record.FLAGS & SNAPSHOT_STATIC) != 0;
+
+            if(is_static && watch_type == AOI_WATCH_TYPES::BOTH) {
+                return false;
+            }
+
+            if((record.FLAGS & SNAPSHOT_DORMANT) && (is_static || watch_type != AOI_WATCH_TYPES::MAKER)) {
+                return false;
+            }
+
+            // 有可见数量限制的watcher一定有排名
+            if(((record.FLAGS & SNAPSHOT_RANKED) != 0) != ((watch_type & AOI_WATCH_TYPES::WATCHER) && record.VISIBLE_LIMIT)) {
+                return false;
+            }
+        }
+
+        std::vector<std::pair<uint32_t, uint32_t>> edges((size_t)header.EDGE_COUNT);
+        std::vector<size_t> edge_counts(element_count, 0);
+
+        for(size_t j = 0; j < edges.size(); ++j) {
+            SnapshotEdgeType record = ReadSnapshotRecord<SnapshotEdgeType>(data + sections[2], j);
+
+            if(record.WATCHER >= element_count || record.MAKER >= element_count || record.WATCHER == record.MAKER ||
+                    !(elements[record.WATCHER].WATCH_TYPE & AOI_WATCH_TYPES::WATCHER) ||
+                    !(elements[record.MAKER].WATCH_TYPE & AOI_WATCH_TYPES::MAKER)) {
+                return false;
+            }
+
+            edges[j] = std::make_pair(record.WATCHER, record.MAKER);
+            ++edge_counts[record.WATCHER];
+        }
+
+        std::vector<std::pair<uint32_t, uint32_t>> sorted_edges(edges);
+        std::sort(sorted_edges.begin(), sorted_edges.end());
+
+        if(std::adjacent_find(sorted_edges.begin(), sorted_edges.end()) != sorted_edges.end()) {
+            return false;
+        }
+
+        // 排名中的每个候选都必须是已有的关系，每个关系只出现一次
+        std::vector<std::pair<uint32_t, uint32_t>> ranked((size_t)header.RANK_COUNT);
+        std::vector<size_t> visible_counts(element_count, 0);
+        std::vector<size_t> culled_counts(element_count, 0);
+        std::vector<RankItemType> worst_visible(element_count);
+        std::vector<RankItemType> best_culled(element_count);
+
+        for(size_t j = 0; j < ranked.size(); ++j) {
+            SnapshotRankType record = ReadSnapshotRecord<SnapshotRankType>(data + sections[3], j);
+
+            if(record.WATCHER >= element_count || record.MAKER >= element_count || !(elements[record.WATCHER].FLAGS & SNAPSHOT_RANKED) ||
+                    !std::binary_search(sorted_edges.begin(), sorted_edges.end(), std::make_pair(record.WATCHER, record.MAKER))) {
+                return false;
+            }
+
+            ranked[j] = std::make_pair(record.WATCHER, record.MAKER);
+            RankItemType item{record.PRIORITY, elements[record.MAKER].KEY};
+
+            if(record.VISIBLE) {
+                if(!visible_counts[record.WATCHER]++ || worst_visible[record.WATCHER] < item) {
+                    worst_visible[record.WATCHER] = item;
+                }
+            } else {
+                if(!culled_counts[record.WATCHER]++ || item < best_culled[record.WATCHER]) {
+                    best_culled[record.WATCHER] = item;
+                }
+            }
+        }
+
+        std::sort(ranked.begin(), ranked.end());
+
+        if(std::adjacent_find(ranked.begin(), ranked.end()) != ranked.end()) {
+            return false;
+        }
+
+        // 没有重复时，排名的记录数等于关系数就说明每个关系都在排名中；
+        // 可见的是优先级最高的 min(limit, 关系数) 个
+        for(size_t j = 0; j < element_count; ++j) {
+            if(!(elements[j].FLAGS & SNAPSHOT_RANKED)) {
+                continue;
+            }
+
+            if(visible_counts[j] + culled_counts[j] != edge_counts[j] ||
+                    visible_counts[j] != std::min((size_t)elements[j].VISIBLE_LIMIT, edge_counts[j])) {
+                return false;
+            }
+
+            if(visible_counts[j] && culled_counts[j] && best_culled[j] < worst_visible[j]) {
+                return false;
+            }
+        }
+
+        std::vector<bool> kinetic_loaded(element_count, false);
+
+        for(size_t j = 0; j < (size_t)header.KINETIC_COUNT; ++j) {
+            SnapshotKineticType record = ReadSnapshotRecord<SnapshotKineticType>(data + sections[4], j);
+
+            if(record.ELEMENT >= element_count || (elements[record.ELEMENT].FLAGS & (SNAPSHOT_STATIC | SNAPSHOT_DORMANT)) ||
+                    kinetic_loaded[record.ELEMENT]) {
+                return false;
+            }
+
+            kinetic_loaded[record.ELEMENT] = true;
+        }
+
+        // 建立索引
+        m_now = config.NOW;
+        m_kinetic_horizon = config.KINETIC_HORIZON;
+
+        std::vector<ElementType *> pointers(element_count);
+        m_elements.reserve(element_count);
+
+        for(size_t j = 0; j < element_count; ++j) {
+            const SnapshotElementType &record = elements[j];
+
+            ElementType &element = m_elements.emplace(std::piecewise_construct, std::forward_as_tuple(record.KEY),
+                    std::forward_as_tuple(&m_edges)).first->second;
+            pointers[j] = &element;
+
+            element.WATCH_TYPE = record.WATCH_TYPE;
+            element.VISIBLE_LIMIT = record.VISIBLE_LIMIT;
+            element.STATIC = (record.FLAGS & SNAPSHOT_STATIC) != 0;
+            element.DORMANT = (record.FLAGS & SNAPSHOT_DORMANT) != 0;
+            CopyPos(record.POS, element.POS);
+            CopyPos(record.WATCH_RANGE, element.WATCH_RANGE);
+            CopyPos(record.MAKER_RADIUS, element.MAKER_RADIUS);
+            CopyPos(record.ANCHOR, element.ANCHOR);
+
+            if(element.WATCH_TYPE & AOI_WATCH_TYPES::MAKER) {
+                InsertMakerIndex(record.KEY, element);
+            }
+
+            if(element.WATCH_TYPE & AOI_WATCH_TYPES::WATCHER) {
+                InsertWatcherIndex(record.KEY, element);
+            }
+
+            if(record.FLAGS & SNAPSHOT_RANKED) {
+                m_visible_ranks[record.KEY].LIMIT = record.VISIBLE_LIMIT;
+            }
+        }
+
+        for(const std::pair<uint32_t, uint32_t> &edge: edges) {
+            LinkRelation(elements[edge.first].KEY, *pointers[edge.first], elements[edge.second].KEY, *pointers[edge.second]);
+        }
+
+        for(size_t j = 0; j < (size_t)header.RANK_COUNT; ++j) {
+            SnapshotRankType record = ReadSnapshotRecord<SnapshotRankType>(data + sections[3], j);
+            VisibleRankType &rank = m_visible_ranks[elements[record.WATCHER].KEY];
+            const KEY_TYPE &maker = elements[record.MAKER].KEY;
+
+            (record.VISIBLE ? rank.VISIBLE : rank.CULLED).push_back(RankItemType{record.PRIORITY, maker});
+        }
+
+        for(auto iter = m_visible_ranks.begin(); iter != m_visible_ranks.end(); ++iter) {
+            RebuildRank(iter->second);
+        }
+
+        for(size_t j = 0; j < (size_t)header.KINETIC_COUNT; ++j) {
+            SnapshotKineticType record = ReadSnapshotRecord<SnapshotKineticType>(data + sections[4], j);
+            const KEY_TYPE &key = elements[record.ELEMENT].KEY;
+
+            KineticType &kinetic = m_kinetics[key];
+            CopyPos(record.VELOCITY, kinetic.VELOCITY);
+            InsertKinetic(key, *pointers[record.ELEMENT], kinetic);
+
+            m_kinetic_queue.erase(std::make_pair(kinetic.EXPIRY, key));
+            kinetic.EXPIRY = record.EXPIRY;
+            m_kinetic_queue.emplace(kinetic.EXPIRY, key);
+        }
+
+        return true;
+    }
+
+    // 开始把之后的修改记录到journal中，先写入头部、配置和当前状态的快照，journal原有的内容被清空
+    // 之后只在末尾追加，调用者可以随时把已有内容写到文件后清空，继续记录；journal为NULL时停止记录
+    // 优先级回调不记录，使用自定义优先级时回放前要设置同样的回调
+    bool SetJournal(std::string *journal) {
+        m_journal = NULL;
+
+        if(!journal) {
+            return true;
+        }
+
+        std::string snapshot;
+        if(!SaveSnapshot(snapshot)) {
+            return false;
+        }
+
+        AoiJournalHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.MAGIC, "AOIJ", 4);
+        header.VERSION = AoiJournalHeader::VERSION_CURRENT;
+        header.DIMENSION = DIMENSION;
+        header.KEY_SIZE = sizeof(KEY_TYPE);
+        header.POS_SIZE = sizeof(POS_TYPE);
+        header.FLAGS = (std::is_floating_point<POS_TYPE>::value ? AoiJournalHeader::POS_FLOAT : 0) |
+            (NOTIFY_MOVE_EVENT ? AoiJournalHeader::NOTIFY_MOVE : 0);
+        header.SNAPSHOT_SIZE = snapshot.size();
+
+        journal->clear();
+        journal->append((const char *)&header, sizeof(header));
+        m_journal = journal;
+        JournalPos(m_max_watch_range);
+        JournalPos(m_max_maker_radius);
+        JournalPos(m_hysteresis);
+        journal->append(snapshot);
+
+        return true;
+    }
+
+    // 读出journal中的配置，用来创建回放的group，类型和维度不同时返回false
+    static bool ReadJournalConfig(const char *data, size_t size, POS_TYPE max_watch_range[DIMENSION], POS_TYPE max_maker_radius[DIMENSION],
+            POS_TYPE hysteresis[DIMENSION]) {
+        AoiJournalHeader header;
+
+        if(!AoiJournalHeader::Read(data, size, header) || header.DIMENSION != DIMENSION ||
+                header.KEY_SIZE != sizeof(KEY_TYPE) || header.POS_SIZE != sizeof(POS_TYPE) ||
+                ((header.FLAGS & AoiJournalHeader::POS_FLOAT) != 0) != std::is_floating_point<POS_TYPE>::value) {
+            return false;
+        }
+
+        size_t offset = sizeof(AoiJournalHeader);
+
+        return ReadJournalPos(data, size, offset, max_watch_range) && ReadJournalPos(data, size, offset, max_maker_radius) &&
+            ReadJournalPos(data, size, offset, hysteresis);
+    }
+
+    // 恢复journal开始记录时的状态，offset返回第一条操作记录的位置，之后用 ReplayJournal 逐条回放
+    bool LoadJournal(const char *data, size_t size, size_t &offset) {
+        POS_TYPE max_watch_range[DIMENSION];
+        POS_TYPE max_maker_radius[DIMENSION];
+        POS_TYPE hysteresis[DIMENSION];
+
+        if(!ReadJournalConfig(data, size, max_watch_range, max_maker_radius, hysteresis)) {
+            return false;
+        }
+
+        AoiJournalHeader header;
+        AoiJournalHeader::Read(data, size, header);
+
+        size_t start = sizeof(AoiJournalHeader) + sizeof(POS_TYPE) * DIMENSION * 3;
+
+        if(header.SNAPSHOT_SIZE > size - start || !LoadSnapshot(data + start, (size_t)header.SNAPSHOT_SIZE)) {
+            return false;
+        }
+
+        offset = start + (size_t)header.SNAPSHOT_SIZE;
+        return true;
+    }
+
+    // 回放offset处的一条记录，成功后offset移到下一条，op返回记录的操作类型
+    // 返回值只表示记录是否完整，操作本身的结果和记录时相同
+    bool ReplayJournal(const char *data, size_t size, size_t &offset, int &op) {
+        size_t next = offset;
+        uint8_t op_byte;
+
+        if(!ReadJournalValue(data, size, next, op_byte)) {
+            return false;
+        }
+
+        op = op_byte;
+
+        if(op == AOI_JOURNAL_OPS::ADVANCE_TIME || op == AOI_JOURNAL_OPS::SET_KINETIC_HORIZON) {
+            POS_TYPE value;
+
+            if(!ReadJournalValue(data, size, next, value)) {
+                return false;
+            }
+
+            if(op == AOI_JOURNAL_OPS::ADVANCE_TIME) {
+                AdvanceTime(value);
+            } else {
+                SetKineticHorizon(value);
+            }
+
+            offset = next;
+            return true;
+        }
+
+        if(op == AOI_JOURNAL_OPS::MOVE_VIEW_GROUP) {
+            uint32_t count;
+
+            if(!ReadJournalValue(data, size, next, count) || (size - next) / (sizeof(KEY_TYPE) + sizeof(POS_TYPE) * DIMENSION) < count) {
+                return false;
+            }
+
+            m_view_journal_keys.resize(count);
+            m_view_journal_positions.resize((size_t)count * DIMENSION);
+
+            for(uint32_t j = 0; j < count; ++j) {
+                ReadJournalValue(data, size, next, m_view_journal_keys[j]);
+                ReadJournalPos(data, size, next, m_view_journal_positions.data() + (size_t)j * DIMENSION);
+            }
+
+            MoveViewGroup(m_view_journal_keys.data(), m_view_journal_positions.data(), count);
+
+            offset = next;
+            return true;
+        }
+
+        KEY_TYPE key;
+        POS_TYPE first[DIMENSION];
+        POS_TYPE second[DIMENSION];
+        POS_TYPE third[DIMENSION];
+        int32_t value;
+        uint32_t limit;
+
+        if(!ReadJournalValue(data, size, next, key)) {
+            return false;
+        }
+
+        switch(op) {
+            case AOI_JOURNAL_OPS::ENTER:
+                if(!ReadJournalValue(data, size, next, value) || !ReadJournalPos(data, size, next, first) ||
+                        !ReadJournalPos(data, size, next, second) || !ReadJournalPos(data, size, next, third)) {
+                    return false;
+                }
+
+                Enter(key, first, value, second, third);
+                break;
+            case AOI_JOURNAL_OPS::ENTER_STATIC:
+            case AOI_JOURNAL_OPS::ENTER_TRIGGER:
+                if(!ReadJournalPos(data, size, next, first) || !ReadJournalPos(data, size, next, second)) {
+                    return false;
+                }
+
+                if(op == AOI_JOURNAL_OPS::ENTER_STATIC) {
+                    EnterStatic(key, first, second);
+                } else {
+                    EnterTrigger(key, first, second);
+                }
+                break;
+            case AOI_JOURNAL_OPS::LEAVE:
+                Leave(key);
+                break;
+            case AOI_JOURNAL_OPS::CHANGE_WATCH_TYPE:
+                if(!ReadJournalValue(data, size, next, value)) {
+                    return false;
+                }
+
+                ChangeWatchType(key, value);
+                break;
+            case AOI_JOURNAL_OPS::SET_VISIBLE_LIMIT:
+                if(!ReadJournalValue(data, size, next, limit)) {
+                    return false;
+                }
+
+                SetVisibleLimit(key, limit);
+                break;
+            case AOI_JOURNAL_OPS::MOVE:
+            case AOI_JOURNAL_OPS::MOVE_DIFF:
+            case AOI_JOURNAL_OPS::CHANGE_WATCH_RANGE:
+            case AOI_JOURNAL_OPS::CHANGE_MAKER_RADIUS:
+            case AOI_JOURNAL_OPS::SET_VELOCITY:
+                if(!ReadJournalPos(data, size, next, first)) {
+                    return false;
+                }
+
+                if(op == AOI_JOURNAL_OPS::MOVE) {
+                    Move(key, first);
+                } else if(op == AOI_JOURNAL_OPS::MOVE_DIFF) {
+                    MoveDiff(key, first);
+                } else if(op == AOI_JOURNAL_OPS::CHANGE_WATCH_RANGE) {
+                    ChangeWatchRange(key, first);
+                } else if(op == AOI_JOURNAL_OPS::CHANGE_MAKER_RADIUS) {
+                    ChangeMakerRadius(key, first);
+                } else {
+                    SetVelocity(key, first);
+                }
+                break;
+            default:
+                return false;
+        }
+
+        offset = next;
+        return true;
+    }
+
+    // 开始记录复制流，之后每个tick调用 FlushReplication 输出这段时间的变化，从group用 ApplyReplication 应用
+    // 从group需要先用 SaveSnapshot/LoadSnapshot 同步到开始记录时的状态
+    void SetReplication(bool enable) {
+        m_replication = enable;
+        m_replica_times.clear();
+        m_replica_elements.clear();
+        m_replica_edges.clear();
+        m_replica_ranks.clear();
+    }
+
+    // 输出上次调用之后的变化，每个元素、关系和可见排名只输出最终状态
+    bool FlushReplication(std::string &batch) {
+        static_assert(std::is_trivially_copyable<KEY_TYPE>::value && std::is_trivially_copyable<POS_TYPE>::value,
+                "replication needs trivially copyable KEY_TYPE and POS_TYPE");
+
+        batch.clear();
+
+        if(!m_replication) {
+            return false;
+        }
+
+        uint64_t rank_item_count = 0;
+        for(const KEY_TYPE &key: m_replica_ranks) {
+            auto riter = m_visible_ranks.find(key);
+
+            if(riter != m_visible_ranks.end()) {
+                rank_item_count += riter->second.SLOTS.size();
+            }
+        }
+
+        ReplicaHeaderType header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.MAGIC, "AOIR", 4);
+        header.VERSION = REPLICA_VERSION;
+        header.DIMENSION = DIMENSION;
+        header.KEY_SIZE = sizeof(KEY_TYPE);
+        header.POS_SIZE = sizeof(POS_TYPE);
+        header.TIME_COUNT = m_replica_times.size();
+        header.ELEMENT_COUNT = m_replica_elements.size();
+        header.EDGE_COUNT = m_replica_edges.size();
+        header.RANK_COUNT = m_replica_ranks.size();
+        header.RANK_ITEM_COUNT = rank_item_count;
+        header.NOW = m_now;
+        header.KINETIC_HORIZON = m_kinetic_horizon;
+
+        batch.reserve(SnapshotSectionSize(sizeof(header), 1) +
+                SnapshotSectionSize(sizeof(POS_TYPE), header.TIME_COUNT) +
+                SnapshotSectionSize(sizeof(ReplicaElementType), header.ELEMENT_COUNT) +
+                SnapshotSectionSize(sizeof(ReplicaEdgeType), header.EDGE_COUNT) +
+                SnapshotSectionSize(sizeof(ReplicaRankType), header.RANK_COUNT) +
+                SnapshotSectionSize(sizeof(ReplicaRankItemType), header.RANK_ITEM_COUNT));
+
+        AppendSnapshotRecord(batch, header);
+        AlignSnapshot(batch);
+
+        for(const POS_TYPE &now: m_replica_times) {
+            AppendSnapshotRecord(batch, now);
+        }
+        AlignSnapshot(batch);
+
+        for(const KEY_TYPE &key: m_replica_elements) {
+            ReplicaElementType record;
+            memset(&record, 0, sizeof(record));
+            record.KEY = key;
+
+            auto iter = m_elements.find(key);
+
+            if(iter == m_elements.end()) {
+                record.FLAGS = REPLICA_REMOVED;
+                AppendSnapshotRecord(batch, record);
+                continue;
+            }
+
+            const ElementType &element = iter->second;
+            CopyPos(element.POS, record.POS);
+            CopyPos(element.WATCH_RANGE, record.WATCH_RANGE);
+            CopyPos(element.MAKER_RADIUS, record.MAKER_RADIUS);
+            CopyPos(element.DORMANT ? element.ANCHOR : element.POS, record.ANCHOR);
+            record.WATCH_TYPE = element.WATCH_TYPE;
+            record.VISIBLE_LIMIT = element.VISIBLE_LIMIT;
+            record.FLAGS = (element.STATIC ? REPLICA_STATIC : 0) | (element.DORMANT ? REPLICA_DORMANT : 0);
+
+            auto kiter = m_kinetics.find(key);
+
+            if(kiter != m_kinetics.end()) {
+                record.FLAGS |= REPLICA_KINETIC;
+                CopyPos(kiter->second.VELOCITY, record.VELOCITY);
+                record.EXPIRY = kiter->second.EXPIRY;
+            }
+
+            AppendSnapshotRecord(batch, record);
+        }
+        AlignSnapshot(batch);
+
+        for(const std::pair<KEY_TYPE, KEY_TYPE> &pair: m_replica_edges) {
+            ReplicaEdgeType record;
+            memset(&record, 0, sizeof(record));
+            record.WATCHER = pair.first;
+            record.MAKER = pair.second;
+            record.LINKED = IsRelated(pair.first, pair.second);
+            AppendSnapshotRecord(batch, record);
+        }
+        AlignSnapshot(batch);
+
+        std::vector<const VisibleRankType *> ranks;
+        ranks.reserve(m_replica_ranks.size());
+
+        for(const KEY_TYPE &key: m_replica_ranks) {
+            ReplicaRankType record;
+            memset(&record, 0, sizeof(record));
+            record.KEY = key;
+
+            auto riter = m_visible_ranks.find(key);
+
+            if(riter != m_visible_ranks.end()) {
+                record.LIMIT = riter->second.LIMIT;
+                record.ITEM_COUNT = riter->second.SLOTS.size();
+                ranks.emplace_back(&riter->second);
+            }
+
+            AppendSnapshotRecord(batch, record);
+        }
+        AlignSnapshot(batch);
+
+        for(const VisibleRankType *rank: ranks) {
+            for(int visible = 1; visible >= 0; --visible) {
+                for(const RankItemType &item: visible ? rank->VISIBLE : rank->CULLED) {
+                    ReplicaRankItemType record;
+                    memset(&record, 0, sizeof(record));
+                    record.PRIORITY = item.PRIORITY;
+                    record.MAKER = item.KEY;
+                    record.VISIBLE = visible;
+                    AppendSnapshotRecord(batch, record);
+                }
+            }
+        }
+        AlignSnapshot(batch);
+
+        m_replica_times.clear();
+        m_replica_elements.clear();
+        m_replica_edges.clear();
+        m_replica_ranks.clear();
+
+        return true;
+    }
+
+    // 从group应用主group输出的变化，直接修改索引和关系，不做范围查询，不产生事件
+    // 数据不完整或者和当前状态不一致时返回false，group保持不变
+    bool ApplyReplication(const char *data, size_t size) {
+        static_assert(std::is_trivially_copyable<KEY_TYPE>::value && std::is_trivially_copyable<POS_TYPE>::value,
+                "replication needs trivially copyable KEY_TYPE and POS_TYPE");
+
+        if(size < sizeof(ReplicaHeaderType)) {
+            return false;
+        }
+
+        ReplicaHeaderType header = ReadSnapshotRecord<ReplicaHeaderType>(data, 0);
+
+        if(memcmp(header.MAGIC, "AOIR", 4) != 0 || header.VERSION != REPLICA_VERSION || header.DIMENSION != DIMENSION ||
+                header.KEY_SIZE != sizeof(KEY_TYPE) || header.POS_SIZE != sizeof(POS_TYPE)) {
+            return false;
+        }
+
+        // 避免下面计算大小时溢出
+        if(header.TIME_COUNT > size || header.ELEMENT_COUNT > size || header.EDGE_COUNT > size ||
+                header.RANK_COUNT > size || header.RANK_ITEM_COUNT > size) {
+            return false;
+        }
+
+        size_t offset = SnapshotSectionSize(sizeof(ReplicaHeaderType), 1);
+        size_t sections[5];
+        size_t section_sizes[5] = {
+            SnapshotSectionSize(sizeof(POS_TYPE), header.TIME_COUNT),
+            SnapshotSectionSize(sizeof(ReplicaElementType), header.ELEMENT_COUNT),
+            SnapshotSectionSize(sizeof(ReplicaEdgeType), header.EDGE_COUNT),
+            SnapshotSectionSize(sizeof(ReplicaRankType), header.RANK_COUNT),
+            SnapshotSectionSize(sizeof(ReplicaRankItemType), header.RANK_ITEM_COUNT),
+        };
+
+        for(int s = 0; s < 5; ++s) {
+            sections[s] = offset;
+            offset += section_sizes[s];
+        }
+
+        if(offset != size) {
+            return false;
+        }
+
+        // 先检查所有记录，修改group之前发现错误
+        std::unordered_map<KEY_TYPE, int> final_types; // 本次有变化的元素最终的类型，0表示已离开
+        final_types.reserve((size_t)header.ELEMENT_COUNT);
+
+        for(size_t j = 0; j < (size_t)header.ELEMENT_COUNT; ++j) {
+            ReplicaElementType record = ReadSnapshotRecord<ReplicaElementType>(data + sections[1], j);
+
+            int watch_type = (record.FLAGS & REPLICA_REMOVED) ? 0 : record.WATCH_TYPE;
+
+            if(!final_types.emplace(record.KEY, watch_type).second) {
+                return false;
+            }
+
+            if(record.FLAGS & REPLICA_REMOVED) {
+                continue;
+            }
+
+            if(watch_type < AOI_WATCH_TYPES::WATCHER || watch_type > AOI_WATCH_TYPES::BOTH) {
+                return false;
+            }
+
+            bool is_static = (record.FLAGS & REPLICA_STATIC) != 0;
+
+            if(is_static && (watch_type == AOI_WATCH_TYPES::BOTH || (record.FLAGS & (REPLICA_DORMANT | REPLICA_KINETIC)))) {
+                return false;
+            }
+
+            if((record.FLAGS & REPLICA_DORMANT) && (watch_type != AOI_WATCH_TYPES::MAKER || (record.FLAGS & REPLICA_KINETIC))) {
+                return false;
+            }
+        }
+
+        auto final_type = [&final_types, this](const KEY_TYPE &key) {
+            auto fiter = final_types.find(key);
+
+            if(fiter != final_types.end()) {
+                return fiter->second;
+            }
+
+            auto iter = this->m_elements.find(key);
+            return iter == this->m_elements.end() ? 0 : iter->second.WATCH_TYPE;
+        };
+
+        for(size_t j = 0; j < (size_t)header.EDGE_COUNT; ++j) {
+            ReplicaEdgeType record = ReadSnapshotRecord<ReplicaEdgeType>(data + sections[2], j);
+
+            if(record.LINKED && (record.WATCHER == record.MAKER || !(final_type(record.WATCHER) & AOI_WATCH_TYPES::WATCHER) ||
+                        !(final_type(record.MAKER) & AOI_WATCH_TYPES::MAKER))) {
+                return false;
+            }
+        }
+
+        uint64_t rank_item_count = 0;
+
+        for(size_t j = 0; j < (size_t)header.RANK_COUNT; ++j) {
+            ReplicaRankType record = ReadSnapshotRecord<ReplicaRankType>(data + sections[3], j);
+
+            if((record.LIMIT && !(final_type(record.KEY) & AOI_WATCH_TYPES::WATCHER)) || (!record.LIMIT && record.ITEM_COUNT)) {
+                return false;
+            }
+
+            rank_item_count += record.ITEM_COUNT;
+        }
+
+        if(rank_item_count != header.RANK_ITEM_COUNT) {
+            return false;
+        }
+
+        // 运动元素按同样的时间点推进，和主group的计算顺序相同，得到的位置也相同
+        for(size_t j = 0; j < (size_t)header.TIME_COUNT; ++j) {
+            POS_TYPE now = ReadSnapshotRecord<POS_TYPE>(data + sections[0], j);
+
+            if(!(m_now < now)) {
+                continue;
+            }
+
+            POS_TYPE dt = now - m_now;
+            m_now = now;
+
+            for(auto iter = m_kinetics.begin(); iter != m_kinetics.end(); ++iter) {
+                ElementType &element = m_elements[iter->first];
+
+                POS_TYPE old_pos[DIMENSION];
+                CopyPos(element.POS, old_pos);
+
+                for(int i = 0; i < DIMENSION; ++i) {
+                    element.POS[i] += iter->second.VELOCITY[i] * dt;
+                }
+
+                UpdateKineticIndex(iter->first, element, iter->second, old_pos);
+            }
+        }
+
+        m_now = header.NOW;
+        m_kinetic_horizon = header.KINETIC_HORIZON;
+
+        for(size_t j = 0; j < (size_t)header.ELEMENT_COUNT; ++j) {
+            ReplicaElementType record = ReadSnapshotRecord<ReplicaElementType>(data + sections[1], j);
+            const KEY_TYPE &key = record.KEY;
+
+            auto iter = m_elements.find(key);
+
+            // 静态元素只能修改可见数量，其他都相同时不需要重建静态索引
+            if(iter != m_elements.end() && iter->second.STATIC && (record.FLAGS & REPLICA_STATIC) &&
+                    iter->second.WATCH_TYPE == record.WATCH_TYPE && iter->second.VISIBLE_LIMIT == record.VISIBLE_LIMIT &&
+                    IsSamePos(iter->second.POS, record.POS) && IsSamePos(iter->second.WATCH_RANGE, record.WATCH_RANGE) &&
+                    IsSamePos(iter->second.MAKER_RADIUS, record.MAKER_RADIUS)) {
+                continue;
+            }
+
+            if(iter != m_elements.end()) {
+                ElementType &element = iter->second;
+
+                auto kiter = m_kinetics.find(key);
+                if(kiter != m_kinetics.end()) {
+                    RemoveKinetic(key, kiter->second);
+                    m_kinetics.erase(kiter);
+                }
+
+                if(element.WATCH_TYPE & AOI_WATCH_TYPES::MAKER) {
+                    RemoveMakerIndex(key, element);
+                }
+
+                if(element.WATCH_TYPE & AOI_WATCH_TYPES::WATCHER) {
+                    RemoveWatcherIndex(key, element);
+                }
+
+                if(record.FLAGS & REPLICA_REMOVED) {
+                    while(element.RELATED_MAKERS.size()) {
+                        KEY_TYPE maker = *element.RELATED_MAKERS.begin();
+                        UnlinkRelation(key, element, maker, m_elements[maker]);
+                    }
+
+                    while(element.RELATED_WATCHERS.size()) {
+                        KEY_TYPE watcher = *element.RELATED_WATCHERS.begin();
+                        UnlinkRelation(watcher, m_elements[watcher], key, element);
+                    }
+
+                    m_visible_ranks.erase(key);
+                    m_edges.FreeHead(element.RELATED_MAKERS.Head());
+                    m_elements.erase(iter);
+                    continue;
+                }
+            } else if(record.FLAGS & REPLICA_REMOVED) {
+                continue;
+            } else {
+                iter = m_elements.emplace(std::piecewise_construct, std::forward_as_tuple(key),
+                        std::forward_as_tuple(&m_edges)).first;
+            }
+
+            ElementType &element = iter->second;
+            element.WATCH_TYPE = record.WATCH_TYPE;
+            SetElementVisibleLimit(element, record.VISIBLE_LIMIT);
+            element.STATIC = (record.FLAGS & REPLICA_STATIC) != 0;
+            element.DORMANT = (record.FLAGS & REPLICA_DORMANT) != 0;
+            CopyPos(record.POS, element.POS);
+            CopyPos(record.WATCH_RANGE, element.WATCH_RANGE);
+            CopyPos(record.MAKER_RADIUS, element.MAKER_RADIUS);
+            CopyPos(record.ANCHOR, element.ANCHOR);
+            element.WATCHER_HINT.VALID = false;
+            element.MAKER_HINT.VALID = false;
+
+            if(element.WATCH_TYPE & AOI_WATCH_TYPES::MAKER) {
+                InsertMakerIndex(key, element);
+            }
+
+            if(element.WATCH_TYPE & AOI_WATCH_TYPES::WATCHER) {
+                InsertWatcherIndex(key, element);
+            }
+
+            if(record.FLAGS & REPLICA_KINETIC) {
+                KineticType &kinetic = m_kinetics[key];
+                CopyPos(record.VELOCITY, kinetic.VELOCITY);
+                InsertKinetic(key, element, kinetic);
+
+                m_kinetic_queue.erase(std::make_pair(kinetic.EXPIRY, key));
+                kinetic.EXPIRY = record.EXPIRY;
+                m_kinetic_queue.emplace(kinetic.EXPIRY, key);
+            }
+        }
+
+        for(size_t j = 0; j < (size_t)header.EDGE_COUNT; ++j) {
+            ReplicaEdgeType record = ReadSnapshotRecord<ReplicaEdgeType>(data + sections[2], j);
+
+            if(record.LINKED == IsRelated(record.WATCHER, record.MAKER)) {
+                continue;
+            }
+
+            ElementType &watcher_element = m_elements[record.WATCHER];
+            ElementType &maker_element = m_elements[record.MAKER];
+
+            if(record.LINKED) {
+                LinkRelation(record.WATCHER, watcher_element, record.MAKER, maker_element);
+            } else {
+                UnlinkRelation(record.WATCHER, watcher_element, record.MAKER, maker_element);
+            }
+        }
+
+        size_t item_index = 0;
+
+        for(size_t j = 0; j < (size_t)header.RANK_COUNT; ++j) {
+            ReplicaRankType record = ReadSnapshotRecord<ReplicaRankType>(data + sections[3], j);
+
+            if(!record.LIMIT) {
+                m_visible_ranks.erase(record.KEY);
+                continue;
+            }
+
+            VisibleRankType &rank = m_visible_ranks[record.KEY];
+            rank = VisibleRankType();
+            rank.LIMIT = record.LIMIT;
+
+            for(uint32_t k = 0; k < record.ITEM_COUNT; ++k) {
+                ReplicaRankItemType item = ReadSnapshotRecord<ReplicaRankItemType>(data + sections[4], item_index++);
+
+                (item.VISIBLE ? rank.VISIBLE : rank.CULLED).push_back(RankItemType{item.PRIORITY, item.MAKER});
+            }
+
+            RebuildRank(rank);
+        }
+
+        return true;
+    }
+
+    std::string DumpElements() {
+        std::ostringstream ss;
+
+        ss << "** DUMP ELEMENTS BEGIN\n";
+        for(auto iter = m_elements.begin(); iter != m_elements.end(); ++iter) {
+            ss << "ID=" << iter->first << ": ";
+            const ElementType &element = iter->second;
+
+            ss << "POS=(";
+            for(int i = 0; i < DIMENSION; ++i) {
+                if(i != 0) {
+                    ss << ",";
+                }
+
+                ss << element.POS[i];
+            }
+            ss << ") ";
+
+            if(element.WATCH_TYPE & AOI_WATCH_TYPES::WATCHER) {
+                ss << "<W> ";
+                ss << "WATCH_RANGE=(";
+                for(int i = 0; i < DIMENSION; ++i) {
+                    if(i != 0) {
+                        ss << ",";
+                    }
+
+                    ss << element.WATCH_RANGE[i];
+                }
+                ss << ") ";
+
+                if(element.VISIBLE_LIMIT) {
+                    ss << "VISIBLE_LIMIT=" << element.VISIBLE_LIMIT << " ";
+                }
+
+                ss << "RELATED_MAKERS=(";
+                for(const KEY_TYPE &key: element.RELATED_MAKERS) {
+                    ss << key << ",";
+                }
+                ss << ") ";
+            }
+
+            if(element.WATCH_TYPE & AOI_WATCH_TYPES::MAKER) {
+                ss << "<M> ";
+                if(element.DORMANT) {
+                    ss << "DORMANT ";
+                }
+
+                if(!IsZeroPos(element.MAKER_RADIUS)) {
+                    ss << "MAKER_RADIUS=(";
+                    for(int i = 0; i < DIMENSION; ++i) {
+                        if(i != 0) {
+                            ss << ",";
+                        }
+
+                        ss << element.MAKER_RADIUS[i];
+                    }
+                    ss << ") ";
+                }
+
+                ss << "RELATED_WATCHERS=(";
+                for(const KEY_TYPE &key: element.RELATED_WATCHERS) {
+                    ss << key << ",";
+                }
+                ss << ") ";
+            }
+
+            ss << "\n";
+        }
+        ss << "** DUMP ELEMENTS END";
+
+        return ss.str();
+    }
+
+    std::string DumpSlist() {
+        std::ostringstream ss;
+        ss << "** DUMP SLIST BEGIN\n";
+        BuildTriggerIndex();
+
+        for(int i = 0; i < DIMENSION; ++i) {
+            for(int b = 0; b < WATCHER_BUCKET_COUNT; ++b) {
+                WatcherBucketType &bucket = m_dimensions[i].WATCHER_BUCKETS[b];
+
+                if(bucket.RANGES.empty()) {
+                    continue;
+                }
+
+                ss << "*** DUMP dimension #" << i << " bucket #" << b << " MAX_RANGE=" << bucket.RANGES.rbegin()->first << "\n";
+
+                ss << "*** DUMP dimension #" << i << " bucket #" << b << " WATCHER_LOWER_LIST BEGIN\n";
+                ss << bucket.WATCHER_LOWER_LIST.DumpLevels() << "\n";
+                ss << "*** DUMP dimension #" << i << " bucket #" << b << " WATCHER_LOWER_LIST END\n";
+
+                ss << "*** DUMP dimension #" << i << " bucket #" << b << " WATCHER_UPPER_LIST BEGIN\n";
+                ss << bucket.WATCHER_UPPER_LIST.DumpLevels() << "\n";
+                ss << "*** DUMP dimension #" << i << " bucket #" << b << " WATCHER_UPPER_LIST END\n";
+            }
+
+            ss << "*** DUMP dimension #" << i << " MAKER_LIST BEGIN\n";
+            ss << m_dimensions[i].MAKER_LIST.DumpLevels() << "\n";
+            ss << "*** DUMP dimension #" << i << " MAKER_LIST END\n";
+
+            if(m_static_count) {
+                BuildStaticIndex();
+
+                ss << "*** DUMP dimension #" << i << " STATIC_LIST BEGIN\n";
+                for(const std::pair<POS_TYPE, KEY_TYPE> &item: m_dimensions[i].STATIC_LIST) {
+                    ss << item.second << ":" << item.first << " ";
+                }
+                ss << "\n*** DUMP dimension #" << i << " STATIC_LIST END\n";
+            }
+
+            if(m_triggers.size() && i == m_trigger_dimension) {
+                ss << "*** DUMP dimension #" << i << " TRIGGER_LIST BEGIN\n";
+                for(const TriggerType &item: m_trigger_list) {
+                    ss << item.KEY << ":[" << item.LOWER << "," << item.UPPER << "] ";
+                }
+                ss << "\n*** DUMP dimension #" << i << " TRIGGER_LIST END\n";
+            }
+        }
+        ss << "** DUMP SLIST END";
+        return ss.str();
+    }
+
+    bool TestSelf() {
+        for(auto iter = m_elements.begin(); iter != m_elements.end(); ++iter) {
+            if(!TestElement(iter->first, iter->second)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // 抽样检查，适合在线上每帧调用：先检查最近被修改过的元素，再随机抽取 samples 个不同的元素，
+    // 耗时超过 budget_ns 时提前结束；最近修改的元素只在开启统计时记录，见 SetConsistencyCheck
+    // 返回发现的不一致的元素数量，开启统计时同时计入 StatsType
+    unsigned long CheckConsistency(unsigned samples, unsigned long budget_ns) {
+        if(m_elements.empty()) {
+            m_check_recent.clear();
+            return 0;
+        }
+
+        // 检查时的查询不计入统计
+        StatsType saved = m_stats;
+        auto begin = std::chrono::steady_clock::now();
+        auto deadline = begin + std::chrono::nanoseconds(budget_ns);
+
+        unsigned long checked = 0;
+        unsigned long failures = 0;
+
+        auto check = [this, &checked, &failures, &saved](const KEY_TYPE &key, const ElementType &element) {
+            ++checked;
+
+            if(!this->TestElement(key, element)) {
+                ++failures;
+                saved.HAS_CHECK_FAILURE_KEY = true;
+                saved.CHECK_FAILURE_KEY = key;
+            }
+        };
+
+        std::sort(m_check_recent.begin(), m_check_recent.end());
+        m_check_recent.erase(std::unique(m_check_recent.begin(), m_check_recent.end()), m_check_recent.end());
+
+        size_t recent = 0;
+
+        for(; recent < m_check_recent.size() && std::chrono::steady_clock::now() < deadline; ++recent) {
+            auto iter = m_elements.find(m_check_recent[recent]);
+
+            if(iter != m_elements.end()) {
+                check(iter->first, iter->second);
+            }
+        }
+
+        // 没检查完的留到下次
+        m_check_recent.erase(m_check_recent.begin(), m_check_recent.begin() + recent);
+
+        // 抽样数量不少于元素数量时全部检查一遍
+        if(samples >= m_elements.size()) {
+            for(auto iter = m_elements.begin(); iter != m_elements.end() && std::chrono::steady_clock::now() < deadline; ++iter) {
+                check(iter->first, iter->second);
+            }
+        } else {
+            // 随机选一个非空的桶，再随机选链上的一个元素，抽到重复的元素时重新抽
+            std::unordered_set<KEY_TYPE> sampled;
+            sampled.reserve(samples);
+
+            while(sampled.size() < samples && std::chrono::steady_clock::now() < deadline) {
+                size_t bucket = m_check_rng() % m_elements.bucket_count();
+                size_t bucket_size = m_elements.bucket_size(bucket);
+
+                if(bucket_size == 0) {
+                    continue;
+                }
+
+                auto iter = m_elements.begin(bucket);
+                std::advance(iter, m_check_rng() % bucket_size);
+
+                if(sampled.insert(iter->first).second) {
+                    check(iter->first, iter->second);
+                }
+            }
+        }
+
+        if(ENABLE_STATS) {
+            m_stats = saved;
+            m_stats.CHECKED += checked;
+            m_stats.CHECK_FAILURES += failures;
+            m_stats.CHECK_NS += (unsigned long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+        }
+
+        return failures;
+    }
+
+    // 开启统计时，公开操作修改过的元素记录下来留给 CheckConsistency 优先检查，最多保留 capacity 个，为0时不记录
+    void SetConsistencyCheck(size_t capacity) {
+        m_check_recent_capacity = capacity;
+        m_check_recent.clear();
+        m_check_recent.shrink_to_fit();
+    }
+
+private:
+    // 检查一个元素的关系和重新查询的结果是否一致
+    bool TestElement(const KEY_TYPE &key, const ElementType &e) {
+        if(e.WATCH_TYPE & AOI_WATCH_TYPES::WATCHER) {
+            std::vector<KEY_TYPE> makerlist;
+            GetMakersInRange(e.POS, e.WATCH_RANGE, makerlist, &key, 1);
+
+            std::vector<KEY_TYPE> stored_makerlist(e.RELATED_MAKERS.begin(), e.RELATED_MAKERS.end());
+
+            if(stored_makerlist.size() != e.RELATED_MAKERS.size()) {
+                return false;
+            }
+
+            std::sort(makerlist.begin(), makerlist.end());
+            std::sort(stored_makerlist.begin(), stored_makerlist.end());
+
+            // 区间内的maker一定可见，滞后区间内的maker可能可见，更远的一定不可见
+            if(!std::includes(stored_makerlist.begin(), stored_makerlist.end(), makerlist.begin(), makerlist.end())) {
+                return false;
+            }
+
+            for(const KEY_TYPE &maker: stored_makerlist) {
+                auto miter = m_elements.find(maker);
+
+                if(miter == m_elements.end() || maker == key || !(miter->second.WATCH_TYPE & AOI_WATCH_TYPES::MAKER)) {
+                    return false;
+                }
+
+                if(!CanKeepWatching(e.POS, e.WATCH_RANGE, miter->second.POS, miter->second.MAKER_RADIUS)) {
+                    return false;
+                }
+
+                if(!IsRelated(key, maker)) {
+                    return false;
+                }
+            }
+
+            if(!TestVisibleRank(key, e)) {
+                return false;
+            }
+        }
+
+        if(e.DORMANT && !TestDormant(key, e)) {
+            return false;
+        }
+
+        unsigned ranked_watchers = 0;
+
+        for(const KEY_TYPE &watcher: e.RELATED_WATCHERS) {
+            auto witer = m_elements.find(watcher);
+
+            if(witer != m_elements.end() && witer->second.VISIBLE_LIMIT) {
+                ++ranked_watchers;
+            }
+        }
+
+        if(ranked_watchers != e.RANKED_WATCHERS) {
+            return false;
+        }
+
+        if(e.WATCH_TYPE & AOI_WATCH_TYPES::MAKER) {
+            std::vector<KEY_TYPE> watcherlist;
+            GetWatchersRelatedToPos(e.POS, e.MAKER_RADIUS, watcherlist, &key, 1);
+
+            std::vector<KEY_TYPE> stored_watcherlist(e.RELATED_WATCHERS.begin(), e.RELATED_WATCHERS.end());
+
+            if(stored_watcherlist.size() != e.RELATED_WATCHERS.size()) {
+                return false;
+            }
+
+            std::sort(watcherlist.begin(), watcherlist.end());
+            std::sort(stored_watcherlist.begin(), stored_watcherlist.end());
+
+            if(!std::includes(stored_watcherlist.begin(), stored_watcherlist.end(), watcherlist.begin(), watcherlist.end())) {
+                return false;
+            }
+
+            for(const KEY_TYPE &watcher: stored_watcherlist) {
+                auto witer = m_elements.find(watcher);
+
+                if(witer == m_elements.end() || watcher == key || !(witer->second.WATCH_TYPE & AOI_WATCH_TYPES::WATCHER)) {
+                    return false;
+                }
+
+                if(!CanKeepWatching(witer->second.POS, witer->second.WATCH_RANGE, e.POS, e.MAKER_RADIUS)) {
+                    return false;
+                }
+
+                if(!IsRelated(watcher, key)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    void Callback(const KEY_TYPE &receiver, const KEY_TYPE &sender, const AOI_EVENT_TYPE &event) {
+        if(ENABLE_STATS) {
+            switch(event.EVENT_ID) {
+                case AOI_EVENT_IDS::ENTER:
+                    ++m_stats.ENTER_EVENTS;
+                    break;
+                case AOI_EVENT_IDS::LEAVE:
+                    ++m_stats.LEAVE_EVENTS;
+                    break;
+                case AOI_EVENT_IDS::MOVE:
+                    ++m_stats.MOVE_EVENTS;
+                    break;
+                default:
+                    ++m_stats.OTHER_EVENTS;
+                    break;
+            }
+        }
+
+        if(m_eventcb) {
+            m_eventcb(m_id, receiver, sender, event);
+        }
+    }
+
+    // maker 通知 watcher 的入口，有可见数量限制的 watcher 在这里转换成可见集合的变化
+    // notify_move 为false时只更新排名，不发送MOVE事件
+    void NotifyWatcher(const KEY_TYPE &watcher, const KEY_TYPE &maker, const AOI_EVENT_TYPE &event, bool notify_move = true) {
+        auto riter = m_visible_ranks.empty() ? m_visible_ranks.end() : m_visible_ranks.find(watcher);
+
+        if(riter == m_visible_ranks.end()) {
+            if(event.EVENT_ID != AOI_EVENT_IDS::MOVE || (NOTIFY_MOVE_EVENT && notify_move)) {
+                Callback(watcher, maker, event);
+            }
+            return;
+        }
+
+        auto iter = m_elements.find(watcher);
+
+        if(iter == m_elements.end()) {
+            return;
+        }
+
+        VisibleRankType &rank = riter->second;
+        MarkReplicaRank(watcher);
+
+        auto siter = rank.SLOTS.find(maker);
+        bool was_visible = siter != rank.SLOTS.end() && siter->second.VISIBLE;
+
+        if(event.EVENT_ID == AOI_EVENT_IDS::LEAVE) {
+            if(siter != rank.SLOTS.end()) {
+                RankSlotType slot = siter->second;
+                rank.SLOTS.erase(siter);
+                RankErase(rank, slot.VISIBLE, slot.INDEX);
+            }
+        } else {
+            double priority = CalcPriority(watcher, iter->second, maker, event.POS);
+
+            if(siter != rank.SLOTS.end()) {
+                RankHeap(rank, siter->second.VISIBLE)[siter->second.INDEX].PRIORITY = priority;
+                RankFix(rank, siter->second.VISIBLE, siter->second.INDEX);
+            } else {
+                RankPush(rank, false, RankItemType{priority, maker});
+            }
+        }
+
+        std::vector<KEY_TYPE> shown;
+        std::vector<KEY_TYPE> hidden;
+        RebalanceVisible(rank, shown, hidden);
+
+        bool is_visible = IsVisibleInRank(rank, maker);
+
+        // 本maker的事件沿用原事件的位置信息，其他maker由于排名变化产生的事件单独构造
+        if(was_visible && !is_visible) {
+            AOI_EVENT_TYPE leave_event = event;
+            leave_event.EVENT_ID = AOI_EVENT_IDS::LEAVE;
+            Callback(watcher, maker, leave_event);
+        }
+
+        hidden.erase(std::remove(hidden.begin(), hidden.end(), maker), hidden.end());
+        shown.erase(std::remove(shown.begin(), shown.end(), maker), shown.end());
+        EmitVisibleChanges(watcher, shown, hidden);
+
+        if(!was_visible && is_visible) {
+            AOI_EVENT_TYPE enter_event = event;
+            enter_event.EVENT_ID = AOI_EVENT_IDS::ENTER;
+            Callback(watcher, maker, enter_event);
+        } else if(NOTIFY_MOVE_EVENT && notify_move && was_visible && is_visible && event.EVENT_ID == AOI_EVENT_IDS::MOVE) {
+            Callback(watcher, maker, event);
+        }
+    }
+
+    double CalcPriority(const KEY_TYPE &watcher, const ElementType &watcher_element, const KEY_TYPE &maker, const POS_TYPE maker_pos[DIMENSION]) {
+        if(m_prioritycb) {
+            return m_prioritycb(watcher, watcher_element.POS, maker, maker_pos);
+        }
+
+        double distance = 0;
+        for(int i = 0; i < DIMENSION; ++i) {
+            double diff = (double)(maker_pos[i] - watcher_element.POS[i]);
+            distance += diff * diff;
+        }
+        return distance;
+    }
+
+    bool IsVisibleInRank(const VisibleRankType &rank, const KEY_TYPE &maker) {
+        auto siter = rank.SLOTS.find(maker);
+
+        return siter != rank.SLOTS.end() && siter->second.VISIBLE;
+    }
+
+    bool IsVisibleTo(const KEY_TYPE &watcher, const KEY_TYPE &maker) {
+        auto riter = m_visible_ranks.find(watcher);
+
+        return riter == m_visible_ranks.end() || IsVisibleInRank(riter->second, maker);
+    }
+
+    void GetVisibleKeys(const VisibleRankType &rank, std::vector<KEY_TYPE> &keys) {
+        keys.clear();
+        for(const RankItemType &item: rank.VISIBLE) {
+            keys.emplace_back(item.KEY);
+        }
+    }
+
+    void GetVisibleWatchers(const KEY_TYPE &key, const ElementType &element, std::vector<KEY_TYPE> &watchers) {
+        watchers.clear();
+
+        if(m_visible_ranks.empty()) {
+            watchers.assign(element.RELATED_WATCHERS.begin(), element.RELATED_WATCHERS.end());
+            return;
+        }
+
+        for(const KEY_TYPE &watcher: element.RELATED_WATCHERS) {
+            if(IsVisibleTo(watcher, key)) {
+                watchers.emplace_back(watcher);
+            }
+        }
+    }
+
+    // a 在堆中应该位于 b 的上方：VISIBLE 是最差的在堆顶，CULLED 是最好的在堆顶
+    static bool RankAbove(bool visible, const RankItemType &a, const RankItemType &b) {
+        return visible ? b < a : a < b;
+    }
+
+    static std::vector<RankItemType> &RankHeap(VisibleRankType &rank, bool visible) {
+        return visible ? rank.VISIBLE : rank.CULLED;
+    }
+
+    static void RankPlace(VisibleRankType &rank, bool visible, size_t index) {
+        RankSlotType &slot = rank.SLOTS[RankHeap(rank, visible)[index].KEY];
+        slot.VISIBLE = visible;
+        slot.INDEX = index;
+    }
+
+    // 只更新位置发生变化的候选的下标
+    static void RankSiftUp(VisibleRankType &rank, bool visible, size_t index) {
+        std::vector<RankItemType> &heap = RankHeap(rank, visible);
+        RankItemType item = heap[index];
+        size_t start = index;
+
+        while(index > 0 && RankAbove(visible, item, heap[(index - 1) / 2])) {
+            heap[index] = heap[(index - 1) / 2];
+            RankPlace(rank, visible, index);
+            index = (index - 1) / 2;
+        }
+
+        if(index != start) {
+            heap[index] = item;
+            RankPlace(rank, visible, index);
+        }
+    }
+
+    static void RankSiftDown(VisibleRankType &rank, bool visible, size_t index) {
+        std::vector<RankItemType> &heap = RankHeap(rank, visible);
+        RankItemType item = heap[index];
+        size_t start = index;
+
+        for(;;) {
+            size_t child = index * 2 + 1;
+
+            if(child >= heap.size()) {
+                break;
+            }
+
+            if(child + 1 < heap.size() && RankAbove(visible, heap[child + 1], heap[child])) {
+                ++child;
+            }
+
+            if(!RankAbove(visible, heap[child], item)) {
+                break;
+            }
+
+            heap[index] = heap[child];
+            RankPlace(rank, visible, index);
+            index = child;
+        }
+
+        if(index != start) {
+            heap[index] = item;
+            RankPlace(rank, visible, index);
+        }
+    }
+
+    static void RankFix(VisibleRankType &rank, bool visible, size_t index) {
+        std::vector<RankItemType> &heap = RankHeap(rank, visible);
+
+        if(index > 0 && RankAbove(visible, heap[index], heap[(index - 1) / 2])) {
+            RankSiftUp(rank, visible, index);
+        } else {
+            RankSiftDown(rank, visible, index);
+        }
+    }
+
+    static void RankPush(VisibleRankType &rank, bool visible, const RankItemType &item) {
+        std::vector<RankItemType> &heap = RankHeap(rank, visible);
+        heap.push_back(item);
+        RankPlace(rank, visible, heap.size() - 1);
+        RankSiftUp(rank, visible, heap.size() - 1);
+    }
+
+    // 取出的候选在 SLOTS 中的记录由调用者处理
+    static RankItemType RankErase(VisibleRankType &rank, bool visible, size_t index) {
+        std::vector<RankItemType> &heap = RankHeap(rank, visible);
+        RankItemType item = heap[index];
+
+        heap[index] = heap.back();
+        heap.pop_back();
+
+        if(index < heap.size()) {
+            RankPlace(rank, visible, index);
+            RankFix(rank, visible, index);
+        }
+
+        return item;
+    }
+
+    // 两个堆的内容已经确定，重新建堆和下标
+    static void RebuildRank(VisibleRankType &rank) {
+        std::make_heap(rank.VISIBLE.begin(), rank.VISIBLE.end());
+        std::make_heap(rank.CULLED.begin(), rank.CULLED.end(), [](const RankItemType &a, const RankItemType &b) {
+            return b < a;
+        });
+
+        rank.SLOTS.clear();
+        rank.SLOTS.reserve(rank.VISIBLE.size() + rank.CULLED.size());
+
+        for(size_t i = 0; i < rank.VISIBLE.size(); ++i) {
+            RankPlace(rank, true, i);
+        }
+
+        for(size_t i = 0; i < rank.CULLED.size(); ++i) {
+            RankPlace(rank, false, i);
+        }
+    }
+
+    // 候选数量或者优先级变化后调整两个堆，每次调整只移动边界上的候选
+    void RebalanceVisible(VisibleRankType &rank, std::vector<KEY_TYPE> &shown, std::vector<KEY_TYPE> &hidden) {
+        while(rank.VISIBLE.size() > rank.LIMIT) {
+            RankItemType worst = RankErase(rank, true, 0);
+            hidden.emplace_back(worst.KEY);
+            RankPush(rank, false, worst);
+        }
+
+        while(rank.VISIBLE.size() < rank.LIMIT && rank.CULLED.size()) {
+            RankItemType best = RankErase(rank, false, 0);
+            shown.emplace_back(best.KEY);
+            RankPush(rank, true, best);
+        }
+
+        while(rank.VISIBLE.size() && rank.CULLED.size() && rank.CULLED[0] < rank.VISIBLE[0]) {
+            RankItemType worst = rank.VISIBLE[0];
+            RankItemType best = rank.CULLED[0];
+
+            hidden.emplace_back(worst.KEY);
+            shown.emplace_back(best.KEY);
+
+            rank.VISIBLE[0] = best;
+            RankPlace(rank, true, 0);
+            RankSiftDown(rank, true, 0);
+
+            rank.CULLED[0] = worst;
+            RankPlace(rank, false, 0);
+            RankSiftDown(rank, false, 0);
+        }
+    }
+
+    // 按 RELATED_MAKERS 重新计算所有候选的优先级并选出可见集合，用于开始限制、修改数量上限或者优先级规则
+    void ResyncVisible(const KEY_TYPE &key, ElementType &element, VisibleRankType &rank, std::vector<KEY_TYPE> &old_visible) {
+        MarkReplicaRank(key);
+
+        std::vector<RankItemType> candidates;
+        candidates.reserve(element.RELATED_MAKERS.size());
+
+        for(const KEY_TYPE &maker: element.RELATED_MAKERS) {
+            auto iter = m_elements.find(maker);
+
+            if(iter == m_elements.end()) {
+                continue;
+            }
+
+            candidates.push_back(RankItemType{CalcPriority(key, element, maker, iter->second.POS), maker});
+        }
+
+        size_t visible_count = std::min((size_t)rank.LIMIT, candidates.size());
+        std::nth_element(candidates.begin(), candidates.begin() + visible_count, candidates.end());
+
+        rank.VISIBLE.assign(candidates.begin(), candidates.begin() + visible_count);
+        rank.CULLED.assign(candidates.begin() + visible_count, candidates.end());
+        RebuildRank(rank);
+
+        std::vector<KEY_TYPE> new_visible;
+        GetVisibleKeys(rank, new_visible);
+
+        std::sort(old_visible.begin(), old_visible.end());
+        std::sort(new_visible.begin(), new_visible.end());
+
+        std::vector<KEY_TYPE> hidden;
+        std::vector<KEY_TYPE> shown;
+        DiffSortedKeylist2(hidden, shown, old_visible, new_visible);
+
+        EmitVisibleChanges(key, shown, hidden);
+    }
+
+    // watcher移动后所有候选的优先级都变了，原地重新计算后重新建堆，不分配内存
+    // 两个堆的成员不变，只有跨过可见边界的候选才在两个堆之间移动并产生事件
+    // leave_makers、enter_makers 是本次已经解除、建立的关系
+    bool ResyncVisibleIfLimited(const KEY_TYPE &key, ElementType &element,
+            const std::vector<KEY_TYPE> &leave_makers, const std::vector<KEY_TYPE> &enter_makers) {
+        auto riter = m_visible_ranks.find(key);
+
+        if(riter == m_visible_ranks.end()) {
+            return false;
+        }
+
+        VisibleRankType &rank = riter->second;
+        MarkReplicaRank(key);
+
+        ScratchKeys shown(this);
+        ScratchKeys hidden(this);
+
+        for(const KEY_TYPE &maker: leave_makers) {
+            auto siter = rank.SLOTS.find(maker);
+
+            if(siter == rank.SLOTS.end()) {
+                continue;
+            }
+
+            RankSlotType slot = siter->second;
+            rank.SLOTS.erase(siter);
+            RankErase(rank, slot.VISIBLE, slot.INDEX);
+
+            if(slot.VISIBLE) {
+                hidden.emplace_back(maker);
+            }
+        }
+
+        for(int visible = 1; visible >= 0; --visible) {
+            std::vector<RankItemType> &heap = RankHeap(rank, visible);
+
+            for(RankItemType &item: heap) {
+                auto iter = m_elements.find(item.KEY);
+
+                if(iter != m_elements.end()) {
+                    item.PRIORITY = CalcPriority(key, element, item.KEY, iter->second.POS);
+                }
+            }
+
+            for(size_t i = heap.size() / 2; i-- > 0;) {
+                RankSiftDown(rank, visible, i);
+            }
+        }
+
+        for(const KEY_TYPE &maker: enter_makers) {
+            auto iter = m_elements.find(maker);
+
+            if(iter == m_elements.end() || rank.SLOTS.count(maker)) {
+                continue;
+            }
+
+            RankPush(rank, false, RankItemType{CalcPriority(key, element, maker, iter->second.POS), maker});
+        }
+
+        RebalanceVisible(rank, shown, hidden);
+        EmitVisibleChanges(key, shown, hidden);
+
+        return true;
+    }
+
+    void EmitVisibleChanges(const KEY_TYPE &watcher, const std::vector<KEY_TYPE> &shown, const std::vector<KEY_TYPE> &hidden) {
+        AOI_EVENT_TYPE event;
+
+        event.EVENT_ID = AOI_EVENT_IDS::LEAVE;
+        for(const KEY_TYPE &maker: hidden) {
+            auto iter = m_elements.find(maker);
+
+            if(iter == m_elements.end()) {
+                continue;
+            }
+
+            CopyPos(iter->second.POS, event.POS);
+            Callback(watcher, maker, event);
+        }
+
+        event.EVENT_ID = AOI_EVENT_IDS::ENTER;
+        for(const KEY_TYPE &maker: shown) {
+            auto iter = m_elements.find(maker);
+
+            if(iter == m_elements.end()) {
+                continue;
+            }
+
+            CopyPos(iter->second.POS, event.POS);
+            Callback(watcher, maker, event);
+        }
+    }
+
+    bool TestVisibleRank(const KEY_TYPE &key, const ElementType &e) {
+        auto riter = m_visible_ranks.find(key);
+
+        if(e.VISIBLE_LIMIT == 0) {
+            return riter == m_visible_ranks.end();
+        }
+
+        if(riter == m_visible_ranks.end()) {
+            return false;
+        }
+
+        const VisibleRankType &rank = riter->second;
+
+        if(rank.LIMIT != e.VISIBLE_LIMIT || rank.SLOTS.size() != e.RELATED_MAKERS.size()) {
+            return false;
+        }
+
+        if(rank.VISIBLE.size() != std::min((size_t)rank.LIMIT, e.RELATED_MAKERS.size()) ||
+                rank.VISIBLE.size() + rank.CULLED.size() != rank.SLOTS.size()) {
+            return false;
+        }
+
+        if(rank.VISIBLE.size() && rank.CULLED.size() && rank.CULLED[0] < rank.VISIBLE[0]) {
+            return false;
+        }
+
+        for(int visible = 1; visible >= 0; --visible) {
+            const std::vector<RankItemType> &heap = visible ? rank.VISIBLE : rank.CULLED;
+
+            for(size_t i = 0; i < heap.size(); ++i) {
+                auto siter = rank.SLOTS.find(heap[i].KEY);
+
+                if(siter == rank.SLOTS.end() || siter->second.VISIBLE != (visible != 0) || siter->second.INDEX != i) {
+                    return false;
+                }
+
+                if(i > 0 && RankAbove(visible, heap[i], heap[(i - 1) / 2])) {
+                    return false;
+                }
+            }
+        }
+
+        for(const KEY_TYPE &maker: e.RELATED_MAKERS) {
+            auto siter = rank.SLOTS.find(maker);
+            auto iter = m_elements.find(maker);
+
+            if(siter == rank.SLOTS.end() || iter == m_elements.end()) {
+                return false;
+            }
+
+            const RankItemType &item = (siter->second.VISIBLE ? rank.VISIBLE : rank.CULLED)[siter->second.INDEX];
+
+            if(!m_prioritycb && item.PRIORITY != CalcPriority(key, e, maker, iter->second.POS)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // 由另一个区间的数量加减边缘推算，边缘可能有重复计数，结果不小于0
+    static unsigned long EstimateCount(unsigned long base, unsigned long add, unsigned long sub) {
+        return base + add < sub ? 0 : base + add - sub;
+    }
+
+    // 两种方式都有样本时按耗时比较，否则直接比较代价
+    static bool ChooseUpdate(double update_weight, unsigned long update_complexity, double shift_weight, unsigned long shift_complexity) {
+        if(update_weight > 0 && shift_weight > 0) {
+            return update_weight * (update_complexity + 1) < shift_weight * (shift_complexity + 1);
+        }
+
+        return update_complexity < shift_complexity;
+    }
+
+    // 采样时可能反转 use_update，在作用域结束时把测得的耗时计入实际执行的方式的权重
+    class ChooserTimer {
+    public:
+        ChooserTimer(bool calibration, ChooserSamplerType &sampler, bool &use_update, double &update_weight, unsigned long update_complexity,
+                double &shift_weight, unsigned long shift_complexity) : m_weight(NULL), m_complexity(0) {
+            if(!calibration || ++sampler.TICKS % CHOOSER_SAMPLE_INTERVAL) {
+                return;
+            }
+
+            if(++sampler.SAMPLES % CHOOSER_EXPLORE_INTERVAL == 0) {
+                use_update = !use_update;
+            }
+
+            m_weight = use_update ? &update_weight : &shift_weight;
+            m_complexity = use_update ? update_complexity : shift_complexity;
+            m_start = std::chrono::steady_clock::now();
+        }
+
+        ~ChooserTimer() {
+            if(!m_weight) {
+                return;
+            }
+
+            double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - m_start).count() / (m_complexity + 1);
+            *m_weight = *m_weight > 0 ? *m_weight + (ns - *m_weight) * CHOOSER_EWMA_ALPHA : ns;
+        }
+
+    private:
+        double *m_weight;
+        unsigned long m_complexity;
+        std::chrono::steady_clock::time_point m_start;
+    };
+
+    // 记录公开操作的耗时，没有开启统计时是空的
+    // 公开操作内部调用其他公开操作时只记录最外层
+    template<bool Enable, typename Dummy = void>
+    class OpTimer {
+    public:
+        OpTimer(AoiGroup *group, int op, const KEY_TYPE *key) {
+        }
+
+        void AddKey(const KEY_TYPE &key) {
+        }
+    };
+
+    template<typename Dummy>
+    class OpTimer<true, Dummy> {
+    public:
+        OpTimer(AoiGroup *group, int op, const KEY_TYPE *key) : m_group(group) {
+            if(m_group->m_op_depth++) {
+                return;
+            }
+
+            m_slow.OP = op;
+            m_slow.HAS_KEY = key != NULL;
+
+            if(key) {
+                m_slow.KEY = *key;
+
+                if(m_group->m_check_recent.size() < m_group->m_check_recent_capacity) {
+                    m_group->m_check_recent.emplace_back(*key);
+                }
+            }
+
+            const StatsType &stats = m_group->m_stats;
+            m_slow.CANDIDATES_SCANNED = stats.QUERY_SCANNED + stats.SHIFT_SCANNED;
+            m_slow.CANDIDATES_ACCEPTED = stats.QUERY_ACCEPTED + stats.SHIFT_ACCEPTED;
+            m_slow.RANK_COUNTS = stats.RANK_COUNTS;
+            m_slow.EVENTS = stats.ENTER_EVENTS + stats.LEAVE_EVENTS + stats.MOVE_EVENTS + stats.OTHER_EVENTS;
+            m_start = std::chrono::steady_clock::now();
+        }
+
+        // 一次操作修改多个元素时，其他元素也留给 CheckConsistency 检查
+        void AddKey(const KEY_TYPE &key) {
+            if(m_group->m_op_depth == 1 && m_group->m_check_recent.size() < m_group->m_check_recent_capacity) {
+                m_group->m_check_recent.emplace_back(key);
+            }
+        }
+
+        ~OpTimer() {
+            if(--m_group->m_op_depth) {
+                return;
+            }
+
+            m_slow.NS = (unsigned long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+            m_group->RecordOp(m_slow);
+        }
+
+    private:
+        AoiGroup *m_group;
+        SlowOpType m_slow;
+        std::chrono::steady_clock::time_point m_start;
+    };
+
+    using OP_TIMER = OpTimer<ENABLE_STATS>;
+
+    // slow 中的计数是操作开始时的值
+    void RecordOp(SlowOpType &slow) {
+        if(m_latency.empty()) {
+            m_latency.resize(AOI_JOURNAL_OPS::COUNT);
+        }
+
+        m_latency[slow.OP].Record(slow.NS);
+
+        if(slow.NS < m_slow_op_threshold_ns || !m_slow_op_capacity) {
+            return;
+        }
+
+        slow.CANDIDATES_SCANNED = m_stats.QUERY_SCANNED + m_stats.SHIFT_SCANNED - slow.CANDIDATES_SCANNED;
+        slow.CANDIDATES_ACCEPTED = m_stats.QUERY_ACCEPTED + m_stats.SHIFT_ACCEPTED - slow.CANDIDATES_ACCEPTED;
+        slow.RANK_COUNTS = m_stats.RANK_COUNTS - slow.RANK_COUNTS;
+        slow.EVENTS = m_stats.ENTER_EVENTS + m_stats.LEAVE_EVENTS + m_stats.MOVE_EVENTS + m_stats.OTHER_EVENTS - slow.EVENTS;
+
+        if(m_slow_ops.size() < m_slow_op_capacity) {
+            m_slow_ops.emplace_back(slow);
+        } else {
+            m_slow_ops[m_slow_op_next] = slow;
+            m_slow_op_next = (m_slow_op_next + 1) % m_slow_op_capacity;
+        }
+    }
+
+    void BuildStaticIndex() {
+        size_t size = m_dimensions[0].STATIC_LIST.size();
+
+        if(m_static_sorted == size && m_static_removed.empty()) {
+            return;
+        }
+
+        for(int i = 0; i < DIMENSION; ++i) {
+            std::vector<std::pair<POS_TYPE, KEY_TYPE>> &list = m_dimensions[i].STATIC_LIST;
+
+            std::sort(list.begin() + m_static_sorted, list.end());
+            std::inplace_merge(list.begin(), list.begin() + m_static_sorted, list.end());
+
+            if(m_static_removed.size()) {
+                list.erase(std::remove_if(list.begin(), list.end(), [this](const std::pair<POS_TYPE, KEY_TYPE> &item) {
+                                return this->m_static_removed.count(item.second) != 0;
+                            }), list.end());
+            }
+        }
+
+        m_static_sorted = m_dimensions[0].STATIC_LIST.size();
+        m_static_removed.clear();
+    }
+
+    // 静态maker中落在区间内的部分，区间两端是否包含的含义和跳表相同
+    std::pair<size_t, size_t> StaticRange(int dim, const POS_TYPE &begin, bool begin_inclusive, const POS_TYPE &end, bool end_inclusive) {
+        BuildStaticIndex();
+
+        const std::vector<std::pair<POS_TYPE, KEY_TYPE>> &list = m_dimensions[dim].STATIC_LIST;
+
+        auto first = begin_inclusive ?
+            std::partition_point(list.begin(), list.end(), [&begin](const std::pair<POS_TYPE, KEY_TYPE> &item) { return item.first < begin; }) :
+            std::partition_point(list.begin(), list.end(), [&begin](const std::pair<POS_TYPE, KEY_TYPE> &item) { return !(begin < item.first); });
+
+        auto last = end_inclusive ?
+            std::partition_point(first, list.end(), [&end](const std::pair<POS_TYPE, KEY_TYPE> &item) { return !(end < item.first); }) :
+            std::partition_point(first, list.end(), [&end](const std::pair<POS_TYPE, KEY_TYPE> &item) { return item.first < end; });
+
+        return std::make_pair(first - list.begin(), last - list.begin());
+    }
+
+    // 动态和静态的maker一起计数、遍历
+    unsigned long CountMakers(int dim, const POS_TYPE &begin, bool begin_inclusive, const POS_TYPE &end, bool end_inclusive) {
+        unsigned long count = m_dimensions[dim].MAKER_LIST.GetElementsCountByRangedValue(begin, begin_inclusive, end, end_inclusive);
+
+        if(ENABLE_STATS) {
+            ++m_stats.RANK_COUNTS;
+        }
+
+        if(m_static_count) {
+            std::pair<size_t, size_t> range = StaticRange(dim, begin, begin_inclusive, end, end_inclusive);
+            count += range.second - range.first;
+        }
+
+        return count;
+    }
+
+    template<typename CB>
+    void GetMakers(int dim, const POS_TYPE &begin, bool begin_inclusive, const POS_TYPE &end, bool end_inclusive, CB &&cb) {
+        m_dimensions[dim].MAKER_LIST.GetElementsByRangedValue(begin, begin_inclusive, end, end_inclusive, cb);
+
+        if(m_static_count) {
+            std::pair<size_t, size_t> range = StaticRange(dim, begin, begin_inclusive, end, end_inclusive);
+            const std::vector<std::pair<POS_TYPE, KEY_TYPE>> &list = m_dimensions[dim].STATIC_LIST;
+
+            for(size_t j = range.first; j < range.second; ++j) {
+                cb(0, list[j].second, list[j].first);
+            }
+        }
+    }
+
+    // 选择一个维度建立触发器的区间树：按扫描线计算每个维度上最多有多少个区间重叠，取最少的维度，
+    // 这样任意一个点查询时需要检查的触发器最少
+    void BuildTriggerIndex() {
+        if(!m_trigger_dirty) {
+            return;
+        }
+
+        m_trigger_dirty = false;
+        m_trigger_list.clear();
+
+        if(m_triggers.empty()) {
+            m_trigger_max_upper.clear();
+            return;
+        }
+
+        // 端点相同时先进入后离开，闭区间在端点处也算重叠
+        std::vector<std::pair<POS_TYPE, int>> points;
+        unsigned long best_depth = 0;
+        m_trigger_dimension = -1;
+
+        for(int i = 0; i < DIMENSION; ++i) {
+            points.clear();
+
+            for(const KEY_TYPE &key: m_triggers) {
+                const ElementType &e = m_elements[key];
+                points.emplace_back(e.POS[i] - e.WATCH_RANGE[i], 0);
+                points.emplace_back(e.POS[i] + e.WATCH_RANGE[i], 1);
+            }
+
+            std::sort(points.begin(), points.end());
+
+            unsigned long depth = 0;
+            unsigned long max_depth = 0;
+
+            for(const std::pair<POS_TYPE, int> &point: points) {
+                if(point.second == 0) {
+                    max_depth = std::max(max_depth, ++depth);
+                } else {
+                    --depth;
+                }
+            }
+
+            if(m_trigger_dimension < 0 || max_depth < best_depth) {
+                m_trigger_dimension = i;
+                best_depth = max_depth;
+            }
+        }
+
+        int dim = m_trigger_dimension;
+
+        for(const KEY_TYPE &key: m_triggers) {
+            const ElementType &e = m_elements[key];
+            m_trigger_list.push_back(TriggerType{ e.POS[dim] - e.WATCH_RANGE[dim], e.POS[dim] + e.WATCH_RANGE[dim], key });
+        }
+
+        std::sort(m_trigger_list.begin(), m_trigger_list.end());
+
+        m_trigger_max_upper.resize(m_trigger_list.size());
+        BuildTriggerMaxUpper(0, m_trigger_list.size());
+    }
+
+    POS_TYPE BuildTriggerMaxUpper(size_t l, size_t r) {
+        size_t mid = l + (r - l) / 2;
+        POS_TYPE max_upper = m_trigger_list[mid].UPPER;
+
+        if(l < mid) {
+            max_upper = std::max(max_upper, BuildTriggerMaxUpper(l, mid));
+        }
+
+        if(mid + 1 < r) {
+            max_upper = std::max(max_upper, BuildTriggerMaxUpper(mid + 1, r));
+        }
+
+        m_trigger_max_upper[mid] = max_upper;
+        return max_upper;
+    }
+
+    // 区间 [l, r) 中和 [lower, upper] 相交的触发器，左子树上边界都小于 lower 时跳过，
+    // 下边界超过 upper 之后的都不用再看
+    template<typename CB>
+    void QueryTriggers(size_t l, size_t r, const POS_TYPE &lower, const POS_TYPE &upper, CB &cb) {
+        while(l < r) {
+            size_t mid = l + (r - l) / 2;
+
+            if(m_trigger_max_upper[mid] < lower) {
+                return;
+            }
+
+            QueryTriggers(l, mid, lower, upper, cb);
+
+            const TriggerType &trigger = m_trigger_list[mid];
+
+            if(upper < trigger.LOWER) {
+                return;
+            }
+
+            if(!(trigger.UPPER < lower)) {
+                cb(trigger.KEY);
+            }
+
+            l = mid + 1;
+        }
+    }
+
+    // 在建立索引的维度上和 [lower, upper] 相交的触发器，其他维度由调用者检查
+    template<typename CB>
+    void GetTriggersNear(const POS_TYPE lower[DIMENSION], const POS_TYPE upper[DIMENSION], CB &cb) {
+        BuildTriggerIndex();
+
+        int dim = m_trigger_dimension;
+        QueryTriggers(0, m_trigger_list.size(), lower[dim], upper[dim], cb);
+    }
+
+    // 临时的key列表，内存从group缓存的列表中借用，析构时清空后归还
+    // 回调里再次调用group的接口时，会借到另外的列表
+    static constexpr size_t SCRATCH_KEEP_CAPACITY = 4096;
+
+    class ScratchKeys : public std::vector<KEY_TYPE> {
+    public:
+        explicit ScratchKeys(AoiGroup *group) : m_group(group) {
+            if(!group->m_scratch_keys.empty()) {
+                this->swap(group->m_scratch_keys.back());
+                group->m_scratch_keys.pop_back();
+            }
+        }
+
+        ScratchKeys(const ScratchKeys &) = delete;
+        ScratchKeys &operator=(const ScratchKeys &) = delete;
+
+        ~ScratchKeys() {
+            if(this->capacity() > SCRATCH_KEEP_CAPACITY) {
+                return;
+            }
+
+            this->clear();
+            m_group->m_scratch_keys.emplace_back();
+            m_group->m_scratch_keys.back().swap(*this);
+        }
+
+    private:
+        AoiGroup *m_group;
+    };
+
+    // 值没有变化时不操作跳表，只在一个维度上移动时其他维度的索引不动
+    static void UpdateIndex(ZeeSkiplist<KEY_TYPE, POS_TYPE> &list, const KEY_TYPE &key, const POS_TYPE &old_value, const POS_TYPE &value) {
+        if(!(old_value == value)) {
+            list.Update(key, old_value, value);
+        }
+    }
+
+    void CopyPos(const POS_TYPE src[DIMENSION], POS_TYPE dst[DIMENSION]) {
+        std::copy(src, src + DIMENSION, dst);
+    }
+
+    bool IsSamePos(const POS_TYPE x[DIMENSION], const POS_TYPE y[DIMENSION]) {
+        return std::equal(x, x + DIMENSION, y);
+    }
+
+    bool IsZeroPos(const POS_TYPE x[DIMENSION]) {
+        for(int i = 0; i < DIMENSION; ++i) {
+            if(!(x[i] == POS_ZERO)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void TrimWatchRange(POS_TYPE watch_range[DIMENSION]) {
+        for(int i = 0; i < DIMENSION; ++i) {
+            if(watch_range[i] < POS_ZERO) {
+                watch_range[i] = POS_ZERO;
+            } else if(m_max_watch_range[i] < watch_range[i]) {
+                watch_range[i] = m_max_watch_range[i];
+            }
+        }
+    }
+
+    // watcher的区间和maker的可见区间在每个维度上都相交（开区间）
+    bool CanWatch(const POS_TYPE watcher_pos[DIMENSION], const POS_TYPE watch_range[DIMENSION],
+            const POS_TYPE maker_pos[DIMENSION], const POS_TYPE maker_radius[DIMENSION]) {
+        return AoiBox<POS_TYPE, DIMENSION>::Inside(watcher_pos, watch_range, maker_radius, maker_pos);
+    }
+
+    // 已经可见的maker，超出区间加上滞后距离才离开
+    bool CanKeepWatching(const POS_TYPE watcher_pos[DIMENSION], const POS_TYPE watch_range[DIMENSION],
+            const POS_TYPE maker_pos[DIMENSION], const POS_TYPE maker_radius[DIMENSION]) {
+        return AoiBox<POS_TYPE, DIMENSION>::Inside(watcher_pos, watch_range, maker_radius, m_hysteresis, maker_pos);
+    }
+
+    void TrimMakerRadius(POS_TYPE maker_radius[DIMENSION]) {
+        for(int i = 0; i < DIMENSION; ++i) {
+            if(maker_radius[i] < POS_ZERO) {
+                maker_radius[i] = POS_ZERO;
+            } else if(m_max_maker_radius[i] < maker_radius[i]) {
+                maker_radius[i] = m_max_maker_radius[i];
+            }
+        }
+    }
+
+    int WatcherBucketIndex(int dim, const POS_TYPE &range) {
+        const DimensionType &dimension = m_dimensions[dim];
+
+        for(int b = 0; b < WATCHER_BUCKET_COUNT - 1; ++b) {
+            if(!(dimension.BUCKET_BOUNDS[b] < range)) {
+                return b;
+            }
+        }
+
+        return WATCHER_BUCKET_COUNT - 1;
+    }
+
+    // 当前实际在使用的最大范围
+    POS_TYPE CurrentMaxWatchRange(int dim) {
+        for(int b = WATCHER_BUCKET_COUNT - 1; b >= 0; --b) {
+            const WatcherBucketType &bucket = m_dimensions[dim].WATCHER_BUCKETS[b];
+
+            if(bucket.RANGES.size()) {
+                return bucket.RANGES.rbegin()->first;
+            }
+        }
+
+        return POS_ZERO;
+    }
+
+    void InsertWatcherEdges(int dim, const KEY_TYPE &key, const POS_TYPE &pos, const POS_TYPE &range) {
+        WatcherBucketType &bucket = m_dimensions[dim].WATCHER_BUCKETS[WatcherBucketIndex(dim, range)];
+
+        bucket.WATCHER_LOWER_LIST.Insert(key, pos - range);
+        bucket.WATCHER_UPPER_LIST.Insert(key, pos + range);
+        ++bucket.RANGES[range];
+    }
+
+    void RemoveWatcherEdges(int dim, const KEY_TYPE &key, const POS_TYPE &pos, const POS_TYPE &range) {
+        WatcherBucketType &bucket = m_dimensions[dim].WATCHER_BUCKETS[WatcherBucketIndex(dim, range)];
+
+        bucket.WATCHER_LOWER_LIST.Delete(key, pos - range);
+        bucket.WATCHER_UPPER_LIST.Delete(key, pos + range);
+
+        auto iter = bucket.RANGES.find(range);
+        assert(iter != bucket.RANGES.end());
+
+        if(--iter->second == 0) {
+            bucket.RANGES.erase(iter);
+        }
+    }
+
+    void UpdateWatcherEdges(int dim, const KEY_TYPE &key, const POS_TYPE &old_pos, const POS_TYPE &old_range, const POS_TYPE &pos, const POS_TYPE &range) {
+        int old_bucket_index = WatcherBucketIndex(dim, old_range);
+        int bucket_index = WatcherBucketIndex(dim, range);
+
+        if(old_bucket_index != bucket_index) {
+            RemoveWatcherEdges(dim, key, old_pos, old_range);
+            InsertWatcherEdges(dim, key, pos, range);
+            return;
+        }
+
+        WatcherBucketType &bucket = m_dimensions[dim].WATCHER_BUCKETS[bucket_index];
+
+        UpdateIndex(bucket.WATCHER_LOWER_LIST, key, old_pos - old_range, pos - range);
+        UpdateIndex(bucket.WATCHER_UPPER_LIST, key, old_pos + old_range, pos + range);
+
+        if(!(old_range == range)) {
+            auto iter = bucket.RANGES.find(old_range);
+            assert(iter != bucket.RANGES.end());
+
+            if(--iter->second == 0) {
+                bucket.RANGES.erase(iter);
+            }
+
+            ++bucket.RANGES[range];
+        }
+    }
+
+    // 所有分桶中，lower或upper边界落在给定区间内的watcher
+    unsigned long CountWatcherEdges(int dim, bool use_lower, const POS_TYPE &begin, bool begin_included, const POS_TYPE &end, bool end_included) {
+        unsigned long count = 0;
+
+        for(int b = 0; b < WATCHER_BUCKET_COUNT; ++b) {
+            WatcherBucketType &bucket = m_dimensions[dim].WATCHER_BUCKETS[b];
+
+            if(bucket.RANGES.empty()) {
+                continue;
+            }
+
+            ZeeSkiplist<KEY_TYPE, POS_TYPE> &list = use_lower ? bucket.WATCHER_LOWER_LIST : bucket.WATCHER_UPPER_LIST;
+            count += list.GetElementsCountByRangedValue(begin, begin_included, end, end_included);
+
+            if(ENABLE_STATS) {
+                ++m_stats.RANK_COUNTS;
+            }
+        }
+
+        return count;
+    }
+
+    template<typename CB>
+    void GetWatcherEdges(int dim, bool use_lower, const POS_TYPE &begin, bool begin_included, const POS_TYPE &end, bool end_included, CB &cb) {
+        for(int b = 0; b < WATCHER_BUCKET_COUNT; ++b) {
+            WatcherBucketType &bucket = m_dimensions[dim].WATCHER_BUCKETS[b];
+
+            if(bucket.RANGES.empty()) {
+                continue;
+            }
+
+            ZeeSkiplist<KEY_TYPE, POS_TYPE> &list = use_lower ? bucket.WATCHER_LOWER_LIST : bucket.WATCHER_UPPER_LIST;
+            list.GetElementsByRangedValue(begin, begin_included, end, end_included, cb);
+        }
+    }
+
+    // 第dim维上可能和区间 (lower, upper) 相交的watcher，
+    // 按lower边界搜索时 W.lo < upper 且 W.lo > lower - 2 * range，每个桶的range取桶内实际使用的最大值
+    unsigned long CountWatchersNear(int dim, bool use_lower, const POS_TYPE &lower, const POS_TYPE &upper) {
+        unsigned long count = 0;
+
+        for(int b = 0; b < WATCHER_BUCKET_COUNT; ++b) {
+            WatcherBucketType &bucket = m_dimensions[dim].WATCHER_BUCKETS[b];
+
+            if(bucket.RANGES.empty()) {
+                continue;
+            }
+
+            POS_TYPE max_range = bucket.RANGES.rbegin()->first;
+
+            if(use_lower) {
+                count += bucket.WATCHER_LOWER_LIST.GetElementsCountByRangedValue(lower - max_range - max_range, false, upper, false);
+            } else {
+                count += bucket.WATCHER_UPPER_LIST.GetElementsCountByRangedValue(lower, false, upper + max_range + max_range, false);
+            }
+
+            if(ENABLE_STATS) {
+                ++m_stats.RANK_COUNTS;
+            }
+        }
+
+        return count;
+    }
+
+    template<typename CB>
+    void GetWatchersNear(int dim, bool use_lower, const POS_TYPE &lower, const POS_TYPE &upper, CB &cb) {
+        for(int b = 0; b < WATCHER_BUCKET_COUNT; ++b) {
+            WatcherBucketType &bucket = m_dimensions[dim].WATCHER_BUCKETS[b];
+
+            if(bucket.RANGES.empty()) {
+                continue;
+            }
+
+            POS_TYPE max_range = bucket.RANGES.rbegin()->first;
+
+            if(use_lower) {
+                bucket.WATCHER_LOWER_LIST.GetElementsByRangedValue(lower - max_range - max_range, false, upper, false, cb);
+            } else {
+                bucket.WATCHER_UPPER_LIST.GetElementsByRangedValue(lower, false, upper + max_range + max_range, false, cb);
+            }
+        }
+    }
+
+    POS_TYPE AbsPos(const POS_TYPE &x) {
+        return x < POS_ZERO ? POS_ZERO - x : x;
+    }
+
+    POS_TYPE MaxKineticSpeed(int dim) {
+        if(m_kinetic_speeds[dim].empty()) {
+            return POS_ZERO;
+        }
+
+        return m_kinetic_speeds[dim].rbegin()->first;
+    }
+
+    void GetKineticVelocity(const KEY_TYPE &key, POS_TYPE velocity[DIMENSION]) {
+        auto iter = m_kinetics.find(key);
+
+        if(iter == m_kinetics.end()) {
+            std::fill(velocity, velocity + DIMENSION, POS_ZERO);
+        } else {
+            CopyPos(iter->second.VELOCITY, velocity);
+        }
+    }
+
+    void InsertKinetic(const KEY_TYPE &key, const ElementType &element, KineticType &kinetic) {
+        CopyPos(element.POS, kinetic.LIST_POS);
+
+        for(int i = 0; i < DIMENSION; ++i) {
+            m_dimensions[i].KINETIC_LIST.Insert(key, kinetic.LIST_POS[i]);
+            ++m_kinetic_speeds[i][AbsPos(kinetic.VELOCITY[i])];
+        }
+
+        // 当前的关系是正确的，下次推进时间时再计算预测
+        kinetic.EXPIRY = m_now;
+        m_kinetic_queue.emplace(kinetic.EXPIRY, key);
+        MarkReplicaElement(key);
+    }
+
+    void RemoveKinetic(const KEY_TYPE &key, KineticType &kinetic) {
+        m_kinetic_queue.erase(std::make_pair(kinetic.EXPIRY, key));
+
+        for(int i = 0; i < DIMENSION; ++i) {
+            m_dimensions[i].KINETIC_LIST.Delete(key, kinetic.LIST_POS[i]);
+
+            auto iter = m_kinetic_speeds[i].find(AbsPos(kinetic.VELOCITY[i]));
+            assert(iter != m_kinetic_speeds[i].end());
+
+            if(--iter->second == 0) {
+                m_kinetic_speeds[i].erase(iter);
+            }
+        }
+    }
+
+    // 预测失效，下次推进时间时重新计算关系
+    void ExpireKinetic(const KEY_TYPE &key, KineticType &kinetic) {
+        m_kinetic_queue.erase(std::make_pair(kinetic.EXPIRY, key));
+        kinetic.EXPIRY = m_now;
+        m_kinetic_queue.emplace(kinetic.EXPIRY, key);
+        MarkReplicaElement(key);
+    }
+
+    // 只更新查询用的索引里的位置，不处理可见排名，KINETIC_LIST 等到重新计算预测时再更新
+    void UpdateKineticIndex(const KEY_TYPE &key, ElementType &element, KineticType &kinetic, const POS_TYPE old_pos[DIMENSION]) {
+        for(int i = 0; i < DIMENSION; ++i) {
+            if(element.WATCH_TYPE & AOI_WATCH_TYPES::MAKER) {
+                UpdateIndex(m_dimensions[i].MAKER_LIST, key, old_pos[i], element.POS[i]);
+            }
+
+            if(element.WATCH_TYPE & AOI_WATCH_TYPES::WATCHER) {
+                UpdateWatcherEdges(i, key, old_pos[i], element.WATCH_RANGE[i], element.POS[i], element.WATCH_RANGE[i]);
+            }
+        }
+
+        // 位置不是通过移动变化的，缓存的数量不再能用来推算
+        element.WATCHER_HINT.VALID = false;
+        element.MAKER_HINT.VALID = false;
+    }
+
+    void SyncKineticIndex(const KEY_TYPE &key, ElementType &element, KineticType &kinetic, const POS_TYPE old_pos[DIMENSION]) {
+        UpdateKineticIndex(key, element, kinetic, old_pos);
+
+        if(m_visible_ranks.empty()) {
+            return;
+        }
+
+        // 有可见数量限制的watcher按新位置重新排名
+        if(element.RANKED_WATCHERS) {
+            AOI_EVENT_TYPE event;
+            event.EVENT_ID = AOI_EVENT_IDS::MOVE;
+            CopyPos(element.POS, event.POS);
+            CopyPos(old_pos, event.POS_FROM);
+
+            std::vector<KEY_TYPE> watchers(element.RELATED_WATCHERS.begin(), element.RELATED_WATCHERS.end());
+
+            for(const KEY_TYPE &watcher: watchers) {
+                if(m_visible_ranks.count(watcher)) {
+                    NotifyWatcher(watcher, key, event, false);
+                }
             }
         }
+
+        if(element.WATCH_TYPE & AOI_WATCH_TYPES::WATCHER) {
+            ScratchKeys unchanged(this);
+            ResyncVisibleIfLimited(key, element, unchanged, unchanged);
+        }
     }
 
-    void GetMakersInRange(const POS_TYPE pos[DIMENSION], const POS_TYPE range[DIMENSION], std::vector<KEY_TYPE> &makers, const KEY_TYPE *excludes_sorted = NULL, size_t excludes_size = 0, const GetMakersInRangeHint *hint = NULL) {
-        static_assert(DIMENSION > 0, "DIMENSION should > 0");
-        assert(std::is_sorted(excludes_sorted, excludes_sorted + excludes_size));
-        makers.clear();
+    // 没有到期的运动元素在 KINETIC_LIST 中的位置最多偏离实际位置 速度 * 预测时长：
+    // 计算预测时同步位置，预测不超过预测时长，到期的元素在推进时间时一定会重新计算
+    POS_TYPE KineticDrift(int dim) {
+        return MaxKineticSpeed(dim) * m_kinetic_horizon;
+    }
 
-        // 找到几个维度里面，落在区间内的maker数量最少的那个维度，减少后续筛选的数量
-        GetMakersInRangeHint h;
-        if(!hint) {
-            CalcGetMakersInRangeHint(pos, range, h);
-            hint = &h;
+    void SyncKineticList(const KEY_TYPE &key, const ElementType &element, KineticType &kinetic) {
+        for(int i = 0; i < DIMENSION; ++i) {
+            UpdateIndex(m_dimensions[i].KINETIC_LIST, key, kinetic.LIST_POS[i], element.POS[i]);
         }
 
-        assert(hint->TARGET_DIMENSION >= 0);
+        CopyPos(element.POS, kinetic.LIST_POS);
+    }
 
-        // 遍历维度 target_dimension，进行筛选
-        {
-            int i = hint->TARGET_DIMENSION;
-            POS_TYPE lower = pos[i] - range[i];
-            POS_TYPE upper = pos[i] + range[i];
+    // 元素发生了预测之外的变化（移动、进入、改变范围或速度），附近运动元素的预测都失效
+    void TouchKinetic(const KEY_TYPE &key, const ElementType &element) {
+        if(m_kinetics.empty()) {
+            return;
+        }
+
+        auto kiter = m_kinetics.find(key);
+
+        if(kiter != m_kinetics.end()) {
+            SyncKineticList(key, element, kiter->second);
+            ExpireKinetic(key, kiter->second);
+        }
+
+        // 预测时长内可能和本元素发生关系变化的距离
+        POS_TYPE reach[DIMENSION];
+        for(int i = 0; i < DIMENSION; ++i) {
+            POS_TYPE speed = MaxKineticSpeed(i);
+            // 触发器的范围可能超过 max_watch_range
+            POS_TYPE range = element.STATIC && m_max_watch_range[i] < element.WATCH_RANGE[i] ? element.WATCH_RANGE[i] : m_max_watch_range[i];
+            reach[i] = range + m_max_maker_radius[i] + m_hysteresis[i] + (speed + speed) * m_kinetic_horizon;
+        }
+
+        ExpireKineticNear(key, element.POS, reach);
+    }
+
+    // 实际位置在 pos 附近 reach 以内的运动元素的预测失效，不包括 key 自己
+    void ExpireKineticNear(const KEY_TYPE &key, const POS_TYPE pos[DIMENSION], const POS_TYPE reach[DIMENSION]) {
+        if(m_kinetics.empty()) {
+            return;
+        }
+
+        POS_TYPE lower[DIMENSION];
+        POS_TYPE upper[DIMENSION];
+        int target_dimension = -1;
+        unsigned long complexity = 0;
+
+        for(int i = 0; i < DIMENSION; ++i) {
+            lower[i] = pos[i] - reach[i] - KineticDrift(i);
+            upper[i] = pos[i] + reach[i] + KineticDrift(i);
+
+            unsigned long count = m_dimensions[i].KINETIC_LIST.GetElementsCountByRangedValue(lower[i], true, upper[i], true);
+
+            if(target_dimension < 0 || count < complexity) {
+                target_dimension = i;
+                complexity = count;
+            }
+        }
+
+        std::vector<KEY_TYPE> touched;
+
+        int i = target_dimension;
+        m_dimensions[i].KINETIC_LIST.GetElementsByRangedValue(lower[i], true, upper[i], true,
+                [&touched, this, &key, pos, reach](unsigned long _0, const KEY_TYPE &k, const POS_TYPE &_1) {
+                    if(k == key) {
+                        return;
+                    }
+
+                    auto iter = this->m_elements.find(k);
+
+                    if(iter == this->m_elements.end()) {
+                        return;
+                    }
+
+                    ElementType &e = iter->second;
 
-            m_dimensions[i].MAKER_LIST.GetElementsByRangedValue(lower, false, upper, false,
-                    [&makers, excludes_sorted, excludes_size, this, pos, range](unsigned long _0, const KEY_TYPE &key, const POS_TYPE &_1) {
-                        if(excludes_size && std::binary_search(excludes_sorted, excludes_sorted + excludes_size, key)) {
+                    for(int d = 0; d < DIMENSION; ++d) {
+                        if(reach[d] < this->AbsPos(e.POS[d] - pos[d])) {
                             return;
                         }
+                    }
+
+                    touched.emplace_back(k);
+                });
+
+        for(const KEY_TYPE &k: touched) {
+            ExpireKinetic(k, m_kinetics[k]);
+        }
+    }
+
+    // 计算运动元素下一次需要重新计算关系的时间：
+    // 在预测时长内可能接触到的元素中，取关系最早可能发生变化的时间
+    void ScheduleKinetic(const KEY_TYPE &key, ElementType &element, KineticType &kinetic) {
+        POS_TYPE time = m_kinetic_horizon;
+
+        SyncKineticList(key, element, kinetic);
+
+        // 对方也可能在运动，搜索范围按双方的速度扩大
+        POS_TYPE extra[DIMENSION];
+        for(int i = 0; i < DIMENSION; ++i) {
+            extra[i] = m_hysteresis[i] + (AbsPos(kinetic.VELOCITY[i]) + MaxKineticSpeed(i)) * m_kinetic_horizon;
+        }
+
+        POS_TYPE velocity[DIMENSION];
+
+        if(element.WATCH_TYPE & AOI_WATCH_TYPES::WATCHER) {
+            POS_TYPE range[DIMENSION];
+            for(int i = 0; i < DIMENSION; ++i) {
+                range[i] = element.WATCH_RANGE[i] + extra[i];
+            }
+
+            std::vector<KEY_TYPE> makers;
+            GetMakersInRange(element.POS, range, makers, &key, 1);
+
+            for(const KEY_TYPE &maker: makers) {
+                auto iter = m_elements.find(maker);
 
-                        // 检查key是否在范围内
-                        auto iter = this->m_elements.find(key);
-                        if(iter == this->m_elements.end()) {
+                if(iter == m_elements.end()) {
+                    continue;
+                }
+
+                GetKineticVelocity(maker, velocity);
+
+                POS_TYPE t = POS_ZERO;
+                if(CalcKineticCrossTime(element, kinetic.VELOCITY, iter->second, velocity, IsRelated(key, maker), t) && t < time) {
+                    time = t;
+                }
+            }
+
+            CalcDormantWakeTime(element, kinetic.VELOCITY, time);
+        }
+
+        if(element.WATCH_TYPE & AOI_WATCH_TYPES::MAKER) {
+            POS_TYPE radius[DIMENSION];
+            for(int i = 0; i < DIMENSION; ++i) {
+                radius[i] = element.MAKER_RADIUS[i] + extra[i];
+            }
+
+            std::vector<KEY_TYPE> watchers;
+            GetWatchersRelatedToPos(element.POS, radius, watchers, &key, 1);
+
+            for(const KEY_TYPE &watcher: watchers) {
+                auto iter = m_elements.find(watcher);
+
+                if(iter == m_elements.end()) {
+                    continue;
+                }
+
+                GetKineticVelocity(watcher, velocity);
+
+                POS_TYPE t = POS_ZERO;
+                if(CalcKineticCrossTime(iter->second, velocity, element, kinetic.VELOCITY, IsRelated(watcher, key), t) && t < time) {
+                    time = t;
+                }
+            }
+        }
+
+        m_kinetic_queue.erase(std::make_pair(kinetic.EXPIRY, key));
+        kinetic.EXPIRY = m_now + time;
+        m_kinetic_queue.emplace(kinetic.EXPIRY, key);
+        MarkReplicaElement(key);
+    }
+
+    // 运动的watcher进入休眠maker锚点附近 DormantReach 时需要唤醒它，time 不超过最早进入的时间
+    // 只按每个维度进入的时间取最大值，不考虑离开，得到的时间只会偏早
+    void CalcDormantWakeTime(const ElementType &watcher, const POS_TYPE velocity[DIMENSION], POS_TYPE &time) {
+        if(!m_dormant_count) {
+            return;
+        }
+
+        POS_TYPE lower[DIMENSION];
+        POS_TYPE upper[DIMENSION];
+        int target_dimension = -1;
+        unsigned long complexity = 0;
+
+        for(int i = 0; i < DIMENSION; ++i) {
+            POS_TYPE reach = DormantReach(i) + AbsPos(velocity[i]) * time;
+            lower[i] = watcher.POS[i] - reach;
+            upper[i] = watcher.POS[i] + reach;
+
+            unsigned long count = m_dimensions[i].DORMANT_LIST.GetElementsCountByRangedValue(lower[i], true, upper[i], true);
+
+            if(target_dimension < 0 || count < complexity) {
+                target_dimension = i;
+                complexity = count;
+            }
+        }
+
+        if(complexity == 0) {
+            return;
+        }
+
+        int i = target_dimension;
+        m_dimensions[i].DORMANT_LIST.GetElementsByRangedValue(lower[i], true, upper[i], true,
+                [this, &watcher, velocity, &time, &lower, &upper](unsigned long _0, const KEY_TYPE &k, const POS_TYPE &_1) {
+                    auto iter = this->m_elements.find(k);
+
+                    if(iter == this->m_elements.end()) {
+                        return;
+                    }
+
+                    const POS_TYPE *anchor = iter->second.ANCHOR;
+                    POS_TYPE wake = POS_ZERO;
+
+                    for(int d = 0; d < DIMENSION; ++d) {
+                        if(anchor[d] < lower[d] || upper[d] < anchor[d]) {
                             return;
                         }
 
-                        ElementType &e = iter->second;
+                        POS_TYPE distance = anchor[d] - watcher.POS[d];
+                        POS_TYPE reach = this->DormantReach(d);
+                        POS_TYPE t = POS_ZERO;
 
-                        for(int k = 0; k < DIMENSION; ++k) {
-                            POS_TYPE lo = pos[k] - range[k];
-                            POS_TYPE up = pos[k] + range[k];
+                        if(reach < distance && POS_ZERO < velocity[d]) {
+                            t = (distance - reach) / velocity[d];
+                        } else if(distance < POS_ZERO - reach && velocity[d] < POS_ZERO) {
+                            t = (POS_ZERO - reach - distance) / (POS_ZERO - velocity[d]);
+                        } else if(reach < this->AbsPos(distance)) {
+                            return; // 这个维度上不会靠近
+                        }
 
-                            if( !(lo < e.POS[k]) || !(e.POS[k] < up) ) {
-                                return;
-                            }
+                        if(wake < t) {
+                            wake = t;
                         }
+                    }
 
-                        makers.emplace_back(key);
+                    if(wake < time) {
+                        time = wake;
+                    }
+                });
+    }
 
-                    });
+    // watcher和maker按各自的速度运动，关系最早可能发生变化的时间，不会变化时返回false
+    // 整数坐标下除法向下取整，得到的时间只会偏早
+    bool CalcKineticCrossTime(const ElementType &watcher, const POS_TYPE watcher_velocity[DIMENSION],
+            const ElementType &maker, const POS_TYPE maker_velocity[DIMENSION], bool related, POS_TYPE &time) {
+        bool found = false;
+
+        for(int i = 0; i < DIMENSION; ++i) {
+            POS_TYPE d = maker.POS[i] - watcher.POS[i];
+            POS_TYPE dv = maker_velocity[i] - watcher_velocity[i];
+            POS_TYPE threshold = watcher.WATCH_RANGE[i] + maker.MAKER_RADIUS[i];
+            POS_TYPE t = POS_ZERO;
+
+            if(related) {
+                // 任意一个维度超出离开区间就会离开
+                threshold += m_hysteresis[i];
+
+                if(POS_ZERO < dv) {
+                    t = (threshold - d) / dv;
+                } else if(dv < POS_ZERO) {
+                    t = (threshold + d) / (POS_ZERO - dv);
+                } else {
+                    continue;
+                }
+
+                if(!found || t < time) {
+                    time = t;
+                    found = true;
+                }
+            } else {
+                // 所有维度都进入区间才会进入，取每个维度进入时间的最大值
+                if(POS_ZERO - threshold < d && d < threshold) {
+                    t = POS_ZERO;
+                } else if(!(d < threshold) && dv < POS_ZERO) {
+                    t = (d - threshold) / (POS_ZERO - dv);
+                } else if(!(POS_ZERO - threshold < d) && POS_ZERO < dv) {
+                    t = (POS_ZERO - threshold - d) / dv;
+                } else {
+                    return false;
+                }
+
+                if(!found || time < t) {
+                    time = t;
+                    found = true;
+                }
+            }
         }
+
+        return found;
     }
 
-    void CalcGetWatchersRelatedToPosHint(const POS_TYPE pos[DIMENSION], GetWatchersRelatedToPosHint &hint) {
-        hint.TARGET_DIMENSION = -1;
-        hint.COMPLEXITY = 0;
-        hint.USE_LOWER = true;
+    // 休眠的maker在索引中的位置和实际位置的最大偏差
+    POS_TYPE DormantSlack(int dim) {
+        return m_dormant_count ? m_max_watch_range[dim] : POS_ZERO;
+    }
+
+    // 休眠的maker锚点附近 2 * max_watch_range + max_maker_radius 内没有watcher，
+    // maker离锚点不超过 max_watch_range 时，任何watcher都看不到它
+    POS_TYPE DormantReach(int dim) {
+        return m_max_watch_range[dim] + m_max_watch_range[dim] + m_max_maker_radius[dim];
+    }
+
+    // 锚点 DormantReach 范围的盒子内没有非静态watcher；
+    // 在lower边界落在区间内数量最少的维度上逐个检查实际位置
+    bool HasWatcherNear(const POS_TYPE pos[DIMENSION]) {
+        if(HasTriggerNear(pos)) {
+            return true;
+        }
+
+        POS_TYPE reach[DIMENSION];
+        int target = 0;
+        unsigned long min_count = 0;
 
         for(int i = 0; i < DIMENSION; ++i) {
-            POS_TYPE lower_begin = pos[i] - m_max_watch_range[i] - m_max_watch_range[i];
-            POS_TYPE lower_end = pos[i];
+            reach[i] = DormantReach(i);
+            unsigned long count = CountWatcherEdges(i, true, pos[i] - reach[i] - m_max_watch_range[i], true, pos[i] + reach[i], true);
 
-            unsigned long count = m_dimensions[i].WATCHER_LOWER_LIST.GetElementsCountByRangedValue(lower_begin, false, lower_end, false);
+            if(count == 0) {
+                return false;
+            }
 
-            if(hint.TARGET_DIMENSION < 0 || count < hint.COMPLEXITY) {
-                hint.TARGET_DIMENSION = i;
-                hint.COMPLEXITY = count;
-                hint.USE_LOWER = true;
+            if(i == 0 || count < min_count) {
+                target = i;
+                min_count = count;
             }
+        }
 
-            POS_TYPE upper_begin = pos[i];
-            POS_TYPE upper_end = pos[i] + m_max_watch_range[i] + m_max_watch_range[i];
+        bool found = false;
 
-            count = m_dimensions[i].WATCHER_UPPER_LIST.GetElementsCountByRangedValue(upper_begin, false, upper_end, false);
+        auto cb = [&found, &reach, pos, this](unsigned long _0, const KEY_TYPE &key, const POS_TYPE &_1) {
+            if(found) {
+                return;
+            }
 
-            if(count < hint.COMPLEXITY) {
-                hint.TARGET_DIMENSION = i;
-                hint.COMPLEXITY = count;
-                hint.USE_LOWER = false;
+            const ElementType &w = this->m_elements[key];
+
+            if(w.STATIC) {
+                return; // 触发器已经按各自的范围检查过
             }
+
+            for(int d = 0; d < DIMENSION; ++d) {
+                if(reach[d] < this->AbsPos(w.POS[d] - pos[d])) {
+                    return;
+                }
+            }
+
+            found = true;
+        };
+
+        GetWatcherEdges(target, true, pos[target] - reach[target] - m_max_watch_range[target], true, pos[target] + reach[target], true, cb);
+
+        return found;
+    }
+
+    void TryDormant(const KEY_TYPE &key, ElementType &element) {
+        if(element.DORMANT || element.STATIC || element.WATCH_TYPE != AOI_WATCH_TYPES::MAKER || element.RELATED_WATCHERS.size()) {
+            return;
+        }
+
+        if(m_kinetics.size() && m_kinetics.count(key)) {
+            return;
+        }
+
+        if(HasWatcherNear(element.POS)) {
+            return;
+        }
+
+        element.DORMANT = true;
+        CopyPos(element.POS, element.ANCHOR);
+        ++m_dormant_count;
+        MarkReplicaElement(key);
+
+        for(int i = 0; i < DIMENSION; ++i) {
+            m_dimensions[i].DORMANT_LIST.Insert(key, element.ANCHOR[i]);
         }
+
+        ExpireKineticNearAnchor(key, element);
     }
 
-    void GetWatchersRelatedToPos(const POS_TYPE pos[DIMENSION], std::vector<KEY_TYPE> &watchers, const KEY_TYPE *excludes_sorted = NULL, size_t excludes_size = 0, const GetWatchersRelatedToPosHint *hint = NULL) {
-        static_assert(DIMENSION > 0, "DIMENSION should > 0");
-        assert(std::is_sorted(excludes_sorted, excludes_sorted + excludes_size));
-        watchers.clear();
+    // 运动watcher的预测没有考虑新的锚点，可能在预测时长内进入唤醒范围的都重新计算
+    void ExpireKineticNearAnchor(const KEY_TYPE &key, const ElementType &element) {
+        POS_TYPE reach[DIMENSION];
 
-        // 找到几个维度里，落在搜索区间数量最少的维度
-        GetWatchersRelatedToPosHint h;
-        if(!hint) {
-            CalcGetWatchersRelatedToPosHint(pos, h);
-            hint = &h;
+        for(int i = 0; i < DIMENSION; ++i) {
+            reach[i] = DormantReach(i) + MaxKineticSpeed(i) * m_kinetic_horizon;
         }
 
-        assert(hint->TARGET_DIMENSION >= 0);
+        ExpireKineticNear(key, element.ANCHOR, reach);
+    }
 
-        {
-            int i = hint->TARGET_DIMENSION;
+    // 把索引恢复到 pos 的位置
+    void WakeDormant(const KEY_TYPE &key, ElementType &element, const POS_TYPE pos[DIMENSION]) {
+        assert(element.DORMANT);
 
-            auto cb = [&watchers, excludes_sorted, excludes_size, this, pos](unsigned long _0, const KEY_TYPE &key, const POS_TYPE &_1) {
-                if(excludes_size && std::binary_search(excludes_sorted, excludes_sorted + excludes_size, key)) {
-                    return;
-                }
+        for(int i = 0; i < DIMENSION; ++i) {
+            UpdateIndex(m_dimensions[i].MAKER_LIST, key, element.ANCHOR[i], pos[i]);
+            m_dimensions[i].DORMANT_LIST.Delete(key, element.ANCHOR[i]);
+        }
 
-                // 检查key能否观察到pos
-                auto iter = this->m_elements.find(key);
-                if(iter == this->m_elements.end()) {
+        element.DORMANT = false;
+        --m_dormant_count;
+        MarkReplicaElement(key);
+    }
+
+    // 返回false表示需要唤醒，按普通maker处理
+    bool MoveDormant(const KEY_TYPE &key, ElementType &element) {
+        bool near_anchor = true;
+
+        for(int i = 0; i < DIMENSION; ++i) {
+            if(m_max_watch_range[i] < AbsPos(element.POS[i] - element.ANCHOR[i])) {
+                near_anchor = false;
+                break;
+            }
+        }
+
+        if(near_anchor) {
+            return true;
+        }
+
+        if(HasWatcherNear(element.POS)) {
+            return false;
+        }
+
+        // 附近仍然没有watcher，换一个锚点
+        for(int i = 0; i < DIMENSION; ++i) {
+            UpdateIndex(m_dimensions[i].MAKER_LIST, key, element.ANCHOR[i], element.POS[i]);
+            UpdateIndex(m_dimensions[i].DORMANT_LIST, key, element.ANCHOR[i], element.POS[i]);
+        }
+
+        CopyPos(element.POS, element.ANCHOR);
+        ExpireKineticNearAnchor(key, element);
+
+        return true;
+    }
+
+    // 触发器范围不受 max_watch_range 限制，锚点和触发器的距离不超过 range + max_maker_radius + max_watch_range 时，
+    // 休眠maker在锚点附近移动就可能进入触发器
+    POS_TYPE TriggerReach(int dim, const POS_TYPE &range) {
+        return range + m_max_maker_radius[dim] + m_max_watch_range[dim];
+    }
+
+    bool HasTriggerNear(const POS_TYPE pos[DIMENSION]) {
+        if(m_triggers.empty()) {
+            return false;
+        }
+
+        POS_TYPE lower[DIMENSION];
+        POS_TYPE upper[DIMENSION];
+
+        for(int i = 0; i < DIMENSION; ++i) {
+            POS_TYPE reach = TriggerReach(i, POS_ZERO);
+            lower[i] = pos[i] - reach;
+            upper[i] = pos[i] + reach;
+        }
+
+        bool found = false;
+
+        auto cb = [&found, this, pos](const KEY_TYPE &k) {
+            if(found) {
+                return;
+            }
+
+            const ElementType &e = this->m_elements[k];
+
+            for(int d = 0; d < DIMENSION; ++d) {
+                if(this->TriggerReach(d, e.WATCH_RANGE[d]) < this->AbsPos(e.POS[d] - pos[d])) {
                     return;
                 }
+            }
 
-                ElementType &e = iter->second;
+            found = true;
+        };
 
-                for(int k = 0; k < DIMENSION; ++k) {
-                    POS_TYPE lower = e.POS[k] - e.WATCH_RANGE[k];
-                    POS_TYPE upper = e.POS[k] + e.WATCH_RANGE[k];
+        GetTriggersNear(lower, upper, cb);
 
-                    if( !(lower < pos[k]) ||  !(pos[k] < upper) ) {
-                        return;
-                    }
-                }
+        return found;
+    }
 
-                watchers.emplace_back(key);
-            };
+    // watcher将要出现在 pos 时，先唤醒附近休眠的maker，之后的计算都使用准确的位置
+    void WakeDormantNear(const POS_TYPE pos[DIMENSION]) {
+        if(!m_dormant_count) {
+            return;
+        }
 
-            if(hint->USE_LOWER) {
-                POS_TYPE lower_begin = pos[i] - m_max_watch_range[i] - m_max_watch_range[i];
-                POS_TYPE lower_end = pos[i];
-                m_dimensions[i].WATCHER_LOWER_LIST.GetElementsByRangedValue(lower_begin, false, lower_end, false, cb);
-            } else {
-                POS_TYPE upper_begin = pos[i];
-                POS_TYPE upper_end = pos[i] + m_max_watch_range[i] + m_max_watch_range[i];
-                m_dimensions[i].WATCHER_UPPER_LIST.GetElementsByRangedValue(upper_begin, false, upper_end, false, cb);
-            }
+        POS_TYPE reach[DIMENSION];
+        for(int i = 0; i < DIMENSION; ++i) {
+            reach[i] = DormantReach(i);
         }
 
+        WakeDormantInBox(pos, reach);
     }
 
-    void BroadcastEventToWatchersByPos(POS_TYPE pos[DIMENSION], const KEY_TYPE &sender, const AOI_EVENT_TYPE &event) {
-        std::vector<KEY_TYPE> watchers;
-        GetWatchersRelatedToPos(pos, watchers);
+    // 唤醒锚点在 pos 附近 reach 以内的休眠maker
+    void WakeDormantInBox(const POS_TYPE pos[DIMENSION], const POS_TYPE reach[DIMENSION]) {
+        if(!m_dormant_count) {
+            return;
+        }
+
+        int target_dimension = -1;
+        unsigned long complexity = 0;
+
+        for(int i = 0; i < DIMENSION; ++i) {
+            unsigned long count = m_dimensions[i].DORMANT_LIST.GetElementsCountByRangedValue(pos[i] - reach[i], true, pos[i] + reach[i], true);
+
+            if(target_dimension < 0 || count < complexity) {
+                target_dimension = i;
+                complexity = count;
+            }
+        }
+
+        if(complexity == 0) {
+            return;
+        }
+
+        std::vector<KEY_TYPE> woken;
+
+        int i = target_dimension;
+        m_dimensions[i].DORMANT_LIST.GetElementsByRangedValue(pos[i] - reach[i], true, pos[i] + reach[i], true,
+                [&woken, this, pos, reach](unsigned long _0, const KEY_TYPE &k, const POS_TYPE &_1) {
+                    auto iter = this->m_elements.find(k);
+
+                    if(iter == this->m_elements.end()) {
+                        return;
+                    }
+
+                    ElementType &e = iter->second;
+
+                    for(int d = 0; d < DIMENSION; ++d) {
+                        if(reach[d] < this->AbsPos(e.ANCHOR[d] - pos[d])) {
+                            return;
+                        }
+                    }
 
-        for(const KEY_TYPE &watcher: watchers) {
-            Callback(watcher, sender, event);
+                    woken.emplace_back(k);
+                });
+
+        for(const KEY_TYPE &k: woken) {
+            ElementType &e = m_elements[k];
+            WakeDormant(k, e, e.POS);
+            TouchKinetic(k, e);
         }
     }
 
-    std::string DumpElements() {
-        std::ostringstream ss;
-
-        ss << "** DUMP ELEMENTS BEGIN\n";
-        for(auto iter = m_elements.begin(); iter != m_elements.end(); ++iter) {
-            ss << "ID=" << iter->first << ": ";
-            const ElementType &element = iter->second;
+    bool TestDormant(const KEY_TYPE &key, const ElementType &e) {
+        if(e.WATCH_TYPE != AOI_WATCH_TYPES::MAKER || e.RELATED_WATCHERS.size() || m_kinetics.count(key)) {
+            return false;
+        }
 
-            ss << "POS=(";
-            for(int i = 0; i < DIMENSION; ++i) {
-                if(i != 0) {
-                    ss << ",";
-                }
+        if(HasTriggerNear(e.ANCHOR)) {
+            return false;
+        }
 
-                ss << element.POS[i];
+        POS_TYPE reach[DIMENSION];
+        for(int i = 0; i < DIMENSION; ++i) {
+            if(m_max_watch_range[i] < AbsPos(e.POS[i] - e.ANCHOR[i])) {
+                return false;
             }
-            ss << ") ";
 
-            if(element.WATCH_TYPE & AOI_WATCH_TYPES::WATCHER) {
-                ss << "<W> ";
-                ss << "WATCH_RANGE=(";
-                for(int i = 0; i < DIMENSION; ++i) {
-                    if(i != 0) {
-                        ss << ",";
-                    }
+            reach[i] = DormantReach(i);
+        }
 
-                    ss << element.WATCH_RANGE[i];
-                }
-                ss << ") ";
+        std::vector<KEY_TYPE> watchers;
+        GetWatchersRelatedToPos(e.ANCHOR, reach, watchers);
 
-                ss << "RELATED_MAKERS=(";
-                for(const KEY_TYPE &key: element.RELATED_MAKERS) {
-                    ss << key << ",";
-                }
-                ss << ") ";
+        for(const KEY_TYPE &watcher: watchers) {
+            const ElementType &w = m_elements[watcher];
+            bool near = true;
+
+            if(w.STATIC) {
+                continue; // 触发器已经按各自的范围检查过
             }
 
-            if(element.WATCH_TYPE & AOI_WATCH_TYPES::MAKER) {
-                ss << "<M> ";
-                ss << "RELATED_WATCHERS=(";
-                for(const KEY_TYPE &key: element.RELATED_WATCHERS) {
-                    ss << key << ",";
+            for(int i = 0; i < DIMENSION; ++i) {
+                if(reach[i] < AbsPos(w.POS[i] - e.ANCHOR[i])) {
+                    near = false;
                 }
-                ss << ") ";
             }
 
-            ss << "\n";
+            if(near) {
+                return false;
+            }
         }
-        ss << "** DUMP ELEMENTS END";
 
-        return ss.str();
+        return true;
     }
 
-    std::string DumpSlist() {
-        std::ostringstream ss;
-        ss << "** DUMP SLIST BEGIN\n";
-        for(int i = 0; i < DIMENSION; ++i) {
-            ss << "*** DUMP dimension #" << i << " WATCHER_LOWER_LIST BEGIN\n";
-            ss << m_dimensions[i].WATCHER_LOWER_LIST.DumpLevels() << "\n";
-            ss << "*** DUMP dimension #" << i << " WATCHER_LOWER_LIST END\n";
+    bool IsRelated(const KEY_TYPE &watcher, const KEY_TYPE &maker) {
+        return m_edges.Find(watcher, maker) != EDGE_TABLE::NIL;
+    }
 
-            ss << "*** DUMP dimension #" << i << " WATCHER_UPPER_LIST BEGIN\n";
-            ss << m_dimensions[i].WATCHER_UPPER_LIST.DumpLevels() << "\n";
-            ss << "*** DUMP dimension #" << i << " WATCHER_UPPER_LIST END\n";
+    // 一次修改两端的链表
+    void LinkRelation(const KEY_TYPE &watcher, ElementType &watcher_element, const KEY_TYPE &maker, ElementType &maker_element) {
+        m_edges.Link(watcher, watcher_element.RELATED_MAKERS, maker, maker_element.RELATED_WATCHERS);
 
-            ss << "*** DUMP dimension #" << i << " MAKER_LIST BEGIN\n";
-            ss << m_dimensions[i].MAKER_LIST.DumpLevels() << "\n";
-            ss << "*** DUMP dimension #" << i << " MAKER_LIST END\n";
+        if(watcher_element.VISIBLE_LIMIT) {
+            ++maker_element.RANKED_WATCHERS;
+        }
+
+        if(m_replication) {
+            m_replica_edges.emplace(watcher, maker);
         }
-        ss << "** DUMP SLIST END";
-        return ss.str();
     }
 
-    bool TestSelf() {
-        for(auto iter = m_elements.begin(); iter != m_elements.end(); ++iter) {
-            const KEY_TYPE &key = iter->first;
-            const ElementType &e = iter->second;
+    void UnlinkRelation(const KEY_TYPE &watcher, ElementType &watcher_element, const KEY_TYPE &maker, ElementType &maker_element) {
+        m_edges.Unlink(watcher, watcher_element.RELATED_MAKERS, maker, maker_element.RELATED_WATCHERS);
 
-            if(e.WATCH_TYPE & AOI_WATCH_TYPES::WATCHER) {
-                std::vector<KEY_TYPE> makerlist;
-                GetMakersInRange(e.POS, e.WATCH_RANGE, makerlist, &key, 1);
+        if(watcher_element.VISIBLE_LIMIT) {
+            --maker_element.RANKED_WATCHERS;
+        }
 
-                std::vector<KEY_TYPE> stored_makerlist(e.RELATED_MAKERS.begin(), e.RELATED_MAKERS.end());
+        if(m_replication) {
+            m_replica_edges.emplace(watcher, maker);
+        }
+    }
 
-                std::sort(makerlist.begin(), makerlist.end());
-                std::sort(stored_makerlist.begin(), stored_makerlist.end());
+    // 开启或者取消可见数量限制时，同时修改相关maker上的计数
+    void SetElementVisibleLimit(ElementType &element, unsigned limit) {
+        if(!element.VISIBLE_LIMIT != !limit) {
+            for(const KEY_TYPE &maker: element.RELATED_MAKERS) {
+                auto iter = m_elements.find(maker);
 
-                if(makerlist.size() != stored_makerlist.size()) {
-                    return false;
+                if(iter == m_elements.end()) {
+                    continue;
                 }
 
-                if(!std::equal(makerlist.begin(), makerlist.end(), stored_makerlist.begin())) {
-                    return false;
+                if(limit) {
+                    ++iter->second.RANKED_WATCHERS;
+                } else {
+                    --iter->second.RANKED_WATCHERS;
                 }
             }
+        }
 
-            if(e.WATCH_TYPE & AOI_WATCH_TYPES::MAKER) {
-                std::vector<KEY_TYPE> watcherlist;
-                GetWatchersRelatedToPos(e.POS, watcherlist, &key, 1);
+        element.VISIBLE_LIMIT = limit;
+    }
 
-                std::vector<KEY_TYPE> stored_watcherlist(e.RELATED_WATCHERS.begin(), e.RELATED_WATCHERS.end());
+    // 只修改索引，不查询关系，也不产生事件
+    void InsertWatcherIndex(const KEY_TYPE &key, ElementType &element) {
+        if(element.STATIC) {
+            m_triggers.insert(key);
+            m_trigger_dirty = true;
+        } else {
+            for(int i = 0; i < DIMENSION; ++i) {
+                InsertWatcherEdges(i, key, element.POS[i], element.WATCH_RANGE[i]);
+            }
+        }
+    }
 
-                std::sort(watcherlist.begin(), watcherlist.end());
-                std::sort(stored_watcherlist.begin(), stored_watcherlist.end());
+    void RemoveWatcherIndex(const KEY_TYPE &key, ElementType &element) {
+        if(element.STATIC) {
+            m_triggers.erase(key);
+            m_trigger_dirty = true;
+        } else {
+            for(int i = 0; i < DIMENSION; ++i) {
+                RemoveWatcherEdges(i, key, element.POS[i], element.WATCH_RANGE[i]);
+            }
+        }
+    }
 
-                if(watcherlist.size() != stored_watcherlist.size()) {
-                    return false;
-                }
+    // 休眠的maker在 MAKER_LIST 中的位置是锚点
+    void InsertMakerIndex(const KEY_TYPE &key, ElementType &element) {
+        if(element.STATIC) {
+            // 同一个key离开后还没重建就再次加入，先重建，避免新加入的也被去掉
+            if(m_static_removed.count(key)) {
+                BuildStaticIndex();
+            }
 
-                if(!std::equal(watcherlist.begin(), watcherlist.end(), stored_watcherlist.begin())) {
-                    return false;
-                }
+            for(int i = 0; i < DIMENSION; ++i) {
+                m_dimensions[i].STATIC_LIST.emplace_back(element.POS[i], key);
+            }
+
+            ++m_static_count;
+        } else {
+            for(int i = 0; i < DIMENSION; ++i) {
+                m_dimensions[i].MAKER_LIST.Insert(key, element.DORMANT ? element.ANCHOR[i] : element.POS[i]);
             }
         }
 
-        return true;
-    }
+        if(element.DORMANT) {
+            for(int i = 0; i < DIMENSION; ++i) {
+                m_dimensions[i].DORMANT_LIST.Insert(key, element.ANCHOR[i]);
+            }
 
-private:
-    void Callback(const KEY_TYPE &receiver, const KEY_TYPE &sender, const AOI_EVENT_TYPE &event) {
-        if(m_eventcb) {
-            m_eventcb(m_id, receiver, sender, event);
+            ++m_dormant_count;
         }
-    }
 
-    void CopyPos(const POS_TYPE src[DIMENSION], POS_TYPE dst[DIMENSION]) {
-        std::copy(src, src + DIMENSION, dst);
+        ++m_maker_count;
     }
 
-    bool IsSamePos(const POS_TYPE x[DIMENSION], const POS_TYPE y[DIMENSION]) {
-        return std::equal(x, x + DIMENSION, y);
-    }
+    void RemoveMakerIndex(const KEY_TYPE &key, ElementType &element) {
+        if(element.STATIC) {
+            m_static_removed.insert(key);
 
-    bool IsZeroPos(const POS_TYPE x[DIMENSION]) {
-        for(int i = 0; i < DIMENSION; ++i) {
-            if(!(x[i] == POS_ZERO)) {
-                return false;
+            // 全部离开时直接清空
+            if(--m_static_count == 0) {
+                for(int i = 0; i < DIMENSION; ++i) {
+                    m_dimensions[i].STATIC_LIST.clear();
+                }
+
+                m_static_sorted = 0;
+                m_static_removed.clear();
+            }
+        } else {
+            for(int i = 0; i < DIMENSION; ++i) {
+                m_dimensions[i].MAKER_LIST.Delete(key, element.DORMANT ? element.ANCHOR[i] : element.POS[i]);
             }
         }
-        return true;
-    }
 
-    void TrimWatchRange(POS_TYPE watch_range[DIMENSION]) {
-        for(int i = 0; i < DIMENSION; ++i) {
-            if(watch_range[i] < POS_ZERO) {
-                watch_range[i] = POS_ZERO;
-            } else if(m_max_watch_range[i] < watch_range[i]) {
-                watch_range[i] = m_max_watch_range[i];
+        if(element.DORMANT) {
+            for(int i = 0; i < DIMENSION; ++i) {
+                m_dimensions[i].DORMANT_LIST.Delete(key, element.ANCHOR[i]);
             }
+
+            --m_dormant_count;
         }
+
+        --m_maker_count;
     }
 
     void InsertWatcher(const KEY_TYPE &key, ElementType &element) {
-        for(int i = 0; i < DIMENSION; ++i) {
-            POS_TYPE lower = element.POS[i] - element.WATCH_RANGE[i];
-            POS_TYPE upper = element.POS[i] + element.WATCH_RANGE[i];
-
-            m_dimensions[i].WATCHER_LOWER_LIST.Insert(key, lower);
-            m_dimensions[i].WATCHER_UPPER_LIST.Insert(key, upper);
-        }
+        InsertWatcherIndex(key, element);
 
         std::vector<KEY_TYPE> makers;
 
@@ -692,9 +5778,17 @@ private:
             }
 
             ElementType &maker_element = iter->second;
-            maker_element.RELATED_WATCHERS.insert(key);
+            LinkRelation(key, element, maker, maker_element);
+        }
 
-            element.RELATED_MAKERS.insert(maker);
+        if(element.VISIBLE_LIMIT) {
+            // 有数量限制，只通知排名靠前的maker
+            VisibleRankType &rank = m_visible_ranks[key];
+            rank.LIMIT = element.VISIBLE_LIMIT;
+
+            std::vector<KEY_TYPE> old_visible;
+            ResyncVisible(key, element, rank, old_visible);
+            return;
         }
 
         if(makers.size()) {
@@ -719,13 +5813,11 @@ private:
     }
 
     void InsertMaker(const KEY_TYPE &key, ElementType &element) {
-        for(int i = 0; i < DIMENSION; ++i) {
-            m_dimensions[i].MAKER_LIST.Insert(key, element.POS[i]);
-        }
+        InsertMakerIndex(key, element);
 
         std::vector<KEY_TYPE> watchers;
 
-        GetWatchersRelatedToPos(element.POS, watchers, &key, 1); // 排除自己，不被自己观察
+        GetWatchersRelatedToPos(element.POS, element.MAKER_RADIUS, watchers, &key, 1); // 排除自己，不被自己观察
 
         for(const KEY_TYPE &watcher: watchers) {
             auto iter = m_elements.find(watcher);
@@ -735,9 +5827,7 @@ private:
             }
 
             ElementType &watcher_element = iter->second;
-            watcher_element.RELATED_MAKERS.insert(key);
-
-            element.RELATED_WATCHERS.insert(watcher);
+            LinkRelation(watcher, watcher_element, key, element);
         }
 
         if(watchers.size()) {
@@ -747,34 +5837,46 @@ private:
 
             for(const KEY_TYPE &watcher: watchers) {
                 // 通知周围的watcher,本maker已进入
-                Callback(watcher, key, event);
+                NotifyWatcher(watcher, key, event);
             }
         }
     }
 
-    void UpdateWatcher(const KEY_TYPE &key, ElementType &element, const ElementType &old_element, const GetMakersInRangeHint *hint = NULL) {
+    void UpdateWatcher(const KEY_TYPE &key, ElementType &element, const ElementShapeType &old_element, const GetMakersInRangeHint *hint = NULL) {
         for(int i = 0; i < DIMENSION; ++i) {
-            POS_TYPE lower = element.POS[i] - element.WATCH_RANGE[i];
-            POS_TYPE upper = element.POS[i] + element.WATCH_RANGE[i];
-
-            POS_TYPE old_lower = old_element.POS[i] - old_element.WATCH_RANGE[i];
-            POS_TYPE old_upper = old_element.POS[i] + old_element.WATCH_RANGE[i];
-
-            m_dimensions[i].WATCHER_LOWER_LIST.Update(key, old_lower, lower);
-            m_dimensions[i].WATCHER_UPPER_LIST.Update(key, old_upper, upper);
+            UpdateWatcherEdges(i, key, old_element.POS[i], old_element.WATCH_RANGE[i], element.POS[i], element.WATCH_RANGE[i]);
         }
 
-        std::vector<KEY_TYPE> new_makers;
+        ScratchKeys new_makers(this);
 
         GetMakersInRange(element.POS, element.WATCH_RANGE, new_makers, &key, 1, hint); // 排除自己，不观察自己
+
+        ApplyWatcherMakers(key, element, new_makers);
+    }
+
+    // new_makers 是范围内的所有maker，和原来的关系比较，发送进入、离开的事件
+    void ApplyWatcherMakers(const KEY_TYPE &key, ElementType &element, ScratchKeys &new_makers) {
+        // 处于滞后区间内的maker保持原来的关系
+        if(!IsZeroPos(m_hysteresis)) {
+            for(const KEY_TYPE &maker: element.RELATED_MAKERS) {
+                auto iter = m_elements.find(maker);
+
+                if(iter != m_elements.end() && CanKeepWatching(element.POS, element.WATCH_RANGE, iter->second.POS, iter->second.MAKER_RADIUS)) {
+                    new_makers.emplace_back(maker);
+                }
+            }
+        }
+
         std::sort(new_makers.begin(), new_makers.end());
+        new_makers.erase(std::unique(new_makers.begin(), new_makers.end()), new_makers.end());
 
         
-        std::vector<KEY_TYPE> leave_makers;
-        std::vector<KEY_TYPE> keep_makers;
-        std::vector<KEY_TYPE> enter_makers;
+        ScratchKeys leave_makers(this);
+        ScratchKeys keep_makers(this);
+        ScratchKeys enter_makers(this);
 
-        std::vector<KEY_TYPE> old_makers(old_element.RELATED_MAKERS.begin(), old_element.RELATED_MAKERS.end());
+        ScratchKeys old_makers(this);
+        old_makers.assign(element.RELATED_MAKERS.begin(), element.RELATED_MAKERS.end());
         std::sort(old_makers.begin(), old_makers.end());
 
         // new_makers和old_makers都是有序的
@@ -782,8 +5884,6 @@ private:
         DiffSortedKeylist(leave_makers, keep_makers, enter_makers, old_makers, new_makers);
 
         for(const KEY_TYPE &maker: leave_makers) {
-            element.RELATED_MAKERS.erase(maker);
-
             auto iter = m_elements.find(maker);
 
             if(iter == m_elements.end()) {
@@ -792,12 +5892,10 @@ private:
 
             ElementType &maker_element = iter->second;
 
-            maker_element.RELATED_WATCHERS.erase(key);
+            UnlinkRelation(key, element, maker, maker_element);
         }
 
         for(const KEY_TYPE &maker: enter_makers) {
-            element.RELATED_MAKERS.insert(maker);
-
             auto iter = m_elements.find(maker);
 
             if(iter == m_elements.end()) {
@@ -806,7 +5904,11 @@ private:
 
             ElementType &maker_element = iter->second;
 
-            maker_element.RELATED_WATCHERS.insert(key);
+            LinkRelation(key, element, maker, maker_element);
+        }
+
+        if(ResyncVisibleIfLimited(key, element, leave_makers, enter_makers)) {
+            return;
         }
 
         if(leave_makers.size() || enter_makers.size()) {
@@ -844,35 +5946,49 @@ private:
         }
     }
 
-    void UpdateMaker(const KEY_TYPE &key, ElementType &element, const ElementType &old_element, const GetWatchersRelatedToPosHint *hint = NULL) {
+    void UpdateMaker(const KEY_TYPE &key, ElementType &element, const ElementShapeType &old_element, const GetWatchersRelatedToPosHint *hint = NULL) {
         for(int i = 0; i < DIMENSION; ++i) {
-            m_dimensions[i].MAKER_LIST.Update(key, old_element.POS[i], element.POS[i]);
+            UpdateIndex(m_dimensions[i].MAKER_LIST, key, old_element.POS[i], element.POS[i]);
         }
 
-        std::vector<KEY_TYPE> new_watchers;
+        ScratchKeys new_watchers(this);
+
+        GetWatchersRelatedToPos(element.POS, element.MAKER_RADIUS, new_watchers, &key, 1, hint); // 排除自己，不被自己观察
+
+        // 处于滞后区间内的watcher保持原来的关系
+        if(!IsZeroPos(m_hysteresis)) {
+            for(const KEY_TYPE &watcher: element.RELATED_WATCHERS) {
+                auto iter = m_elements.find(watcher);
+
+                if(iter != m_elements.end() && CanKeepWatching(iter->second.POS, iter->second.WATCH_RANGE, element.POS, element.MAKER_RADIUS)) {
+                    new_watchers.emplace_back(watcher);
+                }
+            }
+        }
 
-        GetWatchersRelatedToPos(element.POS, new_watchers, &key, 1, hint); // 排除自己，不被自己观察
         std::sort(new_watchers.begin(), new_watchers.end());
+        new_watchers.erase(std::unique(new_watchers.begin(), new_watchers.end()), new_watchers.end());
 
-        std::vector<KEY_TYPE> leave_watchers;
-        std::vector<KEY_TYPE> keep_watchers;
-        std::vector<KEY_TYPE> enter_watchers;
+        ScratchKeys leave_watchers(this);
+        ScratchKeys keep_watchers(this);
+        ScratchKeys enter_watchers(this);
 
-        std::vector<KEY_TYPE> old_watchers(old_element.RELATED_WATCHERS.begin(), old_element.RELATED_WATCHERS.end());
+        ScratchKeys old_watchers(this);
+        old_watchers.assign(element.RELATED_WATCHERS.begin(), element.RELATED_WATCHERS.end());
         std::sort(old_watchers.begin(), old_watchers.end());
 
         // 这里 old_watchers 和 new_watchers 都是有序的，不需要再排序
         // 如果改动了代码，导致无序，那么需要在这里进行排序
 
-        if(NOTIFY_MOVE_EVENT) {
+        // 有可见数量限制的watcher需要知道范围内maker的移动，重新排名
+        // 只改变可见半径时不算移动
+        if((NOTIFY_MOVE_EVENT || element.RANKED_WATCHERS) && !IsSamePos(element.POS, old_element.POS)) {
             DiffSortedKeylist(leave_watchers, keep_watchers, enter_watchers, old_watchers, new_watchers);
         } else {
             DiffSortedKeylist2(leave_watchers, enter_watchers, old_watchers, new_watchers);
         }
 
         for(const KEY_TYPE &watcher: leave_watchers) {
-            element.RELATED_WATCHERS.erase(watcher);
-
             auto iter = m_elements.find(watcher);
 
             if(iter == m_elements.end()) {
@@ -881,12 +5997,10 @@ private:
 
             ElementType &watcher_element = iter->second;
 
-            watcher_element.RELATED_MAKERS.erase(key);
+            UnlinkRelation(watcher, watcher_element, key, element);
         }
 
         for(const KEY_TYPE &watcher: enter_watchers) {
-            element.RELATED_WATCHERS.insert(watcher);
-
             auto iter = m_elements.find(watcher);
 
             if(iter == m_elements.end()) {
@@ -895,10 +6009,10 @@ private:
 
             ElementType &watcher_element = iter->second;
 
-            watcher_element.RELATED_MAKERS.insert(key);
+            LinkRelation(watcher, watcher_element, key, element);
         }
 
-        if(leave_watchers.size() || (NOTIFY_MOVE_EVENT && keep_watchers.size()) || enter_watchers.size()) {
+        if(leave_watchers.size() || keep_watchers.size() || enter_watchers.size()) {
             AOI_EVENT_TYPE event;
 
             CopyPos(element.POS, event.POS);
@@ -907,353 +6021,488 @@ private:
             event.EVENT_ID = AOI_EVENT_IDS::LEAVE;
             for(const KEY_TYPE &watcher: leave_watchers) {
                 // 通知watcher，本maker已离开
-                Callback(watcher, key, event);
+                NotifyWatcher(watcher, key, event);
             }
 
-            if(NOTIFY_MOVE_EVENT) {
-                event.EVENT_ID = AOI_EVENT_IDS::MOVE;
-                for(const KEY_TYPE &watcher: keep_watchers) {
-                    // 通知watcher移动信息
-                    Callback(watcher, key, event);
-                }
+            event.EVENT_ID = AOI_EVENT_IDS::MOVE;
+            for(const KEY_TYPE &watcher: keep_watchers) {
+                // 通知watcher移动信息
+                NotifyWatcher(watcher, key, event);
             }
 
             event.EVENT_ID = AOI_EVENT_IDS::ENTER;
             for(const KEY_TYPE &watcher: enter_watchers) {
                 // 通知watcher，本maker已进入
-                Callback(watcher, key, event);
+                NotifyWatcher(watcher, key, event);
             }
         }
     }
 
     void RemoveWatcher(const KEY_TYPE &key, ElementType &element) {
-        for(int i = 0; i < DIMENSION; ++i) {
-            POS_TYPE lower = element.POS[i] - element.WATCH_RANGE[i];
-            POS_TYPE upper = element.POS[i] + element.WATCH_RANGE[i];
+        RemoveWatcherIndex(key, element);
 
-            m_dimensions[i].WATCHER_LOWER_LIST.Delete(key, lower);
-            m_dimensions[i].WATCHER_UPPER_LIST.Delete(key, upper);
+        // 沿着自己的链表摘除所有的边
+        while(element.RELATED_MAKERS.size()) {
+            KEY_TYPE maker = *element.RELATED_MAKERS.begin();
+            UnlinkRelation(key, element, maker, m_elements[maker]);
         }
 
-        for(const KEY_TYPE &maker: element.RELATED_MAKERS) {
-            auto iter = m_elements.find(maker);
+        m_visible_ranks.erase(key);
+        MarkReplicaRank(key);
 
-            if(iter == m_elements.end()) {
+        // 移除watcher不产生任何事件
+    }
+
+    void RemoveMaker(const KEY_TYPE &key, ElementType &element) {
+        RemoveMakerIndex(key, element);
+
+        if(element.RELATED_WATCHERS.size()) {
+            AOI_EVENT_TYPE event;
+            event.EVENT_ID = AOI_EVENT_IDS::LEAVE;
+            CopyPos(element.POS, event.POS);
+
+            std::vector<KEY_TYPE> watchers;
+            watchers.reserve(element.RELATED_WATCHERS.size());
+
+            // 沿着自己的链表摘除所有的边
+            while(element.RELATED_WATCHERS.size()) {
+                KEY_TYPE watcher = *element.RELATED_WATCHERS.begin();
+                watchers.emplace_back(watcher);
+                UnlinkRelation(watcher, m_elements[watcher], key, element);
+            }
+
+            for(const KEY_TYPE &watcher: watchers) {
+                // 通知周围的watcher，本maker已离开
+                NotifyWatcher(watcher, key, event);
+            }
+        }
+    }
+
+    // MoveViewGroup 中watcher一侧的处理，所有成员已经移动到新的位置
+    // 先按同一时刻的状态算出每个成员看到的maker，之后再逐个应用，应用时的回调不会影响其他成员的计算
+    void MoveViewGroupWatchers(std::vector<ViewMemberType> &members) {
+        size_t watchers = 0;
+
+        // 并集和交集的边界，交集的边界由各成员边界取最大、最小得到，按单个成员判断的结果和分别判断完全一致
+        POS_TYPE union_lower[DIMENSION];
+        POS_TYPE union_upper[DIMENSION];
+        POS_TYPE core_lower[DIMENSION];
+        POS_TYPE core_upper[DIMENSION];
+        POS_TYPE max_range[DIMENSION];
+
+        for(ViewMemberType &member: members) {
+            auto iter = member.DONE ? m_elements.end() : m_elements.find(member.KEY);
+
+            if(iter == m_elements.end() || !(iter->second.WATCH_TYPE & AOI_WATCH_TYPES::WATCHER)) {
                 continue;
             }
 
-            ElementType &maker_element = iter->second;
+            const ElementType &element = iter->second;
+
+            for(int i = 0; i < DIMENSION; ++i) {
+                POS_TYPE lower = element.POS[i] - element.WATCH_RANGE[i];
+                POS_TYPE upper = element.POS[i] + element.WATCH_RANGE[i];
 
-            maker_element.RELATED_WATCHERS.erase(key);
+                if(!watchers) {
+                    union_lower[i] = core_lower[i] = lower;
+                    union_upper[i] = core_upper[i] = upper;
+                    max_range[i] = element.WATCH_RANGE[i];
+                } else {
+                    union_lower[i] = std::min(union_lower[i], lower);
+                    union_upper[i] = std::max(union_upper[i], upper);
+                    core_lower[i] = std::max(core_lower[i], lower);
+                    core_upper[i] = std::min(core_upper[i], upper);
+                    max_range[i] = std::max(max_range[i], element.WATCH_RANGE[i]);
+                }
+            }
+
+            ++watchers;
         }
 
-        element.RELATED_MAKERS.clear();
+        // 并集超过最大的观察范围的两倍时，成员不在一起，共享查询得不到好处
+        bool together = watchers > 1;
 
-        // 移除watcher不产生任何事件
-    }
+        for(int i = 0; i < DIMENSION && together; ++i) {
+            together = !(max_range[i] + max_range[i] + max_range[i] + max_range[i] < union_upper[i] - union_lower[i]);
+        }
+
+        if(!together) {
+            for(ViewMemberType &member: members) {
+                auto iter = member.DONE ? m_elements.end() : m_elements.find(member.KEY);
+
+                if(iter != m_elements.end() && (iter->second.WATCH_TYPE & AOI_WATCH_TYPES::WATCHER)) {
+                    MoveWatcher(member.KEY, iter->second, member.OLD);
+                }
+            }
+
+            return;
+        }
+
+        // 选候选最少的维度遍历，休眠的maker在索引中的位置可能有偏差，按实际位置筛选
+        int target = 0;
+        unsigned long target_count = 0;
 
-    void RemoveMaker(const KEY_TYPE &key, ElementType &element) {
         for(int i = 0; i < DIMENSION; ++i) {
-            m_dimensions[i].MAKER_LIST.Delete(key, element.POS[i]);
+            unsigned long count = CountMakers(i, union_lower[i] - m_max_maker_radius[i] - DormantSlack(i), false,
+                    union_upper[i] + m_max_maker_radius[i] + DormantSlack(i), false);
+
+            if(i == 0 || count < target_count) {
+                target = i;
+                target_count = count;
+            }
+        }
+
+        // 指针只在下面没有回调的计算阶段使用
+        std::vector<std::pair<KEY_TYPE, const ElementType *>> candidates;
+        unsigned long scanned = 0;
+
+        GetMakers(target, union_lower[target] - m_max_maker_radius[target] - DormantSlack(target), false,
+                union_upper[target] + m_max_maker_radius[target] + DormantSlack(target), false,
+                [this, &candidates, &scanned, &union_lower, &union_upper](unsigned long _0, const KEY_TYPE &key, const POS_TYPE &_1) {
+                    auto iter = this->m_elements.find(key);
+
+                    if(iter == this->m_elements.end()) {
+                        return;
+                    }
+
+                    const ElementType &e = iter->second;
+                    bool inside = true;
+
+                    for(int i = 0; i < DIMENSION; ++i) {
+                        inside &= (union_lower[i] - e.MAKER_RADIUS[i] < e.POS[i]) & (e.POS[i] < union_upper[i] + e.MAKER_RADIUS[i]);
+                    }
+
+                    ++scanned;
+
+                    if(inside) {
+                        candidates.emplace_back(iter->first, &e);
+                    }
+                });
+
+        // 交集内的候选排在前面，对所有成员都可见
+        auto core_end = std::partition(candidates.begin(), candidates.end(),
+                [&core_lower, &core_upper](const std::pair<KEY_TYPE, const ElementType *> &candidate) {
+                    const ElementType &e = *candidate.second;
+                    bool inside = true;
+
+                    for(int i = 0; i < DIMENSION; ++i) {
+                        inside &= (core_lower[i] - e.MAKER_RADIUS[i] < e.POS[i]) & (e.POS[i] < core_upper[i] + e.MAKER_RADIUS[i]);
+                    }
+
+                    return inside;
+                });
+
+        if(ENABLE_STATS) {
+            ++m_stats.QUERIES;
+            m_stats.QUERY_SCANNED += scanned;
+            m_stats.QUERY_ACCEPTED += candidates.size();
+            m_stats.VIEW_GROUP_MEMBERS += watchers;
+            m_stats.VIEW_GROUP_EDGE_CHECKS += watchers * (candidates.end() - core_end);
         }
 
-        for(const KEY_TYPE &watcher: element.RELATED_WATCHERS) {
-            auto iter = m_elements.find(watcher);
+        // 每个成员看到的maker依次存放，第 j 个成员的在 [ends[j - 1], ends[j]) 中
+        std::vector<KEY_TYPE> view_makers;
+        std::vector<size_t> ends(members.size(), 0);
+        std::vector<bool> shared(members.size(), false);
+
+        for(size_t j = 0; j < members.size(); ++j) {
+            ViewMemberType &member = members[j];
+            auto iter = member.DONE ? m_elements.end() : m_elements.find(member.KEY);
+
+            if(iter != m_elements.end() && (iter->second.WATCH_TYPE & AOI_WATCH_TYPES::WATCHER)) {
+                ElementType &element = iter->second;
+                shared[j] = true;
+
+                for(int i = 0; i < DIMENSION; ++i) {
+                    UpdateWatcherEdges(i, member.KEY, member.OLD.POS[i], member.OLD.WATCH_RANGE[i], element.POS[i], element.WATCH_RANGE[i]);
+                }
+
+                element.WATCHER_HINT.VALID = false;
+
+                for(auto citer = candidates.begin(); citer != core_end; ++citer) {
+                    if(citer->second != &element) {
+                        view_makers.emplace_back(citer->first);
+                    }
+                }
+
+                for(auto citer = core_end; citer != candidates.end(); ++citer) {
+                    if(citer->second != &element && CanWatch(element.POS, element.WATCH_RANGE, citer->second->POS, citer->second->MAKER_RADIUS)) {
+                        view_makers.emplace_back(citer->first);
+                    }
+                }
+            }
+
+            ends[j] = view_makers.size();
+        }
 
-            if(iter == m_elements.end()) {
+        // 应用时产生事件，回调中可能移除了后面的成员
+        for(size_t j = 0; j < members.size(); ++j) {
+            if(!shared[j]) {
                 continue;
             }
 
-            ElementType &watcher_element = iter->second;
-
-            watcher_element.RELATED_MAKERS.erase(key);
-        }
+            auto iter = m_elements.find(members[j].KEY);
 
-        if(element.RELATED_WATCHERS.size()) {
-            AOI_EVENT_TYPE event;
-            event.EVENT_ID = AOI_EVENT_IDS::LEAVE;
-            CopyPos(element.POS, event.POS);
+            if(iter == m_elements.end() || !(iter->second.WATCH_TYPE & AOI_WATCH_TYPES::WATCHER)) {
+                continue;
+            }
 
-            std::vector<KEY_TYPE> watchers(element.RELATED_WATCHERS.begin(), element.RELATED_WATCHERS.end());
-            element.RELATED_WATCHERS.clear();
+            ScratchKeys new_makers(this);
+            new_makers.assign(view_makers.begin() + (j ? ends[j - 1] : 0), view_makers.begin() + ends[j]);
 
-            for(const KEY_TYPE &watcher: watchers) {
-                // 通知周围的watcher，本maker已离开
-                Callback(watcher, key, event);
-            }
+            ApplyWatcherMakers(members[j].KEY, iter->second, new_makers);
         }
     }
 
-    void CalcMoveWatcherHint(ElementType &element, const ElementType &old_element, MoveWatcherHint &hint) {
+    // 同时计算增量处理和重新查询的代价
+    // 每个维度上边缘区域的数量需要准确计算；整个区间的数量只用于估算代价和选择维度，
+    // 优先从上次的缓存推算：新区间 = 旧区间 + 进入的边缘 - 离开的边缘
+    void CalcMoveWatcherHint(ElementType &element, const ElementShapeType &old_element, MoveWatcherHint &hint, GetMakersInRangeHint &update_hint) {
         static_assert(DIMENSION > 0, "DIMENSION should > 0");
 
-        // 不同维度各自计算，最后相加
-        hint.COMPLEXITY = 0;
+        // 离开的maker：在旧区间内、不在新区间内；进入的maker相反
+        // 可以在某个维度上遍历整个区间再筛选，也可以在每个维度上只遍历区间变化的边缘部分
+        // 移动时边缘只在一侧，范围缩小时两侧都会有，范围扩大时同理
+        unsigned long leave_edge[DIMENSION];
+        unsigned long enter_edge[DIMENSION];
+        unsigned long leave_edge_complexity = 0;
+        unsigned long enter_edge_complexity = 0;
 
-        for(int d = 0; d < DIMENSION; ++d) {
-            
-            // LEAVE
-            int leave_dimension = -1;
-            unsigned long leave_complixity = 0;
-            for(int i = 0; i < DIMENSION; ++i) {
-                if(i == d) {
-                    if(old_element.POS[i] < element.POS[i]) {
-                        POS_TYPE old_edge = old_element.POS[i] - old_element.WATCH_RANGE[i];
-                        POS_TYPE new_edge = element.POS[i] - element.WATCH_RANGE[i];
+        for(int i = 0; i < DIMENSION; ++i) {
+            POS_TYPE lower = element.POS[i] - element.WATCH_RANGE[i];
+            POS_TYPE upper = element.POS[i] + element.WATCH_RANGE[i];
 
-                        // old_edge should <= new_edge
+            POS_TYPE old_lower = old_element.POS[i] - old_element.WATCH_RANGE[i];
+            POS_TYPE old_upper = old_element.POS[i] + old_element.WATCH_RANGE[i];
 
-                        unsigned long count = m_dimensions[i].MAKER_LIST.GetElementsCountByRangedValue(old_edge, false, new_edge, true);
+            // LEAVE，离开按照加上滞后距离的区间计算
+            POS_TYPE leave_lower = lower - m_hysteresis[i];
+            POS_TYPE leave_upper = upper + m_hysteresis[i];
+            POS_TYPE old_leave_lower = old_lower - m_hysteresis[i];
+            POS_TYPE old_leave_upper = old_upper + m_hysteresis[i];
 
-                        if(leave_dimension < 0 || count < leave_complixity) {
-                            leave_dimension = i;
-                            leave_complixity = count;
-                        }
+            leave_edge[i] = 0;
 
-                    } else {
-                        POS_TYPE old_edge = old_element.POS[i] + old_element.WATCH_RANGE[i];
-                        POS_TYPE new_edge = element.POS[i] + element.WATCH_RANGE[i];
+            if(old_leave_lower < leave_lower) {
+                leave_edge[i] += CountMakers(i, old_leave_lower - m_max_maker_radius[i], false, leave_lower, true);
+            }
 
-                        // new_edge should <= old_edge
-                        unsigned long count = m_dimensions[i].MAKER_LIST.GetElementsCountByRangedValue(new_edge, true, old_edge, false);
+            if(leave_upper < old_leave_upper) {
+                leave_edge[i] += CountMakers(i, leave_upper, true, old_leave_upper + m_max_maker_radius[i], false);
+            }
 
-                        if(leave_dimension < 0 || count < leave_complixity) {
-                            leave_dimension = i;
-                            leave_complixity = count;
-                        }
-                    }
-                } else {
-                    POS_TYPE lower = old_element.POS[i] - old_element.WATCH_RANGE[i];
-                    POS_TYPE upper = old_element.POS[i] + old_element.WATCH_RANGE[i];
-                    unsigned long count = m_dimensions[i].MAKER_LIST.GetElementsCountByRangedValue(lower, false, upper, false);
+            // ENTER
+            enter_edge[i] = 0;
 
-                    if(leave_dimension < 0 || count < leave_complixity) {
-                        leave_dimension = i;
-                        leave_complixity = count;
-                    }
-                }
+            if(lower < old_lower) {
+                enter_edge[i] += CountMakers(i, lower - m_max_maker_radius[i], false, old_lower, true);
             }
 
-            hint.LEAVE_DIMENSION[d] = leave_dimension;
-            hint.COMPLEXITY += leave_complixity;
-            
-            // ENTER
-            int enter_dimension = -1;
-            unsigned long enter_complexity = 0;
+            if(old_upper < upper) {
+                enter_edge[i] += CountMakers(i, old_upper, true, upper + m_max_maker_radius[i], false);
+            }
+
+            leave_edge_complexity += leave_edge[i];
+            enter_edge_complexity += enter_edge[i];
+        }
+
+        unsigned long leave_full[DIMENSION];
+        unsigned long enter_full[DIMENSION];
+        HintCacheType &cache = element.WATCHER_HINT;
+
+        if(cache.VALID && cache.DERIVED < HINT_CACHE_MAX_DERIVED) {
+            ++m_chooser_stats.HINT_CACHE_HITS;
+            ++cache.DERIVED;
+
             for(int i = 0; i < DIMENSION; ++i) {
-                if(i == d) {
-                    if(old_element.POS[i] < element.POS[i]) {
-                        POS_TYPE old_edge = old_element.POS[i] + old_element.WATCH_RANGE[i];
-                        POS_TYPE new_edge = element.POS[i] + element.WATCH_RANGE[i];
+                leave_full[i] = cache.COUNTS[i];
+                enter_full[i] = EstimateCount(leave_full[i], enter_edge[i], leave_edge[i]);
+            }
+        } else {
+            ++m_chooser_stats.HINT_CACHE_MISSES;
+            cache.VALID = true;
+            cache.DERIVED = 0;
 
-                        unsigned long count = m_dimensions[i].MAKER_LIST.GetElementsCountByRangedValue(old_edge, true, new_edge, false);
+            for(int i = 0; i < DIMENSION; ++i) {
+                POS_TYPE lower = element.POS[i] - element.WATCH_RANGE[i] - m_max_maker_radius[i] - DormantSlack(i);
+                POS_TYPE upper = element.POS[i] + element.WATCH_RANGE[i] + m_max_maker_radius[i] + DormantSlack(i);
 
-                        if(enter_dimension < 0 || count < enter_complexity) {
-                            enter_dimension = i;
-                            enter_complexity = count;
-                        }
-                    } else {
-                        POS_TYPE old_edge = old_element.POS[i] - old_element.WATCH_RANGE[i];
-                        POS_TYPE new_edge = element.POS[i] - element.WATCH_RANGE[i];
+                enter_full[i] = CountMakers(i, lower, false, upper, false);
+                leave_full[i] = EstimateCount(enter_full[i], leave_edge[i], enter_edge[i]);
+            }
+        }
 
-                        unsigned long count = m_dimensions[i].MAKER_LIST.GetElementsCountByRangedValue(new_edge, false, old_edge, true);
+        std::copy(enter_full, enter_full + DIMENSION, cache.COUNTS);
 
-                        if(enter_dimension < 0 || count < enter_complexity) {
-                            enter_dimension = i;
-                            enter_complexity = count;
-                        }
-                    }
-                } else {
-                    POS_TYPE lower = element.POS[i] - element.WATCH_RANGE[i];
-                    POS_TYPE upper = element.POS[i] + element.WATCH_RANGE[i];
+        hint.LEAVE_DIMENSION = 0;
+        hint.ENTER_DIMENSION = 0;
 
-                    unsigned long count = m_dimensions[i].MAKER_LIST.GetElementsCountByRangedValue(lower, false, upper, false);
+        for(int i = 1; i < DIMENSION; ++i) {
+            if(leave_full[i] < leave_full[hint.LEAVE_DIMENSION]) {
+                hint.LEAVE_DIMENSION = i;
+            }
 
-                    if(enter_dimension < 0 || count < enter_complexity) {
-                        enter_dimension = i;
-                        enter_complexity = count;
-                    }
-                }
+            if(enter_full[i] < enter_full[hint.ENTER_DIMENSION]) {
+                hint.ENTER_DIMENSION = i;
             }
+        }
+
+        unsigned long leave_full_complexity = leave_full[hint.LEAVE_DIMENSION];
+        unsigned long enter_full_complexity = enter_full[hint.ENTER_DIMENSION];
+
+        // 重新查询时使用进入的整个区间
+        PlanGetMakersInRange(enter_full, update_hint);
+
+        // 遍历边缘更划算时，不使用单一维度
+        if(!(leave_full_complexity < leave_edge_complexity)) {
+            hint.LEAVE_DIMENSION = -1;
+        }
 
-            hint.ENTER_DIMENSION[d] = enter_dimension;
-            hint.COMPLEXITY += enter_complexity;
+        if(!(enter_full_complexity < enter_edge_complexity)) {
+            hint.ENTER_DIMENSION = -1;
         }
 
+        hint.COMPLEXITY = std::min(leave_full_complexity, leave_edge_complexity) + std::min(enter_full_complexity, enter_edge_complexity);
     }
 
-    void MoveWatcher(const KEY_TYPE &key, ElementType &element, const ElementType &old_element) {
+    // 位置、范围都可以变化，在新旧区间有重叠时只处理变化的部分
+    void MoveWatcher(const KEY_TYPE &key, ElementType &element, const ElementShapeType &old_element) {
         for(int i = 0; i < DIMENSION; ++i) {
             POS_TYPE diff = element.POS[i] < old_element.POS[i] ? old_element.POS[i] - element.POS[i] :
                 element.POS[i] - old_element.POS[i];
 
-            if(!(diff < element.WATCH_RANGE[i] + old_element.WATCH_RANGE[i])) {
+            if(!(diff < element.WATCH_RANGE[i] + old_element.WATCH_RANGE[i] + m_max_maker_radius[i] + m_max_maker_radius[i])) {
+                element.WATCHER_HINT.VALID = false;
+                ++m_chooser_stats.WATCHER_UPDATES;
                 UpdateWatcher(key, element, old_element);
                 return;
             }
         }
 
         GetMakersInRangeHint update_hint;
-        CalcGetMakersInRangeHint(element.POS, element.WATCH_RANGE, update_hint);
-
         MoveWatcherHint move_hint;
-        CalcMoveWatcherHint(element, old_element, move_hint);
+        CalcMoveWatcherHint(element, old_element, move_hint, update_hint);
+
+        // 重新查询还需要和原来的所有maker比较
+        unsigned long update_complexity = update_hint.COMPLEXITY + element.RELATED_MAKERS.size();
+        bool use_update = ChooseUpdate(m_chooser_stats.WATCHER_UPDATE_WEIGHT, update_complexity,
+                m_chooser_stats.WATCHER_SHIFT_WEIGHT, move_hint.COMPLEXITY);
+
+        ChooserTimer timer(m_chooser_calibration, m_watcher_sampler, use_update, m_chooser_stats.WATCHER_UPDATE_WEIGHT, update_complexity,
+                m_chooser_stats.WATCHER_SHIFT_WEIGHT, move_hint.COMPLEXITY);
 
-        if(update_hint.COMPLEXITY < move_hint.COMPLEXITY) {
+        if(use_update) {
+            ++m_chooser_stats.WATCHER_UPDATES;
             UpdateWatcher(key, element, old_element, &update_hint);
         } else {
+            ++m_chooser_stats.WATCHER_SHIFTS;
             ShiftWatcher(key, element, old_element, &move_hint);
         }
     }
 
-    void ShiftWatcher(const KEY_TYPE &key, ElementType &element, const ElementType &old_element, MoveWatcherHint *hint) {
+    void ShiftWatcher(const KEY_TYPE &key, ElementType &element, const ElementShapeType &old_element, MoveWatcherHint *hint) {
         for(int i = 0; i < DIMENSION; ++i) {
-            POS_TYPE lower = element.POS[i] - element.WATCH_RANGE[i];
-            POS_TYPE upper = element.POS[i] + element.WATCH_RANGE[i];
-
-            POS_TYPE old_lower = old_element.POS[i] - old_element.WATCH_RANGE[i];
-            POS_TYPE old_upper = old_element.POS[i] + old_element.WATCH_RANGE[i];
-
-            m_dimensions[i].WATCHER_LOWER_LIST.Update(key, old_lower, lower);
-            m_dimensions[i].WATCHER_UPPER_LIST.Update(key, old_upper, upper);
+            UpdateWatcherEdges(i, key, old_element.POS[i], old_element.WATCH_RANGE[i], element.POS[i], element.WATCH_RANGE[i]);
         }
 
-        std::vector<KEY_TYPE> leave_makers;
-        std::vector<KEY_TYPE> keep_makers;
-        std::vector<KEY_TYPE> enter_makers;
-
-        for(int i = 0; i < DIMENSION; ++i) {
-            // LEAVE
-            int leave_dimension = hint->LEAVE_DIMENSION[i];
-            assert(leave_dimension >= 0);
-
-            int d = i;
-            auto leave_cb = [&leave_makers, this, key, &old_element, &element, d](unsigned long _0, const KEY_TYPE &k, const POS_TYPE &_1) {
-                if(k == key) {
-                    return;
-                }
+        ScratchKeys leave_makers(this);
+        ScratchKeys keep_makers(this);
+        ScratchKeys enter_makers(this);
 
-                auto iter = this->m_elements.find(k);
+        // LEAVE
+        auto leave_cb = [&leave_makers, this, key, &old_element, &element](unsigned long _0, const KEY_TYPE &k, const POS_TYPE &_1) {
+            if(k == key) {
+                return;
+            }
 
-                if(iter == this->m_elements.end()) {
-                    return;
-                }
+            auto iter = this->m_elements.find(k);
 
-                ElementType &e = iter->second;
+            if(iter == this->m_elements.end()) {
+                return;
+            }
 
-                for(int i = 0; i < DIMENSION; ++i) {
-                    if(i == d) {
-                        if(old_element.POS[i] < element.POS[i]) {
-                            POS_TYPE old_edge = old_element.POS[i] - old_element.WATCH_RANGE[i];
-                            POS_TYPE new_edge = element.POS[i] - element.WATCH_RANGE[i];
-
-                            if(!(old_edge < e.POS[i]) || new_edge < e.POS[i]) {
-                                return;
-                            }
-                        } else {
-                            POS_TYPE old_edge = old_element.POS[i] + old_element.WATCH_RANGE[i];
-                            POS_TYPE new_edge = element.POS[i] + element.WATCH_RANGE[i];
-
-                            if(e.POS[i] < new_edge || !(e.POS[i] < old_edge)) {
-                                return;
-                            }
-                        }
-                    } else {
-                        POS_TYPE lower = old_element.POS[i] - old_element.WATCH_RANGE[i];
-                        POS_TYPE upper = old_element.POS[i] + old_element.WATCH_RANGE[i];
+            if(ENABLE_STATS) {
+                ++this->m_stats.SHIFT_SCANNED;
+            }
 
-                        if(!(lower < e.POS[i]) || !(e.POS[i] < upper)) {
-                            return;
-                        }
-                    }
-                }
+            ElementType &e = iter->second;
 
+            // 处于滞后区间内的maker，只有原本可见的才需要离开
+            if(this->IsRelated(key, k) &&
+                    !this->CanKeepWatching(element.POS, element.WATCH_RANGE, e.POS, e.MAKER_RADIUS)) {
                 leave_makers.emplace_back(k);
-            };
-
-            if(leave_dimension == i) {
-                if(old_element.POS[i] < element.POS[i]) {
-                    POS_TYPE old_edge = old_element.POS[i] - old_element.WATCH_RANGE[i];
-                    POS_TYPE new_edge = element.POS[i] - element.WATCH_RANGE[i];
+            }
+        };
 
-                    m_dimensions[i].MAKER_LIST.GetElementsByRangedValue(old_edge, false, new_edge, true, leave_cb);
-                } else {
-                    POS_TYPE old_edge = old_element.POS[i] + old_element.WATCH_RANGE[i];
-                    POS_TYPE new_edge = element.POS[i] + element.WATCH_RANGE[i];
+        if(hint->LEAVE_DIMENSION >= 0) {
+            int i = hint->LEAVE_DIMENSION;
+            POS_TYPE old_lower = old_element.POS[i] - old_element.WATCH_RANGE[i] - m_hysteresis[i];
+            POS_TYPE old_upper = old_element.POS[i] + old_element.WATCH_RANGE[i] + m_hysteresis[i];
 
-                    m_dimensions[i].MAKER_LIST.GetElementsByRangedValue(new_edge, true, old_edge, false, leave_cb);
-                }
-            } else {
-                POS_TYPE lower = old_element.POS[i] - old_element.WATCH_RANGE[i];
-                POS_TYPE upper = old_element.POS[i] + old_element.WATCH_RANGE[i];
+            GetMakers(i, old_lower - m_max_maker_radius[i], false, old_upper + m_max_maker_radius[i], false, leave_cb);
+        } else {
+            for(int i = 0; i < DIMENSION; ++i) {
+                POS_TYPE lower = element.POS[i] - element.WATCH_RANGE[i] - m_hysteresis[i];
+                POS_TYPE upper = element.POS[i] + element.WATCH_RANGE[i] + m_hysteresis[i];
 
-                m_dimensions[i].MAKER_LIST.GetElementsByRangedValue(lower, false, upper, false, leave_cb);
-            }
+                POS_TYPE old_lower = old_element.POS[i] - old_element.WATCH_RANGE[i] - m_hysteresis[i];
+                POS_TYPE old_upper = old_element.POS[i] + old_element.WATCH_RANGE[i] + m_hysteresis[i];
 
-            // ENTER
-            int enter_dimension = hint->ENTER_DIMENSION[i];
-            assert(enter_dimension >= 0);
+                if(old_lower < lower) {
+                    GetMakers(i, old_lower - m_max_maker_radius[i], false, lower, true, leave_cb);
+                }
 
-            auto enter_cb = [&enter_makers, this, key, &old_element, &element, d](unsigned long _0, const KEY_TYPE &k, const POS_TYPE &_1) {
-                if(k == key) {
-                    return;
+                if(upper < old_upper) {
+                    GetMakers(i, upper, true, old_upper + m_max_maker_radius[i], false, leave_cb);
                 }
+            }
+        }
 
-                auto iter = this->m_elements.find(k);
+        // ENTER
+        auto enter_cb = [&enter_makers, this, key, &old_element, &element](unsigned long _0, const KEY_TYPE &k, const POS_TYPE &_1) {
+            if(k == key) {
+                return;
+            }
 
-                if(iter == this->m_elements.end()) {
-                    return;
-                }
+            auto iter = this->m_elements.find(k);
 
-                ElementType &e = iter->second;
+            if(iter == this->m_elements.end()) {
+                return;
+            }
 
-                for(int i = 0; i < DIMENSION; ++i) {
-                    if(i == d) {
-                        if(old_element.POS[i] < element.POS[i]) {
-                            POS_TYPE old_edge = old_element.POS[i] + old_element.WATCH_RANGE[i];
-                            POS_TYPE new_edge = element.POS[i] + element.WATCH_RANGE[i];
-
-                            if(e.POS[i] < old_edge || !(e.POS[i] < new_edge)) {
-                                return;
-                            }
-                        } else {
-                            POS_TYPE old_edge = old_element.POS[i] - old_element.WATCH_RANGE[i];
-                            POS_TYPE new_edge = element.POS[i] - element.WATCH_RANGE[i];
-
-                            if(!(new_edge < e.POS[i]) || old_edge < e.POS[i]) {
-                                return;
-                            }
-                        }
-                    } else {
-                        POS_TYPE lower = element.POS[i] - element.WATCH_RANGE[i];
-                        POS_TYPE upper = element.POS[i] + element.WATCH_RANGE[i];
+            if(ENABLE_STATS) {
+                ++this->m_stats.SHIFT_SCANNED;
+            }
 
-                        if(!(lower < e.POS[i]) || !(e.POS[i] < upper)) {
-                            return;
-                        }
-                    }
-                }
+            ElementType &e = iter->second;
 
+            if(this->CanWatch(element.POS, element.WATCH_RANGE, e.POS, e.MAKER_RADIUS) &&
+                    !this->IsRelated(key, k)) {
                 enter_makers.emplace_back(k);
-            };
-
-            if(enter_dimension == i) {
-                if(old_element.POS[i] < element.POS[i]) {
-                        POS_TYPE old_edge = old_element.POS[i] + old_element.WATCH_RANGE[i];
-                        POS_TYPE new_edge = element.POS[i] + element.WATCH_RANGE[i];
+            }
+        };
 
-                        m_dimensions[i].MAKER_LIST.GetElementsByRangedValue(old_edge, true, new_edge, false, enter_cb);
-                    } else {
-                        POS_TYPE old_edge = old_element.POS[i] - old_element.WATCH_RANGE[i];
-                        POS_TYPE new_edge = element.POS[i] - element.WATCH_RANGE[i];
+        if(hint->ENTER_DIMENSION >= 0) {
+            int i = hint->ENTER_DIMENSION;
+            POS_TYPE lower = element.POS[i] - element.WATCH_RANGE[i];
+            POS_TYPE upper = element.POS[i] + element.WATCH_RANGE[i];
 
-                        m_dimensions[i].MAKER_LIST.GetElementsByRangedValue(new_edge, false, old_edge, true, enter_cb);
-                    }
-            } else {
+            GetMakers(i, lower - m_max_maker_radius[i], false, upper + m_max_maker_radius[i], false, enter_cb);
+        } else {
+            for(int i = 0; i < DIMENSION; ++i) {
                 POS_TYPE lower = element.POS[i] - element.WATCH_RANGE[i];
                 POS_TYPE upper = element.POS[i] + element.WATCH_RANGE[i];
 
-                m_dimensions[i].MAKER_LIST.GetElementsByRangedValue(lower, false, upper, false, enter_cb);
+                POS_TYPE old_lower = old_element.POS[i] - old_element.WATCH_RANGE[i];
+                POS_TYPE old_upper = old_element.POS[i] + old_element.WATCH_RANGE[i];
+
+                if(lower < old_lower) {
+                    GetMakers(i, lower - m_max_maker_radius[i], false, old_lower, true, enter_cb);
+                }
+
+                if(old_upper < upper) {
+                    GetMakers(i, old_upper, true, upper + m_max_maker_radius[i], false, enter_cb);
+                }
             }
         }
 
@@ -1266,11 +6515,13 @@ private:
         leave_makers.resize(leave_makers_end - leave_makers.begin());
         enter_makers.resize(enter_makers_end - enter_makers.begin());
 
+        if(ENABLE_STATS) {
+            m_stats.SHIFT_ACCEPTED += leave_makers.size() + enter_makers.size();
+        }
+
         // 已经得到进入、离开的makers
 
         for(const KEY_TYPE &maker: leave_makers) {
-            element.RELATED_MAKERS.erase(maker);
-
             auto iter = m_elements.find(maker);
 
             if(iter == m_elements.end()) {
@@ -1278,12 +6529,10 @@ private:
             }
 
             ElementType &maker_element = iter->second;
-            maker_element.RELATED_WATCHERS.erase(key);
+            UnlinkRelation(key, element, maker, maker_element);
         }
 
         for(const KEY_TYPE &maker: enter_makers) {
-            element.RELATED_MAKERS.insert(maker);
-
             auto iter = m_elements.find(maker);
 
             if(iter == m_elements.end()) {
@@ -1292,7 +6541,11 @@ private:
 
             ElementType &maker_element = iter->second;
 
-            maker_element.RELATED_WATCHERS.insert(key);
+            LinkRelation(key, element, maker, maker_element);
+        }
+
+        if(ResyncVisibleIfLimited(key, element, leave_makers, enter_makers)) {
+            return;
         }
 
         if(leave_makers.size() || enter_makers.size()) {
@@ -1326,279 +6579,276 @@ private:
         }
     }
 
-    void CalcMoveMakerHint(ElementType &element, const ElementType &old_element, MoveMakerHint &hint) {
+    void CalcMoveMakerHint(ElementType &element, const ElementShapeType &old_element, MoveMakerHint &hint, GetWatchersRelatedToPosHint &update_hint) {
         static_assert(DIMENSION > 0, "DIMENSION should > 0");
 
-        hint.COMPLEXITY = 0;
+        // maker在第i维上占据区间 [pos - radius, pos + radius]，watcher区间和它相交即可见
+        // 离开：watcher的upper边界落在 (old_lower, lower]，或lower边界落在 [upper, old_upper)
+        // 进入：watcher的upper边界落在 (lower, old_lower]，或lower边界落在 [old_upper, upper)
+        unsigned long leave_edge[DIMENSION];
+        unsigned long enter_edge[DIMENSION];
+        unsigned long leave_edge_complexity = 0;
+        unsigned long enter_edge_complexity = 0;
 
-        for(int d = 0; d < DIMENSION; ++d) {
-            // leave
-            int leave_dimension = -1;
-            bool leave_use_lower = true;
-            unsigned long leave_complixity = 0;
-            for(int i = 0; i < DIMENSION; ++i) {
-                if(i == d) {
-                    if(old_element.POS[i] < element.POS[i]) {
-                        unsigned long count = m_dimensions[i].WATCHER_UPPER_LIST.GetElementsCountByRangedValue(old_element.POS[i], false, element.POS[i], true);
+        for(int i = 0; i < DIMENSION; ++i) {
+            POS_TYPE lower = element.POS[i] - element.MAKER_RADIUS[i];
+            POS_TYPE upper = element.POS[i] + element.MAKER_RADIUS[i];
 
-                        if(leave_dimension < 0 || count < leave_complixity) {
-                            leave_dimension = i;
-                            leave_complixity = count;
-                        }
-                    } else {
-                        unsigned long count = m_dimensions[i].WATCHER_LOWER_LIST.GetElementsCountByRangedValue(element.POS[i], true, old_element.POS[i], false);
+            POS_TYPE old_lower = old_element.POS[i] - old_element.MAKER_RADIUS[i];
+            POS_TYPE old_upper = old_element.POS[i] + old_element.MAKER_RADIUS[i];
 
-                        if(leave_dimension < 0 || count < leave_complixity) {
-                            leave_dimension = i;
-                            leave_complixity = count;
-                        }
-                    }
-                } else {
-                    POS_TYPE lower_begin = old_element.POS[i] - m_max_watch_range[i] - m_max_watch_range[i];
-                    POS_TYPE lower_end = old_element.POS[i];
+            // LEAVE，离开按照加上滞后距离的区间计算
+            POS_TYPE leave_lower = lower - m_hysteresis[i];
+            POS_TYPE leave_upper = upper + m_hysteresis[i];
+            POS_TYPE old_leave_lower = old_lower - m_hysteresis[i];
+            POS_TYPE old_leave_upper = old_upper + m_hysteresis[i];
 
-                    unsigned long count = m_dimensions[i].WATCHER_LOWER_LIST.GetElementsCountByRangedValue(lower_begin, false, lower_end, false);
+            leave_edge[i] = 0;
 
-                    if(leave_dimension < 0 || count < leave_complixity) {
-                        leave_dimension = i;
-                        leave_use_lower = true;
-                        leave_complixity = count;
-                    }
+            if(old_leave_lower < leave_lower) {
+                leave_edge[i] += CountWatcherEdges(i, false, old_leave_lower, false, leave_lower, true);
+            }
 
-                    POS_TYPE upper_begin = old_element.POS[i];
-                    POS_TYPE upper_end = old_element.POS[i] + m_max_watch_range[i] + m_max_watch_range[i];
+            if(leave_upper < old_leave_upper) {
+                leave_edge[i] += CountWatcherEdges(i, true, leave_upper, true, old_leave_upper, false);
+            }
 
-                    count = m_dimensions[i].WATCHER_UPPER_LIST.GetElementsCountByRangedValue(upper_begin, false, upper_end, false);
+            // ENTER
+            enter_edge[i] = 0;
 
-                    if(count < leave_complixity) {
-                        leave_dimension = i;
-                        leave_use_lower = false;
-                        leave_complixity = count;
-                    }
-                }
+            if(lower < old_lower) {
+                enter_edge[i] += CountWatcherEdges(i, false, lower, false, old_lower, true);
+            }
+
+            if(old_upper < upper) {
+                enter_edge[i] += CountWatcherEdges(i, true, old_upper, true, upper, false);
             }
 
-            hint.LEAVE_DIMENSION[d] = leave_dimension;
-            hint.LEAVE_USE_LOWER[d] = leave_use_lower;
-            hint.COMPLEXITY += leave_complixity;
+            leave_edge_complexity += leave_edge[i];
+            enter_edge_complexity += enter_edge[i];
+        }
+
+        unsigned long leave_full[DIMENSION];
+        unsigned long enter_full[DIMENSION];
+        HintCacheType &cache = element.MAKER_HINT;
+
+        if(cache.VALID && cache.DERIVED < HINT_CACHE_MAX_DERIVED) {
+            ++m_chooser_stats.HINT_CACHE_HITS;
+            ++cache.DERIVED;
 
-            // enter
-            int enter_dimension = -1;
-            bool enter_use_lower = true;
-            unsigned long enter_complexity = 0;
             for(int i = 0; i < DIMENSION; ++i) {
-                if(i == d) {
-                    if(old_element.POS[i] < element.POS[i]) {
-                        unsigned long count = m_dimensions[i].WATCHER_LOWER_LIST.GetElementsCountByRangedValue(old_element.POS[i], true, element.POS[i], false);
+                leave_full[i] = cache.COUNTS[i];
+                enter_full[i] = EstimateCount(leave_full[i], enter_edge[i], leave_edge[i]);
+            }
+        } else {
+            ++m_chooser_stats.HINT_CACHE_MISSES;
+            cache.VALID = true;
+            cache.DERIVED = 0;
 
-                        if(enter_dimension < 0 || count < enter_complexity) {
-                            enter_dimension = i;
-                            enter_complexity = count;
-                        }
-                    } else {
-                        unsigned long count = m_dimensions[i].WATCHER_UPPER_LIST.GetElementsCountByRangedValue(element.POS[i], false, old_element.POS[i], true);
+            for(int i = 0; i < DIMENSION; ++i) {
+                POS_TYPE lower = element.POS[i] - element.MAKER_RADIUS[i];
+                POS_TYPE upper = element.POS[i] + element.MAKER_RADIUS[i];
 
-                        if(enter_dimension < 0 || count < enter_complexity) {
-                            enter_dimension = i;
-                            enter_complexity = count;
-                        }
-                    }
-                } else {
-                    POS_TYPE lower_begin = element.POS[i] - m_max_watch_range[i] - m_max_watch_range[i];
-                    POS_TYPE lower_end = element.POS[i];
+                unsigned long lower_count = CountWatchersNear(i, true, lower, upper);
+                unsigned long upper_count = CountWatchersNear(i, false, lower, upper);
 
-                    unsigned long count = m_dimensions[i].WATCHER_LOWER_LIST.GetElementsCountByRangedValue(lower_begin, false, lower_end, false);
+                cache.USE_LOWER[i] = !(upper_count < lower_count);
+                enter_full[i] = cache.USE_LOWER[i] ? lower_count : upper_count;
+                leave_full[i] = EstimateCount(enter_full[i], leave_edge[i], enter_edge[i]);
+            }
+        }
 
-                    if(enter_dimension < 0 || count < enter_complexity) {
-                        enter_dimension = i;
-                        enter_use_lower = true;
-                        enter_complexity = count;
-                    }
+        std::copy(enter_full, enter_full + DIMENSION, cache.COUNTS);
 
-                    POS_TYPE upper_begin = element.POS[i];
-                    POS_TYPE upper_end = element.POS[i] + m_max_watch_range[i] + m_max_watch_range[i];
+        hint.LEAVE_DIMENSION = 0;
+        hint.ENTER_DIMENSION = 0;
 
-                    count = m_dimensions[i].WATCHER_UPPER_LIST.GetElementsCountByRangedValue(upper_begin, false, upper_end, false);
+        for(int i = 1; i < DIMENSION; ++i) {
+            if(leave_full[i] < leave_full[hint.LEAVE_DIMENSION]) {
+                hint.LEAVE_DIMENSION = i;
+            }
 
-                    if(count < enter_complexity) {
-                        enter_dimension = i;
-                        enter_use_lower = false;
-                        enter_complexity = count;
-                    }
-                }
+            if(enter_full[i] < enter_full[hint.ENTER_DIMENSION]) {
+                hint.ENTER_DIMENSION = i;
             }
+        }
+
+        hint.LEAVE_USE_LOWER = cache.USE_LOWER[hint.LEAVE_DIMENSION];
+        hint.ENTER_USE_LOWER = cache.USE_LOWER[hint.ENTER_DIMENSION];
+
+        unsigned long leave_full_complexity = leave_full[hint.LEAVE_DIMENSION];
+        unsigned long enter_full_complexity = enter_full[hint.ENTER_DIMENSION];
+
+        update_hint.TARGET_DIMENSION = hint.ENTER_DIMENSION;
+        update_hint.USE_LOWER = hint.ENTER_USE_LOWER;
+        update_hint.COMPLEXITY = enter_full_complexity;
 
-            hint.ENTER_DIMENSION[d] = enter_dimension;
-            hint.ENTER_USE_LOWER[d] = enter_use_lower;
-            hint.COMPLEXITY += enter_complexity;
+        if(!(leave_full_complexity < leave_edge_complexity)) {
+            hint.LEAVE_DIMENSION = -1;
         }
+
+        if(!(enter_full_complexity < enter_edge_complexity)) {
+            hint.ENTER_DIMENSION = -1;
+        }
+
+        hint.COMPLEXITY = std::min(leave_full_complexity, leave_edge_complexity) + std::min(enter_full_complexity, enter_edge_complexity);
     }
 
-    void MoveMaker(const KEY_TYPE &key, ElementType &element, const ElementType &old_element) {
+    // 位置、可见半径都可以变化
+    void MoveMaker(const KEY_TYPE &key, ElementType &element, const ElementShapeType &old_element) {
         for(int i = 0; i < DIMENSION; ++i) {
             POS_TYPE diff = element.POS[i] < old_element.POS[i] ? old_element.POS[i] - element.POS[i] :
             element.POS[i] - old_element.POS[i];
 
-            if(!(diff < m_max_watch_range[i] + m_max_watch_range[i])) {
+            POS_TYPE max_watch_range = CurrentMaxWatchRange(i);
+
+            if(!(diff < max_watch_range + max_watch_range + element.MAKER_RADIUS[i] + old_element.MAKER_RADIUS[i])) {
+                element.MAKER_HINT.VALID = false;
+                ++m_chooser_stats.MAKER_UPDATES;
                 UpdateMaker(key, element, old_element);
                 return;
             }
         }
 
         GetWatchersRelatedToPosHint update_hint;
-        CalcGetWatchersRelatedToPosHint(element.POS, update_hint);
-
         MoveMakerHint move_hint;
-        CalcMoveMakerHint(element, old_element, move_hint);
+        CalcMoveMakerHint(element, old_element, move_hint, update_hint);
+
+        unsigned long update_complexity = update_hint.COMPLEXITY + element.RELATED_WATCHERS.size();
+        bool use_update = ChooseUpdate(m_chooser_stats.MAKER_UPDATE_WEIGHT, update_complexity,
+                m_chooser_stats.MAKER_SHIFT_WEIGHT, move_hint.COMPLEXITY);
 
-        if(update_hint.COMPLEXITY < move_hint.COMPLEXITY) {
+        ChooserTimer timer(m_chooser_calibration, m_maker_sampler, use_update, m_chooser_stats.MAKER_UPDATE_WEIGHT, update_complexity,
+                m_chooser_stats.MAKER_SHIFT_WEIGHT, move_hint.COMPLEXITY);
+
+        if(use_update) {
+            ++m_chooser_stats.MAKER_UPDATES;
             UpdateMaker(key, element, old_element, &update_hint);
         } else {
+            ++m_chooser_stats.MAKER_SHIFTS;
             ShiftMaker(key, element, old_element, &move_hint);
         }
     }
 
-    void ShiftMaker(const KEY_TYPE &key, ElementType &element, const ElementType &old_element, MoveMakerHint *hint) {
+    void ShiftMaker(const KEY_TYPE &key, ElementType &element, const ElementShapeType &old_element, MoveMakerHint *hint) {
         for(int i = 0; i < DIMENSION; ++i) {
-            m_dimensions[i].MAKER_LIST.Update(key, old_element.POS[i], element.POS[i]);
+            UpdateIndex(m_dimensions[i].MAKER_LIST, key, old_element.POS[i], element.POS[i]);
         }
 
-        std::vector<KEY_TYPE> leave_watchers;
-        std::vector<KEY_TYPE> keep_watchers;
-        std::vector<KEY_TYPE> enter_watchers;
+        ScratchKeys leave_watchers(this);
+        ScratchKeys keep_watchers(this);
+        ScratchKeys enter_watchers(this);
 
-        for(int i = 0; i < DIMENSION; ++i) {
-            // leave
-            int leave_dimension = hint->LEAVE_DIMENSION[i];
-            bool leave_use_lower = hint->LEAVE_USE_LOWER[i];
-            assert(leave_dimension >= 0);
-
-            int d = i;
-            auto leave_cb = [&leave_watchers, this, key, &old_element, &element, d](unsigned long _0, const KEY_TYPE &k, const POS_TYPE &_1) {
-                // filter watchers who can SEE old_element
-                
-                if(k == key) {
-                    return;
-                }
+        // leave
+        auto leave_cb = [&leave_watchers, this, key, &old_element, &element](unsigned long _0, const KEY_TYPE &k, const POS_TYPE &_1) {
+            if(k == key) {
+                return;
+            }
 
-                auto iter = this->m_elements.find(k);
+            auto iter = this->m_elements.find(k);
 
-                if(iter == this->m_elements.end()) {
-                    return;
-                }
+            if(iter == this->m_elements.end()) {
+                return;
+            }
 
-                ElementType &e = iter->second;
-                
-                for(int i = 0; i < DIMENSION; ++i) {
-                    POS_TYPE lower = e.POS[i] - e.WATCH_RANGE[i];
-                    POS_TYPE upper = e.POS[i] + e.WATCH_RANGE[i];
-
-                    if(i == d) {
-                        if(old_element.POS[i] < element.POS[i]) {
-                            if(!( lower < old_element.POS[i] && old_element.POS[i] < upper && !(element.POS[i] < upper))) {
-                                return;
-                            }
-                        } else {
-                            if(!( !(lower < element.POS[i]) && lower < old_element.POS[i] && old_element.POS[i] < upper )) {
-                                return;
-                            }
-                        }
-                    } else {
-                        if( !(lower < old_element.POS[i]) || !(old_element.POS[i] < upper) ) {
-                            return;
-                        }
-                    }
-                }
+            if(ENABLE_STATS) {
+                ++this->m_stats.SHIFT_SCANNED;
+            }
+
+            ElementType &e = iter->second;
 
+            if(this->IsRelated(k, key) &&
+                    !this->CanKeepWatching(e.POS, e.WATCH_RANGE, element.POS, element.MAKER_RADIUS)) {
                 leave_watchers.emplace_back(k);
-            };
+            }
+        };
 
-            if(i == leave_dimension) {
-                if(old_element.POS[i] < element.POS[i]) {
-                    m_dimensions[i].WATCHER_UPPER_LIST.GetElementsByRangedValue(old_element.POS[i], false, element.POS[i], true, leave_cb);
-                } else {
-                    m_dimensions[i].WATCHER_LOWER_LIST.GetElementsByRangedValue(element.POS[i], true, old_element.POS[i], false, leave_cb);
-                }
-            } else {
-                if(leave_use_lower) {
-                    POS_TYPE lower_begin = old_element.POS[i] - m_max_watch_range[i] - m_max_watch_range[i];
-                    POS_TYPE lower_end = old_element.POS[i];
+        if(hint->LEAVE_DIMENSION >= 0) {
+            int i = hint->LEAVE_DIMENSION;
 
-                    m_dimensions[i].WATCHER_LOWER_LIST.GetElementsByRangedValue(lower_begin, false, lower_end, false, leave_cb);
-                } else {
-                    POS_TYPE upper_begin = old_element.POS[i];
-                    POS_TYPE upper_end = old_element.POS[i] + m_max_watch_range[i] + m_max_watch_range[i];
+            GetWatchersNear(i, hint->LEAVE_USE_LOWER, old_element.POS[i] - old_element.MAKER_RADIUS[i] - m_hysteresis[i], old_element.POS[i] + old_element.MAKER_RADIUS[i] + m_hysteresis[i], leave_cb);
+        } else {
+            for(int i = 0; i < DIMENSION; ++i) {
+                POS_TYPE lower = element.POS[i] - element.MAKER_RADIUS[i] - m_hysteresis[i];
+                POS_TYPE upper = element.POS[i] + element.MAKER_RADIUS[i] + m_hysteresis[i];
+
+                POS_TYPE old_lower = old_element.POS[i] - old_element.MAKER_RADIUS[i] - m_hysteresis[i];
+                POS_TYPE old_upper = old_element.POS[i] + old_element.MAKER_RADIUS[i] + m_hysteresis[i];
+
+                if(old_lower < lower) {
+                    GetWatcherEdges(i, false, old_lower, false, lower, true, leave_cb);
+                }
 
-                    m_dimensions[i].WATCHER_UPPER_LIST.GetElementsByRangedValue(upper_begin, false, upper_end, false, leave_cb);
+                if(upper < old_upper) {
+                    GetWatcherEdges(i, true, upper, true, old_upper, false, leave_cb);
                 }
             }
+        }
 
+        // enter
+        auto enter_cb = [&enter_watchers, this, key, &old_element, &element](unsigned long _0, const KEY_TYPE &k, const POS_TYPE &_1) {
+            if(k == key) {
+                return;
+            }
 
-            // enter
-            int enter_dimension = hint->ENTER_DIMENSION[i];
-            bool enter_use_lower = hint->ENTER_USE_LOWER[i];
-            assert(enter_dimension >= 0);
+            auto iter = this->m_elements.find(k);
 
-            auto enter_cb = [&enter_watchers, this, key, &old_element, &element, d](unsigned long _0, const KEY_TYPE &k, const POS_TYPE &_1) {
-                // filter watchers who can SEE element
+            if(iter == this->m_elements.end()) {
+                return;
+            }
 
-                if(k == key) {
-                    return;
-                }
+            if(ENABLE_STATS) {
+                ++this->m_stats.SHIFT_SCANNED;
+            }
 
-                auto iter = this->m_elements.find(k);
+            ElementType &e = iter->second;
 
-                if(iter == this->m_elements.end()) {
-                    return;
-                }
+            if(this->CanWatch(e.POS, e.WATCH_RANGE, element.POS, element.MAKER_RADIUS) &&
+                    !this->IsRelated(k, key)) {
+                enter_watchers.emplace_back(k);
+            }
+        };
 
-                ElementType &e = iter->second;
-                
-                for(int i = 0; i < DIMENSION; ++i) {
-                    POS_TYPE lower = e.POS[i] - e.WATCH_RANGE[i];
-                    POS_TYPE upper = e.POS[i] + e.WATCH_RANGE[i];
-
-                    if(i == d) {
-                        if(old_element.POS[i] < element.POS[i]) {
-                            if(!( !(lower < old_element.POS[i]) && lower < element.POS[i] && element.POS[i] < upper )) {
-                                return;
-                            }
-                        } else {
-                            if(!( lower < element.POS[i] && element.POS[i] < upper && !(old_element.POS[i] < upper) )) {
-                                return;
-                            }
-                        }
-                    } else {
-                        if( !(lower < element.POS[i]) || !(element.POS[i] < upper) ) {
-                            return;
-                        }
-                    }
-                }
+        if(hint->ENTER_DIMENSION >= 0) {
+            int i = hint->ENTER_DIMENSION;
 
-                enter_watchers.emplace_back(k);
-            };
+            GetWatchersNear(i, hint->ENTER_USE_LOWER, element.POS[i] - element.MAKER_RADIUS[i], element.POS[i] + element.MAKER_RADIUS[i], enter_cb);
+        } else {
+            for(int i = 0; i < DIMENSION; ++i) {
+                POS_TYPE lower = element.POS[i] - element.MAKER_RADIUS[i];
+                POS_TYPE upper = element.POS[i] + element.MAKER_RADIUS[i];
 
-            if(i == enter_dimension) {
-                if(old_element.POS[i] < element.POS[i]) {
-                    m_dimensions[i].WATCHER_LOWER_LIST.GetElementsByRangedValue(old_element.POS[i], true, element.POS[i], false, enter_cb);
-                } else {
-                    m_dimensions[i].WATCHER_UPPER_LIST.GetElementsByRangedValue(element.POS[i], false, old_element.POS[i], true, enter_cb);
-                }
-            } else {
-                if(enter_use_lower) {
-                    POS_TYPE lower_begin = element.POS[i] - m_max_watch_range[i] - m_max_watch_range[i];
-                    POS_TYPE lower_end = element.POS[i];
+                POS_TYPE old_lower = old_element.POS[i] - old_element.MAKER_RADIUS[i];
+                POS_TYPE old_upper = old_element.POS[i] + old_element.MAKER_RADIUS[i];
 
-                    m_dimensions[i].WATCHER_LOWER_LIST.GetElementsByRangedValue(lower_begin, false, lower_end, false, enter_cb);
-                } else {
-                    POS_TYPE upper_begin = element.POS[i];
-                    POS_TYPE upper_end = element.POS[i] + m_max_watch_range[i] + m_max_watch_range[i];
+                if(lower < old_lower) {
+                    GetWatcherEdges(i, false, lower, false, old_lower, true, enter_cb);
+                }
 
-                    m_dimensions[i].WATCHER_UPPER_LIST.GetElementsByRangedValue(upper_begin, false, upper_end, false, enter_cb);
+                if(old_upper < upper) {
+                    GetWatcherEdges(i, true, old_upper, true, upper, false, enter_cb);
                 }
             }
         }
 
+        // 触发器不在分桶中，按移动前后区间的并集查一次
+        if(m_triggers.size()) {
+            POS_TYPE lower[DIMENSION];
+            POS_TYPE upper[DIMENSION];
+
+            for(int i = 0; i < DIMENSION; ++i) {
+                lower[i] = std::min(element.POS[i] - element.MAKER_RADIUS[i], old_element.POS[i] - old_element.MAKER_RADIUS[i]) - m_hysteresis[i];
+                upper[i] = std::max(element.POS[i] + element.MAKER_RADIUS[i], old_element.POS[i] + old_element.MAKER_RADIUS[i]) + m_hysteresis[i];
+            }
+
+            auto trigger_cb = [&leave_cb, &enter_cb](const KEY_TYPE &k) {
+                leave_cb(0, k, POS_ZERO);
+                enter_cb(0, k, POS_ZERO);
+            };
+
+            GetTriggersNear(lower, upper, trigger_cb);
+        }
+
         std::sort(leave_watchers.begin(), leave_watchers.end());
         std::sort(enter_watchers.begin(), enter_watchers.end());
 
@@ -1608,9 +6858,11 @@ private:
         leave_watchers.resize(leave_watchers_end - leave_watchers.begin());
         enter_watchers.resize(enter_watchers_end - enter_watchers.begin());
 
-        for(const KEY_TYPE &watcher: leave_watchers) {
-            element.RELATED_WATCHERS.erase(watcher);
+        if(ENABLE_STATS) {
+            m_stats.SHIFT_ACCEPTED += leave_watchers.size() + enter_watchers.size();
+        }
 
+        for(const KEY_TYPE &watcher: leave_watchers) {
             auto iter = m_elements.find(watcher);
 
             if(iter == m_elements.end()) {
@@ -1618,16 +6870,15 @@ private:
             }
 
             ElementType &watcher_element = iter->second;
-            watcher_element.RELATED_MAKERS.erase(key);
+            UnlinkRelation(watcher, watcher_element, key, element);
         }
 
-        if(NOTIFY_MOVE_EVENT) {
+        // 只改变可见半径时不算移动
+        if((NOTIFY_MOVE_EVENT || element.RANKED_WATCHERS) && !IsSamePos(element.POS, old_element.POS)) {
             keep_watchers.assign(element.RELATED_WATCHERS.begin(), element.RELATED_WATCHERS.end());
         }
 
         for(const KEY_TYPE &watcher: enter_watchers) {
-            element.RELATED_WATCHERS.insert(watcher);
-
             auto iter = m_elements.find(watcher);
 
             if(iter == m_elements.end()) {
@@ -1635,11 +6886,11 @@ private:
             }
 
             ElementType &watcher_element = iter->second;
-            watcher_element.RELATED_MAKERS.insert(key);
+            LinkRelation(watcher, watcher_element, key, element);
         }
 
         // notify
-        if(leave_watchers.size() || (NOTIFY_MOVE_EVENT && keep_watchers.size()) || enter_watchers.size()) {
+        if(leave_watchers.size() || keep_watchers.size() || enter_watchers.size()) {
             AOI_EVENT_TYPE event;
             
             CopyPos(element.POS, event.POS);
@@ -1647,19 +6898,17 @@ private:
 
             event.EVENT_ID = AOI_EVENT_IDS::LEAVE;
             for(const KEY_TYPE &watcher: leave_watchers) {
-                Callback(watcher, key, event);
+                NotifyWatcher(watcher, key, event);
             }
 
-            if(NOTIFY_MOVE_EVENT) {
-                event.EVENT_ID = AOI_EVENT_IDS::MOVE;
-                for(const KEY_TYPE &watcher: keep_watchers) {
-                    Callback(watcher, key, event);
-                }
+            event.EVENT_ID = AOI_EVENT_IDS::MOVE;
+            for(const KEY_TYPE &watcher: keep_watchers) {
+                NotifyWatcher(watcher, key, event);
             }
 
             event.EVENT_ID = AOI_EVENT_IDS::ENTER;
             for(const KEY_TYPE &watcher: enter_watchers) {
-                Callback(watcher, key, event);
+                NotifyWatcher(watcher, key, event);
             }
         }
     }
@@ -1727,4 +6976,8 @@ private:
     }
 };
 
+// POS_ZERO 会以引用的方式使用（例如 std::fill），需要类外定义
+template<typename KeyType, typename PosType, int Dimension, bool NotifyMoveEvent, bool EnableStats>
+constexpr typename AoiGroup<KeyType, PosType, Dimension, NotifyMoveEvent, EnableStats>::POS_TYPE AoiGroup<KeyType, PosType, Dimension, NotifyMoveEvent, EnableStats>::POS_ZERO;
+
 #endif
@@ -0,0 +1,163 @@
+#include "aoi_group.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+// 回放 AoiGroup::SetJournal 记录的journal，统计每种操作的耗时和产生的事件
+// 用法: aoireplay <journal文件> [回放次数]
+
+struct OpStatsType {
+    std::vector<double> COSTS; // 单次操作耗时，单位微秒
+};
+
+static double Percentile(std::vector<double> &costs, double p) {
+    if(costs.empty()) {
+        return 0;
+    }
+
+    size_t index = (size_t)(p * (costs.size() - 1));
+    std::nth_element(costs.begin(), costs.begin() + index, costs.end());
+    return costs[index];
+}
+
+template<typename GroupType>
+int Replay(const std::string &journal, int rounds) {
+    using POS_TYPE = typename GroupType::POS_TYPE;
+    constexpr int DIMENSION = GroupType::DIMENSION;
+
+    POS_TYPE max_watch_range[DIMENSION];
+    POS_TYPE max_maker_radius[DIMENSION];
+    POS_TYPE hysteresis[DIMENSION];
+
+    if(!GroupType::ReadJournalConfig(journal.data(), journal.size(), max_watch_range, max_maker_radius, hysteresis)) {
+        std::cout << "invalid journal config\n";
+        return 1;
+    }
+
+    OpStatsType op_stats[AOI_JOURNAL_OPS::COUNT];
+    std::map<int, unsigned long> event_counts;
+
+    for(int round = 0; round < rounds; ++round) {
+        GroupType group(1, max_watch_range, max_maker_radius, hysteresis);
+        group.SetCallback([&event_counts](unsigned long id, const typename GroupType::KEY_TYPE &receiver,
+                    const typename GroupType::KEY_TYPE &sender, const typename GroupType::AOI_EVENT_TYPE &event) {
+            ++event_counts[event.EVENT_ID];
+        });
+
+        size_t offset = 0;
+
+        if(!group.LoadJournal(journal.data(), journal.size(), offset)) {
+            std::cout << "invalid journal snapshot\n";
+            return 1;
+        }
+
+        while(offset < journal.size()) {
+            int op;
+            auto begin = std::chrono::steady_clock::now();
+            bool ok = group.ReplayJournal(journal.data(), journal.size(), offset, op);
+            auto end = std::chrono::steady_clock::now();
+
+            if(!ok) {
+                std::cout << "invalid journal record at offset " << offset << "\n";
+                return 1;
+            }
+
+            op_stats[op].COSTS.emplace_back(std::chrono::duration<double, std::micro>(end - begin).count());
+        }
+    }
+
+    AoiJournalHeader header;
+    AoiJournalHeader::Read(journal.data(), journal.size(), header);
+    std::cout << "journal bytes: " << journal.size() << ", snapshot bytes: " << header.SNAPSHOT_SIZE << ", rounds: " << rounds << "\n";
+    std::cout << std::left << std::setw(22) << "OP" << std::right << std::setw(10) << "COUNT" << std::setw(14) << "TOTAL_MS"
+        << std::setw(12) << "P50_US" << std::setw(12) << "P99_US" << std::setw(12) << "MAX_US" << "\n";
+
+    double total = 0;
+    unsigned long count = 0;
+
+    for(int op = 1; op < AOI_JOURNAL_OPS::COUNT; ++op) {
+        std::vector<double> &costs = op_stats[op].COSTS;
+
+        if(costs.empty()) {
+            continue;
+        }
+
+        double sum = 0;
+        for(double cost: costs) {
+            sum += cost;
+        }
+
+        total += sum;
+        count += costs.size();
+
+        std::cout << std::left << std::setw(22) << AoiJournalOpRepr(op) << std::right << std::setw(10) << costs.size()
+            << std::fixed << std::setprecision(3) << std::setw(14) << sum / 1000 << std::setw(12) << Percentile(costs, 0.5)
+            << std::setw(12) << Percentile(costs, 0.99) << std::setw(12) << *std::max_element(costs.begin(), costs.end()) << "\n";
+    }
+
+    std::cout << std::left << std::setw(22) << "ALL" << std::right << std::setw(10) << count
+        << std::fixed << std::setprecision(3) << std::setw(14) << total / 1000 << "\n";
+
+    for(auto iter = event_counts.begin(); iter != event_counts.end(); ++iter) {
+        std::cout << "events " << AoiEventIdRepr(iter->first) << ": " << iter->second << "\n";
+    }
+
+    return 0;
+}
+
+// 只实例化常用的几种类型，key按大小选择无符号整数，位置按是否浮点选择 long 或 double
+template<int Dimension, bool NotifyMoveEvent>
+int ReplayByType(const AoiJournalHeader &header, const std::string &journal, int rounds) {
+    bool pos_float = (header.FLAGS & AoiJournalHeader::POS_FLOAT) != 0;
+
+    if(header.POS_SIZE != 8) {
+        std::cout << "unsupported pos size: " << header.POS_SIZE << "\n";
+        return 1;
+    }
+
+    if(header.KEY_SIZE == 4) {
+        return pos_float ? Replay<AoiGroup<uint32_t, double, Dimension, NotifyMoveEvent>>(journal, rounds) :
+            Replay<AoiGroup<uint32_t, long, Dimension, NotifyMoveEvent>>(journal, rounds);
+    }
+
+    if(header.KEY_SIZE == 8) {
+        return pos_float ? Replay<AoiGroup<uint64_t, double, Dimension, NotifyMoveEvent>>(journal, rounds) :
+            Replay<AoiGroup<uint64_t, long, Dimension, NotifyMoveEvent>>(journal, rounds);
+    }
+
+    std::cout << "unsupported key size: " << header.KEY_SIZE << "\n";
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    if(argc < 2) {
+        std::cout << "usage: " << argv[0] << " <journal> [rounds]\n";
+        return 1;
+    }
+
+    std::ifstream file(argv[1], std::ios::binary);
+    std::ostringstream ss;
+    ss << file.rdbuf();
+    std::string journal = ss.str();
+
+    int rounds = argc > 2 ? std::max(1, atoi(argv[2])) : 1;
+
+    AoiJournalHeader header;
+    if(!AoiJournalHeader::Read(journal.data(), journal.size(), header)) {
+        std::cout << "invalid journal header\n";
+        return 1;
+    }
+
+    bool notify_move = (header.FLAGS & AoiJournalHeader::NOTIFY_MOVE) != 0;
+
+    switch(header.DIMENSION) {
+        case 2:
+            return notify_move ? ReplayByType<2, true>(header, journal, rounds) : ReplayByType<2, false>(header, journal, rounds);
+        case 3:
+            return notify_move ? ReplayByType<3, true>(header, journal, rounds) : ReplayByType<3, false>(header, journal, rounds);
+        default:
+            std::cout << "unsupported dimension: " << header.DIMENSION << "\n";
+            return 1;
+    }
+}
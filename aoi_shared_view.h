@@ -0,0 +1,419 @@
+#ifndef __AOI_SHARED_VIEW_H__
+#define __AOI_SHARED_VIEW_H__
+
+#include "aoi_group.h"
+
+#include <atomic>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// 把 AoiGroup 中元素的位置和可见的maker列表发布到共享内存，同一台机器上的其他进程(例如网关)直接读取
+// group 仍然是唯一的权威数据，共享内存中只是每次 Publish 时的只读副本
+//
+// 区域中有两个缓冲区，写入方总是写不在使用中的缓冲区，写完后切换 ACTIVE
+// 每个缓冲区有自己的序号，写入期间为奇数，读取方读之前和读之后序号相同且为偶数才说明读到的数据完整
+// 读取方只有在写入方连续发布两次时才可能需要重试，读取过程不需要加锁，也没有系统调用
+
+// 创建和映射共享内存，失败时返回NULL
+struct AoiSharedRegion {
+    static void *Create(const char *name, size_t size) {
+        int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+
+        if(fd < 0) {
+            return NULL;
+        }
+
+        if(ftruncate(fd, (off_t)size) != 0) {
+            close(fd);
+            return NULL;
+        }
+
+        void *region = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+
+        return region == MAP_FAILED ? NULL : region;
+    }
+
+    // 只读映射，size返回区域的大小
+    static const void *Open(const char *name, size_t &size) {
+        int fd = shm_open(name, O_RDONLY, 0);
+
+        if(fd < 0) {
+            return NULL;
+        }
+
+        struct stat st;
+        if(fstat(fd, &st) != 0 || st.st_size <= 0) {
+            close(fd);
+            return NULL;
+        }
+
+        size = (size_t)st.st_size;
+        void *region = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+
+        return region == MAP_FAILED ? NULL : region;
+    }
+
+    static void Close(const void *region, size_t size) {
+        munmap(const_cast<void *>(region), size);
+    }
+
+    static void Remove(const char *name) {
+        shm_unlink(name);
+    }
+};
+
+template<typename KeyType, typename PosType, int Dimension>
+struct AoiSharedViewLayout {
+    using KEY_TYPE = KeyType;
+    using POS_TYPE = PosType;
+    static constexpr int DIMENSION = Dimension;
+
+    static_assert(std::is_trivially_copyable<KEY_TYPE>::value && std::is_trivially_copyable<POS_TYPE>::value,
+            "shared view needs trivially copyable KEY_TYPE and POS_TYPE");
+    static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t) && ATOMIC_LLONG_LOCK_FREE == 2,
+            "shared view needs lock free 64-bit atomics");
+
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t ALIGN = 64;
+
+    struct HeaderType {
+        char MAGIC[4];
+        uint32_t VERSION;
+        uint32_t DIMENSION;
+        uint32_t KEY_SIZE;
+        uint32_t POS_SIZE;
+        uint32_t RESERVED;
+        uint64_t BUFFER_SIZE; // 每个缓冲区的大小
+        std::atomic<uint64_t> ACTIVE; // 读取方应该读的缓冲区
+        std::atomic<uint64_t> SEQUENCES[2];
+    };
+
+    // 缓冲区开头是计数，之后是按key排序的元素，最后是所有元素的可见maker列表
+    struct BufferHeaderType {
+        uint64_t ELEMENT_COUNT;
+        uint64_t RELATION_COUNT;
+        uint64_t PUBLISH_COUNT; // 第几次发布，读取方可以据此判断是否有更新
+        uint64_t RESERVED;
+    };
+
+    struct ElementType {
+        KEY_TYPE KEY;
+        POS_TYPE POS[DIMENSION];
+        int32_t WATCH_TYPE;
+        uint32_t RELATION_COUNT;
+        uint64_t RELATION_OFFSET; // 在maker列表中的下标
+    };
+
+    static size_t AlignUp(size_t size) {
+        return (size + ALIGN - 1) / ALIGN * ALIGN;
+    }
+
+    static size_t BufferOffset(int buffer, uint64_t buffer_size) {
+        return AlignUp(sizeof(HeaderType)) + (size_t)buffer * (size_t)buffer_size;
+    }
+
+    static size_t ElementsOffset() {
+        return AlignUp(sizeof(BufferHeaderType));
+    }
+
+    static size_t RelationsOffset(uint64_t element_count) {
+        return ElementsOffset() + AlignUp(sizeof(ElementType) * (size_t)element_count);
+    }
+
+    static size_t BufferSize(size_t max_elements, size_t max_relations) {
+        return RelationsOffset(max_elements) + AlignUp(sizeof(KEY_TYPE) * max_relations);
+    }
+};
+
+// 写入方，在拥有 AoiGroup 的进程中使用，每次 Publish 重建整个缓冲区
+template<typename KeyType, typename PosType, int Dimension>
+class AoiSharedViewWriter {
+public:
+    using LAYOUT = AoiSharedViewLayout<KeyType, PosType, Dimension>;
+    using KEY_TYPE = KeyType;
+    using POS_TYPE = PosType;
+    static constexpr int DIMENSION = Dimension;
+
+    // 容纳 max_elements 个元素、总共 max_relations 个可见关系需要的区域大小
+    static size_t RegionSize(size_t max_elements, size_t max_relations) {
+        return LAYOUT::AlignUp(sizeof(typename LAYOUT::HeaderType)) + 2 * LAYOUT::BufferSize(max_elements, max_relations);
+    }
+
+    // region 由调用者分配(通常是 AoiSharedRegion::Create)，按 ALIGN 对齐，并且在写入方的整个生命周期内有效
+    bool Init(void *region, size_t size) {
+        size_t header_size = LAYOUT::AlignUp(sizeof(typename LAYOUT::HeaderType));
+
+        if(!region || ((uintptr_t)region % LAYOUT::ALIGN) || size < header_size + 2 * LAYOUT::BufferSize(0, 0)) {
+            return false;
+        }
+
+        m_region = (char *)region;
+        m_buffer_size = (size - header_size) / 2 / LAYOUT::ALIGN * LAYOUT::ALIGN;
+
+        typename LAYOUT::HeaderType *header = Header();
+        memset((void *)header, 0, sizeof(*header));
+        memcpy(header->MAGIC, "AOIV", 4);
+        header->VERSION = LAYOUT::VERSION;
+        header->DIMENSION = DIMENSION;
+        header->KEY_SIZE = sizeof(KEY_TYPE);
+        header->POS_SIZE = sizeof(POS_TYPE);
+        header->BUFFER_SIZE = m_buffer_size;
+
+        for(int b = 0; b < 2; ++b) {
+            memset(m_region + LAYOUT::BufferOffset(b, m_buffer_size), 0, sizeof(typename LAYOUT::BufferHeaderType));
+        }
+
+        header->ACTIVE.store(0, std::memory_order_release);
+        return true;
+    }
+
+    // 发布group当前的状态，区域放不下时返回false，读取方继续看到上一次发布的内容
+    template<typename GroupType>
+    bool Publish(GroupType &group) {
+        static_assert(std::is_same<typename GroupType::KEY_TYPE, KEY_TYPE>::value && std::is_same<typename GroupType::POS_TYPE, POS_TYPE>::value &&
+                GroupType::DIMENSION == DIMENSION, "group type mismatch");
+
+        if(!m_region) {
+            return false;
+        }
+
+        m_elements.clear();
+        m_relations.clear();
+
+        group.ForEachElement([this, &group](const KEY_TYPE &key, const POS_TYPE pos[DIMENSION], int watch_type) {
+            typename LAYOUT::ElementType element;
+            memset(&element, 0, sizeof(element));
+            element.KEY = key;
+            std::copy(pos, pos + DIMENSION, element.POS);
+            element.WATCH_TYPE = watch_type;
+
+            if(watch_type & AOI_WATCH_TYPES::WATCHER) {
+                group.GetMakersList(key, m_makers);
+                element.RELATION_OFFSET = m_relations.size();
+                element.RELATION_COUNT = (uint32_t)m_makers.size();
+                m_relations.insert(m_relations.end(), m_makers.begin(), m_makers.end());
+            }
+
+            m_elements.emplace_back(element);
+        });
+
+        if(LAYOUT::RelationsOffset(m_elements.size()) + sizeof(KEY_TYPE) * m_relations.size() > m_buffer_size) {
+            return false;
+        }
+
+        std::sort(m_elements.begin(), m_elements.end(), [](const typename LAYOUT::ElementType &a, const typename LAYOUT::ElementType &b) {
+                    return a.KEY < b.KEY;
+                });
+
+        typename LAYOUT::HeaderType *header = Header();
+        int buffer = 1 - (int)header->ACTIVE.load(std::memory_order_relaxed);
+        std::atomic<uint64_t> &sequence = header->SEQUENCES[buffer];
+        uint64_t seq = sequence.load(std::memory_order_relaxed);
+
+        // 序号变成奇数之后才能开始写
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        char *data = m_region + LAYOUT::BufferOffset(buffer, m_buffer_size);
+
+        typename LAYOUT::BufferHeaderType buffer_header;
+        memset(&buffer_header, 0, sizeof(buffer_header));
+        buffer_header.ELEMENT_COUNT = m_elements.size();
+        buffer_header.RELATION_COUNT = m_relations.size();
+        buffer_header.PUBLISH_COUNT = ++m_publish_count;
+
+        memcpy(data, &buffer_header, sizeof(buffer_header));
+
+        if(m_elements.size()) {
+            memcpy(data + LAYOUT::ElementsOffset(), m_elements.data(), sizeof(typename LAYOUT::ElementType) * m_elements.size());
+        }
+
+        if(m_relations.size()) {
+            memcpy(data + LAYOUT::RelationsOffset(m_elements.size()), m_relations.data(), sizeof(KEY_TYPE) * m_relations.size());
+        }
+
+        sequence.store(seq + 2, std::memory_order_release);
+        header->ACTIVE.store(buffer, std::memory_order_release);
+
+        return true;
+    }
+
+private:
+    typename LAYOUT::HeaderType *Header() {
+        return (typename LAYOUT::HeaderType *)m_region;
+    }
+
+    char *m_region = NULL;
+    uint64_t m_buffer_size = 0;
+    uint64_t m_publish_count = 0;
+
+    // 每次发布复用，避免重复分配
+    std::vector<typename LAYOUT::ElementType> m_elements;
+    std::vector<KEY_TYPE> m_relations;
+    std::vector<KEY_TYPE> m_makers;
+};
+
+// 读取方，可以在任意进程中使用，只读访问区域
+template<typename KeyType, typename PosType, int Dimension>
+class AoiSharedViewReader {
+public:
+    using LAYOUT = AoiSharedViewLayout<KeyType, PosType, Dimension>;
+    using KEY_TYPE = KeyType;
+    using POS_TYPE = PosType;
+    static constexpr int DIMENSION = Dimension;
+    using ELEMENT_TYPE = typename LAYOUT::ElementType;
+
+    // 一次读取中看到的缓冲区，只在 Read 的回调中有效
+    // 读取的同时可能被覆盖，所有下标都检查过范围，读到的内容是否完整由 Read 的返回值决定
+    class ViewType {
+    public:
+        ViewType(const char *data, uint64_t buffer_size) : m_data(data) {
+            typename LAYOUT::BufferHeaderType header;
+            memcpy(&header, data, sizeof(header));
+
+            if(LAYOUT::RelationsOffset(header.ELEMENT_COUNT) > buffer_size || header.ELEMENT_COUNT > buffer_size ||
+                    header.RELATION_COUNT > (buffer_size - LAYOUT::RelationsOffset(header.ELEMENT_COUNT)) / sizeof(KEY_TYPE)) {
+                return;
+            }
+
+            m_element_count = (size_t)header.ELEMENT_COUNT;
+            m_relation_count = (size_t)header.RELATION_COUNT;
+            m_publish_count = header.PUBLISH_COUNT;
+        }
+
+        size_t ElementCount() const {
+            return m_element_count;
+        }
+
+        uint64_t PublishCount() const {
+            return m_publish_count;
+        }
+
+        const ELEMENT_TYPE *Elements() const {
+            return (const ELEMENT_TYPE *)(m_data + LAYOUT::ElementsOffset());
+        }
+
+        // 按key二分查找，找不到时返回NULL
+        const ELEMENT_TYPE *Find(const KEY_TYPE &key) const {
+            const ELEMENT_TYPE *begin = Elements();
+            const ELEMENT_TYPE *end = begin + m_element_count;
+            const ELEMENT_TYPE *iter = std::lower_bound(begin, end, key, [](const ELEMENT_TYPE &element, const KEY_TYPE &k) {
+                        return element.KEY < k;
+                    });
+
+            return iter != end && !(key < iter->KEY) ? iter : NULL;
+        }
+
+        // 元素可见的maker列表，count返回数量
+        const KEY_TYPE *Relations(const ELEMENT_TYPE *element, size_t &count) const {
+            if(element->RELATION_OFFSET > m_relation_count || element->RELATION_COUNT > m_relation_count - element->RELATION_OFFSET) {
+                count = 0;
+                return NULL;
+            }
+
+            count = element->RELATION_COUNT;
+            return (const KEY_TYPE *)(m_data + LAYOUT::RelationsOffset(m_element_count)) + element->RELATION_OFFSET;
+        }
+
+    private:
+        const char *m_data;
+        size_t m_element_count = 0;
+        size_t m_relation_count = 0;
+        uint64_t m_publish_count = 0;
+    };
+
+    bool Attach(const void *region, size_t size) {
+        size_t header_size = LAYOUT::AlignUp(sizeof(typename LAYOUT::HeaderType));
+
+        if(!region || size < header_size) {
+            return false;
+        }
+
+        const typename LAYOUT::HeaderType *header = (const typename LAYOUT::HeaderType *)region;
+
+        if(memcmp(header->MAGIC, "AOIV", 4) != 0 || header->VERSION != LAYOUT::VERSION || header->DIMENSION != DIMENSION ||
+                header->KEY_SIZE != sizeof(KEY_TYPE) || header->POS_SIZE != sizeof(POS_TYPE) ||
+                LAYOUT::BufferSize(0, 0) > header->BUFFER_SIZE || header->BUFFER_SIZE > (size - header_size) / 2) {
+            return false;
+        }
+
+        m_region = (const char *)region;
+        m_buffer_size = header->BUFFER_SIZE;
+        return true;
+    }
+
+    // 在一致的缓冲区上调用 cb(const ViewType &)，数据被覆盖时重试，cb可能被调用多次，只有最后一次的结果有效
+    // 连续 max_retries 次都没有读到完整的数据时返回false
+    template<typename CB>
+    bool Read(CB &&cb, unsigned max_retries = 16) {
+        if(!m_region) {
+            return false;
+        }
+
+        const typename LAYOUT::HeaderType *header = (const typename LAYOUT::HeaderType *)m_region;
+
+        for(unsigned retry = 0; retry < max_retries; ++retry) {
+            int buffer = (int)(header->ACTIVE.load(std::memory_order_acquire) & 1);
+            const std::atomic<uint64_t> &sequence = header->SEQUENCES[buffer];
+            uint64_t seq = sequence.load(std::memory_order_acquire);
+
+            if(seq & 1) {
+                continue;
+            }
+
+            ViewType view(m_region + LAYOUT::BufferOffset(buffer, m_buffer_size), m_buffer_size);
+            cb(view);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if(sequence.load(std::memory_order_relaxed) == seq) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool GetElementPosition(const KEY_TYPE &key, POS_TYPE pos[DIMENSION]) {
+        bool found = false;
+
+        bool ok = Read([&found, &key, pos](const ViewType &view) {
+                    const ELEMENT_TYPE *element = view.Find(key);
+                    found = element != NULL;
+
+                    if(found) {
+                        std::copy(element->POS, element->POS + DIMENSION, pos);
+                    }
+                });
+
+        return ok && found;
+    }
+
+    bool GetMakersList(const KEY_TYPE &key, std::vector<KEY_TYPE> &makers) {
+        bool found = false;
+
+        bool ok = Read([&found, &key, &makers](const ViewType &view) {
+                    const ELEMENT_TYPE *element = view.Find(key);
+                    found = element != NULL;
+                    makers.clear();
+
+                    if(found) {
+                        size_t count = 0;
+                        const KEY_TYPE *relations = view.Relations(element, count);
+                        makers.assign(relations, relations + count);
+                    }
+                });
+
+        return ok && found;
+    }
+
+private:
+    const char *m_region = NULL;
+    uint64_t m_buffer_size = 0;
+};
+
+#endif
@@ -1,8 +1,10 @@
 #include "aoi_group.h"
+#include "aoi_shared_view.h"
 #include <iostream>
 #include <time.h>
 #include <random>
 #include <unordered_map>
+#include <set>
 
 constexpr int OP_EXIT = 0;
 constexpr int OP_ENTER = 1;
@@ -159,9 +161,36 @@ void TestInteractive() {
     }
 }
 
-void TestStress() {
+void TestDebug() {
+    constexpr int DIMENSION = 1;
+
+    long max_watch_range[DIMENSION];
+    for(int i = 0; i < DIMENSION; ++i) {
+        max_watch_range[i] = 20;
+    }
+
+    AoiGroup<unsigned, long, DIMENSION> group(999, max_watch_range);
+    std::mt19937 rng;
+    rng.seed(time(NULL));
+
+    long pos, watch_range;
+
+    pos = -38, watch_range = 20;
+    group.Enter(0, &pos, 1, &watch_range);
+    if(!group.TestSelf()) {std::cout << "WARNING: TEST SELF FAILED" << "\n";}
+
+    pos = -18,  watch_range = 20;
+    group.Enter(1, &pos, 2, &watch_range);
+    if(!group.TestSelf()) {std::cout << "WARNING: TEST SELF FAILED" << "\n";}
+
+    pos = 1;
+    group.MoveDiff(0, &pos);
+    if(!group.TestSelf()) {std::cout << "WARNING: TEST SELF FAILED" << "\n";}
+}
+
+void TestVisibleLimit() {
     constexpr int DIMENSION = 2;
-    constexpr bool TEST_SELF = false;
+    constexpr unsigned LIMIT = 3;
 
     long max_watch_range[DIMENSION];
     for(int i = 0; i < DIMENSION; ++i) {
@@ -170,141 +199,2352 @@ void TestStress() {
 
     AoiGroup<unsigned, long, DIMENSION> group(999, max_watch_range);
     std::mt19937 rng;
-    rng.seed(0x87654321);
+    rng.seed(0x12345678);
 
-    constexpr long pos_max = 1000;
-    constexpr unsigned id_max = 10000;
-    constexpr unsigned move_op = 10000;
+    // 通过事件维护客户端视角的可见集合，和 GetMakersList 比较
+    std::unordered_map<unsigned, std::set<unsigned>> views;
+    bool failed = false;
 
-    // 插入 id_max 个元素
-    {
-        std::cout << "begin insert elements: " << id_max << "\n";
+    group.SetCallback([&views, &failed](unsigned long id, unsigned receiver, unsigned sender, AoiGroup<unsigned, long, DIMENSION>::AOI_EVENT_TYPE event){
+                if(event.EVENT_ID == AOI_EVENT_IDS::ENTER) {
+                    failed = !views[receiver].insert(sender).second || failed;
+                } else if(event.EVENT_ID == AOI_EVENT_IDS::LEAVE) {
+                    failed = !views[receiver].erase(sender) || failed;
+                }
+            });
 
-        unsigned inserted = 0;
-        clock_t tbegin = clock();
-        for(unsigned id = 0; id < id_max; ++id) {
-            long pos[DIMENSION];
+    constexpr long pos_max = 100;
+    constexpr unsigned id_max = 200;
+
+    for(unsigned id = 0; id < id_max; ++id) {
+        long pos[DIMENSION];
+        long watch_range[DIMENSION];
+        for(int i = 0; i < DIMENSION; ++i) {
+            pos[i] = (long)(rng() % pos_max);
+            watch_range[i] = ((long)(rng() % max_watch_range[i])) + 1;
+        }
+        group.Enter(id, pos, 3, watch_range);
+
+        if(id % 2) {
+            group.SetVisibleLimit(id, LIMIT);
+        }
+    }
+
+    for(unsigned op = 0; op < 2000 && !failed; ++op) {
+        unsigned id = rng() % id_max;
+        long diff[DIMENSION];
+        for(int i = 0; i < DIMENSION; ++i) {
+            diff[i] = (long)(rng() % 5) - 2;
+        }
+        group.MoveDiff(id, diff);
+
+        if(op % 100 == 0) {
+            group.SetVisibleLimit(id, rng() % (LIMIT + 1));
+        }
+
+        std::vector<unsigned> makers;
+        group.GetMakersList(id, makers);
+
+        if(!group.TestSelf() || views[id] != std::set<unsigned>(makers.begin(), makers.end())) {
+            failed = true;
+        }
+    }
+
+    if(failed) {
+        std::cout << "WARNING: TEST VISIBLE LIMIT FAILED" << "\n";
+    } else {
+        std::cout << "finish test visible limit" << "\n";
+    }
+}
+
+void TestMakerRadius() {
+    constexpr int DIMENSION = 2;
+
+    long max_watch_range[DIMENSION];
+    long max_maker_radius[DIMENSION];
+    for(int i = 0; i < DIMENSION; ++i) {
+        max_watch_range[i] = 20;
+        max_maker_radius[i] = 40;
+    }
+
+    AoiGroup<unsigned, long, DIMENSION> group(999, max_watch_range, max_maker_radius);
+    std::mt19937 rng;
+    rng.seed(0x23456789);
+
+    constexpr long pos_max = 200;
+    constexpr unsigned id_max = 300;
+
+    for(unsigned id = 0; id < id_max; ++id) {
+        long pos[DIMENSION];
+        long watch_range[DIMENSION];
+        long maker_radius[DIMENSION];
+        for(int i = 0; i < DIMENSION; ++i) {
+            pos[i] = (long)(rng() % pos_max);
+            watch_range[i] = ((long)(rng() % max_watch_range[i])) + 1;
+            // 少数大型maker可以被更远的watcher看到
+            maker_radius[i] = id % 10 ? 0 : (long)(rng() % max_maker_radius[i]);
+        }
+        group.Enter(id, pos, 1 + rng() % 3, watch_range, maker_radius);
+    }
+
+    bool failed = !group.TestSelf();
+
+    for(unsigned op = 0; op < 2000 && !failed; ++op) {
+        unsigned id = rng() % id_max;
+        long diff[DIMENSION];
+        for(int i = 0; i < DIMENSION; ++i) {
+            diff[i] = (long)(rng() % 9) - 4;
+        }
+        group.MoveDiff(id, diff);
+
+        if(op % 50 == 0) {
+            long maker_radius[DIMENSION];
             for(int i = 0; i < DIMENSION; ++i) {
-                pos[i] = (long)(rng() % pos_max);
+                maker_radius[i] = (long)(rng() % max_maker_radius[i]);
             }
+            group.ChangeMakerRadius(id, maker_radius);
+        }
+
+        failed = !group.TestSelf();
+    }
+
+    if(failed) {
+        std::cout << "WARNING: TEST MAKER RADIUS FAILED" << "\n";
+    } else {
+        std::cout << "finish test maker radius" << "\n";
+    }
+}
+
+void TestWatchRangeBuckets() {
+    constexpr int DIMENSION = 2;
+
+    long max_watch_range[DIMENSION];
+    for(int i = 0; i < DIMENSION; ++i) {
+        max_watch_range[i] = 64;
+    }
+
+    AoiGroup<unsigned, long, DIMENSION> group(999, max_watch_range);
+    std::mt19937 rng;
+    rng.seed(0x3456789a);
+
+    constexpr long pos_max = 300;
+    constexpr unsigned id_max = 300;
+
+    // 大部分watcher范围很小，少数使用最大范围
+    for(unsigned id = 0; id < id_max; ++id) {
+        long pos[DIMENSION];
+        long watch_range[DIMENSION];
+        for(int i = 0; i < DIMENSION; ++i) {
+            pos[i] = (long)(rng() % pos_max);
+            watch_range[i] = id % 20 ? ((long)(rng() % 8)) + 1 : max_watch_range[i];
+        }
+        group.Enter(id, pos, 3, watch_range);
+    }
+
+    bool failed = !group.TestSelf();
+
+    for(unsigned op = 0; op < 2000 && !failed; ++op) {
+        unsigned id = rng() % id_max;
+        long diff[DIMENSION];
+        for(int i = 0; i < DIMENSION; ++i) {
+            diff[i] = (long)(rng() % 9) - 4;
+        }
+        group.MoveDiff(id, diff);
+
+        if(op % 20 == 0) {
+            // 范围变化时在分桶之间迁移
             long watch_range[DIMENSION];
             for(int i = 0; i < DIMENSION; ++i) {
                 watch_range[i] = ((long)(rng() % max_watch_range[i])) + 1;
             }
-            inserted += group.Enter(id, pos, 3, watch_range) ? 1 : 0;
-
-            if(false && !group.TestSelf()) {
-                std::cout << "WARNING: TEST SELF FAILED" << "\n";
-                break;
-            }
+            group.ChangeWatchRange(id, watch_range);
         }
-        clock_t tdiff = clock() - tbegin;
 
-        std::cout << "finish insert elements: " << inserted << " COST_TIME=" << (double)tdiff / CLOCKS_PER_SEC << "\n";
+        failed = !group.TestSelf();
     }
-    
-    // 移动所有元素
-    {
-        std::cout << "begin move elements: " << id_max << "\n";
 
-        unsigned moved = 0;
-        clock_t tbegin = clock();
-        for(unsigned id = 0; id < move_op && id < id_max; ++id) {
-            long pos[DIMENSION];
+    if(failed) {
+        std::cout << "WARNING: TEST WATCH RANGE BUCKETS FAILED" << "\n";
+    } else {
+        std::cout << "finish test watch range buckets" << "\n";
+    }
+}
+
+void TestChangeWatchRange() {
+    constexpr int DIMENSION = 2;
+
+    long max_watch_range[DIMENSION];
+    for(int i = 0; i < DIMENSION; ++i) {
+        max_watch_range[i] = 30;
+    }
+
+    AoiGroup<unsigned, long, DIMENSION, true> group(999, max_watch_range);
+    std::mt19937 rng;
+    rng.seed(0x456789ab);
+
+    // 只改变范围时不应该产生MOVE事件
+    std::unordered_map<unsigned, std::set<unsigned>> views;
+    bool failed = false;
+    bool changing_range = false;
+
+    group.SetCallback([&views, &failed, &changing_range](unsigned long id, unsigned receiver, unsigned sender, AoiGroup<unsigned, long, DIMENSION, true>::AOI_EVENT_TYPE event){
+                if(event.EVENT_ID == AOI_EVENT_IDS::ENTER) {
+                    failed = !views[receiver].insert(sender).second || failed;
+                } else if(event.EVENT_ID == AOI_EVENT_IDS::LEAVE) {
+                    failed = !views[receiver].erase(sender) || failed;
+                } else if(event.EVENT_ID == AOI_EVENT_IDS::MOVE) {
+                    failed = changing_range || !views[receiver].count(sender) || failed;
+                }
+            });
+
+    constexpr long pos_max = 200;
+    constexpr unsigned id_max = 300;
+
+    long watch_ranges[id_max][DIMENSION];
+
+    for(unsigned id = 0; id < id_max; ++id) {
+        long pos[DIMENSION];
+        for(int i = 0; i < DIMENSION; ++i) {
+            pos[i] = (long)(rng() % pos_max);
+            watch_ranges[id][i] = ((long)(rng() % max_watch_range[i])) + 1;
+        }
+        group.Enter(id, pos, 3, watch_ranges[id]);
+    }
+
+    for(unsigned op = 0; op < 3000 && !failed; ++op) {
+        unsigned id = rng() % id_max;
+
+        if(op % 3) {
+            // 范围小幅度伸缩
             for(int i = 0; i < DIMENSION; ++i) {
-                pos[i] = (long)(rng() % pos_max);
+                watch_ranges[id][i] += (long)(rng() % 5) - 2;
+                watch_ranges[id][i] = std::max(0L, std::min(watch_ranges[id][i], max_watch_range[i]));
             }
-            moved += group.Move(id, pos) ? 1 : 0;
 
-            if(TEST_SELF && !group.TestSelf()) {
-                std::cout << "WARNING: TEST SELF FAILED" << "\n";
-                break;
+            changing_range = true;
+            failed = !group.ChangeWatchRange(id, watch_ranges[id]) || failed;
+            changing_range = false;
+        } else {
+            long diff[DIMENSION];
+            for(int i = 0; i < DIMENSION; ++i) {
+                diff[i] = (long)(rng() % 5) - 2;
             }
+            group.MoveDiff(id, diff);
+        }
+
+        std::vector<unsigned> makers;
+        group.GetMakersList(id, makers);
+
+        if(!group.TestSelf() || views[id] != std::set<unsigned>(makers.begin(), makers.end())) {
+            failed = true;
         }
-        clock_t tdiff = clock() - tbegin;
+    }
+
+    if(failed) {
+        std::cout << "WARNING: TEST CHANGE WATCH RANGE FAILED" << "\n";
+    } else {
+        std::cout << "finish test change watch range" << "\n";
+    }
+}
+
+void TestHysteresis() {
+    constexpr int DIMENSION = 2;
+
+    long max_watch_range[DIMENSION] = { 10, 10 };
+    long max_maker_radius[DIMENSION] = { 0, 0 };
+    long hysteresis[DIMENSION] = { 3, 3 };
 
-        std::cout << "finish move elements: " << moved << " COST_TIME=" << (double)tdiff / CLOCKS_PER_SEC << "\n";
+    AoiGroup<unsigned, long, DIMENSION> group(999, max_watch_range, max_maker_radius, hysteresis);
+
+    unsigned enter_count = 0;
+    unsigned leave_count = 0;
+
+    group.SetCallback([&enter_count, &leave_count](unsigned long id, unsigned receiver, unsigned sender, AoiGroup<unsigned, long, DIMENSION>::AOI_EVENT_TYPE event){
+                if(receiver != 1 || sender != 2) {
+                    return;
+                }
+
+                if(event.EVENT_ID == AOI_EVENT_IDS::ENTER) {
+                    ++enter_count;
+                } else if(event.EVENT_ID == AOI_EVENT_IDS::LEAVE) {
+                    ++leave_count;
+                }
+            });
+
+    long watcher_pos[DIMENSION] = { 0, 0 };
+    long maker_pos[DIMENSION] = { 11, 0 };
+
+    group.Enter(1, watcher_pos, AOI_WATCH_TYPES::WATCHER, max_watch_range);
+    group.Enter(2, maker_pos, AOI_WATCH_TYPES::MAKER);
+
+    bool failed = enter_count != 0;
+
+    // 在边界附近来回抖动，只进入一次
+    for(int i = 0; i < 10; ++i) {
+        long diff[DIMENSION] = { i % 2 ? 3 : -3, 0 };
+        group.MoveDiff(2, diff);
+    }
+
+    failed = failed || enter_count != 1 || leave_count != 0;
+
+    // 超出 range + hysteresis 才离开
+    long far_pos[DIMENSION] = { 13, 0 };
+    group.Move(2, far_pos);
+    failed = failed || leave_count != 1;
+
+    // watcher缩小范围时同样按照滞后距离判断
+    long near_pos[DIMENSION] = { 9, 0 };
+    long watch_range[DIMENSION] = { 7, 7 };
+    group.Move(2, near_pos);
+    group.ChangeWatchRange(1, watch_range);
+    failed = failed || enter_count != 2 || leave_count != 1;
+
+    watch_range[0] = watch_range[1] = 6;
+    group.ChangeWatchRange(1, watch_range);
+    failed = failed || leave_count != 2;
+
+    failed = failed || !group.TestSelf();
+
+    if(failed) {
+        std::cout << "WARNING: TEST HYSTERESIS FAILED" << "\n";
+    } else {
+        std::cout << "finish test hysteresis" << "\n";
+    }
+}
+
+void TestKinetic() {
+    constexpr int DIMENSION = 2;
+
+    long max_watch_range[DIMENSION];
+    for(int i = 0; i < DIMENSION; ++i) {
+        max_watch_range[i] = 20;
+    }
+
+    // kinetic 按速度推进时间，reference 每帧调用 MoveDiff，两边的关系应该一致
+    AoiGroup<unsigned, long, DIMENSION> kinetic(999, max_watch_range);
+    AoiGroup<unsigned, long, DIMENSION> reference(999, max_watch_range);
+    kinetic.SetKineticHorizon(8);
+
+    std::mt19937 rng;
+    rng.seed(0x56789abc);
+
+    constexpr long pos_max = 300;
+    constexpr unsigned id_max = 300;
+
+    long velocities[id_max][DIMENSION];
+
+    for(unsigned id = 0; id < id_max; ++id) {
+        long pos[DIMENSION];
+        long watch_range[DIMENSION];
+        for(int i = 0; i < DIMENSION; ++i) {
+            pos[i] = (long)(rng() % pos_max);
+            watch_range[i] = ((long)(rng() % max_watch_range[i])) + 1;
+            // 一半的元素匀速运动
+            velocities[id][i] = id % 2 ? (long)(rng() % 5) - 2 : 0;
+        }
+        int watch_type = 1 + rng() % 3;
+        kinetic.Enter(id, pos, watch_type, watch_range);
+        reference.Enter(id, pos, watch_type, watch_range);
+        kinetic.SetVelocity(id, velocities[id]);
     }
 
-    // 小幅移动所有元素
-    {
-        std::cout << "begin shift elements: " << id_max << "\n";
+    bool failed = false;
 
-        unsigned shifted = 0;
-        clock_t tbegin = clock();
-        for(unsigned id = 0; id < move_op && id < id_max; ++id) {
+    for(long now = 1; now < 500 && !failed; ++now) {
+        // 静止的元素偶尔被直接移动，运动的元素偶尔改变速度
+        unsigned id = rng() % id_max;
+        if(id % 2) {
+            for(int i = 0; i < DIMENSION; ++i) {
+                velocities[id][i] = (long)(rng() % 5) - 2;
+            }
+            kinetic.SetVelocity(id, velocities[id]);
+        } else {
             long diff[DIMENSION];
             for(int i = 0; i < DIMENSION; ++i) {
-                diff[i] = (long)(rng() % 3) - 1;
+                diff[i] = (long)(rng() % 9) - 4;
             }
-            shifted += group.MoveDiff(id, diff);
+            kinetic.MoveDiff(id, diff);
+            reference.MoveDiff(id, diff);
+        }
 
-            if(TEST_SELF && !group.TestSelf()) {
-                std::cout << "WARNING: TEST SELF FAILED" << "\n";
-                break;
-            }
+        kinetic.AdvanceTime(now);
+        for(unsigned k = 1; k < id_max; k += 2) {
+            reference.MoveDiff(k, velocities[k]);
         }
-        clock_t tdiff = clock() - tbegin;
 
-        std::cout << "finish shift elements: " << shifted << " COST_TIME=" << (double)tdiff / CLOCKS_PER_SEC << "\n";
+        failed = !kinetic.TestSelf();
+
+        for(unsigned k = 0; k < id_max && !failed; ++k) {
+            std::vector<unsigned> kinetic_makers;
+            std::vector<unsigned> reference_makers;
+            kinetic.GetMakersList(k, kinetic_makers);
+            reference.GetMakersList(k, reference_makers);
+
+            failed = std::set<unsigned>(kinetic_makers.begin(), kinetic_makers.end()) !=
+                std::set<unsigned>(reference_makers.begin(), reference_makers.end());
+        }
     }
 
-    // 删除所有元素
-    {
-        std::cout << "begin remove elements: " << id_max << "\n";
+    if(failed) {
+        std::cout << "WARNING: TEST KINETIC FAILED" << "\n";
+    } else {
+        std::cout << "finish test kinetic" << "\n";
+    }
+}
 
-        unsigned deleted = 0;
-        clock_t tbegin = clock();
-        for(unsigned id = 0; id < id_max; ++id) {
-            deleted += group.Leave(id) ? 1 : 0;
+void TestDormantMakers() {
+    constexpr int DIMENSION = 2;
 
-            if(false && !group.TestSelf()) {
-                std::cout << "WARNING: TEST SELF FAILED" << "\n";
-                break;
+    long max_watch_range[DIMENSION];
+    for(int i = 0; i < DIMENSION; ++i) {
+        max_watch_range[i] = 20;
+    }
+
+    AoiGroup<unsigned, long, DIMENSION> group(999, max_watch_range);
+    std::mt19937 rng;
+    rng.seed(0x6789abcd);
+
+    std::unordered_map<unsigned, std::set<unsigned>> views;
+    bool failed = false;
+
+    group.SetCallback([&views, &failed](unsigned long id, unsigned receiver, unsigned sender, AoiGroup<unsigned, long, DIMENSION>::AOI_EVENT_TYPE event){
+                if(event.EVENT_ID == AOI_EVENT_IDS::ENTER) {
+                    failed = !views[receiver].insert(sender).second || failed;
+                } else if(event.EVENT_ID == AOI_EVENT_IDS::LEAVE) {
+                    failed = !views[receiver].erase(sender) || failed;
+                }
+            });
+
+    // 大地图上只有少数watcher，大部分maker附近没有watcher
+    constexpr long pos_max = 600;
+    constexpr unsigned watcher_count = 4;
+    constexpr unsigned id_max = 400;
+
+    for(unsigned id = 0; id < id_max; ++id) {
+        long pos[DIMENSION];
+        for(int i = 0; i < DIMENSION; ++i) {
+            pos[i] = (long)(rng() % pos_max);
+        }
+
+        if(id < watcher_count) {
+            group.Enter(id, pos, AOI_WATCH_TYPES::WATCHER, max_watch_range);
+        } else {
+            group.Enter(id, pos, AOI_WATCH_TYPES::MAKER);
+        }
+    }
+
+    for(unsigned op = 0; op < 20000 && !failed; ++op) {
+        unsigned id = rng() % id_max;
+        long diff[DIMENSION];
+        for(int i = 0; i < DIMENSION; ++i) {
+            // watcher走得快，maker在原地附近游荡
+            diff[i] = id < watcher_count ? (long)(rng() % 41) - 20 : (long)(rng() % 9) - 4;
+        }
+        group.MoveDiff(id, diff);
+
+        if(op % 100 != 0) {
+            continue;
+        }
+
+        failed = !group.TestSelf();
+
+        // 按实际位置计算每个watcher应该看到的maker
+        for(unsigned watcher = 0; watcher < watcher_count && !failed; ++watcher) {
+            long watcher_pos[DIMENSION];
+            group.GetElementPosition(watcher, watcher_pos);
+
+            std::set<unsigned> expected;
+
+            for(unsigned maker = watcher_count; maker < id_max; ++maker) {
+                long maker_pos[DIMENSION];
+                group.GetElementPosition(maker, maker_pos);
+
+                bool inside = true;
+                for(int i = 0; i < DIMENSION; ++i) {
+                    long d = maker_pos[i] - watcher_pos[i];
+                    inside = inside && -max_watch_range[i] < d && d < max_watch_range[i];
+                }
+
+                if(inside) {
+                    expected.insert(maker);
+                }
             }
+
+            failed = expected != views[watcher];
         }
-        clock_t tdiff = clock() - tbegin;
+    }
+
+    // 两个维度上各有一个watcher落在锚点附近的区间内，但都不在锚点附近的盒子内，maker仍然可以休眠，
+    // watcher走近后要能看到它
+    if(!failed) {
+        AoiGroup<unsigned, long, DIMENSION> box_group(999, max_watch_range);
+        std::set<unsigned> box_views;
+
+        box_group.SetCallback([&box_views](unsigned long id, unsigned receiver, unsigned sender, AoiGroup<unsigned, long, DIMENSION>::AOI_EVENT_TYPE event){
+                    if(receiver == 1 && event.EVENT_ID == AOI_EVENT_IDS::ENTER) {
+                        box_views.insert(sender);
+                    }
+                });
+
+        long maker_pos[DIMENSION] = { 0, 0 };
+        long row_pos[DIMENSION] = { 0, 200 };
+        long column_pos[DIMENSION] = { 200, 0 };
+
+        box_group.Enter(1, row_pos, AOI_WATCH_TYPES::WATCHER, max_watch_range);
+        box_group.Enter(2, column_pos, AOI_WATCH_TYPES::WATCHER, max_watch_range);
+        box_group.Enter(3, maker_pos, AOI_WATCH_TYPES::MAKER);
+
+        long wander[DIMENSION] = { 5, 5 };
+        box_group.Move(3, wander);
 
-        std::cout << "finish remove elements: " << deleted << " COST_TIME=" << (double)tdiff / CLOCKS_PER_SEC << "\n";
+        long near_pos[DIMENSION] = { 0, 30 };
+        box_group.Move(1, near_pos);
+        failed = !box_views.empty() || !box_group.TestSelf();
+
+        near_pos[1] = 10;
+        box_group.Move(1, near_pos);
+        failed = failed || box_views.count(3) != 1 || !box_group.TestSelf();
     }
 
-    /*
-    std::cout << "DUMP: " << "\n";
-    std::cout << group.DumpElements() << "\n";
-    std::cout << group.DumpSlist() << "\n";
-    */
+    if(failed) {
+        std::cout << "WARNING: TEST DORMANT MAKERS FAILED" << "\n";
+    } else {
+        std::cout << "finish test dormant makers" << "\n";
+    }
 }
 
-void TestDebug() {
-    constexpr int DIMENSION = 1;
+void TestMoveChooser() {
+    constexpr int DIMENSION = 2;
 
     long max_watch_range[DIMENSION];
     for(int i = 0; i < DIMENSION; ++i) {
-        max_watch_range[i] = 20;
+        max_watch_range[i] = 30;
     }
 
     AoiGroup<unsigned, long, DIMENSION> group(999, max_watch_range);
     std::mt19937 rng;
-    rng.seed(time(NULL));
+    rng.seed(0x3456789a);
 
-    long pos, watch_range;
+    std::unordered_map<unsigned, std::set<unsigned>> views;
+    bool failed = false;
 
-    pos = -38, watch_range = 20;
-    group.Enter(0, &pos, 1, &watch_range);
-    if(!group.TestSelf()) {std::cout << "WARNING: TEST SELF FAILED" << "\n";}
+    group.SetCallback([&views, &failed](unsigned long id, unsigned receiver, unsigned sender, AoiGroup<unsigned, long, DIMENSION>::AOI_EVENT_TYPE event){
+                if(event.EVENT_ID == AOI_EVENT_IDS::ENTER) {
+                    failed = !views[receiver].insert(sender).second || failed;
+                } else if(event.EVENT_ID == AOI_EVENT_IDS::LEAVE) {
+                    failed = !views[receiver].erase(sender) || failed;
+                }
+            });
 
-    pos = -18,  watch_range = 20;
-    group.Enter(1, &pos, 2, &watch_range);
-    if(!group.TestSelf()) {std::cout << "WARNING: TEST SELF FAILED" << "\n";}
+    constexpr long pos_max = 300;
+    constexpr unsigned id_max = 300;
 
-    pos = 1;
-    group.MoveDiff(0, &pos);
-    if(!group.TestSelf()) {std::cout << "WARNING: TEST SELF FAILED" << "\n";}
+    for(unsigned id = 0; id < id_max; ++id) {
+        long pos[DIMENSION];
+        for(int i = 0; i < DIMENSION; ++i) {
+            pos[i] = (long)(rng() % pos_max);
+        }
+        group.Enter(id, pos, AOI_WATCH_TYPES::BOTH, max_watch_range);
+    }
+
+    // 小步移动为主，偶尔跳得很远
+    for(unsigned op = 0; op < 20000 && !failed; ++op) {
+        unsigned id = rng() % id_max;
+        long diff[DIMENSION];
+        for(int i = 0; i < DIMENSION; ++i) {
+            diff[i] = op % 50 == 0 ? (long)(rng() % pos_max) : (long)(rng() % 7) - 3;
+        }
+        group.MoveDiff(id, diff);
+
+        if(op % 500 != 0) {
+            continue;
+        }
+
+        failed = !group.TestSelf();
+
+        for(unsigned watcher = 0; watcher < id_max && !failed; ++watcher) {
+            long watcher_pos[DIMENSION];
+            group.GetElementPosition(watcher, watcher_pos);
+
+            std::set<unsigned> expected;
+
+            for(unsigned maker = 0; maker < id_max; ++maker) {
+                long maker_pos[DIMENSION];
+                group.GetElementPosition(maker, maker_pos);
+
+                bool inside = maker != watcher;
+                for(int i = 0; i < DIMENSION; ++i) {
+                    long d = maker_pos[i] - watcher_pos[i];
+                    inside = inside && -max_watch_range[i] < d && d < max_watch_range[i];
+                }
+
+                if(inside) {
+                    expected.insert(maker);
+                }
+            }
+
+            failed = expected != views[watcher];
+        }
+    }
+
+    // 两种方式都应该被测量过，小步移动大多使用缓存推算
+    const auto &stats = group.GetMoveChooserStats();
+
+    failed = failed || !(stats.WATCHER_SHIFTS && stats.WATCHER_UPDATES && stats.MAKER_SHIFTS && stats.MAKER_UPDATES);
+    failed = failed || !(stats.WATCHER_UPDATE_WEIGHT > 0 && stats.WATCHER_SHIFT_WEIGHT > 0);
+    failed = failed || !(stats.MAKER_UPDATE_WEIGHT > 0 && stats.MAKER_SHIFT_WEIGHT > 0);
+    failed = failed || !(stats.HINT_CACHE_HITS > stats.HINT_CACHE_MISSES);
+
+    std::cout << "move chooser: watcher update/shift " << stats.WATCHER_UPDATES << "/" << stats.WATCHER_SHIFTS
+        << ", maker update/shift " << stats.MAKER_UPDATES << "/" << stats.MAKER_SHIFTS
+        << ", hint cache hit/miss " << stats.HINT_CACHE_HITS << "/" << stats.HINT_CACHE_MISSES << "\n";
+
+    group.ResetMoveChooserStats();
+    failed = failed || stats.WATCHER_SHIFTS || stats.HINT_CACHE_HITS || !(stats.WATCHER_SHIFT_WEIGHT > 0);
+
+    if(failed) {
+        std::cout << "WARNING: TEST MOVE CHOOSER FAILED" << "\n";
+    } else {
+        std::cout << "finish test move chooser" << "\n";
+    }
+}
+
+void TestCorridorQuery() {
+    constexpr int DIMENSION = 2;
+
+    long max_watch_range[DIMENSION];
+    for(int i = 0; i < DIMENSION; ++i) {
+        max_watch_range[i] = 60;
+    }
+
+    AoiGroup<unsigned, long, DIMENSION> group(999, max_watch_range);
+    std::mt19937 rng;
+    rng.seed(0x13572468);
+
+    std::unordered_map<unsigned, std::set<unsigned>> views;
+    bool failed = false;
+
+    group.SetCallback([&views, &failed](unsigned long id, unsigned receiver, unsigned sender, AoiGroup<unsigned, long, DIMENSION>::AOI_EVENT_TYPE event){
+                if(event.EVENT_ID == AOI_EVENT_IDS::ENTER) {
+                    failed = !views[receiver].insert(sender).second || failed;
+                } else if(event.EVENT_ID == AOI_EVENT_IDS::LEAVE) {
+                    failed = !views[receiver].erase(sender) || failed;
+                }
+            });
+
+    // 十字形的两条走廊，单看任一维度都有很多候选，交集很小
+    constexpr long pos_max = 4000;
+    constexpr long corridor = 80;
+    constexpr unsigned watcher_count = 20;
+    constexpr unsigned id_max = 3000;
+
+    for(unsigned id = 0; id < id_max; ++id) {
+        long along = (long)(rng() % pos_max);
+        long across = pos_max / 2 - corridor / 2 + (long)(rng() % corridor);
+        long pos[DIMENSION] = { along, across };
+
+        if(id % 2) {
+            std::swap(pos[0], pos[1]);
+        }
+
+        if(id < watcher_count) {
+            group.Enter(id, pos, AOI_WATCH_TYPES::WATCHER, max_watch_range);
+        } else {
+            group.Enter(id, pos, AOI_WATCH_TYPES::MAKER);
+        }
+    }
+
+    // watcher在走廊里跳跃，每次都重新查询
+    for(unsigned op = 0; op < 2000 && !failed; ++op) {
+        unsigned id = rng() % watcher_count;
+        long pos[DIMENSION] = { (long)(rng() % pos_max), pos_max / 2 - corridor + (long)(rng() % (corridor * 2)) };
+
+        if(op % 2) {
+            std::swap(pos[0], pos[1]);
+        }
+
+        group.Move(id, pos);
+
+        if(op % 100 != 0) {
+            continue;
+        }
+
+        failed = !group.TestSelf();
+
+        for(unsigned watcher = 0; watcher < watcher_count && !failed; ++watcher) {
+            long watcher_pos[DIMENSION];
+            group.GetElementPosition(watcher, watcher_pos);
+
+            std::set<unsigned> expected;
+
+            for(unsigned maker = watcher_count; maker < id_max; ++maker) {
+                long maker_pos[DIMENSION];
+                group.GetElementPosition(maker, maker_pos);
+
+                bool inside = true;
+                for(int i = 0; i < DIMENSION; ++i) {
+                    long d = maker_pos[i] - watcher_pos[i];
+                    inside = inside && -max_watch_range[i] < d && d < max_watch_range[i];
+                }
+
+                if(inside) {
+                    expected.insert(maker);
+                }
+            }
+
+            failed = expected != views[watcher];
+        }
+    }
+
+    if(failed) {
+        std::cout << "WARNING: TEST CORRIDOR QUERY FAILED" << "\n";
+    } else {
+        std::cout << "finish test corridor query" << "\n";
+    }
+}
+
+// 整批筛选的结果要和逐个判断完全一致，-mavx2 编译时覆盖向量化的实现和剩余的尾部
+// 取值范围很小，大量候选正好落在边界上
+template<typename PosType>
+bool TestBatchFilterType(std::mt19937 &rng) {
+    constexpr int max_count = 19;
+    PosType pos[max_count];
+    PosType extent[max_count];
+    unsigned char mask[max_count];
+    unsigned char batch_point[max_count];
+    unsigned char batch_box[max_count];
+
+    for(int round = 0; round < 20000; ++round) {
+        size_t n = rng() % (max_count + 1);
+        PosType center = (PosType)((long)(rng() % 9) - 4);
+        PosType radius = (PosType)(long)(rng() % 4);
+
+        for(size_t j = 0; j < n; ++j) {
+            pos[j] = (PosType)((long)(rng() % 17) - 8);
+            extent[j] = (PosType)(long)(rng() % 5);
+            mask[j] = (unsigned char)(rng() % 4 != 0);
+            batch_point[j] = mask[j];
+            batch_box[j] = mask[j];
+        }
+
+        // 超出 n 的部分不能被改写
+        for(size_t j = n; j < max_count; ++j) {
+            batch_point[j] = 2;
+            batch_box[j] = 2;
+        }
+
+        AoiBatchFilter<PosType>::FilterPoint(center - radius, center + radius, pos, extent, n, batch_point);
+        AoiBatchFilter<PosType>::FilterBox(center, radius, pos, extent, n, batch_box);
+
+        for(size_t j = 0; j < n; ++j) {
+            bool point = mask[j] && center - radius - extent[j] < pos[j] && pos[j] < center + radius + extent[j];
+            bool box = mask[j] && pos[j] - extent[j] - radius < center && center < pos[j] + extent[j] + radius;
+
+            if(batch_point[j] != (unsigned char)point || batch_box[j] != (unsigned char)box) {
+                return false;
+            }
+        }
+
+        for(size_t j = n; j < max_count; ++j) {
+            if(batch_point[j] != 2 || batch_box[j] != 2) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void TestBatchFilter() {
+    std::mt19937 rng;
+    rng.seed(0x5eed1234);
+
+    bool failed = !TestBatchFilterType<double>(rng) || !TestBatchFilterType<long>(rng) || !TestBatchFilterType<int>(rng);
+
+    if(failed) {
+        std::cout << "WARNING: TEST BATCH FILTER FAILED" << "\n";
+    } else {
+#if defined(__AVX2__)
+        std::cout << "finish test batch filter (avx2)" << "\n";
+#else
+        std::cout << "finish test batch filter" << "\n";
+#endif
+    }
+}
+
+void TestStaticMakers() {
+    constexpr int DIMENSION = 2;
+
+    long max_watch_range[DIMENSION];
+    for(int i = 0; i < DIMENSION; ++i) {
+        max_watch_range[i] = 30;
+    }
+
+    AoiGroup<unsigned, long, DIMENSION> group(999, max_watch_range);
+    std::mt19937 rng;
+    rng.seed(0x2468ace0);
+
+    std::unordered_map<unsigned, std::set<unsigned>> views;
+    bool failed = false;
+
+    group.SetCallback([&views, &failed](unsigned long id, unsigned receiver, unsigned sender, AoiGroup<unsigned, long, DIMENSION>::AOI_EVENT_TYPE event){
+                if(event.EVENT_ID == AOI_EVENT_IDS::ENTER) {
+                    failed = !views[receiver].insert(sender).second || failed;
+                } else if(event.EVENT_ID == AOI_EVENT_IDS::LEAVE) {
+                    failed = !views[receiver].erase(sender) || failed;
+                }
+            });
+
+    // 前面是watcher，中间是会移动的maker，后面是静态maker
+    constexpr long pos_max = 500;
+    constexpr unsigned watcher_count = 20;
+    constexpr unsigned dynamic_max = 200;
+    constexpr unsigned id_max = 1000;
+
+    std::set<unsigned> alive;
+
+    for(unsigned id = 0; id < id_max; ++id) {
+        long pos[DIMENSION];
+        for(int i = 0; i < DIMENSION; ++i) {
+            pos[i] = (long)(rng() % pos_max);
+        }
+
+        if(id < watcher_count) {
+            group.Enter(id, pos, AOI_WATCH_TYPES::WATCHER, max_watch_range);
+        } else if(id < dynamic_max) {
+            group.Enter(id, pos, AOI_WATCH_TYPES::MAKER);
+        } else {
+            group.EnterStatic(id, pos);
+        }
+
+        alive.insert(id);
+    }
+
+    long diff[DIMENSION] = { 1, 1 };
+    failed = group.MoveDiff(dynamic_max, diff) || failed; // 静态maker不能移动
+
+    for(unsigned op = 0; op < 20000 && !failed; ++op) {
+        unsigned id = rng() % id_max;
+
+        if(id >= dynamic_max) {
+            // 静态maker离开或者重新加入
+            if(alive.count(id)) {
+                group.Leave(id);
+                alive.erase(id);
+            } else {
+                long pos[DIMENSION];
+                for(int i = 0; i < DIMENSION; ++i) {
+                    pos[i] = (long)(rng() % pos_max);
+                }
+                group.EnterStatic(id, pos);
+                alive.insert(id);
+            }
+        } else {
+            for(int i = 0; i < DIMENSION; ++i) {
+                diff[i] = (long)(rng() % 21) - 10;
+            }
+            group.MoveDiff(id, diff);
+        }
+
+        if(op % 500 != 0) {
+            continue;
+        }
+
+        failed = !group.TestSelf();
+
+        for(unsigned watcher = 0; watcher < watcher_count && !failed; ++watcher) {
+            long watcher_pos[DIMENSION];
+            group.GetElementPosition(watcher, watcher_pos);
+
+            std::set<unsigned> expected;
+
+            for(unsigned maker: alive) {
+                long maker_pos[DIMENSION];
+
+                if(maker < watcher_count || !group.GetElementPosition(maker, maker_pos)) {
+                    continue;
+                }
+
+                bool inside = true;
+                for(int i = 0; i < DIMENSION; ++i) {
+                    long d = maker_pos[i] - watcher_pos[i];
+                    inside = inside && -max_watch_range[i] < d && d < max_watch_range[i];
+                }
+
+                if(inside) {
+                    expected.insert(maker);
+                }
+            }
+
+            failed = expected != views[watcher];
+        }
+    }
+
+    if(failed) {
+        std::cout << "WARNING: TEST STATIC MAKERS FAILED" << "\n";
+    } else {
+        std::cout << "finish test static makers" << "\n";
+    }
+}
+
+void TestTriggers() {
+    constexpr int DIMENSION = 2;
+
+    long max_watch_range[DIMENSION];
+    for(int i = 0; i < DIMENSION; ++i) {
+        max_watch_range[i] = 20;
+    }
+
+    AoiGroup<unsigned, long, DIMENSION> group(999, max_watch_range);
+    std::mt19937 rng;
+    rng.seed(0x13572468);
+
+    std::unordered_map<unsigned, std::set<unsigned>> views;
+    bool failed = false;
+
+    group.SetCallback([&views, &failed](unsigned long id, unsigned receiver, unsigned sender, AoiGroup<unsigned, long, DIMENSION>::AOI_EVENT_TYPE event){
+                if(event.EVENT_ID == AOI_EVENT_IDS::ENTER) {
+                    failed = !views[receiver].insert(sender).second || failed;
+                } else if(event.EVENT_ID == AOI_EVENT_IDS::LEAVE) {
+                    failed = !views[receiver].erase(sender) || failed;
+                }
+            });
+
+    // 前面是触发器，范围远大于 max_watch_range，后面是会移动的maker
+    constexpr long pos_max = 1000;
+    constexpr unsigned trigger_count = 30;
+    constexpr unsigned id_max = 500;
+
+    std::unordered_map<unsigned, std::pair<std::vector<long>, std::vector<long>>> triggers;
+
+    auto enter_trigger = [&group, &rng, &triggers](unsigned id) {
+        long pos[DIMENSION];
+        long range[DIMENSION];
+        for(int i = 0; i < DIMENSION; ++i) {
+            pos[i] = (long)(rng() % pos_max);
+            range[i] = 20 + (long)(rng() % 200);
+        }
+
+        group.EnterTrigger(id, pos, range);
+        triggers[id] = std::make_pair(std::vector<long>(pos, pos + DIMENSION), std::vector<long>(range, range + DIMENSION));
+    };
+
+    for(unsigned id = 0; id < id_max; ++id) {
+        if(id < trigger_count) {
+            enter_trigger(id);
+        } else {
+            long pos[DIMENSION];
+            for(int i = 0; i < DIMENSION; ++i) {
+                pos[i] = (long)(rng() % pos_max);
+            }
+
+            group.Enter(id, pos, AOI_WATCH_TYPES::MAKER);
+        }
+    }
+
+    long diff[DIMENSION] = { 1, 1 };
+    failed = group.MoveDiff(0, diff) || group.ChangeWatchRange(0, max_watch_range) || failed; // 触发器不能移动、改变范围
+
+    for(unsigned op = 0; op < 20000 && !failed; ++op) {
+        unsigned id = rng() % id_max;
+
+        if(id < trigger_count) {
+            // 偶尔有触发器离开后在别处重新加入
+            if(rng() % 20 == 0) {
+                group.Leave(id);
+                triggers.erase(id);
+                views.erase(id);
+                enter_trigger(id);
+            }
+        } else if(rng() % 10 == 0) {
+            long pos[DIMENSION];
+            for(int i = 0; i < DIMENSION; ++i) {
+                pos[i] = (long)(rng() % pos_max);
+            }
+            group.Move(id, pos);
+        } else {
+            for(int i = 0; i < DIMENSION; ++i) {
+                diff[i] = (long)(rng() % 21) - 10;
+            }
+            group.MoveDiff(id, diff);
+        }
+
+        if(op % 500 != 0) {
+            continue;
+        }
+
+        failed = !group.TestSelf();
+
+        for(auto iter = triggers.begin(); iter != triggers.end() && !failed; ++iter) {
+            std::set<unsigned> expected;
+
+            for(unsigned maker = trigger_count; maker < id_max; ++maker) {
+                long maker_pos[DIMENSION];
+                group.GetElementPosition(maker, maker_pos);
+
+                bool inside = true;
+                for(int i = 0; i < DIMENSION; ++i) {
+                    long d = maker_pos[i] - iter->second.first[i];
+                    inside = inside && -iter->second.second[i] < d && d < iter->second.second[i];
+                }
+
+                if(inside) {
+                    expected.insert(maker);
+                }
+            }
+
+            failed = expected != views[iter->first];
+        }
+    }
+
+    if(failed) {
+        std::cout << "WARNING: TEST TRIGGERS FAILED" << "\n";
+    } else {
+        std::cout << "finish test triggers" << "\n";
+    }
+}
+
+void TestSnapshot() {
+    constexpr int DIMENSION = 2;
+    using GroupType = AoiGroup<unsigned, long, DIMENSION>;
+
+    long max_watch_range[DIMENSION] = { 30, 30 };
+    long max_maker_radius[DIMENSION] = { 5, 5 };
+    long hysteresis[DIMENSION] = { 2, 2 };
+
+    GroupType source(1, max_watch_range, max_maker_radius, hysteresis);
+    GroupType restored(2, max_watch_range, max_maker_radius, hysteresis);
+    source.SetKineticHorizon(8);
+    restored.SetKineticHorizon(8);
+
+    std::unordered_map<unsigned, std::set<unsigned>> source_views;
+    std::unordered_map<unsigned, std::set<unsigned>> restored_views;
+    bool failed = false;
+
+    auto make_callback = [&failed](std::unordered_map<unsigned, std::set<unsigned>> &views) {
+        return [&views, &failed](unsigned long id, unsigned receiver, unsigned sender, GroupType::AOI_EVENT_TYPE event) {
+            if(event.EVENT_ID == AOI_EVENT_IDS::ENTER) {
+                failed = !views[receiver].insert(sender).second || failed;
+            } else if(event.EVENT_ID == AOI_EVENT_IDS::LEAVE) {
+                failed = !views[receiver].erase(sender) || failed;
+            }
+        };
+    };
+
+    source.SetCallback(make_callback(source_views));
+
+    constexpr unsigned id_max = 400;
+    constexpr long pos_max = 600;
+    long now = 0;
+
+    // 同样的随机序列在两个group上产生同样的操作
+    auto random_op = [&now, &max_maker_radius](GroupType &group, std::unordered_map<unsigned, std::set<unsigned>> &views, std::mt19937 &rng) {
+        unsigned id = rng() % id_max;
+        unsigned op = rng() % 16;
+
+        long pos[DIMENSION];
+        long range[DIMENSION];
+        for(int i = 0; i < DIMENSION; ++i) {
+            pos[i] = (long)(rng() % pos_max);
+            range[i] = (long)(rng() % 40);
+        }
+
+        if(op < 2) {
+            group.Enter(id, pos, 1 + rng() % 3, range, max_maker_radius);
+        } else if(op == 2) {
+            group.EnterStatic(id, pos);
+        } else if(op == 3) {
+            group.EnterTrigger(id, pos, range);
+        } else if(op == 4) {
+            if(group.Leave(id)) {
+                views.erase(id);
+            }
+        } else if(op == 5) {
+            group.SetVisibleLimit(id, rng() % 4);
+        } else if(op == 6) {
+            long velocity[DIMENSION];
+            for(int i = 0; i < DIMENSION; ++i) {
+                velocity[i] = (long)(rng() % 5) - 2;
+            }
+            group.SetVelocity(id, velocity);
+        } else if(op == 7) {
+            now += 1 + rng() % 3;
+            group.AdvanceTime(now);
+        } else {
+            for(int i = 0; i < DIMENSION; ++i) {
+                pos[i] = (long)(rng() % 11) - 5;
+            }
+            group.MoveDiff(id, pos);
+        }
+    };
+
+    std::mt19937 rng;
+    rng.seed(0x5a5a1234);
+
+    for(unsigned op = 0; op < 5000; ++op) {
+        random_op(source, source_views, rng);
+    }
+
+    // 远处没有watcher的maker进入休眠
+    for(unsigned id = id_max; id < id_max + 20; ++id) {
+        long pos[DIMENSION] = { 10 * pos_max + (long)id, 10 * pos_max };
+        source.Enter(id, pos, AOI_WATCH_TYPES::MAKER);
+    }
+
+    std::string data;
+    failed = !source.SaveSnapshot(data) || failed;
+
+    // 数据不完整时不能恢复，group保持为空
+    failed = restored.LoadSnapshot(data.data(), data.size() - 8) || failed;
+
+    // 恢复时不应该产生任何事件
+    restored.SetCallback(make_callback(restored_views));
+    failed = !restored.LoadSnapshot(data.data(), data.size()) || failed;
+    failed = restored_views.size() || failed;
+    failed = restored.LoadSnapshot(data.data(), data.size()) || failed; // 只能恢复到空的group
+    failed = !restored.TestSelf() || failed;
+
+    // 恢复后看到的和原来完全相同
+    restored_views = source_views;
+
+    for(unsigned id = 0; id < id_max && !failed; ++id) {
+        std::vector<unsigned> source_makers;
+        std::vector<unsigned> restored_makers;
+
+        bool source_found = source.GetMakersList(id, source_makers);
+        bool restored_found = restored.GetMakersList(id, restored_makers);
+
+        std::sort(source_makers.begin(), source_makers.end());
+        std::sort(restored_makers.begin(), restored_makers.end());
+
+        failed = source_found != restored_found || source_makers != restored_makers;
+    }
+
+    // 之后同样的操作产生同样的事件
+    std::mt19937 source_rng(0x77);
+    std::mt19937 restored_rng(0x77);
+    long start = now;
+
+    for(unsigned op = 0; op < 5000 && !failed; ++op) {
+        random_op(source, source_views, source_rng);
+    }
+
+    now = start;
+
+    for(unsigned op = 0; op < 5000 && !failed; ++op) {
+        random_op(restored, restored_views, restored_rng);
+    }
+
+    failed = failed || !restored.TestSelf() || source_views != restored_views;
+
+    if(failed) {
+        std::cout << "WARNING: TEST SNAPSHOT FAILED" << "\n";
+    } else {
+        std::cout << "finish test snapshot" << "\n";
+    }
+}
+
+// 快照中的记录互相矛盾时不能恢复
+// 按快照格式逐段改写记录，下面的结构和 AoiGroup<unsigned, long, 2> 中快照记录的布局相同
+void TestSnapshotValidation() {
+    constexpr int DIMENSION = 2;
+    using GroupType = AoiGroup<unsigned, long, DIMENSION>;
+
+    struct HeaderType {
+        char MAGIC[4];
+        uint32_t VERSION;
+        uint32_t DIMENSION;
+        uint32_t KEY_SIZE;
+        uint32_t POS_SIZE;
+        uint32_t RESERVED;
+        uint64_t ELEMENT_COUNT;
+        uint64_t EDGE_COUNT;
+        uint64_t RANK_COUNT;
+        uint64_t KINETIC_COUNT;
+    };
+
+    struct ConfigType {
+        long MAX_WATCH_RANGE[DIMENSION];
+        long MAX_MAKER_RADIUS[DIMENSION];
+        long HYSTERESIS[DIMENSION];
+        long NOW;
+        long KINETIC_HORIZON;
+    };
+
+    struct ElementType {
+        unsigned KEY;
+        long POS[DIMENSION];
+        long WATCH_RANGE[DIMENSION];
+        long MAKER_RADIUS[DIMENSION];
+        long ANCHOR[DIMENSION];
+        int32_t WATCH_TYPE;
+        uint32_t VISIBLE_LIMIT;
+        uint32_t FLAGS;
+    };
+
+    struct EdgeType {
+        uint32_t WATCHER;
+        uint32_t MAKER;
+    };
+
+    struct RankType {
+        double PRIORITY;
+        uint32_t WATCHER;
+        uint32_t MAKER;
+        uint32_t VISIBLE;
+    };
+
+    struct KineticType {
+        long VELOCITY[DIMENSION];
+        long EXPIRY;
+        uint32_t ELEMENT;
+    };
+
+    long max_watch_range[DIMENSION] = { 30, 30 };
+    GroupType source(1, max_watch_range);
+    source.SetKineticHorizon(8);
+
+    // watcher 1 限制只看到一个，watcher 5 没有限制，maker 3、4 在运动
+    long watcher_pos[DIMENSION] = { 0, 0 };
+    long free_pos[DIMENSION] = { 0, 10 };
+    long maker_pos[3][DIMENSION] = { { 5, 0 }, { 10, 0 }, { 15, 0 } };
+    long velocity[DIMENSION] = { 0, 1 };
+
+    source.Enter(1, watcher_pos, AOI_WATCH_TYPES::WATCHER, max_watch_range);
+    source.Enter(5, free_pos, AOI_WATCH_TYPES::WATCHER, max_watch_range);
+    source.SetVisibleLimit(1, 1);
+
+    for(unsigned id = 2; id <= 4; ++id) {
+        source.Enter(id, maker_pos[id - 2], AOI_WATCH_TYPES::MAKER);
+    }
+
+    source.SetVelocity(3, velocity);
+    source.SetVelocity(4, velocity);
+
+    std::string data;
+    bool failed = !source.SaveSnapshot(data);
+
+    HeaderType header;
+    memcpy(&header, data.data(), sizeof(header));
+
+    auto align = [](size_t size) {
+        return (size + 7) / 8 * 8;
+    };
+
+    size_t element_offset = align(sizeof(HeaderType)) + align(sizeof(ConfigType));
+    size_t edge_offset = element_offset + align(sizeof(ElementType) * header.ELEMENT_COUNT);
+    size_t rank_offset = edge_offset + align(sizeof(EdgeType) * header.EDGE_COUNT);
+    size_t kinetic_offset = rank_offset + align(sizeof(RankType) * header.RANK_COUNT);
+
+    failed = failed || header.ELEMENT_COUNT != 5 || header.RANK_COUNT != 3 || header.KINETIC_COUNT != 2 ||
+        kinetic_offset + align(sizeof(KineticType) * header.KINETIC_COUNT) != data.size();
+
+    auto element_at = [&data, element_offset](size_t j) {
+        return (ElementType *)&data[element_offset + j * sizeof(ElementType)];
+    };
+
+    auto rank_at = [&data, rank_offset](size_t j) {
+        return (RankType *)&data[rank_offset + j * sizeof(RankType)];
+    };
+
+    auto kinetic_at = [&data, kinetic_offset](size_t j) {
+        return (KineticType *)&data[kinetic_offset + j * sizeof(KineticType)];
+    };
+
+    // 改写后的数据不能恢复，group保持为空
+    auto rejected = [&max_watch_range](const std::string &tampered) {
+        GroupType restored(2, max_watch_range);
+        restored.SetKineticHorizon(8);
+        std::vector<unsigned> makers;
+
+        return !restored.LoadSnapshot(tampered.data(), tampered.size()) && !restored.GetMakersList(1, makers);
+    };
+
+    if(!failed) {
+        GroupType restored(2, max_watch_range);
+        restored.SetKineticHorizon(8);
+        failed = !restored.LoadSnapshot(data.data(), data.size()) || !restored.TestSelf();
+    }
+
+    size_t free_index = 0;
+    for(size_t j = 0; j < header.ELEMENT_COUNT; ++j) {
+        if(element_at(j)->KEY == 5) {
+            free_index = j;
+        }
+    }
+
+    // 被裁剪的取优先级最高的一个，把它改成可见时可见和裁剪之间的顺序仍然正确
+    size_t visible_index = header.RANK_COUNT;
+    size_t culled_index = header.RANK_COUNT;
+    for(size_t j = 0; j < header.RANK_COUNT; ++j) {
+        if(rank_at(j)->VISIBLE) {
+            visible_index = j;
+        } else if(culled_index == header.RANK_COUNT || rank_at(j)->PRIORITY < rank_at(culled_index)->PRIORITY) {
+            culled_index = j;
+        }
+    }
+
+    failed = failed || visible_index == header.RANK_COUNT || culled_index == header.RANK_COUNT;
+
+    if(!failed) {
+        // 同一个关系在排名中出现两次
+        std::string tampered = data;
+        RankType *culled = (RankType *)&tampered[rank_offset + culled_index * sizeof(RankType)];
+        culled->MAKER = rank_at(visible_index)->MAKER;
+        culled->VISIBLE = 0;
+        failed = !rejected(tampered);
+    }
+
+    if(!failed) {
+        // 排名比关系少一个
+        std::string tampered = data;
+        HeaderType *h = (HeaderType *)&tampered[0];
+        --h->RANK_COUNT;
+        tampered.erase(rank_offset + culled_index * sizeof(RankType), sizeof(RankType));
+        failed = !rejected(tampered);
+    }
+
+    if(!failed) {
+        // 可见数量超过限制
+        std::string tampered = data;
+        ((RankType *)&tampered[rank_offset + culled_index * sizeof(RankType)])->VISIBLE = 1;
+        failed = !rejected(tampered);
+    }
+
+    if(!failed) {
+        // 可见的优先级比被裁剪的低
+        std::string tampered = data;
+        ((RankType *)&tampered[rank_offset + culled_index * sizeof(RankType)])->VISIBLE = 1;
+        ((RankType *)&tampered[rank_offset + visible_index * sizeof(RankType)])->VISIBLE = 0;
+        failed = !rejected(tampered);
+    }
+
+    if(!failed) {
+        // 有可见数量限制的watcher没有排名
+        std::string tampered = data;
+        ((ElementType *)&tampered[element_offset + free_index * sizeof(ElementType)])->VISIBLE_LIMIT = 2;
+        failed = !rejected(tampered);
+    }
+
+    if(!failed) {
+        // 同一个元素有两条运动记录
+        std::string tampered = data;
+        ((KineticType *)&tampered[kinetic_offset + sizeof(KineticType)])->ELEMENT = kinetic_at(0)->ELEMENT;
+        failed = !rejected(tampered);
+    }
+
+    if(failed) {
+        std::cout << "WARNING: TEST SNAPSHOT VALIDATION FAILED" << "\n";
+    } else {
+        std::cout << "finish test snapshot validation" << "\n";
+    }
+}
+
+void TestJournal() {
+    constexpr int DIMENSION = 2;
+    using GroupType = AoiGroup<unsigned, long, DIMENSION>;
+    using EventRecord = std::tuple<unsigned, unsigned, int>;
+
+    long max_watch_range[DIMENSION] = { 30, 30 };
+    long max_maker_radius[DIMENSION] = { 5, 5 };
+    long hysteresis[DIMENSION] = { 2, 2 };
+
+    GroupType source(1, max_watch_range, max_maker_radius, hysteresis);
+    std::vector<EventRecord> source_events;
+    std::vector<EventRecord> replay_events;
+    bool failed = false;
+
+    source.SetCallback([&source_events](unsigned long id, unsigned receiver, unsigned sender, GroupType::AOI_EVENT_TYPE event) {
+        source_events.emplace_back(receiver, sender, event.EVENT_ID);
+    });
+
+    constexpr unsigned id_max = 300;
+    constexpr long pos_max = 500;
+    long now = 0;
+
+    auto random_op = [&now, &max_maker_radius](GroupType &group, std::mt19937 &rng) {
+        unsigned id = rng() % id_max;
+        unsigned op = rng() % 20;
+
+        long pos[DIMENSION];
+        long range[DIMENSION];
+        for(int i = 0; i < DIMENSION; ++i) {
+            pos[i] = (long)(rng() % pos_max);
+            range[i] = (long)(rng() % 40);
+        }
+
+        if(op < 3) {
+            group.Enter(id, pos, 1 + rng() % 3, range, max_maker_radius);
+        } else if(op == 3) {
+            group.EnterStatic(id, pos);
+        } else if(op == 4) {
+            group.EnterTrigger(id, pos, range);
+        } else if(op == 5) {
+            group.Leave(id);
+        } else if(op == 6) {
+            group.ChangeWatchType(id, 1 + rng() % 3);
+        } else if(op == 7) {
+            group.ChangeWatchRange(id, range);
+        } else if(op == 8) {
+            group.SetVisibleLimit(id, rng() % 4);
+        } else if(op == 9) {
+            for(int i = 0; i < DIMENSION; ++i) {
+                range[i] = (long)(rng() % 5) - 2;
+            }
+            group.SetVelocity(id, range);
+        } else if(op == 10) {
+            now += 1 + rng() % 3;
+            group.AdvanceTime(now);
+        } else if(op == 11) {
+            group.Move(id, pos);
+        } else {
+            for(int i = 0; i < DIMENSION; ++i) {
+                pos[i] = (long)(rng() % 11) - 5;
+            }
+            group.MoveDiff(id, pos);
+        }
+    };
+
+    std::mt19937 rng;
+    rng.seed(0x3c3c5678);
+
+    // 开始记录前已有的状态通过快照恢复
+    for(unsigned op = 0; op < 3000; ++op) {
+        random_op(source, rng);
+    }
+
+    std::string journal;
+    failed = !source.SetJournal(&journal) || failed;
+    source_events.clear();
+
+    for(unsigned op = 0; op < 5000; ++op) {
+        random_op(source, rng);
+    }
+
+    source.SetJournal(NULL);
+    random_op(source, rng); // 停止后不再记录
+    size_t journal_size = journal.size();
+    random_op(source, rng);
+    failed = journal.size() != journal_size || failed;
+
+    long config_range[DIMENSION];
+    long config_radius[DIMENSION];
+    long config_hysteresis[DIMENSION];
+    failed = !GroupType::ReadJournalConfig(journal.data(), journal.size(), config_range, config_radius, config_hysteresis) || failed;
+    failed = !std::equal(max_watch_range, max_watch_range + DIMENSION, config_range) || failed;
+
+    GroupType replay(2, config_range, config_radius, config_hysteresis);
+    replay.SetCallback([&replay_events](unsigned long id, unsigned receiver, unsigned sender, GroupType::AOI_EVENT_TYPE event) {
+        replay_events.emplace_back(receiver, sender, event.EVENT_ID);
+    });
+
+    size_t offset = 0;
+    unsigned replayed = 0;
+    failed = !replay.LoadJournal(journal.data(), journal.size(), offset) || failed;
+
+    while(offset < journal.size() && !failed) {
+        int op;
+        failed = !replay.ReplayJournal(journal.data(), journal.size(), offset, op);
+        ++replayed;
+    }
+
+    failed = failed || replayed != 5000 || !replay.TestSelf();
+
+    // 同一时刻推进的运动元素顺序不固定，事件按集合比较
+    std::sort(source_events.begin(), source_events.end());
+    std::sort(replay_events.begin(), replay_events.end());
+
+    failed = failed || source_events.empty() || source_events != replay_events;
+
+    // 截断的记录不能回放
+    GroupType truncated(3, config_range, config_radius, config_hysteresis);
+    offset = 0;
+    int op;
+    failed = failed || !truncated.LoadJournal(journal.data(), journal.size(), offset) ||
+        truncated.ReplayJournal(journal.data(), offset + 1, offset, op);
+
+    if(failed) {
+        std::cout << "WARNING: TEST JOURNAL FAILED" << "\n";
+    } else {
+        std::cout << "finish test journal" << "\n";
+    }
+}
+
+void TestReplication() {
+    constexpr int DIMENSION = 2;
+    using GroupType = AoiGroup<unsigned, long, DIMENSION>;
+    using ViewsType = std::unordered_map<unsigned, std::set<unsigned>>;
+
+    long max_watch_range[DIMENSION] = { 30, 30 };
+    long max_maker_radius[DIMENSION] = { 5, 5 };
+    long hysteresis[DIMENSION] = { 2, 2 };
+
+    GroupType leader(1, max_watch_range, max_maker_radius, hysteresis);
+    GroupType follower(2, max_watch_range, max_maker_radius, hysteresis);
+    leader.SetKineticHorizon(8);
+
+    ViewsType leader_views;
+    ViewsType views;
+    unsigned follower_events = 0;
+    bool failed = false;
+
+    follower.SetCallback([&views, &follower_events, &failed](unsigned long id, unsigned receiver, unsigned sender, GroupType::AOI_EVENT_TYPE event) {
+        if(event.EVENT_ID == AOI_EVENT_IDS::ENTER) {
+            failed = !views[receiver].insert(sender).second || failed;
+        } else if(event.EVENT_ID == AOI_EVENT_IDS::LEAVE) {
+            failed = !views[receiver].erase(sender) || failed;
+        }
+
+        ++follower_events;
+    });
+
+    constexpr unsigned id_max = 300;
+    constexpr long pos_max = 500;
+    long now = 0;
+
+    auto random_op = [&now, &max_maker_radius](GroupType &group, ViewsType &views, std::mt19937 &rng) {
+        unsigned id = rng() % id_max;
+        unsigned op = rng() % 20;
+
+        long pos[DIMENSION];
+        long range[DIMENSION];
+        for(int i = 0; i < DIMENSION; ++i) {
+            pos[i] = (long)(rng() % pos_max);
+            range[i] = (long)(rng() % 40);
+        }
+
+        if(op < 3) {
+            group.Enter(id, pos, 1 + rng() % 3, range, max_maker_radius);
+        } else if(op == 3) {
+            group.EnterStatic(id, pos);
+        } else if(op == 4) {
+            group.EnterTrigger(id, pos, range);
+        } else if(op == 5) {
+            if(group.Leave(id)) {
+                views.erase(id);
+            }
+        } else if(op == 6) {
+            int watch_type = 1 + rng() % 3;
+
+            // 不再是watcher时不产生事件
+            if(group.ChangeWatchType(id, watch_type) && !(watch_type & AOI_WATCH_TYPES::WATCHER)) {
+                views.erase(id);
+            }
+        } else if(op == 7) {
+            group.ChangeWatchRange(id, range);
+        } else if(op == 8) {
+            group.SetVisibleLimit(id, rng() % 4);
+        } else if(op == 9) {
+            for(int i = 0; i < DIMENSION; ++i) {
+                range[i] = (long)(rng() % 5) - 2;
+            }
+            group.SetVelocity(id, range);
+        } else if(op == 10) {
+            now += 1 + rng() % 3;
+            group.AdvanceTime(now);
+        } else if(op == 11) {
+            group.Move(id, pos);
+        } else {
+            for(int i = 0; i < DIMENSION; ++i) {
+                pos[i] = (long)(rng() % 11) - 5;
+            }
+            group.MoveDiff(id, pos);
+        }
+    };
+
+    auto same_makers = [&leader, &follower]() {
+        for(unsigned id = 0; id < id_max; ++id) {
+            std::vector<unsigned> leader_makers;
+            std::vector<unsigned> follower_makers;
+
+            bool leader_found = leader.GetMakersList(id, leader_makers);
+            bool follower_found = follower.GetMakersList(id, follower_makers);
+
+            std::sort(leader_makers.begin(), leader_makers.end());
+            std::sort(follower_makers.begin(), follower_makers.end());
+
+            if(leader_found != follower_found || leader_makers != follower_makers) {
+                return false;
+            }
+        }
+
+        return true;
+    };
+
+    std::mt19937 rng;
+    rng.seed(0x13572468);
+
+    // 开始复制前的状态通过快照同步
+    for(unsigned op = 0; op < 2000; ++op) {
+        random_op(leader, leader_views, rng);
+    }
+
+    std::string data;
+    failed = !leader.SaveSnapshot(data) || !follower.LoadSnapshot(data.data(), data.size()) || failed;
+    leader.SetReplication(true);
+
+    // 每个tick输出一次，从group应用时不产生事件
+    for(unsigned tick = 0; tick < 300 && !failed; ++tick) {
+        unsigned ops = rng() % 40;
+
+        for(unsigned op = 0; op < ops; ++op) {
+            random_op(leader, leader_views, rng);
+        }
+
+        failed = !leader.FlushReplication(data) || !follower.ApplyReplication(data.data(), data.size());
+        failed = failed || follower_events || !same_makers();
+    }
+
+    failed = failed || !follower.TestSelf();
+
+    // 数据不完整时不修改
+    random_op(leader, leader_views, rng);
+    leader.FlushReplication(data);
+    failed = failed || follower.ApplyReplication(data.data(), data.size() - 8) || !follower.ApplyReplication(data.data(), data.size());
+
+    // 切换到从group之后，事件和从group的状态一致，同样的操作得到同样的结果
+    // 同一时刻推进的运动元素顺序不固定，中间过程的事件可能不同，只比较最终结果
+    for(unsigned id = 0; id < id_max; ++id) {
+        std::vector<unsigned> makers;
+
+        if(follower.GetMakersList(id, makers)) {
+            views[id].insert(makers.begin(), makers.end());
+        }
+    }
+
+    std::mt19937 leader_rng(0x99);
+    std::mt19937 follower_rng(0x99);
+    long start = now;
+
+    for(unsigned op = 0; op < 5000 && !failed; ++op) {
+        random_op(leader, leader_views, leader_rng);
+    }
+
+    now = start;
+    follower_events = 0;
+
+    for(unsigned op = 0; op < 5000 && !failed; ++op) {
+        random_op(follower, views, follower_rng);
+    }
+
+    for(unsigned id = 0; id < id_max && !failed; ++id) {
+        std::vector<unsigned> makers;
+        follower.GetMakersList(id, makers);
+
+        failed = std::set<unsigned>(makers.begin(), makers.end()) != views[id];
+    }
+
+    failed = failed || !follower.TestSelf() || !follower_events || !same_makers();
+
+    if(failed) {
+        std::cout << "WARNING: TEST REPLICATION FAILED" << "\n";
+    } else {
+        std::cout << "finish test replication" << "\n";
+    }
+}
+
+void TestSharedView() {
+    constexpr int DIMENSION = 2;
+    using GroupType = AoiGroup<unsigned, long, DIMENSION>;
+    using WriterType = AoiSharedViewWriter<unsigned, long, DIMENSION>;
+    using ReaderType = AoiSharedViewReader<unsigned, long, DIMENSION>;
+
+    long max_watch_range[DIMENSION] = { 30, 30 };
+    long max_maker_radius[DIMENSION] = { 5, 5 };
+    long hysteresis[DIMENSION] = { 2, 2 };
+
+    GroupType group(1, max_watch_range, max_maker_radius, hysteresis);
+
+    constexpr unsigned id_max = 300;
+    constexpr long pos_max = 300;
+    std::mt19937 rng(0x44);
+
+    for(unsigned id = 0; id < id_max; ++id) {
+        long pos[DIMENSION] = { (long)(rng() % pos_max), (long)(rng() % pos_max) };
+        long watch_range[DIMENSION] = { (long)(rng() % 30), (long)(rng() % 30) };
+
+        group.Enter(id, pos, 1 + rng() % 3, watch_range);
+
+        if(id % 7 == 0) {
+            group.SetVisibleLimit(id, 4);
+        }
+    }
+
+    // 测试中用对齐的堆内存代替共享内存
+    size_t size = WriterType::RegionSize(id_max, id_max * id_max);
+    std::vector<uint64_t> memory((size + 63) / 8 + 8);
+    void *region = (void *)(((uintptr_t)memory.data() + 63) / 64 * 64);
+
+    WriterType writer;
+    ReaderType reader;
+    bool failed = reader.Attach(region, size); // 没有初始化的区域不能读取
+
+    failed = failed || !writer.Init(region, size) || !reader.Attach(region, size);
+
+    auto same_view = [&group, &reader]() {
+        for(unsigned id = 0; id < id_max + 10; ++id) {
+            long pos[DIMENSION];
+            long view_pos[DIMENSION];
+            bool exists = group.GetElementPosition(id, pos);
+
+            if(exists != reader.GetElementPosition(id, view_pos) || (exists && !std::equal(pos, pos + DIMENSION, view_pos))) {
+                return false;
+            }
+
+            std::vector<unsigned> makers;
+            std::vector<unsigned> view_makers;
+            group.GetMakersList(id, makers);
+            reader.GetMakersList(id, view_makers);
+
+            if(makers != view_makers) {
+                return false;
+            }
+        }
+
+        return true;
+    };
+
+    for(unsigned tick = 0; tick < 20 && !failed; ++tick) {
+        failed = !writer.Publish(group) || !same_view();
+
+        uint64_t publish_count = 0;
+        failed = !reader.Read([&publish_count](const ReaderType::ViewType &view) {
+                    publish_count = view.PublishCount();
+                }) || publish_count != tick + 1 || failed;
+
+        for(unsigned i = 0; i < 50; ++i) {
+            unsigned id = rng() % id_max;
+            long pos[DIMENSION] = { (long)(rng() % pos_max), (long)(rng() % pos_max) };
+
+            if(rng() % 10 == 0) {
+                group.Leave(id) || group.Enter(id, pos, 1 + rng() % 3);
+            } else {
+                group.Move(id, pos);
+            }
+        }
+    }
+
+    // 放不下时发布失败，读取方仍然看到上一次发布的内容，这里是初始化后的空内容
+    WriterType small_writer;
+    size_t small_size = WriterType::RegionSize(10, 10);
+    std::vector<unsigned> makers;
+    failed = failed || !small_writer.Init(region, small_size) || small_writer.Publish(group) || !reader.Attach(region, small_size);
+    failed = failed || reader.GetMakersList(0, makers) || !reader.Read([&failed](const ReaderType::ViewType &view) {
+                failed = view.ElementCount() != 0 || failed;
+            });
+
+    if(failed) {
+        std::cout << "WARNING: TEST SHARED VIEW FAILED" << "\n";
+    } else {
+        std::cout << "finish test shared view" << "\n";
+    }
+}
+
+void TestStats() {
+    constexpr int DIMENSION = 2;
+    using GroupType = AoiGroup<unsigned, long, DIMENSION, true, true>;
+
+    long max_watch_range[DIMENSION] = { 30, 30 };
+
+    GroupType group(1, max_watch_range);
+    using DisabledGroupType = AoiGroup<unsigned, long, DIMENSION>;
+    DisabledGroupType disabled(2, max_watch_range);
+
+    unsigned long events[3] = { 0 };
+    group.SetCallback([&events](unsigned long id, unsigned receiver, unsigned sender, const GroupType::AOI_EVENT_TYPE &event) {
+        ++events[-event.EVENT_ID - 1];
+    });
+
+    constexpr unsigned id_max = 500;
+    constexpr long pos_max = 400;
+    std::mt19937 rng(0x46);
+
+    for(unsigned id = 0; id < id_max; ++id) {
+        long pos[DIMENSION] = { (long)(rng() % pos_max), (long)(rng() % pos_max) };
+        long watch_range[DIMENSION] = { (long)(rng() % 30) + 1, (long)(rng() % 30) + 1 };
+
+        group.Enter(id, pos, 1 + rng() % 3, watch_range);
+    }
+
+    for(unsigned op = 0; op < 5000; ++op) {
+        unsigned id = rng() % id_max;
+        long pos[DIMENSION];
+        group.GetElementPosition(id, pos);
+
+        if(op % 10) {
+            long diff[DIMENSION] = { (long)(rng() % 5) - 2, (long)(rng() % 5) - 2 };
+            group.MoveDiff(id, diff);
+        } else {
+            pos[0] = (long)(rng() % pos_max);
+            pos[1] = (long)(rng() % pos_max);
+            group.Move(id, pos);
+        }
+    }
+
+    DisabledGroupType::StatsType disabled_stats;
+    GroupType::StatsType stats;
+    bool failed = disabled.TakeStats(disabled_stats) || !group.TakeStats(stats);
+
+    const GroupType::MoveChooserStatsType &chooser = group.GetMoveChooserStats();
+    failed = failed || stats.WATCHER_UPDATES != chooser.WATCHER_UPDATES || stats.WATCHER_SHIFTS != chooser.WATCHER_SHIFTS ||
+        stats.MAKER_UPDATES != chooser.MAKER_UPDATES || stats.MAKER_SHIFTS != chooser.MAKER_SHIFTS;
+    failed = failed || stats.ENTER_EVENTS != events[0] || stats.LEAVE_EVENTS != events[1] || stats.MOVE_EVENTS != events[2];
+    failed = failed || !stats.QUERIES || stats.QUERY_ACCEPTED > stats.QUERY_SCANNED || stats.SHIFT_ACCEPTED > stats.SHIFT_SCANNED ||
+        !stats.SHIFT_SCANNED || !stats.RANK_COUNTS;
+
+    unsigned long relations = 0;
+    unsigned long watchers = 0;
+    unsigned long max_makers = 0;
+
+    for(unsigned id = 0; id < id_max; ++id) {
+        std::vector<unsigned> makers;
+        group.GetMakersList(id, makers);
+        relations += makers.size();
+        max_makers = std::max(max_makers, (unsigned long)makers.size());
+    }
+
+    for(int i = 0; i < GroupType::STATS_HISTOGRAM_SIZE; ++i) {
+        watchers += stats.RELATED_MAKERS_HISTOGRAM[i];
+    }
+
+    failed = failed || stats.ELEMENTS != id_max || stats.RELATIONS != relations || stats.MAX_RELATED_MAKERS != max_makers ||
+        !watchers || watchers > id_max;
+
+    // 取出之后计数清空，关系集合的大小不变
+    GroupType::StatsType again;
+    failed = failed || !group.TakeStats(again) || again.WATCHER_UPDATES || again.MAKER_SHIFTS || again.ENTER_EVENTS ||
+        again.QUERIES || again.RANK_COUNTS || again.RELATIONS != relations;
+
+    failed = failed || !group.TestSelf();
+
+    if(failed) {
+        std::cout << "WARNING: TEST STATS FAILED" << "\n";
+    } else {
+        std::cout << "finish test stats" << "\n";
+    }
+}
+
+void TestLatency() {
+    constexpr int DIMENSION = 2;
+    using GroupType = AoiGroup<unsigned, long, DIMENSION, false, true>;
+
+    bool failed = false;
+
+    // 直方图的桶首尾相接，相对误差不超过 1 / SUB_BUCKET_COUNT
+    for(int i = 0; i + 1 < AoiLatencyHistogram::BUCKET_COUNT && !failed; ++i) {
+        uint64_t lower = AoiLatencyHistogram::BucketLower(i);
+        uint64_t upper = AoiLatencyHistogram::BucketUpper(i);
+
+        failed = AoiLatencyHistogram::BucketLower(i + 1) != upper + 1 || AoiLatencyHistogram::BucketIndex(lower) != i ||
+            AoiLatencyHistogram::BucketIndex(upper) != i || (upper - lower) * AoiLatencyHistogram::SUB_BUCKET_COUNT > lower;
+    }
+
+    long max_watch_range[DIMENSION] = { 30, 30 };
+    GroupType group(1, max_watch_range);
+
+    // 还没有任何操作时也按操作类型返回全部直方图
+    std::vector<AoiLatencyHistogram> histograms;
+    failed = failed || !group.TakeLatency(histograms) || histograms.size() != AOI_JOURNAL_OPS::COUNT ||
+        histograms[AOI_JOURNAL_OPS::MOVE].COUNT != 0;
+
+    unsigned long events = 0;
+    group.SetCallback([&events](unsigned long id, unsigned receiver, unsigned sender, const GroupType::AOI_EVENT_TYPE &event) {
+        ++events;
+    });
+
+    constexpr unsigned id_max = 300;
+    constexpr long pos_max = 200;
+    std::mt19937 rng(0x47);
+
+    // 阈值为0时记录所有操作
+    group.SetSlowOpThreshold(0, 8);
+
+    for(unsigned id = 0; id < id_max; ++id) {
+        long pos[DIMENSION] = { (long)(rng() % pos_max), (long)(rng() % pos_max) };
+        long watch_range[DIMENSION] = { (long)(rng() % 30) + 1, (long)(rng() % 30) + 1 };
+
+        group.Enter(id, pos, AOI_WATCH_TYPES::BOTH, watch_range);
+    }
+
+    for(unsigned op = 0; op < 1000; ++op) {
+        long pos[DIMENSION] = { (long)(rng() % pos_max), (long)(rng() % pos_max) };
+        group.Move(rng() % id_max, pos);
+    }
+
+    group.AdvanceTime(1);
+
+    failed = failed || !group.TakeLatency(histograms) || histograms.size() != AOI_JOURNAL_OPS::COUNT ||
+        histograms[AOI_JOURNAL_OPS::ENTER].COUNT != id_max || histograms[AOI_JOURNAL_OPS::MOVE].COUNT != 1000 ||
+        histograms[AOI_JOURNAL_OPS::ADVANCE_TIME].COUNT != 1 || histograms[AOI_JOURNAL_OPS::LEAVE].COUNT != 0;
+
+    for(const AoiLatencyHistogram &histogram: histograms) {
+        failed = failed || histogram.Percentile(0.5) > histogram.Percentile(0.99) || histogram.Percentile(0.99) > histogram.MAX_NS ||
+            histogram.Percentile(1) != histogram.MAX_NS;
+    }
+
+    failed = failed || !group.TakeLatency(histograms) || histograms[AOI_JOURNAL_OPS::MOVE].COUNT != 0;
+
+    // 缓冲区中只保留最近的8个，按发生的顺序取出
+    std::vector<GroupType::SlowOpType> slow_ops;
+    failed = failed || !group.TakeSlowOps(slow_ops) || slow_ops.size() != 8 || slow_ops.back().OP != AOI_JOURNAL_OPS::ADVANCE_TIME ||
+        slow_ops.back().HAS_KEY || slow_ops.front().OP != AOI_JOURNAL_OPS::MOVE;
+
+    // 传送到人群中的记录包含候选数量和产生的事件
+    long crowd[DIMENSION] = { pos_max / 2, pos_max / 2 };
+    long far_away[DIMENSION] = { pos_max * 10, pos_max * 10 };
+    group.Move(0, far_away);
+
+    events = 0;
+    group.Move(0, crowd);
+
+    failed = failed || !group.TakeSlowOps(slow_ops) || slow_ops.size() != 2 || slow_ops[1].OP != AOI_JOURNAL_OPS::MOVE ||
+        !slow_ops[1].HAS_KEY || slow_ops[1].KEY != 0 || slow_ops[1].EVENTS != events || !events ||
+        slow_ops[1].CANDIDATES_ACCEPTED > slow_ops[1].CANDIDATES_SCANNED || !slow_ops[1].CANDIDATES_ACCEPTED;
+
+    // 阈值以下的操作只进直方图
+    group.SetSlowOpThreshold(1000000000, 8);
+    group.Move(0, far_away);
+    failed = failed || !group.TakeSlowOps(slow_ops) || !slow_ops.empty() || !group.TakeLatency(histograms) ||
+        histograms[AOI_JOURNAL_OPS::MOVE].COUNT != 3;
+
+    failed = failed || !group.TestSelf();
+
+    if(failed) {
+        std::cout << "WARNING: TEST LATENCY FAILED" << "\n";
+    } else {
+        std::cout << "finish test latency" << "\n";
+    }
+}
+
+void TestConsistencyCheck() {
+    constexpr int DIMENSION = 2;
+    using GroupType = AoiGroup<unsigned, long, DIMENSION, false, true>;
+
+    long max_watch_range[DIMENSION] = { 30, 30 };
+    long max_maker_radius[DIMENSION] = { 5, 5 };
+    long hysteresis[DIMENSION] = { 2, 2 };
+
+    GroupType group(1, max_watch_range, max_maker_radius, hysteresis);
+    group.SetConsistencyCheck(64);
+
+    constexpr unsigned id_max = 400;
+    constexpr long pos_max = 300;
+    std::mt19937 rng(0x48);
+
+    bool failed = group.CheckConsistency(8, 1000000000) != 0;
+
+    for(unsigned id = 0; id < id_max; ++id) {
+        long pos[DIMENSION] = { (long)(rng() % pos_max), (long)(rng() % pos_max) };
+        long watch_range[DIMENSION] = { (long)(rng() % 30) + 1, (long)(rng() % 30) + 1 };
+
+        group.Enter(id, pos, 1 + rng() % 3, watch_range);
+    }
+
+    // 加入时记录的元素超过了容量，后面的不再记录
+    GroupType::StatsType stats;
+    failed = failed || group.CheckConsistency(0, 1000000000) != 0 || !group.TakeStats(stats) || stats.CHECKED != 64;
+
+    for(unsigned tick = 0; tick < 50 && !failed; ++tick) {
+        std::set<unsigned> touched;
+
+        for(unsigned op = 0; op < 20; ++op) {
+            unsigned id = rng() % id_max;
+            long diff[DIMENSION] = { (long)(rng() % 7) - 3, (long)(rng() % 7) - 3 };
+
+            group.MoveDiff(id, diff);
+            touched.insert(id);
+        }
+
+        // 只检查最近修改过的元素，每个只检查一次，检查时的查询不计入统计
+        group.TakeStats(stats);
+        failed = group.CheckConsistency(0, 1000000000) != 0 || !group.TakeStats(stats) || stats.CHECKED != touched.size() ||
+            stats.CHECK_FAILURES || stats.HAS_CHECK_FAILURE_KEY || stats.QUERIES;
+
+        failed = failed || group.CheckConsistency(16, 1000000000) != 0 || !group.TakeStats(stats) || stats.CHECKED != 16;
+    }
+
+    // 时间预算用完时提前结束，剩下的最近修改的元素留到下次
+    for(unsigned id = 0; id < 100; ++id) {
+        long diff[DIMENSION] = { 1, 0 };
+        group.MoveDiff(id, diff);
+    }
+
+    group.TakeStats(stats);
+    failed = failed || group.CheckConsistency(16, 0) != 0 || !group.TakeStats(stats) || stats.CHECKED != 0;
+    failed = failed || group.CheckConsistency(0, 1000000000) != 0 || !group.TakeStats(stats) || stats.CHECKED != 64;
+
+    failed = failed || !group.TestSelf();
+
+    // 每次抽到的元素互不相同，抽样数量超过元素数量时每个元素检查一次
+    GroupType small(2, max_watch_range, max_maker_radius, hysteresis);
+
+    for(unsigned id = 0; id < 10; ++id) {
+        long pos[DIMENSION] = { (long)(rng() % pos_max), (long)(rng() % pos_max) };
+        small.Enter(id, pos, AOI_WATCH_TYPES::BOTH, max_watch_range);
+    }
+
+    failed = failed || small.CheckConsistency(100, 1000000000) != 0 || !small.TakeStats(stats) || stats.CHECKED != 10;
+    failed = failed || small.CheckConsistency(9, 1000000000) != 0 || !small.TakeStats(stats) || stats.CHECKED != 9;
+
+    // 整组移动时每个成员都留给下次检查
+    small.SetConsistencyCheck(16);
+    unsigned party[] = { 0, 1, 2 };
+    long party_positions[3 * DIMENSION] = { 10, 10, 11, 10, 10, 11 };
+
+    failed = failed || !small.MoveViewGroup(party, party_positions, 3);
+    failed = failed || small.CheckConsistency(0, 1000000000) != 0 || !small.TakeStats(stats) || stats.CHECKED != 3;
+
+    if(failed) {
+        std::cout << "WARNING: TEST CONSISTENCY CHECK FAILED" << "\n";
+    } else {
+        std::cout << "finish test consistency check" << "\n";
+    }
+}
+
+void TestHeatmap() {
+    constexpr int DIMENSION = 2;
+    using GroupType = AoiGroup<unsigned, long, DIMENSION>;
+
+    long max_watch_range[DIMENSION] = { 30, 30 };
+    GroupType group(1, max_watch_range);
+
+    constexpr unsigned id_max = 1000;
+    constexpr long pos_max = 500;
+    std::mt19937 rng(0x49);
+
+    for(unsigned id = 0; id < id_max; ++id) {
+        // 有一部分在网格外
+        long pos[DIMENSION] = { (long)(rng() % pos_max) - 50, (long)(rng() % pos_max) - 50 };
+        long watch_range[DIMENSION] = { (long)(rng() % 30) + 1, (long)(rng() % 30) + 1 };
+
+        group.Enter(id, pos, 1 + rng() % 3, watch_range);
+    }
+
+    long origin[DIMENSION] = { 0, 0 };
+    long cell_size[DIMENSION] = { 50, 40 };
+    unsigned size[DIMENSION] = { 8, 10 };
+
+    GroupType::HeatmapType heatmap;
+    bool failed = !group.GetHeatmap(origin, cell_size, size, heatmap) || heatmap.CELLS.size() != 80;
+
+    std::vector<GroupType::HeatmapCellType> expected(heatmap.CELLS.size());
+    GroupType::HeatmapCellType outside;
+
+    group.ForEachElement([&](unsigned key, const long pos[DIMENSION], int watch_type) {
+        unsigned index[DIMENSION];
+        bool inside = true;
+
+        for(int i = 0; i < DIMENSION; ++i) {
+            inside = inside && pos[i] >= origin[i] && pos[i] < origin[i] + cell_size[i] * (long)size[i];
+            index[i] = inside ? (unsigned)((pos[i] - origin[i]) / cell_size[i]) : 0;
+        }
+
+        GroupType::HeatmapCellType &cell = inside ? expected[heatmap.CellIndex(index)] : outside;
+        std::vector<unsigned> makers;
+        group.GetMakersList(key, makers);
+
+        cell.MAKERS += (watch_type & AOI_WATCH_TYPES::MAKER) ? 1 : 0;
+        cell.WATCHERS += (watch_type & AOI_WATCH_TYPES::WATCHER) ? 1 : 0;
+        cell.RELATIONS += makers.size();
+    });
+
+    auto same_cell = [](const GroupType::HeatmapCellType &a, const GroupType::HeatmapCellType &b) {
+        return a.MAKERS == b.MAKERS && a.WATCHERS == b.WATCHERS && a.RELATIONS == b.RELATIONS;
+    };
+
+    for(size_t i = 0; i < expected.size() && !failed; ++i) {
+        failed = !same_cell(expected[i], heatmap.CELLS[i]);
+    }
+
+    failed = failed || !same_cell(outside, heatmap.OUTSIDE) || !outside.MAKERS;
+
+    // 第0维变化最快
+    unsigned index[DIMENSION] = { 3, 2 };
+    failed = failed || heatmap.CellIndex(index) != 2 * 8 + 3;
+
+    long zero_size[DIMENSION] = { 0, 40 };
+    unsigned huge[DIMENSION] = { 1u << 16, 1u << 16 };
+    failed = failed || group.GetHeatmap(origin, zero_size, size, heatmap) || group.GetHeatmap(origin, cell_size, huge, heatmap);
+
+    if(failed) {
+        std::cout << "WARNING: TEST HEATMAP FAILED" << "\n";
+    } else {
+        std::cout << "finish test heatmap" << "\n";
+    }
+}
+
+void TestViewGroup() {
+    constexpr int DIMENSION = 2;
+    using GroupType = AoiGroup<unsigned, long, DIMENSION>;
+    using ViewsType = std::unordered_map<unsigned, std::set<unsigned>>;
+
+    long max_watch_range[DIMENSION] = { 30, 30 };
+    long max_maker_radius[DIMENSION] = { 5, 5 };
+    long hysteresis[DIMENSION] = { 2, 2 };
+    long no_hysteresis[DIMENSION] = { 0, 0 };
+
+    // group 有滞后和可见数量限制，按事件维护视野；没有滞后时和依次 Move 的结果完全相同
+    GroupType group(1, max_watch_range, max_maker_radius, hysteresis);
+    GroupType shared(2, max_watch_range, max_maker_radius, no_hysteresis);
+    GroupType sequential(3, max_watch_range, max_maker_radius, no_hysteresis);
+
+    ViewsType views;
+    bool failed = false;
+
+    group.SetCallback([&views, &failed](unsigned long id, unsigned receiver, unsigned sender, GroupType::AOI_EVENT_TYPE event) {
+        if(event.EVENT_ID == AOI_EVENT_IDS::ENTER) {
+            failed = !views[receiver].insert(sender).second || failed;
+        } else if(event.EVENT_ID == AOI_EVENT_IDS::LEAVE) {
+            failed = !views[receiver].erase(sender) || failed;
+        }
+    });
+
+    constexpr unsigned party_count = 30;
+    constexpr unsigned party_size = 5;
+    constexpr unsigned loose_count = 300;
+    constexpr long pos_max = 500;
+    std::mt19937 rng(0x50);
+
+    std::string journal;
+    failed = !group.SetJournal(&journal) || failed;
+
+    GroupType *groups[] = { &group, &shared, &sequential };
+    long centers[party_count][DIMENSION];
+
+    for(unsigned p = 0; p < party_count; ++p) {
+        for(int i = 0; i < DIMENSION; ++i) {
+            centers[p][i] = (long)(rng() % pos_max);
+        }
+
+        for(unsigned m = 0; m < party_size; ++m) {
+            long pos[DIMENSION];
+            long range[DIMENSION];
+            long radius[DIMENSION];
+
+            for(int i = 0; i < DIMENSION; ++i) {
+                pos[i] = centers[p][i] + (long)(rng() % 11) - 5;
+                range[i] = 20 + (long)(rng() % 11); // 队伍成员的范围接近
+                radius[i] = (long)(rng() % 4);
+            }
+
+            int watch_type = m == 0 ? AOI_WATCH_TYPES::WATCHER : 3;
+
+            for(GroupType *g: groups) {
+                g->Enter(p * party_size + m, pos, watch_type, range, radius);
+            }
+        }
+
+        group.SetVisibleLimit(p * party_size, 3);
+    }
+
+    for(unsigned id = party_count * party_size; id < party_count * party_size + loose_count; ++id) {
+        long pos[DIMENSION];
+        long range[DIMENSION];
+        long radius[DIMENSION];
+
+        for(int i = 0; i < DIMENSION; ++i) {
+            pos[i] = (long)(rng() % pos_max);
+            range[i] = (long)(rng() % 30);
+            radius[i] = (long)(rng() % 6);
+        }
+
+        int watch_type = 1 + rng() % 3;
+
+        for(GroupType *g: groups) {
+            g->Enter(id, pos, watch_type, range, radius);
+        }
+    }
+
+    unsigned keys[party_size];
+    long positions[party_size * DIMENSION];
+
+    for(unsigned round = 0; round < 200 && !failed; ++round) {
+        for(unsigned p = 0; p < party_count; ++p) {
+            for(int i = 0; i < DIMENSION; ++i) {
+                centers[p][i] += (long)(rng() % 9) - 4;
+            }
+
+            // 偶尔有成员离队，验证分散时的处理
+            bool scatter = rng() % 10 == 0;
+            unsigned count = 1 + rng() % party_size;
+
+            for(unsigned m = 0; m < count; ++m) {
+                keys[m] = p * party_size + (m + round) % party_size;
+
+                for(int i = 0; i < DIMENSION; ++i) {
+                    positions[m * DIMENSION + i] = centers[p][i] + (long)(rng() % 11) - 5 + (scatter && m == 0 ? 200 : 0);
+                }
+            }
+
+            failed = !group.MoveViewGroup(keys, positions, count) || !shared.MoveViewGroup(keys, positions, count) || failed;
+
+            for(unsigned m = 0; m < count; ++m) {
+                sequential.Move(keys[m], positions + m * DIMENSION);
+            }
+        }
+
+        for(unsigned n = 0; n < 50; ++n) {
+            unsigned id = party_count * party_size + rng() % loose_count;
+            long pos[DIMENSION];
+
+            for(int i = 0; i < DIMENSION; ++i) {
+                pos[i] = (long)(rng() % pos_max);
+            }
+
+            for(GroupType *g: groups) {
+                g->Move(id, pos);
+            }
+        }
+    }
+
+    for(unsigned id = 0; id < party_count * party_size + loose_count && !failed; ++id) {
+        std::vector<unsigned> makers;
+        std::vector<unsigned> shared_makers;
+        std::vector<unsigned> sequential_makers;
+
+        group.GetMakersList(id, makers);
+        shared.GetMakersList(id, shared_makers);
+        sequential.GetMakersList(id, sequential_makers);
+
+        std::sort(shared_makers.begin(), shared_makers.end());
+        std::sort(sequential_makers.begin(), sequential_makers.end());
+
+        failed = std::set<unsigned>(makers.begin(), makers.end()) != views[id] || shared_makers != sequential_makers;
+    }
+
+    failed = failed || !group.TestSelf() || !shared.TestSelf();
+
+    // 不存在、静态或者重复的元素整组失败，不做任何修改
+    long pos[DIMENSION] = { 100, 100 };
+    group.EnterStatic(10000, pos);
+
+    unsigned missing[] = { 0, 9999 };
+    unsigned duplicated[] = { 0, 1, 0 };
+    unsigned with_static[] = { 0, 10000 };
+    long far[3 * DIMENSION] = { 1, 1, 2, 2, 3, 3 };
+
+    std::vector<unsigned> before;
+    group.GetMakersList(0, before);
+
+    failed = failed || group.MoveViewGroup(missing, far, 2) || group.MoveViewGroup(duplicated, far, 3) ||
+        group.MoveViewGroup(with_static, far, 2);
+
+    std::vector<unsigned> after;
+    group.GetMakersList(0, after);
+    failed = failed || before != after;
+
+    group.SetJournal(NULL);
+
+    // 回放得到相同的关系
+    GroupType replay(4, max_watch_range, max_maker_radius, hysteresis);
+    size_t offset = 0;
+    failed = failed || !replay.LoadJournal(journal.data(), journal.size(), offset);
+
+    while(offset < journal.size() && !failed) {
+        int op;
+        failed = !replay.ReplayJournal(journal.data(), journal.size(), offset, op);
+    }
+
+    for(unsigned id = 0; id < party_count * party_size + loose_count && !failed; ++id) {
+        std::vector<unsigned> makers;
+        std::vector<unsigned> replay_makers;
+
+        group.GetMakersList(id, makers);
+        replay.GetMakersList(id, replay_makers);
+
+        std::sort(makers.begin(), makers.end());
+        std::sort(replay_makers.begin(), replay_makers.end());
+
+        failed = makers != replay_makers;
+    }
+
+    // 回调中移除maker、再次整组移动，外层还没处理的成员不受影响
+    GroupType nested(5, max_watch_range, max_maker_radius, hysteresis);
+    unsigned outer_keys[] = { 1, 2, 3 };
+    unsigned inner_keys[] = { 20, 21 };
+    long outer_positions[3 * DIMENSION] = { 200, 200, 202, 201, 201, 203 };
+    long inner_positions[2 * DIMENSION] = { 400, 400, 402, 401 };
+    bool removed = false;
+    bool moved = false;
+
+    nested.SetCallback([&nested, &removed, &moved, &inner_keys, &inner_positions](unsigned long id, unsigned receiver, unsigned sender, GroupType::AOI_EVENT_TYPE event) {
+        if(event.EVENT_ID != AOI_EVENT_IDS::ENTER) {
+            return;
+        }
+
+        if(sender == 10 && !removed) {
+            removed = true;
+            nested.Leave(10);
+        } else if(sender == 11 && !moved) {
+            moved = true;
+            nested.MoveViewGroup(inner_keys, inner_positions, 2);
+        }
+    });
+
+    for(unsigned id: outer_keys) {
+        long start[DIMENSION] = { 0, (long)id * 10 };
+        nested.Enter(id, start, AOI_WATCH_TYPES::BOTH, max_watch_range, max_maker_radius);
+    }
+
+    for(unsigned id: inner_keys) {
+        long start[DIMENSION] = { 300, (long)id * 2 };
+        nested.Enter(id, start, AOI_WATCH_TYPES::BOTH, max_watch_range, max_maker_radius);
+    }
+
+    for(unsigned id = 10; id < 14; ++id) {
+        long maker_pos[DIMENSION] = { 205 - (long)id, 200 + (long)id };
+        nested.Enter(id, maker_pos, AOI_WATCH_TYPES::MAKER);
+    }
+
+    failed = failed || !nested.MoveViewGroup(outer_keys, outer_positions, 3) || !removed || !moved || !nested.TestSelf();
+
+    // 每个成员看到其他成员和剩下的maker
+    for(unsigned id: outer_keys) {
+        std::vector<unsigned> makers;
+        std::vector<unsigned> expected;
+        nested.GetMakersList(id, makers);
+        std::sort(makers.begin(), makers.end());
+
+        for(unsigned maker: { 1, 2, 3, 11, 12, 13 }) {
+            if(maker != id) {
+                expected.emplace_back(maker);
+            }
+        }
+
+        failed = failed || makers != expected;
+    }
+
+    if(failed) {
+        std::cout << "WARNING: TEST VIEW GROUP FAILED" << "\n";
+    } else {
+        std::cout << "finish test view group" << "\n";
+    }
 }
 
 int main() {
     //TestInteractive();
-    TestStress();
+    TestVisibleLimit();
+    TestMakerRadius();
+    TestWatchRangeBuckets();
+    TestChangeWatchRange();
+    TestHysteresis();
+    TestKinetic();
+    TestDormantMakers();
+    TestMoveChooser();
+    TestCorridorQuery();
+    TestBatchFilter();
+    TestStaticMakers();
+    TestTriggers();
+    TestSnapshot();
+    TestSnapshotValidation();
+    TestJournal();
+    TestReplication();
+    TestSharedView();
+    TestStats();
+    TestLatency();
+    TestConsistencyCheck();
+    TestHeatmap();
+    TestViewGroup();
     //TestDebug();
 
     return 0;